@@ -4,74 +4,42 @@
 #include <freertos/event_groups.h>
 
 #include <esp_log.h>
+#include <inttypes.h>
+
+#include "trackle_utils_args.h"
+#include "trackle_utils_codec.h"
+#include "trackle_utils_time.h"
 
 EventGroupHandle_t s_wifi_event_group;
 
 void hexToString(unsigned char *in, size_t insz, char *out, size_t outz)
 {
-    memset(out, 0, outz);
-    unsigned char *pin = in;
-    const char *hex = "0123456789abcdef";
-    char *pout = out;
-    for (; pin < in + insz; pout += 2, pin++)
-    {
-        pout[0] = hex[(*pin >> 4) & 0xF];
-        pout[1] = hex[*pin & 0xF];
-        if (pout + 2 - out > insz * 2)
-        {
-            /* Better to truncate output string than overflow buffer */
-            /* it would be still better to either return a status */
-            /* or ensure the target buffer is large enough and it never happen */
-            break;
-        }
-    }
+    if (outz == 0)
+        return;
+
+    // encode the bytes that fit, the output is always NULL terminated
+    const size_t fit = (outz - 1) / 2;
+    trackleHexEncode(in, insz < fit ? insz : fit, out, outz);
 }
 
 int stringToHex(char *hex_str, unsigned char *byte_array, int byte_array_max)
 {
-    int hex_str_len = strlen(hex_str);
-    int i = 0, j = 0;
-
-    // The output array size is half the hex_str length (rounded up)
-    int byte_array_size = (hex_str_len + 1) / 2;
-
-    if (byte_array_size > byte_array_max)
-    {
-        // Too big for the output array
+    if (byte_array_max < 0)
         return -1;
-    }
-
-    if (hex_str_len % 2 == 1)
-    {
-        // hex_str is an odd length, so assume an implicit "0" prefix
-        if (sscanf(&(hex_str[0]), "%1hhx", &(byte_array[0])) != 1)
-        {
-            return -1;
-        }
-
-        i = j = 1;
-    }
-
-    for (; i < hex_str_len; i += 2, j++)
-    {
-        if (sscanf(&(hex_str[i]), "%2hhx", &(byte_array[j])) != 1)
-        {
-            return -1;
-        }
-    }
-
-    return byte_array_size;
+    const int res = trackleHexDecode(hex_str, strlen(hex_str), byte_array, byte_array_max);
+    return res < 0 ? -1 : res;
 }
 
 int splitString(char *value, const char *separator, char *results[], size_t max_results)
 {
-    char *p = strtok(value, separator);
+    char *saveptr = NULL;
+    char *p = strtok_r(value, separator, &saveptr);
     int i = 0;
 
     while (p != NULL && i < max_results)
     {
         results[i++] = p;
-        p = strtok(NULL, separator);
+        p = strtok_r(NULL, separator, &saveptr);
     }
 
     return i;
@@ -79,30 +47,11 @@ int splitString(char *value, const char *separator, char *results[], size_t max_
 
 bool isValid(char *input, const char *op, int b)
 {
-    int a = atoi(input);
-    ESP_LOGD("TAG", "%d %s %d", a, op, b);
-
-    if (strcmp(op, "<") == 0)
-    {
-        return a < b;
-    }
-    else if (strcmp(op, "<=") == 0)
-    {
-        return a <= b;
-    }
-    else if (strcmp(op, ">") == 0)
-    {
-        return a > b;
-    }
-    else if (strcmp(op, ">=") == 0)
-    {
-        return a >= b;
-    }
-    else if (strcmp(op, "=") == 0)
-    {
-        return a == b;
-    }
-    return false;
+    int32_t a;
+    if (!trackleStrToInt32(trackleStr(input), &a))
+        return false;
+    ESP_LOGD("TAG", "%" PRId32 " %s %d", a, op, b);
+    return trackleCompare(a, trackleCompareOpParse(trackleStr(op)), b);
 }
 
 int32_t ouiFromMacAddress(uint8_t *value)
@@ -115,37 +64,9 @@ int32_t nicFromMacAddress(uint8_t *value)
     return (value[3] << 0) + (value[4] << 8) + (value[5] << 16);
 }
 
-/* struct tm to seconds since Unix epoch */
 time_t getGmTimestamp()
 {
-    time_t now;
-    struct tm timeinfo;
-    time(&now);
-    localtime_r(&now, &timeinfo);
-
-    long year;
-    time_t result;
-#define MONTHSPERYEAR 12 /* months per calendar year */
-    static const int cumdays[MONTHSPERYEAR] =
-        {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
-
-    year = 1900 + timeinfo.tm_year + timeinfo.tm_mon / MONTHSPERYEAR;
-    result = (year - 1970) * 365 + cumdays[timeinfo.tm_mon % MONTHSPERYEAR];
-    result += (year - 1968) / 4;
-    result -= (year - 1900) / 100;
-    result += (year - 1600) / 400;
-    if ((year % 4) == 0 && ((year % 100) != 0 || (year % 400) == 0) &&
-        (timeinfo.tm_mon % MONTHSPERYEAR) < 2)
-        result--;
-    result += timeinfo.tm_mday - 1;
-    result *= 24;
-    result += timeinfo.tm_hour;
-    result *= 60;
-    result += timeinfo.tm_min;
-    result *= 60;
-    result += timeinfo.tm_sec;
-
-    return result;
+    return trackleTimeNowMs() / 1000;
 }
 
 int rssiToPercentage(int rssi)
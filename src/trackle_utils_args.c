@@ -0,0 +1,175 @@
+#include "trackle_utils_args.h"
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+void trackleArgsInit(TrackleArgs_t *args, const char *input, char separator)
+{
+    if (input == NULL)
+        input = "";
+    trackleArgsInitLen(args, input, strlen(input), separator);
+}
+
+void trackleArgsInitLen(TrackleArgs_t *args, const char *input, size_t len, char separator)
+{
+    args->cur = input;
+    args->end = input + len;
+    args->separator = separator;
+}
+
+bool trackleArgsNext(TrackleArgs_t *args, TrackleStr_t *token)
+{
+    if (args->cur == NULL)
+        return false;
+
+    const char *sep = memchr(args->cur, args->separator, args->end - args->cur);
+    token->ptr = args->cur;
+    if (sep == NULL)
+    {
+        token->len = args->end - args->cur;
+        args->cur = NULL;
+    }
+    else
+    {
+        token->len = sep - args->cur;
+        args->cur = sep + 1;
+    }
+    return true;
+}
+
+bool trackleArgsRest(TrackleArgs_t *args, TrackleStr_t *token)
+{
+    if (args->cur == NULL)
+        return false;
+    token->ptr = args->cur;
+    token->len = args->end - args->cur;
+    args->cur = NULL;
+    return true;
+}
+
+bool trackleArgsNextInt32(TrackleArgs_t *args, int32_t *value)
+{
+    TrackleStr_t token;
+    return trackleArgsNext(args, &token) && trackleStrToInt32(token, value);
+}
+
+TrackleStr_t trackleStrTrim(TrackleStr_t str)
+{
+    while (str.len > 0 && isSpace(str.ptr[0]))
+    {
+        str.ptr++;
+        str.len--;
+    }
+    while (str.len > 0 && isSpace(str.ptr[str.len - 1]))
+        str.len--;
+    return str;
+}
+
+bool trackleStrEquals(TrackleStr_t str, const char *literal)
+{
+    return strlen(literal) == str.len && memcmp(str.ptr, literal, str.len) == 0;
+}
+
+bool trackleStrCopy(TrackleStr_t str, char *out, size_t outSize)
+{
+    if (str.len >= outSize)
+        return false;
+    memcpy(out, str.ptr, str.len);
+    out[str.len] = '\0';
+    return true;
+}
+
+// digits only, accumulates until the value would exceed max
+static bool parseMagnitude(TrackleStr_t str, uint32_t max, uint32_t *value)
+{
+    if (str.len == 0)
+        return false;
+    uint32_t v = 0;
+    for (size_t i = 0; i < str.len; i++)
+    {
+        const uint32_t digit = (uint8_t)str.ptr[i] - '0';
+        if (digit > 9 || v > (max - digit) / 10)
+            return false;
+        v = v * 10 + digit;
+    }
+    *value = v;
+    return true;
+}
+
+bool trackleStrToInt32(TrackleStr_t str, int32_t *value)
+{
+    str = trackleStrTrim(str);
+    bool negative = false;
+    if (str.len > 0 && (str.ptr[0] == '-' || str.ptr[0] == '+'))
+    {
+        negative = str.ptr[0] == '-';
+        str.ptr++;
+        str.len--;
+    }
+
+    uint32_t magnitude;
+    if (!parseMagnitude(str, negative ? (uint32_t)INT32_MAX + 1 : INT32_MAX, &magnitude))
+        return false;
+    *value = negative ? (int32_t)(0 - magnitude) : (int32_t)magnitude;
+    return true;
+}
+
+bool trackleStrToUint32(TrackleStr_t str, uint32_t *value)
+{
+    str = trackleStrTrim(str);
+    if (str.len > 0 && str.ptr[0] == '+')
+    {
+        str.ptr++;
+        str.len--;
+    }
+    return parseMagnitude(str, UINT32_MAX, value);
+}
+
+TrackleCompare_Op trackleCompareOpParse(TrackleStr_t str)
+{
+    str = trackleStrTrim(str);
+    if (str.len == 1)
+    {
+        switch (str.ptr[0])
+        {
+        case '<':
+            return TRACKLE_CMP_LT;
+        case '>':
+            return TRACKLE_CMP_GT;
+        case '=':
+            return TRACKLE_CMP_EQ;
+        }
+    }
+    else if (str.len == 2 && str.ptr[1] == '=')
+    {
+        switch (str.ptr[0])
+        {
+        case '<':
+            return TRACKLE_CMP_LE;
+        case '>':
+            return TRACKLE_CMP_GE;
+        }
+    }
+    return TRACKLE_CMP_INVALID;
+}
+
+bool trackleCompare(int32_t a, TrackleCompare_Op op, int32_t b)
+{
+    switch (op)
+    {
+    case TRACKLE_CMP_LT:
+        return a < b;
+    case TRACKLE_CMP_LE:
+        return a <= b;
+    case TRACKLE_CMP_GT:
+        return a > b;
+    case TRACKLE_CMP_GE:
+        return a >= b;
+    case TRACKLE_CMP_EQ:
+        return a == b;
+    default:
+        return false;
+    }
+}
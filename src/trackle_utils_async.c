@@ -0,0 +1,197 @@
+#include "trackle_utils_async.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "trackle_esp32.h"
+#include "trackle_utils_trampoline.h"
+#include "trackle_utils_writer.h"
+
+#if TRACKLE_ASYNC_MAX > TRACKLE_TRAMPOLINE_MAX
+#error "TRACKLE_ASYNC_MAX must be at most TRACKLE_TRAMPOLINE_MAX"
+#endif
+
+static const char *ASYNC_TAG = "trackle-utils-async";
+
+typedef struct
+{
+    bool used;
+    char name[TRACKLE_ASYNC_NAME_LEN];
+    int (*function)(const char *);
+    TrackleAsync_Stats stats;
+    uint64_t totalMs;
+} AsyncFunction_t;
+
+typedef struct
+{
+    uint8_t function;
+    uint32_t id;
+    char args[TRACKLE_ASYNC_MAX_ARGS + 1];
+} AsyncJob_t;
+
+static AsyncFunction_t functions[TRACKLE_ASYNC_MAX];
+static AsyncJob_t jobs[TRACKLE_ASYNC_QUEUE_LEN + TRACKLE_ASYNC_WORKERS]; // waiting + running
+static QueueHandle_t freeJobs = NULL; // indexes of jobs not in use
+static QueueHandle_t pendingJobs = NULL;
+static uint32_t lastId = 0;
+static portMUX_TYPE asyncMux = portMUX_INITIALIZER_UNLOCKED;
+
+static AsyncFunction_t *findFunction(const char *name)
+{
+    for (size_t i = 0; i < TRACKLE_ASYNC_MAX; i++)
+    {
+        if (functions[i].used && strcmp(functions[i].name, name) == 0)
+            return &functions[i];
+    }
+    return NULL;
+}
+
+static void publishResult(const AsyncFunction_t *fn, uint32_t id, int result, uint32_t elapsedMs)
+{
+    char json[TRACKLE_ASYNC_NAME_LEN + 64];
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+    trackleWriterBeginObject(&w);
+    trackleWriterKey(&w, "fn");
+    trackleWriterString(&w, fn->name);
+    trackleWriterKey(&w, "id");
+    trackleWriterInt(&w, id);
+    trackleWriterKey(&w, "ret");
+    trackleWriterInt(&w, result);
+    trackleWriterKey(&w, "ms");
+    trackleWriterInt(&w, elapsedMs);
+    trackleWriterEndObject(&w);
+    if (trackleWriterFinish(&w) < 0 || !tracklePublishSecure(TRACKLE_ASYNC_RESULT_EVENT, json))
+        ESP_LOGW(ASYNC_TAG, "cannot publish result of %s, call %" PRIu32, fn->name, id);
+}
+
+static void asyncWorkerTask(void *pvParameter)
+{
+    uint8_t index;
+    while (1)
+    {
+        if (xQueueReceive(pendingJobs, &index, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        AsyncJob_t *job = &jobs[index];
+        AsyncFunction_t *fn = &functions[job->function];
+        const uint32_t start = getMillis();
+        const int result = fn->function(job->args);
+        const uint32_t elapsedMs = getMillis() - start;
+
+        portENTER_CRITICAL(&asyncMux);
+        fn->stats.calls++;
+        fn->stats.lastResult = result;
+        fn->totalMs += elapsedMs;
+        if (elapsedMs > fn->stats.maxMs)
+            fn->stats.maxMs = elapsedMs;
+        portEXIT_CRITICAL(&asyncMux);
+
+        const uint32_t id = job->id;
+        xQueueSend(freeJobs, &index, 0);
+        publishResult(fn, id, result, elapsedMs);
+    }
+}
+
+/**
+ * Called by the cloud, in trackleLoop: queue the call and return its id.
+ */
+static int enqueueCall(uint8_t function, const char *args)
+{
+    AsyncFunction_t *fn = &functions[function];
+    const size_t argsLen = args ? strlen(args) : 0;
+    uint8_t index;
+    int res;
+    if (argsLen > TRACKLE_ASYNC_MAX_ARGS)
+        res = TRACKLE_ASYNC_TOO_LONG;
+    else if (xQueueReceive(freeJobs, &index, 0) != pdTRUE)
+        res = TRACKLE_ASYNC_BUSY;
+    else
+    {
+        AsyncJob_t *job = &jobs[index];
+        job->function = function;
+        lastId = lastId < INT32_MAX ? lastId + 1 : 1;
+        job->id = lastId;
+        memcpy(job->args, args ? args : "", argsLen + 1);
+        res = job->id;
+        xQueueSend(pendingJobs, &index, 0);
+    }
+
+    if (res < 0)
+    {
+        portENTER_CRITICAL(&asyncMux);
+        fn->stats.rejected++;
+        portEXIT_CRITICAL(&asyncMux);
+        ESP_LOGW(ASYNC_TAG, "%s refused: %s", fn->name, res == TRACKLE_ASYNC_BUSY ? "queue full" : "arguments too long");
+    }
+    return res;
+}
+
+// the library passes no context to functions: one trampoline per slot
+TRACKLE_TRAMPOLINES(trampolines, int, enqueueCall, TRACKLE_ASYNC_MAX);
+
+static bool startWorkers()
+{
+    const size_t jobCount = sizeof(jobs) / sizeof(jobs[0]);
+    freeJobs = xQueueCreate(jobCount, sizeof(uint8_t));
+    pendingJobs = xQueueCreate(jobCount, sizeof(uint8_t));
+    if (freeJobs == NULL || pendingJobs == NULL)
+        return false;
+    for (uint8_t i = 0; i < jobCount; i++)
+        xQueueSend(freeJobs, &i, 0);
+
+    for (int i = 0; i < TRACKLE_ASYNC_WORKERS; i++)
+    {
+        if (xTaskCreate(&asyncWorkerTask, "trackle_async", TRACKLE_ASYNC_STACK_SIZE, NULL, 4, NULL) != pdPASS)
+            return false;
+    }
+    return true;
+}
+
+bool trackleAsyncAddPost(const char *name, int (*function)(const char *), Function_PermissionDef permission)
+{
+    if (strlen(name) >= TRACKLE_ASYNC_NAME_LEN || findFunction(name) != NULL)
+        return false;
+    if (freeJobs == NULL && !startWorkers())
+    {
+        ESP_LOGE(ASYNC_TAG, "cannot start workers");
+        return false;
+    }
+
+    for (size_t i = 0; i < TRACKLE_ASYNC_MAX; i++)
+    {
+        AsyncFunction_t *fn = &functions[i];
+        if (fn->used)
+            continue;
+        memset(fn, 0, sizeof(*fn));
+        strcpy(fn->name, name);
+        fn->function = function;
+        fn->used = true;
+        if (!tracklePost(trackle_s, name, trampolines[i], permission))
+        {
+            fn->used = false;
+            return false;
+        }
+        return true;
+    }
+    ESP_LOGE(ASYNC_TAG, "too many functions, max %d", TRACKLE_ASYNC_MAX);
+    return false;
+}
+
+bool trackleAsyncGetStats(const char *name, TrackleAsync_Stats *stats)
+{
+    const AsyncFunction_t *fn = findFunction(name);
+    if (fn == NULL)
+        return false;
+
+    portENTER_CRITICAL(&asyncMux);
+    *stats = fn->stats;
+    stats->avgMs = fn->stats.calls > 0 ? fn->totalMs / fn->stats.calls : 0;
+    portEXIT_CRITICAL(&asyncMux);
+    return true;
+}
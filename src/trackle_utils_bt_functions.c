@@ -1,225 +1,147 @@
 #include "trackle_utils_bt_functions.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
 
 #include <esp_log.h>
+#include "freertos/task.h"
 #include <wifi_provisioning/manager.h>
 
-typedef struct
+static const char *BT_FUNCTIONS_TAG = "trackle-utils-bt-functions";
+
+static TrackleRegistry_t btRegistry;
+typedef enum
 {
-    char name[MAX_BT_POST_NAME_LEN];
-    int (*function)(const char *arg);
-} BtPost_t;
+    BT_REGISTRY_NONE = 0,
+    BT_REGISTRY_INITIALIZING,
+    BT_REGISTRY_READY,
+} BtRegistryState_t;
+
+static volatile BtRegistryState_t btRegistryState = BT_REGISTRY_NONE;
+static portMUX_TYPE btRegistryMux = portMUX_INITIALIZER_UNLOCKED;
 
+// Buffers reused by every call. A single provisioning session is assumed: protocomm over BLE serves one
+// client at a time and runs endpoint handlers from the BLE host task only, so calls never overlap and
+// nothing in here outlives a call.
 typedef struct
 {
-    char name[MAX_BT_GET_NAME_LEN];
-    void *(*function)(const char *arg);
-    int dataType;
-} BtGet_t;
+    char args[MAX_BT_FUNCTION_ARG_LEN + 1];
+    char result[MAX_BT_FUNCTION_RESULT_LEN];
+} BtSessionArena_t;
 
-static int actualBtPostsNum = 0;
-static BtPost_t btPosts[MAX_BT_POSTS_NUM];
+static BtSessionArena_t btArena;
 
-static int actualBtGetsNum = 0;
-static BtGet_t btGets[MAX_BT_GETS_NUM];
-
-static bool isNameAlreadyUsed(const char *name)
+TrackleRegistry_t *Trackle_BtFunctions_registry()
 {
-    for (int i = 0; i < actualBtPostsNum; i++)
+    // the first caller can be any task (application, LAN server). The critical section only claims the
+    // initialization: FreeRTOS semaphore calls are not allowed inside it
+    portENTER_CRITICAL(&btRegistryMux);
+    const BtRegistryState_t state = btRegistryState;
+    if (state == BT_REGISTRY_NONE)
+        btRegistryState = BT_REGISTRY_INITIALIZING;
+    portEXIT_CRITICAL(&btRegistryMux);
+
+    if (state == BT_REGISTRY_NONE)
     {
-        if (strcmp(btPosts[i].name, name) == 0)
-        {
-            return true;
-        }
+        trackleRegistryInit(&btRegistry);
+        portENTER_CRITICAL(&btRegistryMux);
+        btRegistryState = BT_REGISTRY_READY;
+        portEXIT_CRITICAL(&btRegistryMux);
     }
-    for (int i = 0; i < actualBtGetsNum; i++)
+    else
     {
-        if (strcmp(btGets[i].name, name) == 0)
-        {
-            return true;
-        }
+        while (btRegistryState != BT_REGISTRY_READY)
+            vTaskDelay(1);
     }
-    return false;
+    return &btRegistry;
 }
 
 bool Trackle_BtPost_add(const char *name, int (*function)(const char *))
 {
-    if (actualBtPostsNum < MAX_BT_POSTS_NUM)
-    {
-        if (isNameAlreadyUsed(name))
-            return false;
-        if (strlen(name) + 1 > MAX_BT_POST_NAME_LEN) // +1 because there must be space for null character
-            return false;
-        strcpy(btPosts[actualBtPostsNum].name, name);
-        btPosts[actualBtPostsNum].function = function;
-        actualBtPostsNum++;
-        return true;
-    }
-    return false;
+    return trackleRegistryAddPost(Trackle_BtFunctions_registry(), name, function) != TRACKLE_ENDPOINT_INVALID;
 }
 
 bool Trackle_BtGet_add(const char *name, void *(*function)(const char *), Data_TypeDef dataType)
 {
-    if (actualBtGetsNum < MAX_BT_GETS_NUM)
-    {
-        if (isNameAlreadyUsed(name))
-            return false;
-        if (strlen(name) + 1 > MAX_BT_GET_NAME_LEN) // +1 because there must be space for null character
-            return false;
-        strcpy(btGets[actualBtGetsNum].name, name);
-        btGets[actualBtGetsNum].function = function;
-        btGets[actualBtGetsNum].dataType = dataType;
-        actualBtGetsNum++;
-        return true;
-    }
-    return false;
+    return trackleRegistryAddGet(Trackle_BtFunctions_registry(), name, function, dataType) != TRACKLE_ENDPOINT_INVALID;
 }
 
-static esp_err_t btFunctionCallHandler(uint32_t session_id, const uint8_t *inbuf, ssize_t inlen, uint8_t **outbuf, ssize_t *outlen, void *priv_data)
+bool Trackle_BtStream_add(const char *name, TrackleRegistry_BlockCb function)
 {
-    // If no input buffer passed, use empty string as arg, else add null character at end of passed string.
-    char *args = NULL;
-    if (inbuf == NULL)
-    {
-        args = strdup("");
-        if (args == NULL)
-        {
-            return ESP_ERR_NO_MEM;
-        }
-    }
-    else
-    {
-        args = malloc(sizeof(uint8_t) * (inlen + 1));
-        if (args == NULL)
-        {
-            return ESP_ERR_NO_MEM;
-        }
-        memcpy(args, inbuf, inlen);
-        args[inlen] = '\0';
-    }
-
-    const int btFunIdx = *((int *)&priv_data); // Interpret pointer as an integer representing the index of the function of interest.
-    if (btFunIdx < MAX_BT_POSTS_NUM)
-    {
-        int (*function)(const char *) = btPosts[btFunIdx].function;
-        const int funRes = function(args);
-
-        // Return string containing function return code, if there is still memory for its string
-        char *funResStr = malloc(sizeof(char) * 20);
-        if (funResStr == NULL)
-            return ESP_ERR_NO_MEM;
-        sprintf(funResStr, "%d", funRes);
-        *outbuf = (uint8_t *)funResStr;
-        *outlen = strlen(funResStr) + 1;
-    }
-    else
-    {
-        void *(*function)(const char *) = btGets[btFunIdx - MAX_BT_POSTS_NUM].function;
-        const void *funRes = function(args);
-        char *funResStr = NULL;
-        switch (btGets[btFunIdx - MAX_BT_POSTS_NUM].dataType)
-        {
-        case VAR_BOOLEAN:
-        {
-            bool boolRes = *((bool *)funRes);
-            funResStr = strdup(boolRes ? "TRUE" : "FALSE");
-            break;
-        }
-        case VAR_CHAR:
-        {
-            char charRes[2];
-            charRes[0] = *((char *)funRes);
-            charRes[1] = '\0';
-            funResStr = strdup(charRes);
-            break;
-        }
-        case VAR_DOUBLE:
-        {
-            double doubleRes = *((double *)funRes);
-            char doubleResStr[128];
-            const int convBytes = snprintf(doubleResStr, 128, "%f", doubleRes);
-            if (convBytes < 0 || convBytes >= 128)
-                return ESP_ERR_NO_MEM;
-            funResStr = strdup(doubleResStr);
-            break;
-        }
-        case VAR_INT:
-        {
-            int32_t intRes = *((int32_t *)funRes);
-            char intResStr[20];
-            const int convBytes = snprintf(intResStr, 20, "%" PRIi32, intRes);
-            if (convBytes < 0 || convBytes >= 20)
-                return ESP_ERR_NO_MEM;
-            funResStr = strdup(intResStr);
-            break;
-        }
-        case VAR_JSON:
-        case VAR_STRING:
-        {
-            char *stringRes = (char *)funRes;
-            funResStr = strdup(stringRes);
-            break;
-        }
-        case VAR_LONG:
-        {
-            int64_t longRes = *((int64_t *)funRes);
-            char longResStr[40];
-            const int convBytes = snprintf(longResStr, 40, "%" PRIi64, longRes);
-            if (convBytes < 0 || convBytes >= 40)
-                return ESP_ERR_NO_MEM;
-            funResStr = strdup(longResStr);
-            break;
-        }
-        default:
-            ESP_LOGE("", "Unexpected error");
-            return ESP_ERR_NO_MEM;
-        }
-        if (funResStr == NULL)
-            return ESP_ERR_NO_MEM;
-        *outbuf = (uint8_t *)funResStr;
-        *outlen = strlen(funResStr) + 1;
-    }
+    return trackleRegistryAddStream(Trackle_BtFunctions_registry(), name, function) != TRACKLE_ENDPOINT_INVALID;
+}
 
-    // Deallocate string used as arg
-    free(args);
+bool Trackle_BtFunction_remove(const char *name)
+{
+    return trackleRegistryRemove(Trackle_BtFunctions_registry(), name);
+}
 
+/**
+ * Hand the result string over to protocomm, that frees the response buffer once sent (or once
+ * encrypted, when security is enabled). This is the only allocation of a call.
+ */
+static esp_err_t btReturnResult(const char *result, size_t len, uint8_t **outbuf, ssize_t *outlen)
+{
+    uint8_t *out = malloc(len + 1);
+    if (out == NULL)
+        return ESP_ERR_NO_MEM;
+    memcpy(out, result, len);
+    out[len] = '\0';
+    *outbuf = out;
+    *outlen = len + 1; // clients expect the NULL terminator
     return ESP_OK;
 }
 
-esp_err_t btFunctionsEndpointsCreate()
+static esp_err_t btFunctionCallHandler(uint32_t session_id, const uint8_t *inbuf, ssize_t inlen, uint8_t **outbuf, ssize_t *outlen, void *priv_data)
 {
-    for (int i = 0; i < actualBtPostsNum; i++)
+    *outbuf = NULL;
+    *outlen = 0;
+
+    // If no input buffer passed, use empty string as arg, else add null character at end of passed string.
+    if (inbuf == NULL || inlen < 0)
+        inlen = 0;
+    if (inlen > MAX_BT_FUNCTION_ARG_LEN)
     {
-        const esp_err_t err = wifi_prov_mgr_endpoint_create(btPosts[i].name);
-        if (err != ESP_OK)
-            return err;
+        ESP_LOGE(BT_FUNCTIONS_TAG, "Argument too long: %d bytes", (int)inlen);
+        return ESP_ERR_INVALID_SIZE;
     }
-    for (int i = 0; i < actualBtGetsNum; i++)
+    if (inlen > 0)
+        memcpy(btArena.args, inbuf, inlen);
+    btArena.args[inlen] = '\0';
+
+    // the handle of the function when the endpoint was registered: fails if it has been removed since
+    const TrackleEndpoint_Handle handle = (TrackleEndpoint_Handle)(uintptr_t)priv_data;
+    const char *result = NULL;
+    size_t resultLen = 0;
+    const esp_err_t err = trackleRegistryCall(Trackle_BtFunctions_registry(), handle, btArena.args, btArena.result, sizeof(btArena.result), &result, &resultLen);
+    if (err != ESP_OK)
     {
-        const esp_err_t err = wifi_prov_mgr_endpoint_create(btGets[i].name);
-        if (err != ESP_OK)
-            return err;
+        ESP_LOGE(BT_FUNCTIONS_TAG, "Call failed: %s", esp_err_to_name(err));
+        return err;
     }
-    return ESP_OK;
+    return btReturnResult(result, resultLen, outbuf, outlen);
+}
+
+esp_err_t btFunctionsEndpointsCreate()
+{
+    TrackleRegistry_t *reg = Trackle_BtFunctions_registry();
+    esp_err_t err = ESP_OK;
+    trackleRegistryLock(reg);
+    for (TrackleEndpoint_t *ep = trackleRegistryNext(reg, NULL); ep != NULL && err == ESP_OK; ep = trackleRegistryNext(reg, ep))
+        err = wifi_prov_mgr_endpoint_create(ep->name);
+    trackleRegistryUnlock(reg);
+    return err;
 }
 
 esp_err_t btFunctionsEndpointsRegister()
 {
-    for (int i = 0; i < actualBtPostsNum; i++)
-    {
-        const esp_err_t err = wifi_prov_mgr_endpoint_register(btPosts[i].name, btFunctionCallHandler, *((void **)&i));
-        if (err != ESP_OK)
-            return err;
-    }
-    for (int i = 0; i < actualBtGetsNum; i++)
-    {
-        const int iPlusOffset = i + MAX_BT_POSTS_NUM;
-        const esp_err_t err = wifi_prov_mgr_endpoint_register(btGets[i].name, btFunctionCallHandler, *((void **)&iPlusOffset));
-        if (err != ESP_OK)
-            return err;
-    }
-    return ESP_OK;
+    TrackleRegistry_t *reg = Trackle_BtFunctions_registry();
+    esp_err_t err = ESP_OK;
+    trackleRegistryLock(reg);
+    for (TrackleEndpoint_t *ep = trackleRegistryNext(reg, NULL); ep != NULL && err == ESP_OK; ep = trackleRegistryNext(reg, ep))
+        err = wifi_prov_mgr_endpoint_register(ep->name, btFunctionCallHandler, (void *)(uintptr_t)trackleRegistryGetHandle(reg, ep));
+    trackleRegistryUnlock(reg);
+    return err;
 }
@@ -0,0 +1,231 @@
+#include "trackle_utils_cache.h"
+
+#include <string.h>
+
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "trackle_esp32.h"
+#include "trackle_utils_trampoline.h"
+
+#if TRACKLE_CACHE_MAX > TRACKLE_TRAMPOLINE_MAX
+#error "TRACKLE_CACHE_MAX must be at most TRACKLE_TRAMPOLINE_MAX"
+#endif
+
+static const char *CACHE_TAG = "trackle-utils-cache";
+
+typedef union
+{
+    bool b;
+    int32_t i;
+    int64_t l;
+    double d;
+    char c;
+    char str[TRACKLE_CACHE_VALUE_LEN];
+} CacheValue_t;
+
+typedef struct
+{
+    bool used;
+    char name[TRACKLE_CACHE_NAME_LEN];
+    void *(*getter)(const char *);
+    Data_TypeDef dataType;
+    uint32_t ttlMs;
+
+    // the cloud gets a pointer to values[current], new values are written to the other one
+    CacheValue_t values[2];
+    uint8_t current;
+    bool valid; // a getter call succeeded once: a failed refresh keeps the last good value
+    bool refreshing;
+    uint32_t updatedMillis;
+
+    TrackleCache_Stats stats;
+    uint64_t getterUsTotal;
+} CacheSlot_t;
+
+static CacheSlot_t slots[TRACKLE_CACHE_MAX];
+static portMUX_TYPE cacheMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t workerTask = NULL; // the only caller of the getters
+
+static CacheSlot_t *findSlot(const char *name)
+{
+    for (size_t i = 0; i < TRACKLE_CACHE_MAX; i++)
+    {
+        if (slots[i].used && strcmp(slots[i].name, name) == 0)
+            return &slots[i];
+    }
+    return NULL;
+}
+
+static void copyValue(const CacheSlot_t *slot, CacheValue_t *dst, const void *src)
+{
+    switch (slot->dataType)
+    {
+    case VAR_BOOLEAN:
+        dst->b = *(const bool *)src;
+        break;
+    case VAR_INT:
+        dst->i = *(const int32_t *)src;
+        break;
+    case VAR_LONG:
+        dst->l = *(const int64_t *)src;
+        break;
+    case VAR_DOUBLE:
+        dst->d = *(const double *)src;
+        break;
+    case VAR_CHAR:
+        dst->c = *(const char *)src;
+        break;
+    default:
+    {
+        size_t len = strnlen((const char *)src, sizeof(dst->str));
+        if (len == sizeof(dst->str))
+        {
+            ESP_LOGW(CACHE_TAG, "%s truncated to %d bytes", slot->name, TRACKLE_CACHE_VALUE_LEN - 1);
+            len--;
+        }
+        memcpy(dst->str, src, len);
+        dst->str[len] = '\0';
+        break;
+    }
+    }
+}
+
+/**
+ * Call the getter and store the result in the buffer not given to the cloud, then swap. Runs on the
+ * worker only.
+ */
+static void fetch(CacheSlot_t *slot)
+{
+    const int64_t start = esp_timer_get_time();
+    const void *value = slot->getter("");
+    const uint32_t elapsedUs = esp_timer_get_time() - start;
+    if (value != NULL)
+        copyValue(slot, &slot->values[slot->current ^ 1], value);
+
+    portENTER_CRITICAL(&cacheMux);
+    if (value != NULL)
+    {
+        slot->current ^= 1;
+        slot->valid = true;
+        slot->updatedMillis = getMillis();
+    }
+    else
+        slot->stats.failures++;
+    slot->refreshing = false;
+    slot->stats.refreshes++;
+    slot->getterUsTotal += elapsedUs;
+    if (elapsedUs > slot->stats.getterUsMax)
+        slot->stats.getterUsMax = elapsedUs;
+    portEXIT_CRITICAL(&cacheMux);
+}
+
+static void cacheWorkerTask(void *pvParameter)
+{
+    uint32_t pending;
+    while (1)
+    {
+        if (xTaskNotifyWait(0, UINT32_MAX, &pending, portMAX_DELAY) != pdTRUE)
+            continue;
+        for (size_t i = 0; i < TRACKLE_CACHE_MAX; i++)
+        {
+            if (pending & (1u << i))
+                fetch(&slots[i]);
+        }
+    }
+}
+
+static void requestRefresh(CacheSlot_t *slot)
+{
+    xTaskNotify(workerTask, 1u << (slot - slots), eSetBits);
+}
+
+/**
+ * Called by the cloud, in trackleLoop. Never calls the getter: without a value the read is answered
+ * as not ready and the worker fetches one.
+ */
+static void *cachedRead(size_t index, const char *args)
+{
+    CacheSlot_t *slot = &slots[index];
+    const uint32_t now = getMillis();
+
+    portENTER_CRITICAL(&cacheMux);
+    const bool valid = slot->valid;
+    if (valid && now - slot->updatedMillis < slot->ttlMs)
+        slot->stats.hits++;
+    else if (valid)
+        slot->stats.staleHits++;
+    else
+        slot->stats.misses++;
+    const bool refresh = (!valid || now - slot->updatedMillis >= slot->ttlMs) && !slot->refreshing;
+    if (refresh)
+        slot->refreshing = true;
+    void *value = valid ? &slot->values[slot->current] : NULL;
+    portEXIT_CRITICAL(&cacheMux);
+
+    if (refresh)
+        requestRefresh(slot);
+    return value;
+}
+
+// the library passes no context to getters: one trampoline per slot
+TRACKLE_TRAMPOLINES(trampolines, void *, cachedRead, TRACKLE_CACHE_MAX);
+
+bool trackleCacheAddGet(const char *name, void *(*getter)(const char *), Data_TypeDef dataType, uint32_t ttlMs)
+{
+    if (strlen(name) >= TRACKLE_CACHE_NAME_LEN || findSlot(name) != NULL)
+        return false;
+
+    if (workerTask == NULL && xTaskCreate(&cacheWorkerTask, "trackle_cache", 4096, NULL, 4, &workerTask) != pdPASS)
+        return false;
+
+    for (size_t i = 0; i < TRACKLE_CACHE_MAX; i++)
+    {
+        CacheSlot_t *slot = &slots[i];
+        if (slot->used)
+            continue;
+        memset(slot, 0, sizeof(*slot));
+        strcpy(slot->name, name);
+        slot->getter = getter;
+        slot->dataType = dataType;
+        slot->ttlMs = ttlMs;
+        slot->used = true;
+        if (!trackleGet(trackle_s, name, trampolines[i], dataType))
+        {
+            slot->used = false;
+            return false;
+        }
+        return true;
+    }
+    ESP_LOGE(CACHE_TAG, "too many cached variables, max %d", TRACKLE_CACHE_MAX);
+    return false;
+}
+
+bool trackleCacheRefresh(const char *name)
+{
+    CacheSlot_t *slot = findSlot(name);
+    if (slot == NULL)
+        return false;
+
+    portENTER_CRITICAL(&cacheMux);
+    const bool refresh = !slot->refreshing;
+    slot->refreshing = true;
+    portEXIT_CRITICAL(&cacheMux);
+    if (refresh)
+        requestRefresh(slot);
+    return true;
+}
+
+bool trackleCacheGetStats(const char *name, TrackleCache_Stats *stats)
+{
+    const CacheSlot_t *slot = findSlot(name);
+    if (slot == NULL)
+        return false;
+
+    portENTER_CRITICAL(&cacheMux);
+    *stats = slot->stats;
+    stats->getterUsAvg = slot->stats.refreshes > 0 ? slot->getterUsTotal / slot->stats.refreshes : 0;
+    portEXIT_CRITICAL(&cacheMux);
+    return true;
+}
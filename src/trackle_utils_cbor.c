@@ -0,0 +1,339 @@
+#include "trackle_utils_cbor.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "trackle_utils_codec.h"
+
+#define CBOR_MAX_NESTING 16
+
+#define CBOR_AI_INDEFINITE 31
+
+typedef struct
+{
+    uint8_t major;
+    uint8_t ai;
+    uint64_t value;
+} CborHead_t;
+
+// Decode the initial byte and argument of the next item, advancing the reader.
+static bool readHead(TrackleCborReader_t *r, CborHead_t *head)
+{
+    if (r->error || r->pos >= r->len)
+        return false;
+
+    const uint8_t b = r->data[r->pos++];
+    head->major = b >> 5;
+    head->ai = b & 0x1F;
+    head->value = head->ai;
+
+    if (head->ai < 24 || head->ai == CBOR_AI_INDEFINITE)
+        return true;
+    if (head->ai > 27)
+    {
+        r->error = true;
+        return false;
+    }
+
+    const size_t n = (size_t)1 << (head->ai - 24);
+    if (r->len - r->pos < n)
+    {
+        r->error = true;
+        return false;
+    }
+    head->value = 0;
+    for (size_t i = 0; i < n; i++)
+        head->value = (head->value << 8) | r->data[r->pos++];
+    return true;
+}
+
+static double halfToDouble(uint16_t half)
+{
+    const int exp = (half >> 10) & 0x1F;
+    const int mant = half & 0x3FF;
+    double val;
+    if (exp == 0)
+        val = ldexp(mant, -24);
+    else if (exp != 31)
+        val = ldexp(mant + 1024, exp - 25);
+    else
+        val = mant == 0 ? INFINITY : NAN;
+    return (half & 0x8000) ? -val : val;
+}
+
+void trackleCborReaderInit(TrackleCborReader_t *r, const uint8_t *data, size_t len)
+{
+    r->data = data;
+    r->len = len;
+    r->pos = 0;
+    r->error = false;
+}
+
+TrackleCbor_Type trackleCborPeek(TrackleCborReader_t *r)
+{
+    if (r->error)
+        return TRACKLE_CBOR_INVALID;
+    if (r->pos >= r->len)
+        return TRACKLE_CBOR_END;
+
+    const uint8_t b = r->data[r->pos];
+    switch (b >> 5)
+    {
+    case 0:
+    case 1:
+        return TRACKLE_CBOR_INT;
+    case 2:
+        return TRACKLE_CBOR_BYTES;
+    case 3:
+        return TRACKLE_CBOR_TEXT;
+    case 4:
+        return TRACKLE_CBOR_ARRAY;
+    case 5:
+        return TRACKLE_CBOR_MAP;
+    case 6:
+        return TRACKLE_CBOR_INVALID; // tags are not supported
+    default:
+        break;
+    }
+
+    switch (b)
+    {
+    case 0xF4:
+    case 0xF5:
+        return TRACKLE_CBOR_BOOL;
+    case 0xF6:
+    case 0xF7:
+        return TRACKLE_CBOR_NULL;
+    case 0xF9:
+    case 0xFA:
+    case 0xFB:
+        return TRACKLE_CBOR_FLOAT;
+    case 0xFF:
+        return TRACKLE_CBOR_BREAK;
+    default:
+        return TRACKLE_CBOR_INVALID;
+    }
+}
+
+bool trackleCborReadInt(TrackleCborReader_t *r, int64_t *out)
+{
+    if (trackleCborPeek(r) != TRACKLE_CBOR_INT)
+        return false;
+
+    const size_t start = r->pos;
+    CborHead_t head;
+    if (!readHead(r, &head))
+        return false;
+    if (head.ai == CBOR_AI_INDEFINITE || head.value > (uint64_t)INT64_MAX)
+    {
+        r->pos = start;
+        return false;
+    }
+    *out = head.major == 0 ? (int64_t)head.value : -1 - (int64_t)head.value;
+    return true;
+}
+
+bool trackleCborReadDouble(TrackleCborReader_t *r, double *out)
+{
+    const TrackleCbor_Type type = trackleCborPeek(r);
+    if (type == TRACKLE_CBOR_INT)
+    {
+        int64_t i;
+        if (!trackleCborReadInt(r, &i))
+            return false;
+        *out = (double)i;
+        return true;
+    }
+    if (type != TRACKLE_CBOR_FLOAT)
+        return false;
+
+    CborHead_t head;
+    if (!readHead(r, &head))
+        return false;
+    if (head.ai == 25)
+    {
+        *out = halfToDouble((uint16_t)head.value);
+    }
+    else if (head.ai == 26)
+    {
+        const uint32_t bits = (uint32_t)head.value;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        *out = f;
+    }
+    else
+    {
+        memcpy(out, &head.value, sizeof(*out));
+    }
+    return true;
+}
+
+bool trackleCborReadBool(TrackleCborReader_t *r, bool *out)
+{
+    if (trackleCborPeek(r) != TRACKLE_CBOR_BOOL)
+        return false;
+    *out = r->data[r->pos++] == 0xF5;
+    return true;
+}
+
+bool trackleCborReadString(TrackleCborReader_t *r, const char **str, size_t *len)
+{
+    const TrackleCbor_Type type = trackleCborPeek(r);
+    if (type != TRACKLE_CBOR_TEXT && type != TRACKLE_CBOR_BYTES)
+        return false;
+
+    const size_t start = r->pos;
+    CborHead_t head;
+    if (!readHead(r, &head))
+        return false;
+    if (head.ai == CBOR_AI_INDEFINITE)
+    {
+        r->pos = start; // chunked strings are not supported
+        return false;
+    }
+    if (head.value > r->len - r->pos)
+    {
+        r->error = true;
+        return false;
+    }
+    *str = (const char *)&r->data[r->pos];
+    *len = (size_t)head.value;
+    r->pos += (size_t)head.value;
+    return true;
+}
+
+bool trackleCborEnter(TrackleCborReader_t *r, size_t *count)
+{
+    const TrackleCbor_Type type = trackleCborPeek(r);
+    if (type != TRACKLE_CBOR_ARRAY && type != TRACKLE_CBOR_MAP)
+        return false;
+
+    CborHead_t head;
+    if (!readHead(r, &head))
+        return false;
+    *count = head.ai == CBOR_AI_INDEFINITE ? SIZE_MAX : (size_t)head.value;
+    return true;
+}
+
+bool trackleCborLeave(TrackleCborReader_t *r)
+{
+    if (trackleCborPeek(r) != TRACKLE_CBOR_BREAK)
+        return false;
+    r->pos++;
+    return true;
+}
+
+static bool skipItem(TrackleCborReader_t *r, int depth)
+{
+    if (depth > CBOR_MAX_NESTING)
+    {
+        r->error = true;
+        return false;
+    }
+
+    const TrackleCbor_Type type = trackleCborPeek(r);
+    switch (type)
+    {
+    case TRACKLE_CBOR_TEXT:
+    case TRACKLE_CBOR_BYTES:
+    {
+        const char *str;
+        size_t len;
+        return trackleCborReadString(r, &str, &len);
+    }
+    case TRACKLE_CBOR_ARRAY:
+    case TRACKLE_CBOR_MAP:
+    {
+        size_t count;
+        if (!trackleCborEnter(r, &count))
+            return false;
+        if (count == SIZE_MAX)
+        {
+            while (!trackleCborLeave(r))
+            {
+                if (!skipItem(r, depth + 1))
+                    return false;
+            }
+            return true;
+        }
+        // maps hold two items per entry
+        const uint64_t items = type == TRACKLE_CBOR_MAP ? (uint64_t)count * 2 : count;
+        for (uint64_t i = 0; i < items; i++)
+        {
+            if (!skipItem(r, depth + 1))
+                return false;
+        }
+        return true;
+    }
+    case TRACKLE_CBOR_INT:
+    case TRACKLE_CBOR_FLOAT:
+    {
+        CborHead_t head;
+        return readHead(r, &head);
+    }
+    case TRACKLE_CBOR_BOOL:
+    case TRACKLE_CBOR_NULL:
+        r->pos++;
+        return true;
+    default:
+        r->error = r->error || type == TRACKLE_CBOR_INVALID;
+        return false;
+    }
+}
+
+bool trackleCborSkip(TrackleCborReader_t *r)
+{
+    return skipItem(r, 0);
+}
+
+bool trackleCborMapFind(TrackleCborReader_t *r, const char *key)
+{
+    TrackleCborReader_t it = *r;
+    size_t count;
+    if (trackleCborPeek(&it) != TRACKLE_CBOR_MAP || !trackleCborEnter(&it, &count))
+        return false;
+
+    const size_t keyLen = strlen(key);
+    for (size_t i = 0; count == SIZE_MAX || i < count; i++)
+    {
+        if (count == SIZE_MAX && trackleCborPeek(&it) == TRACKLE_CBOR_BREAK)
+            return false;
+
+        const char *k;
+        size_t kLen;
+        if (trackleCborPeek(&it) == TRACKLE_CBOR_TEXT)
+        {
+            if (!trackleCborReadString(&it, &k, &kLen))
+                return false;
+            if (kLen == keyLen && memcmp(k, key, keyLen) == 0)
+            {
+                *r = it;
+                return true;
+            }
+        }
+        else if (!trackleCborSkip(&it))
+        {
+            return false;
+        }
+        if (!trackleCborSkip(&it))
+            return false;
+    }
+    return false;
+}
+
+int trackleCborToText(const uint8_t *data, size_t len, char *out, size_t outSize)
+{
+    if (outSize <= TRACKLE_CBOR_TEXT_PREFIX_LEN)
+        return TRACKLE_CODEC_ERR_SPACE;
+    memcpy(out, TRACKLE_CBOR_TEXT_PREFIX, TRACKLE_CBOR_TEXT_PREFIX_LEN);
+    const int n = trackleBase64Encode(data, len, out + TRACKLE_CBOR_TEXT_PREFIX_LEN, outSize - TRACKLE_CBOR_TEXT_PREFIX_LEN);
+    return n < 0 ? n : n + (int)TRACKLE_CBOR_TEXT_PREFIX_LEN;
+}
+
+int trackleCborFromText(const char *text, uint8_t *out, size_t outSize)
+{
+    if (strncmp(text, TRACKLE_CBOR_TEXT_PREFIX, TRACKLE_CBOR_TEXT_PREFIX_LEN) != 0)
+        return TRACKLE_CODEC_ERR_INPUT; // not a CBOR document
+    text += TRACKLE_CBOR_TEXT_PREFIX_LEN;
+    return trackleBase64Decode(text, strlen(text), out, outSize);
+}
@@ -0,0 +1,195 @@
+#include "trackle_utils_codec.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// "00" "01" ... "ff": one 16 bit copy per input byte
+static const char hexPairs[512 + 1] =
+    "000102030405060708090a0b0c0d0e0f"
+    "101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f"
+    "303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f"
+    "505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f"
+    "707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f"
+    "909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+    "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+    "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+static const char base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char base64UrlAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// decoding tables hold value + 1, 0 marks an invalid character
+static const uint8_t hexValues[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5, ['5'] = 6, ['6'] = 7, ['7'] = 8,
+    ['8'] = 9, ['9'] = 10, ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+static const uint8_t base64Values[256] = {
+    ['A'] = 1, ['B'] = 2, ['C'] = 3, ['D'] = 4, ['E'] = 5, ['F'] = 6, ['G'] = 7, ['H'] = 8,
+    ['I'] = 9, ['J'] = 10, ['K'] = 11, ['L'] = 12, ['M'] = 13, ['N'] = 14, ['O'] = 15, ['P'] = 16,
+    ['Q'] = 17, ['R'] = 18, ['S'] = 19, ['T'] = 20, ['U'] = 21, ['V'] = 22, ['W'] = 23, ['X'] = 24,
+    ['Y'] = 25, ['Z'] = 26, ['a'] = 27, ['b'] = 28, ['c'] = 29, ['d'] = 30, ['e'] = 31, ['f'] = 32,
+    ['g'] = 33, ['h'] = 34, ['i'] = 35, ['j'] = 36, ['k'] = 37, ['l'] = 38, ['m'] = 39, ['n'] = 40,
+    ['o'] = 41, ['p'] = 42, ['q'] = 43, ['r'] = 44, ['s'] = 45, ['t'] = 46, ['u'] = 47, ['v'] = 48,
+    ['w'] = 49, ['x'] = 50, ['y'] = 51, ['z'] = 52, ['0'] = 53, ['1'] = 54, ['2'] = 55, ['3'] = 56,
+    ['4'] = 57, ['5'] = 58, ['6'] = 59, ['7'] = 60, ['8'] = 61, ['9'] = 62, ['+'] = 63, ['/'] = 64,
+};
+
+static const uint8_t base64UrlValues[256] = {
+    ['A'] = 1, ['B'] = 2, ['C'] = 3, ['D'] = 4, ['E'] = 5, ['F'] = 6, ['G'] = 7, ['H'] = 8,
+    ['I'] = 9, ['J'] = 10, ['K'] = 11, ['L'] = 12, ['M'] = 13, ['N'] = 14, ['O'] = 15, ['P'] = 16,
+    ['Q'] = 17, ['R'] = 18, ['S'] = 19, ['T'] = 20, ['U'] = 21, ['V'] = 22, ['W'] = 23, ['X'] = 24,
+    ['Y'] = 25, ['Z'] = 26, ['a'] = 27, ['b'] = 28, ['c'] = 29, ['d'] = 30, ['e'] = 31, ['f'] = 32,
+    ['g'] = 33, ['h'] = 34, ['i'] = 35, ['j'] = 36, ['k'] = 37, ['l'] = 38, ['m'] = 39, ['n'] = 40,
+    ['o'] = 41, ['p'] = 42, ['q'] = 43, ['r'] = 44, ['s'] = 45, ['t'] = 46, ['u'] = 47, ['v'] = 48,
+    ['w'] = 49, ['x'] = 50, ['y'] = 51, ['z'] = 52, ['0'] = 53, ['1'] = 54, ['2'] = 55, ['3'] = 56,
+    ['4'] = 57, ['5'] = 58, ['6'] = 59, ['7'] = 60, ['8'] = 61, ['9'] = 62, ['-'] = 63, ['_'] = 64,
+};
+
+int trackleHexEncode(const uint8_t *in, size_t len, char *out, size_t outSize)
+{
+    if (outSize < TRACKLE_HEX_ENCODED_LEN(len) + 1)
+        return TRACKLE_CODEC_ERR_SPACE;
+
+    char *p = out;
+    for (size_t i = 0; i < len; i++, p += 2)
+        memcpy(p, &hexPairs[in[i] * 2], 2);
+    *p = '\0';
+    return (int)TRACKLE_HEX_ENCODED_LEN(len);
+}
+
+int trackleHexDecode(const char *in, size_t len, uint8_t *out, size_t outSize)
+{
+    const size_t outLen = TRACKLE_HEX_DECODED_LEN(len);
+    if (outSize < outLen)
+        return TRACKLE_CODEC_ERR_SPACE;
+
+    size_t i = 0;
+    size_t o = 0;
+    if (len % 2 == 1)
+    {
+        const uint8_t lo = hexValues[(uint8_t)in[0]];
+        if (lo == 0)
+            return TRACKLE_CODEC_ERR_INPUT;
+        out[o++] = lo - 1;
+        i = 1;
+    }
+    for (; i < len; i += 2)
+    {
+        const uint8_t hi = hexValues[(uint8_t)in[i]];
+        const uint8_t lo = hexValues[(uint8_t)in[i + 1]];
+        if (hi == 0 || lo == 0)
+            return TRACKLE_CODEC_ERR_INPUT;
+        out[o++] = ((hi - 1) << 4) | (lo - 1);
+    }
+    return (int)outLen;
+}
+
+static int base64Encode(const uint8_t *in, size_t len, char *out, size_t outSize, const char *alphabet, bool pad)
+{
+    const size_t textLen = pad ? TRACKLE_BASE64_ENCODED_LEN(len) : TRACKLE_BASE64URL_ENCODED_LEN(len);
+    if (outSize < textLen + 1)
+        return TRACKLE_CODEC_ERR_SPACE;
+
+    char *p = out;
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3)
+    {
+        const uint32_t v = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8) | in[i + 2];
+        p[0] = alphabet[(v >> 18) & 0x3F];
+        p[1] = alphabet[(v >> 12) & 0x3F];
+        p[2] = alphabet[(v >> 6) & 0x3F];
+        p[3] = alphabet[v & 0x3F];
+        p += 4;
+    }
+    if (i < len)
+    {
+        const bool two = i + 1 < len;
+        const uint32_t v = ((uint32_t)in[i] << 16) | (two ? (uint32_t)in[i + 1] << 8 : 0);
+        *p++ = alphabet[(v >> 18) & 0x3F];
+        *p++ = alphabet[(v >> 12) & 0x3F];
+        if (two)
+            *p++ = alphabet[(v >> 6) & 0x3F];
+        else if (pad)
+            *p++ = '=';
+        if (pad)
+            *p++ = '=';
+    }
+    *p = '\0';
+    return (int)textLen;
+}
+
+static int base64Decode(const char *in, size_t len, uint8_t *out, size_t outSize, const uint8_t *values, bool padRequired)
+{
+    if (padRequired && len % 4 != 0)
+        return TRACKLE_CODEC_ERR_INPUT;
+    size_t n = len;
+    if (n > 0 && in[n - 1] == '=')
+        n--;
+    if (n > 0 && in[n - 1] == '=')
+        n--;
+    if (n % 4 == 1 || (len != n && len % 4 != 0))
+        return TRACKLE_CODEC_ERR_INPUT;
+
+    const size_t outLen = n / 4 * 3 + (n % 4 == 0 ? 0 : n % 4 - 1);
+    if (outSize < outLen)
+        return TRACKLE_CODEC_ERR_SPACE;
+
+    size_t i = 0;
+    uint8_t *p = out;
+    for (; i + 4 <= n; i += 4)
+    {
+        const uint8_t a = values[(uint8_t)in[i]];
+        const uint8_t b = values[(uint8_t)in[i + 1]];
+        const uint8_t c = values[(uint8_t)in[i + 2]];
+        const uint8_t d = values[(uint8_t)in[i + 3]];
+        if (a == 0 || b == 0 || c == 0 || d == 0)
+            return TRACKLE_CODEC_ERR_INPUT;
+        const uint32_t v = ((uint32_t)(a - 1) << 18) | ((uint32_t)(b - 1) << 12) | ((uint32_t)(c - 1) << 6) | (d - 1);
+        p[0] = v >> 16;
+        p[1] = v >> 8;
+        p[2] = v;
+        p += 3;
+    }
+    if (i < n)
+    {
+        const uint8_t a = values[(uint8_t)in[i]];
+        const uint8_t b = values[(uint8_t)in[i + 1]];
+        const uint8_t c = n - i == 3 ? values[(uint8_t)in[i + 2]] : 1;
+        if (a == 0 || b == 0 || c == 0)
+            return TRACKLE_CODEC_ERR_INPUT;
+        const uint32_t v = ((uint32_t)(a - 1) << 18) | ((uint32_t)(b - 1) << 12) | ((uint32_t)(c - 1) << 6);
+        *p++ = v >> 16;
+        if (n - i == 3)
+            *p++ = v >> 8;
+    }
+    return (int)outLen;
+}
+
+int trackleBase64Encode(const uint8_t *in, size_t len, char *out, size_t outSize)
+{
+    return base64Encode(in, len, out, outSize, base64Alphabet, true);
+}
+
+int trackleBase64Decode(const char *in, size_t len, uint8_t *out, size_t outSize)
+{
+    return base64Decode(in, len, out, outSize, base64Values, true);
+}
+
+int trackleBase64UrlEncode(const uint8_t *in, size_t len, char *out, size_t outSize)
+{
+    return base64Encode(in, len, out, outSize, base64UrlAlphabet, false);
+}
+
+int trackleBase64UrlDecode(const char *in, size_t len, uint8_t *out, size_t outSize)
+{
+    return base64Decode(in, len, out, outSize, base64UrlValues, false);
+}
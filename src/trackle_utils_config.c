@@ -0,0 +1,269 @@
+#include "trackle_utils_config.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#if TRACKLE_CONFIG_CACHE_SIZE > UINT16_MAX
+#error "TRACKLE_CONFIG_CACHE_SIZE must be at most 65535"
+#endif
+
+static const char *CONFIG_TAG = "trackle-utils-config";
+
+typedef struct
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    bool present; // the key exists
+    bool direct;  // doesn't fit in the cache, read and written on NVS
+    bool dirty;
+    uint32_t dirtySeq; // order of the last write, blobs are flushed in this order
+    uint16_t offset;   // of the blob in cacheArea
+    uint16_t capacity;
+    uint16_t size;
+} ConfigEntry_t;
+
+static nvs_handle_t configHandle;
+static ConfigEntry_t entries[TRACKLE_CONFIG_MAX_ENTRIES];
+static size_t entryCount = 0;
+static uint8_t cacheArea[TRACKLE_CONFIG_CACHE_SIZE];
+static size_t cacheUsed = 0; // blobs are never freed, a blob that grows gets new space
+static uint32_t lastSeq = 0;
+static TrackleConfig_Stats configStats;
+static SemaphoreHandle_t configMutex = NULL; // NVS calls are slow, no critical sections
+static esp_timer_handle_t commitTimer = NULL;
+static TaskHandle_t flushTask = NULL;
+
+static bool allocate(ConfigEntry_t *e, size_t size)
+{
+    if (size > sizeof(cacheArea) - cacheUsed)
+        return false;
+    e->offset = cacheUsed;
+    e->capacity = size;
+    cacheUsed += size;
+    return true;
+}
+
+// NULL if the key can't be cached: access it on NVS
+static ConfigEntry_t *findOrLoad(const char *key)
+{
+    for (size_t i = 0; i < entryCount; i++)
+    {
+        if (strcmp(entries[i].key, key) == 0)
+            return &entries[i];
+    }
+    if (entryCount >= TRACKLE_CONFIG_MAX_ENTRIES || strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+        return NULL;
+
+    size_t len = 0;
+    const esp_err_t err = nvs_get_blob(configHandle, key, NULL, &len);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+        return NULL;
+
+    ConfigEntry_t *e = &entries[entryCount];
+    memset(e, 0, sizeof(*e));
+    strcpy(e->key, key);
+    if (err == ESP_OK)
+    {
+        if (!allocate(e, len) || nvs_get_blob(configHandle, key, cacheArea + e->offset, &len) != ESP_OK)
+            e->direct = true;
+        e->present = true;
+        e->size = len;
+    }
+    entryCount++;
+    return e;
+}
+
+static esp_err_t flushLocked()
+{
+    esp_err_t err = ESP_OK;
+    size_t written = 0;
+    while (1)
+    {
+        ConfigEntry_t *next = NULL;
+        for (size_t i = 0; i < entryCount; i++)
+        {
+            if (entries[i].dirty && (next == NULL || entries[i].dirtySeq < next->dirtySeq))
+                next = &entries[i];
+        }
+        if (next == NULL)
+            break;
+
+        err = nvs_set_blob(configHandle, next->key, cacheArea + next->offset, next->size);
+        if (err != ESP_OK)
+        {
+            configStats.failures++;
+            ESP_LOGE(CONFIG_TAG, "cannot write %s: %s", next->key, esp_err_to_name(err));
+            break; // later blobs must not overtake this one
+        }
+        next->dirty = false;
+        configStats.flashBytesWritten += next->size;
+        written++;
+    }
+
+    if (written > 0)
+    {
+        const esp_err_t commitErr = nvs_commit(configHandle);
+        configStats.commits++;
+        if (err == ESP_OK)
+            err = commitErr;
+        ESP_LOGI(CONFIG_TAG, "%u blobs committed", (unsigned)written);
+    }
+    if (err != ESP_OK)
+        esp_timer_start_once(commitTimer, (uint64_t)TRACKLE_CONFIG_COMMIT_DELAY_MS * 1000); // retry
+    return err;
+}
+
+// runs on the esp_timer task: no NVS access here, it would delay all the other timers
+static void commitTimerCb(void *arg)
+{
+    xTaskNotifyGive(flushTask);
+}
+
+static void flushTaskFn(void *pvParameter)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        trackleConfigFlush();
+    }
+}
+
+static void flushOnShutdown()
+{
+    trackleConfigFlush();
+}
+
+esp_err_t trackleConfigInit(nvs_handle_t handle)
+{
+    configHandle = handle;
+    if (configMutex != NULL)
+        return ESP_OK;
+
+    const esp_timer_create_args_t timerArgs = {
+        .callback = commitTimerCb,
+        .name = "trackle_config",
+    };
+    SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    if (mutex == NULL)
+        return ESP_ERR_NO_MEM;
+    if (xTaskCreate(&flushTaskFn, "trackle_config", 3072, NULL, 2, &flushTask) != pdPASS)
+    {
+        vSemaphoreDelete(mutex);
+        return ESP_ERR_NO_MEM;
+    }
+    if (esp_timer_create(&timerArgs, &commitTimer) != ESP_OK)
+    {
+        vTaskDelete(flushTask);
+        vSemaphoreDelete(mutex);
+        return ESP_ERR_NO_MEM;
+    }
+    configMutex = mutex; // published last: Read and Write check it
+    return esp_register_shutdown_handler(flushOnShutdown);
+}
+
+esp_err_t trackleConfigRead(const char *key, void *out, size_t size)
+{
+    if (configMutex == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    configStats.reads++;
+    esp_err_t err;
+    const ConfigEntry_t *e = findOrLoad(key);
+    if (e == NULL || e->direct)
+    {
+        err = nvs_get_blob(configHandle, key, out, &size);
+    }
+    else
+    {
+        configStats.readHits++;
+        if (!e->present)
+            err = ESP_ERR_NVS_NOT_FOUND;
+        else if (e->size > size)
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+        else
+        {
+            memcpy(out, cacheArea + e->offset, e->size);
+            err = ESP_OK;
+        }
+    }
+    xSemaphoreGive(configMutex);
+    return err;
+}
+
+esp_err_t trackleConfigWrite(const char *key, const void *value, size_t size)
+{
+    if (configMutex == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    configStats.writes++;
+    esp_err_t err = ESP_OK;
+    ConfigEntry_t *e = findOrLoad(key);
+    if (e != NULL && !e->direct && e->present && e->size == size && memcmp(cacheArea + e->offset, value, size) == 0)
+    {
+        configStats.unchangedWrites++;
+    }
+    else if (e != NULL && !e->direct && (size <= e->capacity || allocate(e, size)))
+    {
+        memcpy(cacheArea + e->offset, value, size);
+        e->size = size;
+        e->present = true;
+        // renumbered at every write: a blob written again goes after the ones written in between
+        e->dirtySeq = ++lastSeq;
+        if (!e->dirty)
+        {
+            e->dirty = true;
+            if (!esp_timer_is_active(commitTimer))
+                esp_timer_start_once(commitTimer, (uint64_t)TRACKLE_CONFIG_COMMIT_DELAY_MS * 1000);
+        }
+    }
+    else
+    {
+        // not cached: write through, after the pending blobs to keep the order
+        if (e != NULL)
+        {
+            e->direct = true;
+            e->dirty = false;
+        }
+        err = flushLocked();
+        if (err == ESP_OK)
+            err = nvs_set_blob(configHandle, key, value, size);
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(configHandle);
+            configStats.commits++;
+            configStats.flashBytesWritten += size;
+        }
+    }
+    xSemaphoreGive(configMutex);
+    return err;
+}
+
+esp_err_t trackleConfigFlush()
+{
+    if (configMutex == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(configMutex, portMAX_DELAY);
+    esp_timer_stop(commitTimer);
+    const esp_err_t err = flushLocked();
+    xSemaphoreGive(configMutex);
+    return err;
+}
+
+void trackleConfigGetStats(TrackleConfig_Stats *stats)
+{
+    if (configMutex != NULL)
+        xSemaphoreTake(configMutex, portMAX_DELAY);
+    *stats = configStats;
+    stats->commitsSaved = configStats.writes > configStats.commits ? configStats.writes - configStats.commits : 0;
+    if (configMutex != NULL)
+        xSemaphoreGive(configMutex);
+}
@@ -0,0 +1,134 @@
+#include "trackle_utils_connectivity.h"
+
+#include <inttypes.h>
+
+#include <esp_log.h>
+
+#include "trackle_esp32.h"
+
+static const char *CONNECTIVITY_TAG = "trackle-utils-connectivity";
+
+static portMUX_TYPE connectivityMux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool ipAvailable = false;
+static bool connectRequested = false;
+static bool linkLost = false;
+static bool routeChanged = false;
+static bool wasCloudConnected = false;
+
+// phase timestamps of the session being set up (getMillis)
+static uint32_t linkDownAt = 0;
+static uint32_t linkUpAt = 0;
+static uint32_t ipAt = 0;
+static uint32_t dnsStartAt = 0;
+static uint32_t dnsDoneAt = 0;
+
+static TrackleConnectivity_Stats connectivityStats;
+
+void trackleConnectivityOnLinkUp()
+{
+    portENTER_CRITICAL(&connectivityMux);
+    linkUpAt = getMillis();
+    portEXIT_CRITICAL(&connectivityMux);
+}
+
+void trackleConnectivityOnGotIp()
+{
+    portENTER_CRITICAL(&connectivityMux);
+    ipAt = getMillis();
+    if (linkUpAt == 0 || linkUpAt < linkDownAt)
+        linkUpAt = ipAt; // link without association phase (e.g. wired)
+    ipAvailable = true;
+    connectRequested = true;
+    linkLost = false;
+    portEXIT_CRITICAL(&connectivityMux);
+}
+
+void trackleConnectivityOnLinkDown()
+{
+    portENTER_CRITICAL(&connectivityMux);
+    if (ipAvailable)
+    {
+        linkDownAt = getMillis();
+        linkLost = true;
+    }
+    ipAvailable = false;
+    connectRequested = false;
+    routeChanged = false;
+    portEXIT_CRITICAL(&connectivityMux);
+}
+
+void trackleConnectivityOnRouteChange()
+{
+    portENTER_CRITICAL(&connectivityMux);
+    linkDownAt = linkUpAt = ipAt = getMillis();
+    routeChanged = ipAvailable;
+    portEXIT_CRITICAL(&connectivityMux);
+}
+
+bool trackleConnectivityIsUp()
+{
+    return ipAvailable;
+}
+
+void trackleConnectivityDnsStart()
+{
+    dnsStartAt = getMillis();
+}
+
+void trackleConnectivityDnsDone()
+{
+    dnsDoneAt = getMillis();
+}
+
+bool trackleConnectivityTakeConnectRequest()
+{
+    portENTER_CRITICAL(&connectivityMux);
+    const bool requested = connectRequested;
+    connectRequested = false;
+    portEXIT_CRITICAL(&connectivityMux);
+    return requested;
+}
+
+bool trackleConnectivityTakeLinkLost()
+{
+    portENTER_CRITICAL(&connectivityMux);
+    const bool lost = linkLost;
+    linkLost = false;
+    portEXIT_CRITICAL(&connectivityMux);
+    return lost;
+}
+
+bool trackleConnectivityTakeRouteChange()
+{
+    portENTER_CRITICAL(&connectivityMux);
+    const bool changed = routeChanged;
+    routeChanged = false;
+    portEXIT_CRITICAL(&connectivityMux);
+    return changed;
+}
+
+void trackleConnectivityLoop(bool cloudConnected)
+{
+    if (cloudConnected && !wasCloudConnected)
+    {
+        const uint32_t now = getMillis();
+        connectivityStats.linkMs = linkUpAt - linkDownAt;
+        connectivityStats.ipMs = ipAt - linkUpAt;
+        connectivityStats.dnsMs = dnsDoneAt - dnsStartAt;
+        connectivityStats.handshakeMs = now - dnsDoneAt;
+        connectivityStats.totalMs = now - linkDownAt;
+        connectivityStats.sessions++;
+        ESP_LOGI(CONNECTIVITY_TAG, "cloud connected in %" PRIu32 " ms (link %" PRIu32 ", ip %" PRIu32 ", dns %" PRIu32 ", handshake %" PRIu32 ")",
+                 connectivityStats.totalMs, connectivityStats.linkMs, connectivityStats.ipMs, connectivityStats.dnsMs, connectivityStats.handshakeMs);
+
+        // next session, if the link stays up, is measured from now
+        linkDownAt = linkUpAt = ipAt = now;
+    }
+    wasCloudConnected = cloudConnected;
+}
+
+void trackleConnectivityGetStats(TrackleConnectivity_Stats *stats)
+{
+    *stats = connectivityStats;
+}
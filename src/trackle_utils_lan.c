@@ -0,0 +1,301 @@
+#include "trackle_utils_lan.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "lwip/sockets.h"
+#include "esp_random.h"
+#include "mbedtls/md.h"
+
+#if __has_include("mdns.h")
+#include "mdns.h"
+#define TRACKLE_LAN_MDNS 1
+#endif
+
+#include "trackle_esp32.h"
+#include "trackle_utils_bt_functions.h"
+#include "trackle_utils_powersave.h"
+
+#define LAN_MAC_LEN 32
+#define LAN_NONCE_LEN 8
+#define LAN_EXCHANGE_LEN 16 // client ID and counter, echoed in the response
+#define LAN_HEADER_LEN (LAN_MAC_LEN + LAN_NONCE_LEN + LAN_EXCHANGE_LEN)
+#define LAN_MAX_REQUEST (LAN_HEADER_LEN + TRACKLE_REGISTRY_NAME_LEN + TRACKLE_LAN_MAX_ARGS)
+#define LAN_MAX_RESPONSE (LAN_HEADER_LEN + 1 + TRACKLE_LAN_MAX_RESULT)
+
+static const char *LAN_TAG = "trackle-utils-lan";
+
+typedef struct
+{
+    struct sockaddr_in from;
+    uint8_t exchange[LAN_EXCHANGE_LEN];
+    char name[TRACKLE_REGISTRY_NAME_LEN];
+    char args[TRACKLE_LAN_MAX_ARGS + 1];
+} LanJob_t;
+
+static int lanSocket = -1;
+typedef struct
+{
+    bool used;
+    uint64_t id; // from the authenticated header: the source address can be spoofed
+    uint64_t counter;
+    uint32_t lastMillis;
+} LanClient_t;
+
+static uint8_t lanKey[LAN_MAC_LEN];
+static uint8_t bootNonce[LAN_NONCE_LEN];
+// replay state, only touched by the server task
+static LanClient_t clients[TRACKLE_LAN_MAX_CLIENTS];
+static uint64_t forgottenCounter = 0; // highest counter of the clients forgotten
+static LanJob_t lanJobs[TRACKLE_LAN_QUEUE_LEN];
+static QueueHandle_t freeJobs = NULL; // indexes of lanJobs not in use
+static QueueHandle_t pendingJobs = NULL;
+static TrackleLan_Stats lanStats;
+
+static void hmac(const uint8_t *data, size_t len, uint8_t *out)
+{
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), lanKey, sizeof(lanKey), data, len, out);
+}
+
+// constant time, not to leak how many bytes of a forged MAC are right
+static bool macEqual(const uint8_t *a, const uint8_t *b)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < LAN_MAC_LEN; i++)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+static void reply(const struct sockaddr_in *to, const uint8_t *exchange, TrackleLan_Status status, const char *result, size_t resultLen)
+{
+    uint8_t out[LAN_MAX_RESPONSE];
+    if (resultLen > TRACKLE_LAN_MAX_RESULT)
+    {
+        status = TRACKLE_LAN_TOO_LONG;
+        resultLen = 0;
+    }
+    memcpy(out + LAN_MAC_LEN, bootNonce, LAN_NONCE_LEN);
+    memcpy(out + LAN_MAC_LEN + LAN_NONCE_LEN, exchange, LAN_EXCHANGE_LEN);
+    out[LAN_HEADER_LEN] = status;
+    if (resultLen > 0)
+        memcpy(out + LAN_HEADER_LEN + 1, result, resultLen);
+    const size_t len = LAN_HEADER_LEN + 1 + resultLen;
+    hmac(out + LAN_MAC_LEN, len - LAN_MAC_LEN, out);
+    sendto(lanSocket, out, len, 0, (const struct sockaddr *)to, sizeof(*to));
+}
+
+static void lanWorkerTask(void *pvParameter)
+{
+    char scratch[TRACKLE_LAN_MAX_RESULT];
+    uint8_t index;
+    while (1)
+    {
+        if (xQueueReceive(pendingJobs, &index, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        LanJob_t *job = &lanJobs[index];
+        TrackleRegistry_t *reg = Trackle_BtFunctions_registry();
+        const char *result = NULL;
+        size_t resultLen = 0;
+        const esp_err_t err = trackleRegistryCall(reg, trackleRegistryFind(reg, job->name), job->args, scratch, sizeof(scratch), &result, &resultLen);
+        if (err == ESP_OK)
+            reply(&job->from, job->exchange, TRACKLE_LAN_OK, result, resultLen);
+        else if (err == ESP_ERR_NOT_FOUND)
+            reply(&job->from, job->exchange, TRACKLE_LAN_NOT_FOUND, NULL, 0);
+        else
+            reply(&job->from, job->exchange, err == ESP_ERR_INVALID_SIZE ? TRACKLE_LAN_TOO_LONG : TRACKLE_LAN_ERROR, NULL, 0);
+        if (err != ESP_ERR_NOT_FOUND)
+            lanStats.calls++;
+        xQueueSend(freeJobs, &index, 0);
+    }
+}
+
+static uint64_t readBigEndian(const uint8_t *bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value = (value << 8) | bytes[i];
+    return value;
+}
+
+static bool acceptCounter(uint64_t id, uint64_t counter)
+{
+    LanClient_t *client = NULL;
+    LanClient_t *oldest = &clients[0];
+    for (size_t i = 0; i < TRACKLE_LAN_MAX_CLIENTS && client == NULL; i++)
+    {
+        if (clients[i].used && clients[i].id == id)
+            client = &clients[i];
+        else if (!clients[i].used || (oldest->used && clients[i].lastMillis < oldest->lastMillis))
+            oldest = &clients[i];
+    }
+    if (client == NULL)
+    {
+        // forget the least recently seen client, its counters must not become valid again
+        if (oldest->used && oldest->counter > forgottenCounter)
+            forgottenCounter = oldest->counter;
+        client = oldest;
+        client->used = true;
+        client->id = id;
+        client->counter = forgottenCounter;
+    }
+    if (counter <= client->counter)
+        return false;
+    client->counter = counter;
+    client->lastMillis = getMillis();
+    return true;
+}
+
+/**
+ * Check a request and hand it to a worker. Authentication and replay checks are done here, in the
+ * server task, so that the counter is checked in arrival order.
+ */
+static void handleRequest(const uint8_t *buf, size_t len, const struct sockaddr_in *from)
+{
+    lanStats.requests++;
+    uint8_t mac[LAN_MAC_LEN];
+    if (len <= LAN_HEADER_LEN)
+    {
+        lanStats.authFailures++;
+        return;
+    }
+    hmac(buf + LAN_MAC_LEN, len - LAN_MAC_LEN, mac);
+    if (!macEqual(mac, buf))
+    {
+        lanStats.authFailures++;
+        return;
+    }
+
+    const uint8_t *exchange = buf + LAN_MAC_LEN + LAN_NONCE_LEN;
+    if (memcmp(buf + LAN_MAC_LEN, bootNonce, LAN_NONCE_LEN) != 0)
+    {
+        // captured before a reboot, or a client that doesn't know the nonce yet
+        lanStats.staleNonces++;
+        reply(from, exchange, TRACKLE_LAN_STALE_NONCE, NULL, 0);
+        return;
+    }
+
+    // replay state is keyed on the authenticated client ID, never on the source address
+    if (!acceptCounter(readBigEndian(exchange), readBigEndian(exchange + 8)))
+    {
+        lanStats.replays++;
+        return;
+    }
+    tracklePowersaveNotifyActivity();
+
+    const char *name = (const char *)buf + LAN_HEADER_LEN;
+    const size_t nameLen = strnlen(name, len - LAN_HEADER_LEN);
+    const size_t argsLen = len - LAN_HEADER_LEN - nameLen - (nameLen < len - LAN_HEADER_LEN ? 1 : 0);
+    if (nameLen >= TRACKLE_REGISTRY_NAME_LEN || argsLen > TRACKLE_LAN_MAX_ARGS)
+    {
+        reply(from, exchange, TRACKLE_LAN_TOO_LONG, NULL, 0);
+        return;
+    }
+
+    uint8_t index;
+    if (xQueueReceive(freeJobs, &index, 0) != pdTRUE)
+    {
+        lanStats.busy++;
+        reply(from, exchange, TRACKLE_LAN_BUSY, NULL, 0);
+        return;
+    }
+    LanJob_t *job = &lanJobs[index];
+    job->from = *from;
+    memcpy(job->exchange, exchange, LAN_EXCHANGE_LEN);
+    memcpy(job->name, name, nameLen);
+    job->name[nameLen] = '\0';
+    memcpy(job->args, name + nameLen + 1, argsLen);
+    job->args[argsLen] = '\0';
+    xQueueSend(pendingJobs, &index, 0);
+}
+
+static void lanServerTask(void *pvParameter)
+{
+    static uint8_t buf[LAN_MAX_REQUEST];
+    while (1)
+    {
+        struct sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+        const int len = recvfrom(lanSocket, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromLen);
+        if (len < 0)
+        {
+            ESP_LOGE(LAN_TAG, "recvfrom error: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        handleRequest(buf, len, &from);
+    }
+}
+
+static void announce(uint16_t port)
+{
+#ifdef TRACKLE_LAN_MDNS
+    const esp_err_t err = mdns_init();
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGW(LAN_TAG, "mdns_init error: %s", esp_err_to_name(err));
+        return;
+    }
+    if (err == ESP_OK) // mDNS started here, nobody set the host name yet
+    {
+        char hostname[32];
+        snprintf(hostname, sizeof(hostname), "trackle-%.12s", trackleGetDeviceIdAsStr());
+        mdns_hostname_set(hostname);
+    }
+    mdns_txt_item_t txt[] = {{"id", trackleGetDeviceIdAsStr()}};
+    if (mdns_service_add(NULL, "_trackle", "_udp", port, txt, 1) != ESP_OK)
+        ESP_LOGW(LAN_TAG, "cannot announce service");
+#endif
+}
+
+esp_err_t trackleLanStart(uint16_t port, const uint8_t *secret, size_t secretLen)
+{
+    if (lanSocket >= 0)
+        return ESP_ERR_INVALID_STATE;
+
+    static const char label[] = "trackle-lan-v1";
+    if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), secret, secretLen, (const uint8_t *)label, sizeof(label) - 1, lanKey) != 0)
+        return ESP_FAIL;
+
+    esp_fill_random(bootNonce, sizeof(bootNonce));
+    freeJobs = xQueueCreate(TRACKLE_LAN_QUEUE_LEN, sizeof(uint8_t));
+    pendingJobs = xQueueCreate(TRACKLE_LAN_QUEUE_LEN, sizeof(uint8_t));
+    if (freeJobs == NULL || pendingJobs == NULL)
+        return ESP_ERR_NO_MEM;
+    for (uint8_t i = 0; i < TRACKLE_LAN_QUEUE_LEN; i++)
+        xQueueSend(freeJobs, &i, 0);
+
+    const int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0)
+        return ESP_FAIL;
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        ESP_LOGE(LAN_TAG, "cannot bind port %u: errno %d", port, errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+    lanSocket = sock;
+
+    for (int i = 0; i < TRACKLE_LAN_WORKERS; i++)
+        xTaskCreate(&lanWorkerTask, "trackle_lan_worker", 4096, NULL, 4, NULL);
+    xTaskCreate(&lanServerTask, "trackle_lan", 4096, NULL, 5, NULL);
+
+    announce(port);
+    ESP_LOGI(LAN_TAG, "listening on port %u", port);
+    return ESP_OK;
+}
+
+void trackleLanGetStats(TrackleLan_Stats *stats)
+{
+    *stats = lanStats;
+}
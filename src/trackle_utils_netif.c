@@ -0,0 +1,174 @@
+#include "trackle_utils_netif.h"
+
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_idf_version.h>
+#include "lwip/sockets.h"
+
+#include "trackle_esp32.h"
+#include "trackle_utils.h"
+#include "trackle_utils_connectivity.h"
+
+static const char *NETIF_TAG = "trackle-utils-netif";
+
+typedef struct
+{
+    esp_netif_t *netif;
+    int priority;
+    int connectionType;
+    bool up;
+} TrackleNetif_t;
+
+static TrackleNetif_t netifs[TRACKLE_NETIF_MAX];
+static size_t netifCount = 0;
+static TrackleNetif_t *activeNetif = NULL;
+static TrackleNetif_Stats netifStats;
+
+static portMUX_TYPE netifMux = portMUX_INITIALIZER_UNLOCKED;
+
+static TrackleNetif_t *findNetif(esp_netif_t *netif)
+{
+    for (size_t i = 0; i < netifCount; i++)
+    {
+        if (netifs[i].netif == netif)
+            return &netifs[i];
+    }
+    return NULL;
+}
+
+// best interface that is up, the first registered wins among equal priorities
+static TrackleNetif_t *selectNetif()
+{
+    TrackleNetif_t *best = NULL;
+    for (size_t i = 0; i < netifCount; i++)
+    {
+        if (netifs[i].up && (best == NULL || netifs[i].priority > best->priority))
+            best = &netifs[i];
+    }
+    return best;
+}
+
+bool trackleNetifRegister(esp_netif_t *netif, int priority, int connectionType)
+{
+    bool registered = false;
+    portENTER_CRITICAL(&netifMux);
+    TrackleNetif_t *entry = findNetif(netif);
+    if (entry == NULL && netifCount < TRACKLE_NETIF_MAX)
+        entry = &netifs[netifCount++];
+    if (entry != NULL)
+    {
+        entry->netif = netif;
+        entry->priority = priority;
+        entry->connectionType = connectionType;
+        registered = true;
+    }
+    portEXIT_CRITICAL(&netifMux);
+
+    if (!registered)
+        ESP_LOGE(NETIF_TAG, "too many interfaces, max %d", TRACKLE_NETIF_MAX);
+    return registered;
+}
+
+void trackleNetifSetUp(esp_netif_t *netif, bool up)
+{
+    portENTER_CRITICAL(&netifMux);
+    TrackleNetif_t *entry = findNetif(netif);
+    if (entry != NULL)
+        entry->up = up;
+    TrackleNetif_t *previous = activeNetif;
+    activeNetif = selectNetif();
+    TrackleNetif_t *current = activeNetif;
+    if (current != previous)
+    {
+        netifStats.switches++;
+        netifStats.lastSwitchMillis = getMillis();
+    }
+    portEXIT_CRITICAL(&netifMux);
+
+    if (entry == NULL)
+    {
+        ESP_LOGW(NETIF_TAG, "interface not registered");
+        return;
+    }
+    if (current == previous)
+        return;
+
+    if (current == NULL)
+    {
+        ESP_LOGW(NETIF_TAG, "no interface up");
+        xEventGroupClearBits(s_wifi_event_group, NETWORK_CONNECTED_BIT);
+        trackleConnectivityOnLinkDown();
+        return;
+    }
+
+    ESP_LOGI(NETIF_TAG, "active interface: %s", esp_netif_get_desc(current->netif));
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+    esp_netif_set_default_netif(current->netif);
+#endif
+    xEventGroupSetBits(s_wifi_event_group, NETWORK_CONNECTED_BIT);
+    if (previous == NULL)
+        trackleConnectivityOnGotIp();
+    else
+        trackleConnectivityOnRouteChange(); // failover or failback, move the session
+}
+
+void trackleNetifLinkUp(esp_netif_t *netif)
+{
+    portENTER_CRITICAL(&netifMux);
+    const bool other = activeNetif != NULL && activeNetif->netif != netif;
+    portEXIT_CRITICAL(&netifMux);
+    if (!other)
+        trackleConnectivityOnLinkUp();
+}
+
+bool trackleNetifIsUp(esp_netif_t *netif)
+{
+    portENTER_CRITICAL(&netifMux);
+    const TrackleNetif_t *entry = findNetif(netif);
+    const bool up = entry != NULL && entry->up;
+    portEXIT_CRITICAL(&netifMux);
+    return up;
+}
+
+esp_netif_t *trackleNetifGetActive()
+{
+    portENTER_CRITICAL(&netifMux);
+    esp_netif_t *netif = activeNetif ? activeNetif->netif : NULL;
+    portEXIT_CRITICAL(&netifMux);
+    return netif;
+}
+
+int trackleNetifGetConnectionType()
+{
+    portENTER_CRITICAL(&netifMux);
+    const int type = activeNetif ? activeNetif->connectionType : -1;
+    portEXIT_CRITICAL(&netifMux);
+    return type;
+}
+
+bool trackleNetifBindSocket(int sock)
+{
+    esp_netif_t *netif = trackleNetifGetActive();
+    if (netif == NULL)
+        return netifCount == 0;
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    if (esp_netif_get_netif_impl_name(netif, ifr.ifr_name) != ESP_OK)
+        return false;
+    if (setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, &ifr, sizeof(ifr)) < 0)
+    {
+        ESP_LOGE(NETIF_TAG, "cannot bind socket to %s: errno %d", ifr.ifr_name, errno);
+        return false;
+    }
+    ESP_LOGI(NETIF_TAG, "socket bound to %s", ifr.ifr_name);
+    return true;
+}
+
+void trackleNetifGetStats(TrackleNetif_Stats *stats)
+{
+    portENTER_CRITICAL(&netifMux);
+    *stats = netifStats;
+    portEXIT_CRITICAL(&netifMux);
+}
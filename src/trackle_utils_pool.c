@@ -0,0 +1,302 @@
+#include "trackle_utils_pool.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_idf_version.h>
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#include <esp_memory_utils.h>
+#else
+#include <soc/soc_memory_layout.h>
+#endif
+
+#include "cJSON.h"
+
+typedef struct
+{
+    uint8_t *region;
+    void *freeList;
+    TracklePool_Stats stats;
+} TracklePool_t;
+
+#define POOL_SIZE_ENTRY(size, count) size,
+#define POOL_COUNT_ENTRY(size, count) count,
+
+static const uint16_t poolBlockSizes[] = {TRACKLE_POOL_CLASSES(POOL_SIZE_ENTRY)};
+static const uint16_t poolBlockCounts[] = {TRACKLE_POOL_CLASSES(POOL_COUNT_ENTRY)};
+
+#define POOLS_NUM (sizeof(poolBlockSizes) / sizeof(poolBlockSizes[0]))
+
+static const char *POOL_TAG = "trackle-utils-pool";
+
+static TracklePool_t pools[POOLS_NUM];
+static TracklePool_HeapStats heapStats;
+static bool poolsReady = false;
+static bool noHeapMode = false;
+static portMUX_TYPE poolMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Returns the pool owning ptr, or NULL for heap pointers.
+static TracklePool_t *poolOf(const void *ptr)
+{
+    const uint8_t *p = (const uint8_t *)ptr;
+    for (size_t i = 0; i < POOLS_NUM; i++)
+    {
+        const uint8_t *start = pools[i].region;
+        if (start != NULL && p >= start && p < start + (size_t)pools[i].stats.blockSize * pools[i].stats.blocks)
+            return &pools[i];
+    }
+    return NULL;
+}
+
+static void *heapMalloc(size_t size)
+{
+    void *ptr = NULL;
+    bool spiram = false;
+
+    portENTER_CRITICAL(&poolMux);
+    const bool forbidden = noHeapMode;
+    portEXIT_CRITICAL(&poolMux);
+
+    if (!forbidden)
+    {
+#ifdef CONFIG_SPIRAM
+        if (size >= TRACKLE_POOL_SPIRAM_THRESHOLD)
+        {
+            ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            spiram = ptr != NULL;
+        }
+#endif
+        if (ptr == NULL)
+            ptr = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+
+    portENTER_CRITICAL(&poolMux);
+    if (ptr == NULL)
+        heapStats.failures++;
+    else if (spiram)
+        heapStats.spiramAllocs++;
+    else
+        heapStats.internalAllocs++;
+    portEXIT_CRITICAL(&poolMux);
+
+    return ptr;
+}
+
+static void *heapRealloc(void *ptr, size_t size)
+{
+    portENTER_CRITICAL(&poolMux);
+    const bool forbidden = noHeapMode;
+    portEXIT_CRITICAL(&poolMux);
+
+    // the heap may move the block to grow it: that is a heap allocation as well
+    void *bigger = forbidden ? NULL : heap_caps_realloc(ptr, size, MALLOC_CAP_8BIT);
+
+    portENTER_CRITICAL(&poolMux);
+    if (bigger == NULL)
+        heapStats.failures++;
+    else if (esp_ptr_external_ram(bigger))
+        heapStats.spiramAllocs++;
+    else
+        heapStats.internalAllocs++;
+    portEXIT_CRITICAL(&poolMux);
+
+    return bigger;
+}
+
+static void *cjsonMalloc(size_t size)
+{
+    return tracklePoolMalloc(size);
+}
+
+static void cjsonFree(void *ptr)
+{
+    tracklePoolFree(ptr);
+}
+
+esp_err_t tracklePoolInit()
+{
+    if (poolsReady)
+        return ESP_ERR_INVALID_STATE;
+
+    for (size_t i = 0; i < POOLS_NUM; i++)
+    {
+        TracklePool_t *pool = &pools[i];
+        const size_t blockSize = poolBlockSizes[i];
+        pool->region = heap_caps_malloc(blockSize * poolBlockCounts[i], MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (pool->region == NULL)
+        {
+            ESP_LOGE(POOL_TAG, "cannot allocate pool of %u x %u bytes", poolBlockCounts[i], (unsigned)blockSize);
+            for (size_t j = 0; j < i; j++)
+            {
+                heap_caps_free(pools[j].region);
+                pools[j].region = NULL;
+            }
+            return ESP_ERR_NO_MEM;
+        }
+
+        memset(&pool->stats, 0, sizeof(pool->stats));
+        pool->stats.blockSize = blockSize;
+        pool->stats.blocks = poolBlockCounts[i];
+
+        // thread the free list through the blocks, lowest address first
+        pool->freeList = NULL;
+        for (int b = poolBlockCounts[i] - 1; b >= 0; b--)
+        {
+            void **block = (void **)(pool->region + blockSize * b);
+            *block = pool->freeList;
+            pool->freeList = block;
+        }
+    }
+
+    portENTER_CRITICAL(&poolMux);
+    poolsReady = true;
+    portEXIT_CRITICAL(&poolMux);
+    return ESP_OK;
+}
+
+esp_err_t tracklePoolHookCJSON()
+{
+    portENTER_CRITICAL(&poolMux);
+    const bool ready = poolsReady;
+    portEXIT_CRITICAL(&poolMux);
+    if (!ready)
+        return ESP_ERR_INVALID_STATE;
+
+    // cJSON nodes created before this call are released by cjsonFree too: it accepts heap pointers
+    cJSON_Hooks hooks = {
+        .malloc_fn = cjsonMalloc,
+        .free_fn = cjsonFree,
+    };
+    cJSON_InitHooks(&hooks);
+    return ESP_OK;
+}
+
+void tracklePoolSetNoHeap(bool noHeap)
+{
+    portENTER_CRITICAL(&poolMux);
+    noHeapMode = noHeap;
+    portEXIT_CRITICAL(&poolMux);
+}
+
+void *tracklePoolMalloc(size_t size)
+{
+    if (size == 0)
+        size = 1;
+
+    void *ptr = NULL;
+    portENTER_CRITICAL(&poolMux);
+    if (poolsReady)
+    {
+        bool counted = false;
+        for (size_t i = 0; i < POOLS_NUM && ptr == NULL; i++)
+        {
+            TracklePool_t *pool = &pools[i];
+            if (size > pool->stats.blockSize)
+                continue;
+            if (pool->freeList == NULL)
+            {
+                // exhausted: account it to the best fitting class, then try a bigger one
+                if (!counted)
+                    pool->stats.failures++;
+                counted = true;
+                continue;
+            }
+            ptr = pool->freeList;
+            pool->freeList = *(void **)ptr;
+            pool->stats.allocs++;
+            if (++pool->stats.used > pool->stats.peak)
+                pool->stats.peak = pool->stats.used;
+        }
+    }
+    portEXIT_CRITICAL(&poolMux);
+
+    return ptr != NULL ? ptr : heapMalloc(size);
+}
+
+void *tracklePoolCalloc(size_t n, size_t size)
+{
+    if (size != 0 && n > SIZE_MAX / size)
+        return NULL;
+    void *ptr = tracklePoolMalloc(n * size);
+    if (ptr != NULL)
+        memset(ptr, 0, n * size);
+    return ptr;
+}
+
+void *tracklePoolRealloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return tracklePoolMalloc(size);
+    if (size == 0)
+    {
+        tracklePoolFree(ptr);
+        return NULL;
+    }
+
+    TracklePool_t *pool = poolOf(ptr);
+    if (pool == NULL)
+        return heapRealloc(ptr, size);
+    if (size <= pool->stats.blockSize)
+        return ptr;
+
+    void *bigger = tracklePoolMalloc(size);
+    if (bigger == NULL)
+        return NULL;
+    memcpy(bigger, ptr, pool->stats.blockSize);
+    tracklePoolFree(ptr);
+    return bigger;
+}
+
+void tracklePoolFree(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    TracklePool_t *pool = poolOf(ptr);
+    if (pool == NULL)
+    {
+        heap_caps_free(ptr);
+        return;
+    }
+
+    portENTER_CRITICAL(&poolMux);
+    *(void **)ptr = pool->freeList;
+    pool->freeList = ptr;
+    pool->stats.used--;
+    portEXIT_CRITICAL(&poolMux);
+}
+
+int tracklePoolGetStats(TracklePool_Stats *stats, int maxStats)
+{
+    portENTER_CRITICAL(&poolMux);
+    for (int i = 0; i < (int)POOLS_NUM && i < maxStats; i++)
+        stats[i] = pools[i].stats;
+    portEXIT_CRITICAL(&poolMux);
+    return POOLS_NUM;
+}
+
+void tracklePoolGetHeapStats(TracklePool_HeapStats *stats)
+{
+    portENTER_CRITICAL(&poolMux);
+    *stats = heapStats;
+    portEXIT_CRITICAL(&poolMux);
+}
+
+void tracklePoolLogStats()
+{
+    TracklePool_Stats stats[POOLS_NUM];
+    tracklePoolGetStats(stats, POOLS_NUM);
+    for (size_t i = 0; i < POOLS_NUM; i++)
+    {
+        ESP_LOGI(POOL_TAG, "pool %4u: used %u/%u, peak %u, allocs %" PRIu32 ", failures %" PRIu32,
+                 stats[i].blockSize, stats[i].used, stats[i].blocks, stats[i].peak, stats[i].allocs, stats[i].failures);
+    }
+
+    TracklePool_HeapStats heap;
+    tracklePoolGetHeapStats(&heap);
+    ESP_LOGI(POOL_TAG, "heap fallback: internal %" PRIu32 ", spiram %" PRIu32 ", failures %" PRIu32,
+             heap.internalAllocs, heap.spiramAllocs, heap.failures);
+}
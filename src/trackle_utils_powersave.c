@@ -0,0 +1,151 @@
+#include "trackle_utils_powersave.h"
+
+#include <esp_log.h>
+
+#include "trackle_esp32.h"
+#include "trackle_utils.h"
+
+static const char *POWERSAVE_TAG = "trackle-utils-powersave";
+
+static TracklePowersave_Config psConfig = {
+    .enabled = true,
+    .allowMaxModem = true,
+    .activeHoldMs = 2000,
+    .maxModemAfterMs = 60000,
+    .replyTimeoutMs = 5000,
+};
+
+// mode changes come from the application loop, psMux protects what GetStats reads from other tasks
+static TracklePowersave_Stats psStats;
+static wifi_ps_type_t psMode = WIFI_PS_NONE;
+static bool psStarted = false;
+static uint32_t psModeSince = 0;
+static portMUX_TYPE psMux = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile uint32_t lastTrafficMillis = 0;
+static volatile uint32_t lastSentMillis = 0;
+static volatile bool awaitingReply = false;
+
+static void accountTime(uint32_t now)
+{
+    const uint32_t elapsed = now - psModeSince;
+    psModeSince = now;
+    switch (psMode)
+    {
+    case WIFI_PS_NONE:
+        psStats.noneMs += elapsed;
+        break;
+    case WIFI_PS_MIN_MODEM:
+        psStats.minModemMs += elapsed;
+        break;
+    default:
+        psStats.maxModemMs += elapsed;
+        break;
+    }
+}
+
+static void setMode(wifi_ps_type_t mode, uint32_t now)
+{
+    portENTER_CRITICAL(&psMux);
+    accountTime(now);
+    const wifi_ps_type_t current = psMode;
+    portEXIT_CRITICAL(&psMux);
+    if (mode == current)
+        return;
+
+    if (esp_wifi_set_ps(mode) != ESP_OK)
+    {
+        ESP_LOGW(POWERSAVE_TAG, "cannot set power save mode %d", mode);
+        return;
+    }
+    ESP_LOGD(POWERSAVE_TAG, "power save mode %d -> %d", current, mode);
+    portENTER_CRITICAL(&psMux);
+    psMode = mode;
+    psStats.switches++;
+    portEXIT_CRITICAL(&psMux);
+}
+
+void tracklePowersaveInit()
+{
+    const uint32_t now = getMillis();
+    lastTrafficMillis = now;
+    portENTER_CRITICAL(&psMux);
+    psModeSince = now;
+    psMode = WIFI_PS_NONE;
+    psStarted = true;
+    portEXIT_CRITICAL(&psMux);
+    esp_wifi_set_ps(WIFI_PS_NONE);
+    tracklePowersaveLoop(); // modem sleep at once if provisioning is running
+}
+
+void tracklePowersaveSetConfig(const TracklePowersave_Config *config)
+{
+    psConfig = *config;
+}
+
+void tracklePowersaveGetConfig(TracklePowersave_Config *config)
+{
+    *config = psConfig;
+}
+
+void tracklePowersaveNotifyTraffic(bool inbound)
+{
+    const uint32_t now = getMillis();
+    lastTrafficMillis = now;
+    if (inbound)
+    {
+        awaitingReply = false;
+    }
+    else
+    {
+        lastSentMillis = now;
+        awaitingReply = true;
+    }
+}
+
+void tracklePowersaveNotifyActivity()
+{
+    lastTrafficMillis = getMillis();
+}
+
+void tracklePowersaveLoop()
+{
+    if (!psStarted)
+        return;
+
+    const uint32_t now = getMillis();
+    const EventBits_t bits = xEventGroupGetBits(s_wifi_event_group);
+
+    if (awaitingReply && now - lastSentMillis >= psConfig.replyTimeoutMs)
+        awaitingReply = false;
+
+    const uint32_t idle = now - lastTrafficMillis;
+    wifi_ps_type_t target;
+    if (!psConfig.enabled || (bits & OTA_UPDATING) || awaitingReply || idle < psConfig.activeHoldMs)
+        target = WIFI_PS_NONE;
+    else if (!psConfig.allowMaxModem || idle < psConfig.maxModemAfterMs)
+        target = WIFI_PS_MIN_MODEM;
+    else
+        target = WIFI_PS_MAX_MODEM;
+
+    // Wi-Fi/BT coexistence needs modem sleep
+    if ((bits & IS_PROVISIONING) && target == WIFI_PS_NONE)
+        target = WIFI_PS_MIN_MODEM;
+
+    setMode(target, now);
+}
+
+wifi_ps_type_t tracklePowersaveGetMode()
+{
+    return psMode;
+}
+
+void tracklePowersaveGetStats(TracklePowersave_Stats *stats)
+{
+    const uint32_t now = getMillis();
+    portENTER_CRITICAL(&psMux);
+    if (psStarted)
+        accountTime(now);
+    *stats = psStats;
+    portEXIT_CRITICAL(&psMux);
+}
@@ -0,0 +1,359 @@
+#include "trackle_utils_ratelimit.h"
+
+#include <string.h>
+
+#include <esp_log.h>
+
+#include "trackle_esp32.h"
+#include "trackle_utils_txqueue.h"
+
+#if (TRACKLE_RATELIMIT_SLOTS & (TRACKLE_RATELIMIT_SLOTS - 1)) != 0
+#error "TRACKLE_RATELIMIT_SLOTS must be a power of 2"
+#endif
+
+static const char *RATELIMIT_TAG = "trackle-utils-ratelimit";
+
+// tokens are counted in thousandths, so that slow rates refill smoothly
+#define TOKEN 1000
+
+typedef struct
+{
+    uint32_t ratePerMinute;
+    uint32_t burst;
+    TrackleRateLimit_Policy policy;
+    uint32_t tokens;
+    uint32_t refillMillis;
+    uint32_t refillRemainder; // elapsed ms * rate * TOKEN not converted to tokens yet, < 60000
+} Bucket_t;
+
+typedef struct
+{
+    bool used;
+    char name[TRACKLE_RATELIMIT_NAME_LEN];
+    Bucket_t bucket;
+    uint16_t queued;
+    uint32_t throttled;
+} EventSlot_t;
+
+typedef struct
+{
+    int16_t next;
+    int16_t slot; // event slot, -1 for events without own bucket
+    Event_Type eventType;
+    Event_Flags eventFlag;
+    uint32_t msgKey;
+    char name[TRACKLE_RATELIMIT_NAME_LEN];
+    char data[TRACKLE_RATELIMIT_DATA_LEN];
+} QueuedEvent_t;
+
+// all the state is protected by xTrackleSemaphore
+static Bucket_t globalBucket;
+static EventSlot_t eventSlots[TRACKLE_RATELIMIT_SLOTS];
+static size_t eventCount = 0;
+
+static QueuedEvent_t queue[TRACKLE_RATELIMIT_QUEUE_LEN];
+static int16_t queueHead = -1;
+static int16_t queueTail = -1;
+static int16_t freeHead = -1;
+static bool queueReady = false;
+static uint16_t queueCount = 0;
+static uint16_t unconfiguredQueued = 0;
+
+static TrackleRateLimit_Stats rlStats;
+
+static uint32_t hashName(const char *name)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*name)
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static EventSlot_t *findEvent(const char *name)
+{
+    uint32_t i = hashName(name) & (TRACKLE_RATELIMIT_SLOTS - 1);
+    for (size_t probes = 0; probes < TRACKLE_RATELIMIT_SLOTS; probes++)
+    {
+        EventSlot_t *slot = &eventSlots[i];
+        if (!slot->used)
+            return NULL;
+        if (strcmp(slot->name, name) == 0)
+            return slot;
+        i = (i + 1) & (TRACKLE_RATELIMIT_SLOTS - 1);
+    }
+    return NULL;
+}
+
+static EventSlot_t *addEvent(const char *name)
+{
+    if (eventCount >= TRACKLE_RATELIMIT_MAX_EVENTS)
+        return NULL;
+    uint32_t i = hashName(name) & (TRACKLE_RATELIMIT_SLOTS - 1);
+    while (eventSlots[i].used)
+        i = (i + 1) & (TRACKLE_RATELIMIT_SLOTS - 1);
+    EventSlot_t *slot = &eventSlots[i];
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    strcpy(slot->name, name);
+    eventCount++;
+    return slot;
+}
+
+static void setBucket(Bucket_t *bucket, uint32_t ratePerMinute, uint32_t burst, TrackleRateLimit_Policy policy)
+{
+    bucket->ratePerMinute = ratePerMinute;
+    bucket->burst = burst > 0 ? burst : 1;
+    bucket->policy = policy;
+    bucket->tokens = bucket->burst * TOKEN;
+    bucket->refillMillis = getMillis();
+    bucket->refillRemainder = 0;
+}
+
+static void refill(Bucket_t *bucket, uint32_t now)
+{
+    if (bucket->ratePerMinute == 0)
+        return;
+    // the fraction not converted is carried, the loop refills every few ms even for slow rates
+    const uint64_t elapsed = (uint64_t)(now - bucket->refillMillis) * bucket->ratePerMinute * TOKEN + bucket->refillRemainder;
+    const uint64_t tokens = bucket->tokens + elapsed / 60000;
+    const uint32_t max = bucket->burst * TOKEN;
+    bucket->refillMillis = now;
+    if (tokens >= max)
+    {
+        bucket->tokens = max;
+        bucket->refillRemainder = 0;
+    }
+    else
+    {
+        bucket->tokens = tokens;
+        bucket->refillRemainder = elapsed % 60000;
+    }
+}
+
+static bool hasToken(const Bucket_t *bucket)
+{
+    return bucket->ratePerMinute == 0 || bucket->tokens >= TOKEN;
+}
+
+static void takeToken(Bucket_t *bucket)
+{
+    if (bucket->ratePerMinute != 0)
+        bucket->tokens -= TOKEN;
+}
+
+static void initQueue()
+{
+    for (int i = 0; i < TRACKLE_RATELIMIT_QUEUE_LEN; i++)
+        queue[i].next = (i + 1 < TRACKLE_RATELIMIT_QUEUE_LEN) ? i + 1 : -1;
+    freeHead = 0;
+    queueReady = true;
+}
+
+// replace the last queued event with the same name, the queue is short
+static bool mergeQueued(const char *eventName, const char *data, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key)
+{
+    QueuedEvent_t *last = NULL;
+    for (int16_t i = queueHead; i >= 0; i = queue[i].next)
+    {
+        if (strcmp(queue[i].name, eventName) == 0)
+            last = &queue[i];
+    }
+    if (last == NULL)
+        return false;
+    strcpy(last->data, data);
+    last->eventType = eventType;
+    last->eventFlag = eventFlag;
+    last->msgKey = msg_key;
+    return true;
+}
+
+static bool enqueue(EventSlot_t *ev, const char *eventName, const char *data, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key)
+{
+    if (!queueReady)
+        initQueue();
+    if (freeHead < 0)
+        return false;
+
+    const int16_t i = freeHead;
+    QueuedEvent_t *entry = &queue[i];
+    freeHead = entry->next;
+    entry->next = -1;
+    entry->slot = ev ? ev - eventSlots : -1;
+    entry->eventType = eventType;
+    entry->eventFlag = eventFlag;
+    entry->msgKey = msg_key;
+    strcpy(entry->name, eventName);
+    strcpy(entry->data, data);
+
+    if (queueTail >= 0)
+        queue[queueTail].next = i;
+    else
+        queueHead = i;
+    queueTail = i;
+
+    if (ev)
+        ev->queued++;
+    else
+        unconfiguredQueued++;
+    queueCount++;
+    if (queueCount > rlStats.maxQueued)
+        rlStats.maxQueued = queueCount;
+    return true;
+}
+
+static void dequeue(int16_t prev, int16_t i)
+{
+    QueuedEvent_t *entry = &queue[i];
+    if (prev >= 0)
+        queue[prev].next = entry->next;
+    else
+        queueHead = entry->next;
+    if (queueTail == i)
+        queueTail = prev;
+
+    if (entry->slot >= 0)
+        eventSlots[entry->slot].queued--;
+    else
+        unconfiguredQueued--;
+    queueCount--;
+
+    entry->next = freeHead;
+    freeHead = i;
+}
+
+bool trackleRateLimitSetGlobal(uint32_t ratePerMinute, uint32_t burst, TrackleRateLimit_Policy policy)
+{
+    if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) != pdTRUE)
+        return false;
+    setBucket(&globalBucket, ratePerMinute, burst, policy);
+    xSemaphoreGive(xTrackleSemaphore);
+    return true;
+}
+
+bool trackleRateLimitSetEvent(const char *eventName, uint32_t ratePerMinute, uint32_t burst, TrackleRateLimit_Policy policy)
+{
+    if (strlen(eventName) >= TRACKLE_RATELIMIT_NAME_LEN)
+        return false;
+    if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) != pdTRUE)
+        return false;
+
+    EventSlot_t *ev = findEvent(eventName);
+    if (ev == NULL)
+        ev = addEvent(eventName);
+    if (ev != NULL)
+        setBucket(&ev->bucket, ratePerMinute, burst, policy);
+    xSemaphoreGive(xTrackleSemaphore);
+
+    if (ev == NULL)
+        ESP_LOGE(RATELIMIT_TAG, "too many events, max %d", TRACKLE_RATELIMIT_MAX_EVENTS);
+    return ev != NULL;
+}
+
+uint32_t trackleRateLimitGetThrottled(const char *eventName)
+{
+    uint32_t throttled = 0;
+    if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
+    {
+        const EventSlot_t *ev = findEvent(eventName);
+        if (ev != NULL)
+            throttled = ev->throttled;
+        xSemaphoreGive(xTrackleSemaphore);
+    }
+    return throttled;
+}
+
+void trackleRateLimitGetStats(TrackleRateLimit_Stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
+    {
+        *stats = rlStats;
+        xSemaphoreGive(xTrackleSemaphore);
+    }
+}
+
+TrackleRateLimit_Result trackleRateLimitAdmit(const char *eventName, const char *data, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key)
+{
+    const uint32_t now = getMillis();
+    EventSlot_t *ev = eventCount > 0 ? findEvent(eventName) : NULL;
+    refill(&globalBucket, now);
+    if (ev)
+        refill(&ev->bucket, now);
+
+    // events already waiting keep their order
+    const bool behind = ev ? ev->queued > 0 : unconfiguredQueued > 0;
+    if (!behind && hasToken(&globalBucket) && (ev == NULL || hasToken(&ev->bucket)))
+    {
+        takeToken(&globalBucket);
+        if (ev)
+            takeToken(&ev->bucket);
+        rlStats.admitted++;
+        return TRACKLE_RATELIMIT_ADMITTED;
+    }
+
+    if (ev)
+        ev->throttled++;
+    const TrackleRateLimit_Policy policy = ev ? ev->bucket.policy : globalBucket.policy;
+    if (data == NULL)
+        data = "";
+
+    if (policy == TRACKLE_RATELIMIT_DROP || strlen(eventName) >= TRACKLE_RATELIMIT_NAME_LEN || strlen(data) >= TRACKLE_RATELIMIT_DATA_LEN)
+    {
+        rlStats.dropped++;
+        return TRACKLE_RATELIMIT_DROPPED;
+    }
+    if (policy == TRACKLE_RATELIMIT_MERGE && mergeQueued(eventName, data, eventType, eventFlag, msg_key))
+    {
+        rlStats.merged++;
+        return TRACKLE_RATELIMIT_QUEUED;
+    }
+    if (!enqueue(ev, eventName, data, eventType, eventFlag, msg_key))
+    {
+        rlStats.dropped++;
+        return TRACKLE_RATELIMIT_DROPPED;
+    }
+    rlStats.queued++;
+    return TRACKLE_RATELIMIT_QUEUED;
+}
+
+void trackleRateLimitLoop()
+{
+    if (queueHead < 0 || !trackleConnected(trackle_s) || trackleTxQueueCongested())
+        return;
+
+    const uint32_t now = getMillis();
+    refill(&globalBucket, now);
+    for (size_t i = 0; i < TRACKLE_RATELIMIT_SLOTS; i++)
+    {
+        if (eventSlots[i].used && eventSlots[i].queued > 0)
+            refill(&eventSlots[i].bucket, now);
+    }
+
+    int16_t prev = -1;
+    int16_t i = queueHead;
+    while (i >= 0 && hasToken(&globalBucket))
+    {
+        QueuedEvent_t *entry = &queue[i];
+        const int16_t next = entry->next;
+        Bucket_t *bucket = entry->slot >= 0 ? &eventSlots[entry->slot].bucket : NULL;
+        if (bucket != NULL && !hasToken(bucket))
+        {
+            // later events with the same name wait too, so the order is kept
+            prev = i;
+            i = next;
+            continue;
+        }
+
+        if (!tracklePublish(trackle_s, entry->name, entry->data, 30, entry->eventType, entry->eventFlag, entry->msgKey))
+            break; // retry at the next loop
+        takeToken(&globalBucket);
+        if (bucket != NULL)
+            takeToken(bucket);
+        rlStats.drained++;
+        dequeue(prev, i);
+        i = next;
+    }
+}
@@ -0,0 +1,384 @@
+#include "trackle_utils_registry.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "trackle_utils_args.h"
+#include "trackle_utils_codec.h"
+
+#define SLOT_EMPTY 0
+#define SLOT_USED 1
+#define SLOT_REMOVED 2
+
+#define SLOT_MASK (TRACKLE_REGISTRY_SLOTS - 1)
+
+#if (TRACKLE_REGISTRY_SLOTS & SLOT_MASK) != 0
+#error "TRACKLE_REGISTRY_SLOTS must be a power of two"
+#endif
+
+#if TRACKLE_REGISTRY_SLOTS > 256
+#error "TRACKLE_REGISTRY_SLOTS must be at most 256"
+#endif
+
+// handle: generation << 8 | slot index, generations start from 1 so no handle is 0
+#define HANDLE(index, generation) ((generation) << 8 | (index))
+#define GENERATION_MASK 0xFFFFFF
+
+// FNV-1a
+static uint32_t nameHash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Returns the slot holding name, or NULL. If insertAt is given, it receives the first reusable slot of the probe sequence.
+static TrackleEndpoint_t *lookup(TrackleRegistry_t *reg, const char *name, uint32_t hash, TrackleEndpoint_t **insertAt)
+{
+    if (insertAt != NULL)
+        *insertAt = NULL;
+
+    for (uint32_t i = 0; i < TRACKLE_REGISTRY_SLOTS; i++)
+    {
+        TrackleEndpoint_t *slot = &reg->slots[(hash + i) & SLOT_MASK];
+        if (slot->state == SLOT_EMPTY)
+        {
+            if (insertAt != NULL && *insertAt == NULL)
+                *insertAt = slot;
+            return NULL;
+        }
+        if (slot->state == SLOT_REMOVED)
+        {
+            if (insertAt != NULL && *insertAt == NULL)
+                *insertAt = slot;
+            continue;
+        }
+        if (slot->hash == hash && strcmp(slot->name, name) == 0)
+            return slot;
+    }
+    return NULL;
+}
+
+static TrackleEndpoint_t *addEndpoint(TrackleRegistry_t *reg, const char *name, TrackleEndpoint_Kind kind, Data_TypeDef dataType)
+{
+    if (name == NULL || strlen(name) + 1 > TRACKLE_REGISTRY_NAME_LEN) // +1 because there must be space for null character
+        return NULL;
+    if (reg->count >= TRACKLE_REGISTRY_MAX_ENDPOINTS)
+        return NULL;
+
+    const uint32_t hash = nameHash(name);
+    TrackleEndpoint_t *slot;
+    if (lookup(reg, name, hash, &slot) != NULL || slot == NULL)
+        return NULL;
+
+    memset(slot, 0, sizeof(*slot));
+    strcpy(slot->name, name);
+    slot->hash = hash;
+    slot->kind = kind;
+    slot->dataType = dataType;
+    slot->state = SLOT_USED;
+    reg->lastGeneration = (reg->lastGeneration + 1) & GENERATION_MASK;
+    if (reg->lastGeneration == 0)
+        reg->lastGeneration = 1;
+    slot->generation = reg->lastGeneration;
+    reg->count++;
+    return slot;
+}
+
+static TrackleEndpoint_Handle handleOf(const TrackleRegistry_t *reg, const TrackleEndpoint_t *ep)
+{
+    return ep == NULL ? TRACKLE_ENDPOINT_INVALID : HANDLE((uint32_t)(ep - reg->slots), ep->generation);
+}
+
+// the slot of a handle, NULL if the function has been removed
+static TrackleEndpoint_t *resolve(TrackleRegistry_t *reg, TrackleEndpoint_Handle handle)
+{
+    TrackleEndpoint_t *ep = &reg->slots[handle & 0xFF & SLOT_MASK];
+    return (handle != TRACKLE_ENDPOINT_INVALID && ep->state == SLOT_USED && ep->generation == handle >> 8) ? ep : NULL;
+}
+
+void trackleRegistryInit(TrackleRegistry_t *reg)
+{
+    memset(reg, 0, sizeof(*reg));
+    reg->mutex = xSemaphoreCreateRecursiveMutexStatic(&reg->mutexBuffer);
+}
+
+void trackleRegistryLock(TrackleRegistry_t *reg)
+{
+    xSemaphoreTakeRecursive(reg->mutex, portMAX_DELAY);
+}
+
+void trackleRegistryUnlock(TrackleRegistry_t *reg)
+{
+    xSemaphoreGiveRecursive(reg->mutex);
+}
+
+TrackleEndpoint_Handle trackleRegistryAddPost(TrackleRegistry_t *reg, const char *name, int (*function)(const char *))
+{
+    trackleRegistryLock(reg);
+    TrackleEndpoint_t *ep = addEndpoint(reg, name, TRACKLE_ENDPOINT_POST, VAR_INT);
+    if (ep != NULL)
+        ep->fn.post = function;
+    const TrackleEndpoint_Handle handle = handleOf(reg, ep);
+    trackleRegistryUnlock(reg);
+    return handle;
+}
+
+TrackleEndpoint_Handle trackleRegistryAddGet(TrackleRegistry_t *reg, const char *name, void *(*function)(const char *), Data_TypeDef dataType)
+{
+    trackleRegistryLock(reg);
+    TrackleEndpoint_t *ep = addEndpoint(reg, name, TRACKLE_ENDPOINT_GET, dataType);
+    if (ep != NULL)
+        ep->fn.get = function;
+    const TrackleEndpoint_Handle handle = handleOf(reg, ep);
+    trackleRegistryUnlock(reg);
+    return handle;
+}
+
+TrackleEndpoint_Handle trackleRegistryAddStream(TrackleRegistry_t *reg, const char *name, TrackleRegistry_BlockCb function)
+{
+    trackleRegistryLock(reg);
+    TrackleEndpoint_t *ep = addEndpoint(reg, name, TRACKLE_ENDPOINT_STREAM, VAR_INT);
+    if (ep != NULL)
+        ep->fn.block = function;
+    const TrackleEndpoint_Handle handle = handleOf(reg, ep);
+    trackleRegistryUnlock(reg);
+    return handle;
+}
+
+#define TRACKLE_REGISTRY_ADD_GET_DEF(type, ctype, suffix, serializer)                                                                 \
+    TrackleEndpoint_Handle trackleRegistryAddGet##suffix(TrackleRegistry_t *reg, const char *name, ctype (*function)(const char *)) \
+    {                                                                                                                               \
+        trackleRegistryLock(reg);                                                                                                   \
+        TrackleEndpoint_t *ep = addEndpoint(reg, name, TRACKLE_ENDPOINT_GET_TYPED, type);                                           \
+        if (ep != NULL)                                                                                                             \
+            ep->fn.get##suffix = function;                                                                                          \
+        const TrackleEndpoint_Handle handle = handleOf(reg, ep);                                                                    \
+        trackleRegistryUnlock(reg);                                                                                                 \
+        return handle;                                                                                                              \
+    }
+
+TRACKLE_REGISTRY_TYPES(TRACKLE_REGISTRY_ADD_GET_DEF)
+
+TrackleEndpoint_Handle trackleRegistryFind(TrackleRegistry_t *reg, const char *name)
+{
+    trackleRegistryLock(reg);
+    const TrackleEndpoint_Handle handle = handleOf(reg, lookup(reg, name, nameHash(name), NULL));
+    trackleRegistryUnlock(reg);
+    return handle;
+}
+
+bool trackleRegistryRemove(TrackleRegistry_t *reg, const char *name)
+{
+    trackleRegistryLock(reg);
+    TrackleEndpoint_t *ep = lookup(reg, name, nameHash(name), NULL);
+    if (ep != NULL)
+    {
+        ep->state = SLOT_REMOVED; // keeps probe sequences of other names intact
+        reg->count--;
+    }
+    trackleRegistryUnlock(reg);
+    return ep != NULL;
+}
+
+bool trackleRegistryIsValid(TrackleRegistry_t *reg, TrackleEndpoint_Handle handle)
+{
+    trackleRegistryLock(reg);
+    const bool valid = resolve(reg, handle) != NULL;
+    trackleRegistryUnlock(reg);
+    return valid;
+}
+
+TrackleEndpoint_Handle trackleRegistryGetHandle(TrackleRegistry_t *reg, const TrackleEndpoint_t *ep)
+{
+    return handleOf(reg, ep);
+}
+
+TrackleEndpoint_t *trackleRegistryNext(TrackleRegistry_t *reg, TrackleEndpoint_t *prev)
+{
+    int i = prev == NULL ? 0 : (int)(prev - reg->slots) + 1;
+    for (; i < TRACKLE_REGISTRY_SLOTS; i++)
+    {
+        if (reg->slots[i].state == SLOT_USED)
+            return &reg->slots[i];
+    }
+    return NULL;
+}
+
+static int checkedLength(int convBytes, size_t outSize)
+{
+    return (convBytes < 0 || (size_t)convBytes >= outSize) ? -1 : convBytes;
+}
+
+int trackleRegistrySerializeBool(bool value, char *out, size_t outSize)
+{
+    return checkedLength(snprintf(out, outSize, "%s", value ? "TRUE" : "FALSE"), outSize);
+}
+
+int trackleRegistrySerializeInt(int32_t value, char *out, size_t outSize)
+{
+    return checkedLength(snprintf(out, outSize, "%" PRIi32, value), outSize);
+}
+
+int trackleRegistrySerializeLong(int64_t value, char *out, size_t outSize)
+{
+    return checkedLength(snprintf(out, outSize, "%" PRIi64, value), outSize);
+}
+
+int trackleRegistrySerializeDouble(double value, char *out, size_t outSize)
+{
+    return checkedLength(snprintf(out, outSize, "%f", value), outSize);
+}
+
+int trackleRegistrySerializeChar(char value, char *out, size_t outSize)
+{
+    if (outSize < 2)
+        return -1;
+    out[0] = value;
+    out[1] = '\0';
+    return 1;
+}
+
+#define TRACKLE_REGISTRY_SERIALIZE_TYPED(type, ctype, suffix, serializer) \
+    case type:                                                            \
+        return serializer(ep->fn.get##suffix(args), scratch, scratchSize);
+
+#define TRACKLE_REGISTRY_SERIALIZE_POINTER(type, ctype, suffix, serializer) \
+    case type:                                                              \
+        return serializer(*((const ctype *)value), scratch, scratchSize);
+
+// Serializer dispatch, generated from TRACKLE_REGISTRY_TYPES. Returns the text length, -1 if too long, -2 on NULL value, -3 on bad type.
+static int serializeGet(const TrackleEndpoint_t *ep, const char *args, char *scratch, size_t scratchSize)
+{
+    if (ep->kind == TRACKLE_ENDPOINT_GET_TYPED)
+    {
+        switch (ep->dataType)
+        {
+            TRACKLE_REGISTRY_TYPES(TRACKLE_REGISTRY_SERIALIZE_TYPED)
+        default:
+            return -3;
+        }
+    }
+
+    const void *value = ep->fn.get(args);
+    if (value == NULL)
+        return -2;
+    switch (ep->dataType)
+    {
+        TRACKLE_REGISTRY_TYPES(TRACKLE_REGISTRY_SERIALIZE_POINTER)
+    default:
+        return -3;
+    }
+}
+
+int trackleRegistryWriteBlock(TrackleRegistry_t *reg, TrackleEndpoint_Handle handle, char *args)
+{
+    TrackleArgs_t parser;
+    TrackleStr_t data;
+    uint32_t offset, more;
+    trackleArgsInit(&parser, args, ',');
+    TrackleStr_t token;
+    if (!trackleArgsNext(&parser, &token) || !trackleStrToUint32(token, &offset) || offset > INT32_MAX ||
+        !trackleArgsNext(&parser, &token) || !trackleStrToUint32(token, &more) || more > 1 ||
+        !trackleArgsRest(&parser, &data))
+        return TRACKLE_REGISTRY_ERR_BLOCK;
+
+    // only the block state is handled under the lock: the function (e.g. a flash write) runs without it
+    trackleRegistryLock(reg);
+    TrackleEndpoint_t *ep = resolve(reg, handle);
+    TrackleRegistry_BlockCb block = NULL;
+    int res = 0;
+    if (ep == NULL || ep->kind != TRACKLE_ENDPOINT_STREAM)
+        res = TRACKLE_REGISTRY_ERR_BLOCK;
+    else if (ep->busy)
+        res = TRACKLE_REGISTRY_ERR_BUSY;
+    else if (offset != 0 && offset != ep->nextOffset)
+        res = ep->nextOffset; // resend from here
+    else
+    {
+        ep->busy = true;
+        block = ep->fn.block;
+    }
+    trackleRegistryUnlock(reg);
+    if (block == NULL)
+        return res;
+
+    // the decoded block is shorter than its text: decode over it
+    uint8_t *decoded = (uint8_t *)args;
+    const int len = trackleBase64Decode(data.ptr, data.len, decoded, data.len);
+    const bool malformed = len < 0 || offset + (uint32_t)len > INT32_MAX;
+    res = malformed ? TRACKLE_REGISTRY_ERR_BLOCK : block(offset, decoded, len, more == 0);
+
+    trackleRegistryLock(reg);
+    // the endpoint may have been removed meanwhile, and its slot reused
+    ep = resolve(reg, handle);
+    if (ep != NULL)
+    {
+        // a malformed block leaves the transfer where it was, an error from the function aborts it
+        if (!malformed)
+            ep->nextOffset = res >= 0 && more ? offset + len : 0;
+        ep->busy = false;
+    }
+    trackleRegistryUnlock(reg);
+    return res < 0 ? res : (int)(offset + len);
+}
+
+esp_err_t trackleRegistryCall(TrackleRegistry_t *reg, TrackleEndpoint_Handle handle, char *args, char *scratch, size_t scratchSize, const char **result, size_t *resultLen)
+{
+    trackleRegistryLock(reg);
+    TrackleEndpoint_t *slot = resolve(reg, handle);
+    if (slot == NULL)
+    {
+        trackleRegistryUnlock(reg);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (slot->kind == TRACKLE_ENDPOINT_STREAM)
+    {
+        trackleRegistryUnlock(reg);
+        const int convBytes = checkedLength(snprintf(scratch, scratchSize, "%d", trackleRegistryWriteBlock(reg, handle, args)), scratchSize);
+        if (convBytes < 0)
+            return ESP_ERR_INVALID_SIZE;
+        *result = scratch;
+        *resultLen = convBytes;
+        return ESP_OK;
+    }
+    // other functions run without the lock, on a copy of the endpoint
+    const TrackleEndpoint_t copy = *slot;
+    const TrackleEndpoint_t *ep = &copy;
+    trackleRegistryUnlock(reg);
+
+    int convBytes;
+    if (ep->kind == TRACKLE_ENDPOINT_POST)
+    {
+        convBytes = checkedLength(snprintf(scratch, scratchSize, "%d", ep->fn.post(args)), scratchSize);
+    }
+    else if (ep->kind == TRACKLE_ENDPOINT_GET && (ep->dataType == VAR_STRING || ep->dataType == VAR_JSON))
+    {
+        // strings are returned as they are, without copies
+        const char *str = (const char *)ep->fn.get(args);
+        if (str == NULL)
+            return ESP_FAIL;
+        *result = str;
+        *resultLen = strlen(str);
+        return ESP_OK;
+    }
+    else
+    {
+        convBytes = serializeGet(ep, args, scratch, scratchSize);
+    }
+
+    if (convBytes == -2)
+        return ESP_FAIL;
+    if (convBytes == -3)
+        return ESP_ERR_INVALID_ARG;
+    if (convBytes < 0)
+        return ESP_ERR_INVALID_SIZE;
+    *result = scratch;
+    *resultLen = convBytes;
+    return ESP_OK;
+}
@@ -0,0 +1,207 @@
+#include "trackle_utils_rtt.h"
+
+#include <stdbool.h>
+
+#include "trackle_esp32.h"
+#include "trackle_utils_writer.h"
+
+// estimator state, in milliseconds scaled by 8 to keep precision with integer math
+#define RTT_SCALE 8
+
+typedef struct
+{
+    bool valid;
+    uint32_t srtt;   // scaled
+    uint32_t rttvar; // scaled
+} RttEstimator_t;
+
+static RttEstimator_t strongEstimator;
+static RttEstimator_t weakEstimator;
+static uint32_t rto = TRACKLE_RTT_INITIAL_RTO_MS;
+static uint32_t rtoUpdatedMillis = 0;
+static uint32_t lossPermille = 0;
+static uint32_t strongSamples = 0;
+static uint32_t weakSamples = 0;
+static uint32_t dropped = 0;
+
+static bool exchangeOpen = false;
+static uint32_t exchangeStart = 0;
+static uint32_t exchangeSends = 0;
+
+static portMUX_TYPE rttMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t clampRto(uint32_t value)
+{
+    if (value < TRACKLE_RTT_MIN_RTO_MS)
+        return TRACKLE_RTT_MIN_RTO_MS;
+    if (value > TRACKLE_RTT_MAX_RTO_MS)
+        return TRACKLE_RTT_MAX_RTO_MS;
+    return value;
+}
+
+/**
+ * RFC 6298 update (alpha = 1/8, beta = 1/4), returns SRTT + k * RTTVAR.
+ */
+static uint32_t updateEstimator(RttEstimator_t *est, uint32_t sample, uint32_t k)
+{
+    const uint32_t scaled = sample * RTT_SCALE;
+    if (!est->valid)
+    {
+        est->srtt = scaled;
+        est->rttvar = scaled / 2;
+        est->valid = true;
+    }
+    else
+    {
+        const uint32_t diff = est->srtt > scaled ? est->srtt - scaled : scaled - est->srtt;
+        est->rttvar = est->rttvar - est->rttvar / 4 + diff / 4;
+        est->srtt = est->srtt - est->srtt / 8 + scaled / 8;
+    }
+    return (est->srtt + k * est->rttvar) / RTT_SCALE;
+}
+
+// without fresh samples a small RTO grows and a large one shrinks back towards the default
+static void ageRto(uint32_t now)
+{
+    const uint32_t idle = now - rtoUpdatedMillis;
+    if (rto < 1000 && idle > 16 * rto)
+    {
+        rto = clampRto(2 * rto);
+        rtoUpdatedMillis = now;
+    }
+    else if (rto > 3000 && idle > 4 * rto)
+    {
+        rto = (TRACKLE_RTT_INITIAL_RTO_MS + rto) / 2;
+        rtoUpdatedMillis = now;
+    }
+}
+
+static void closeExchange(uint32_t now)
+{
+    const uint32_t sample = now - exchangeStart;
+    exchangeOpen = false;
+    if (sample > TRACKLE_RTT_MAX_SAMPLE_MS)
+    {
+        dropped++;
+        return;
+    }
+
+    if (exchangeSends <= 1)
+    {
+        const uint32_t rtoStrong = updateEstimator(&strongEstimator, sample, 4);
+        rto = clampRto((rto + rtoStrong) / 2);
+        lossPermille -= lossPermille / 8;
+        strongSamples++;
+    }
+    else
+    {
+        const uint32_t rtoWeak = updateEstimator(&weakEstimator, sample, 1);
+        rto = clampRto((3 * rto + rtoWeak) / 4);
+        lossPermille = lossPermille - lossPermille / 8 + 1000 * (exchangeSends - 1) / exchangeSends / 8;
+        weakSamples++;
+    }
+    rtoUpdatedMillis = now;
+}
+
+void trackleRttNotifySend()
+{
+    const uint32_t now = getMillis();
+    portENTER_CRITICAL(&rttMux);
+    if (exchangeOpen && now - exchangeStart > TRACKLE_RTT_MAX_SAMPLE_MS)
+    {
+        dropped++;
+        exchangeOpen = false;
+    }
+    if (!exchangeOpen)
+    {
+        exchangeOpen = true;
+        exchangeStart = now;
+        exchangeSends = 0;
+    }
+    exchangeSends++;
+    portEXIT_CRITICAL(&rttMux);
+}
+
+void trackleRttNotifyReceive()
+{
+    const uint32_t now = getMillis();
+    portENTER_CRITICAL(&rttMux);
+    if (exchangeOpen)
+        closeExchange(now);
+    portEXIT_CRITICAL(&rttMux);
+}
+
+void trackleRttReset()
+{
+    portENTER_CRITICAL(&rttMux);
+    exchangeOpen = false;
+    portEXIT_CRITICAL(&rttMux);
+}
+
+uint32_t trackleRttGetRto()
+{
+    portENTER_CRITICAL(&rttMux);
+    ageRto(getMillis());
+    const uint32_t value = rto;
+    portEXIT_CRITICAL(&rttMux);
+    return value;
+}
+
+uint32_t trackleRttGetBackoff()
+{
+    const uint32_t value = trackleRttGetRto();
+    if (value < 1000)
+        return 30;
+    if (value > 3000)
+        return 15;
+    return 20;
+}
+
+void trackleRttGetStats(TrackleRtt_Stats *stats)
+{
+    portENTER_CRITICAL(&rttMux);
+    ageRto(getMillis());
+    stats->srttMs = strongEstimator.srtt / RTT_SCALE;
+    stats->rttvarMs = strongEstimator.rttvar / RTT_SCALE;
+    stats->rtoMs = rto;
+    stats->lossPermille = lossPermille;
+    stats->strongSamples = strongSamples;
+    stats->weakSamples = weakSamples;
+    stats->dropped = dropped;
+    portEXIT_CRITICAL(&rttMux);
+}
+
+static void *rttDiagnosticsGet(const char *args)
+{
+    // cloud GETs are served one at a time by trackle_task
+    static char json[160];
+    TrackleRtt_Stats stats;
+    trackleRttGetStats(&stats);
+
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+    trackleWriterBeginObject(&w);
+    trackleWriterKey(&w, "srtt");
+    trackleWriterInt(&w, stats.srttMs);
+    trackleWriterKey(&w, "rttvar");
+    trackleWriterInt(&w, stats.rttvarMs);
+    trackleWriterKey(&w, "rto");
+    trackleWriterInt(&w, stats.rtoMs);
+    trackleWriterKey(&w, "loss");
+    trackleWriterInt(&w, stats.lossPermille);
+    trackleWriterKey(&w, "strong");
+    trackleWriterInt(&w, stats.strongSamples);
+    trackleWriterKey(&w, "weak");
+    trackleWriterInt(&w, stats.weakSamples);
+    trackleWriterKey(&w, "dropped");
+    trackleWriterInt(&w, stats.dropped);
+    trackleWriterEndObject(&w);
+    // 7 numbers of at most 10 digits always fit
+    trackleWriterFinish(&w);
+    return json;
+}
+
+bool trackleRttAddDiagnostics(const char *name)
+{
+    return trackleGet(trackle_s, name, rttDiagnosticsGet, VAR_JSON);
+}
@@ -0,0 +1,374 @@
+#include "trackle_utils_rules.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <nvs_flash.h>
+#include "freertos/FreeRTOS.h"
+
+#include "trackle_esp32.h"
+#include "trackle_utils_args.h"
+
+#define NVS_NAMESPACE "trackle_rules"
+#define NVS_KEYNAME "rules"
+
+// one instruction per condition: operand, comparison and end of term packed in op
+#define OPERAND_SHIFT 4
+#define END_OF_TERM 0x80
+#define CMP_MASK 0x0F
+
+static const char *RULES_TAG = "trackle-utils-rules";
+
+typedef enum
+{
+    OPERAND_VALUE = 0,
+    OPERAND_DELTA,
+    OPERAND_AGE,
+} Operand_t;
+
+typedef struct
+{
+    uint8_t op;
+    float constant;
+} Instruction_t;
+
+typedef struct
+{
+    bool used;
+    char name[TRACKLE_RULES_NAME_LEN];
+    char src[TRACKLE_RULES_SRC_LEN];
+    Instruction_t code[TRACKLE_RULES_MAX_CONDITIONS];
+    uint8_t codeLen;
+    bool published;
+    float lastValue;
+    uint32_t lastMillis;
+} Rule_t;
+
+static Rule_t rules[TRACKLE_RULES_MAX];
+static TrackleRules_Stats rulesStats;
+
+static portMUX_TYPE rulesMux = portMUX_INITIALIZER_UNLOCKED;
+
+static Rule_t *findRule(const char *eventName)
+{
+    for (size_t i = 0; i < TRACKLE_RULES_MAX; i++)
+    {
+        if (rules[i].used && strcmp(rules[i].name, eventName) == 0)
+            return &rules[i];
+    }
+    return NULL;
+}
+
+static bool startsWith(TrackleStr_t *str, const char *prefix)
+{
+    const size_t len = strlen(prefix);
+    if (str->len < len || memcmp(str->ptr, prefix, len) != 0)
+        return false;
+    str->ptr += len;
+    str->len -= len;
+    return true;
+}
+
+static bool parseFloat(TrackleStr_t str, float *value)
+{
+    char buf[24];
+    str = trackleStrTrim(str);
+    if (str.len == 0 || !trackleStrCopy(str, buf, sizeof(buf)))
+        return false;
+    char *end;
+    *value = strtof(buf, &end);
+    return *end == '\0' && isfinite(*value);
+}
+
+static bool compileCondition(TrackleStr_t cond, Instruction_t *instr)
+{
+    cond = trackleStrTrim(cond);
+    Operand_t operand = OPERAND_VALUE;
+    if (startsWith(&cond, "delta"))
+        operand = OPERAND_DELTA;
+    else if (startsWith(&cond, "age"))
+        operand = OPERAND_AGE;
+    else
+        startsWith(&cond, "value");
+    cond = trackleStrTrim(cond);
+
+    const size_t opLen = cond.len > 1 && cond.ptr[1] == '=' ? 2 : 1;
+    const TrackleStr_t opStr = {cond.ptr, cond.len > 0 ? opLen : 0};
+    const TrackleCompare_Op cmp = trackleCompareOpParse(opStr);
+    const TrackleStr_t number = {cond.ptr + opStr.len, cond.len - opStr.len};
+    if (cmp == TRACKLE_CMP_INVALID || !parseFloat(number, &instr->constant))
+        return false;
+    instr->op = (operand << OPERAND_SHIFT) | cmp;
+    return true;
+}
+
+/**
+ * Compile a rule into a Rule_t. An empty list of conditions is valid and gives codeLen 0
+ * (used to remove rules).
+ */
+static bool compileRule(const char *src, Rule_t *rule)
+{
+    TrackleArgs_t parser;
+    TrackleStr_t name, expr, term, cond;
+    memset(rule, 0, sizeof(*rule));
+    if (strlen(src) >= TRACKLE_RULES_SRC_LEN)
+        return false;
+    trackleArgsInit(&parser, src, ':');
+    if (!trackleArgsNext(&parser, &name) || !trackleArgsRest(&parser, &expr))
+        return false;
+    name = trackleStrTrim(name);
+    if (name.len == 0 || !trackleStrCopy(name, rule->name, sizeof(rule->name)))
+        return false;
+    strcpy(rule->src, src);
+
+    if (trackleStrTrim(expr).len == 0)
+        return true;
+
+    TrackleArgs_t terms;
+    trackleArgsInitLen(&terms, expr.ptr, expr.len, '|');
+    while (trackleArgsNext(&terms, &term))
+    {
+        TrackleArgs_t conds;
+        trackleArgsInitLen(&conds, term.ptr, term.len, '&');
+        while (trackleArgsNext(&conds, &cond))
+        {
+            if (rule->codeLen >= TRACKLE_RULES_MAX_CONDITIONS || !compileCondition(cond, &rule->code[rule->codeLen]))
+                return false;
+            rule->codeLen++;
+        }
+        rule->code[rule->codeLen - 1].op |= END_OF_TERM;
+    }
+    return true;
+}
+
+static bool compare(float a, TrackleCompare_Op cmp, float b)
+{
+    switch (cmp)
+    {
+    case TRACKLE_CMP_LT:
+        return a < b;
+    case TRACKLE_CMP_LE:
+        return a <= b;
+    case TRACKLE_CMP_GT:
+        return a > b;
+    case TRACKLE_CMP_GE:
+        return a >= b;
+    case TRACKLE_CMP_EQ:
+        return a == b;
+    default:
+        return false;
+    }
+}
+
+// OR of ANDs: a failed condition skips the rest of its term
+static bool evaluate(const Rule_t *rule, float value, uint32_t now)
+{
+    const float delta = rule->published ? fabsf(value - rule->lastValue) : INFINITY;
+    const float age = rule->published ? (now - rule->lastMillis) / 1000.0f : INFINITY;
+
+    bool term = true;
+    for (uint8_t i = 0; i < rule->codeLen; i++)
+    {
+        const Instruction_t *instr = &rule->code[i];
+        if (term)
+        {
+            const Operand_t operand = (instr->op >> OPERAND_SHIFT) & 0x07;
+            const float x = operand == OPERAND_DELTA ? delta : (operand == OPERAND_AGE ? age : value);
+            term = compare(x, instr->op & CMP_MASK, instr->constant);
+        }
+        if (instr->op & END_OF_TERM)
+        {
+            if (term)
+                return true;
+            term = true;
+        }
+    }
+    return false;
+}
+
+esp_err_t trackleRulesSet(const char *rule)
+{
+    Rule_t compiled;
+    if (!compileRule(rule, &compiled) || compiled.codeLen == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&rulesMux);
+    Rule_t *slot = findRule(compiled.name);
+    for (size_t i = 0; slot == NULL && i < TRACKLE_RULES_MAX; i++)
+    {
+        if (!rules[i].used)
+            slot = &rules[i];
+    }
+    if (slot != NULL)
+    {
+        // a replaced rule keeps the last published value
+        if (slot->used)
+        {
+            compiled.published = slot->published;
+            compiled.lastValue = slot->lastValue;
+            compiled.lastMillis = slot->lastMillis;
+        }
+        compiled.used = true;
+        *slot = compiled;
+    }
+    portEXIT_CRITICAL(&rulesMux);
+
+    if (slot == NULL)
+    {
+        ESP_LOGE(RULES_TAG, "too many rules, max %d", TRACKLE_RULES_MAX);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool trackleRulesRemove(const char *eventName)
+{
+    portENTER_CRITICAL(&rulesMux);
+    Rule_t *rule = findRule(eventName);
+    if (rule != NULL)
+        rule->used = false;
+    portEXIT_CRITICAL(&rulesMux);
+    return rule != NULL;
+}
+
+void trackleRulesClear()
+{
+    portENTER_CRITICAL(&rulesMux);
+    for (size_t i = 0; i < TRACKLE_RULES_MAX; i++)
+        rules[i].used = false;
+    portEXIT_CRITICAL(&rulesMux);
+}
+
+esp_err_t trackleRulesSave()
+{
+    // rules separated by ';', which the syntax doesn't use
+    char buf[TRACKLE_RULES_MAX * TRACKLE_RULES_SRC_LEN];
+    size_t len = 0;
+    portENTER_CRITICAL(&rulesMux);
+    for (size_t i = 0; i < TRACKLE_RULES_MAX; i++)
+    {
+        if (!rules[i].used)
+            continue;
+        if (len > 0)
+            buf[len++] = ';';
+        const size_t srcLen = strlen(rules[i].src);
+        memcpy(buf + len, rules[i].src, srcLen);
+        len += srcLen;
+    }
+    buf[len] = '\0';
+    portEXIT_CRITICAL(&rulesMux);
+
+    nvs_handle_t nvsHandle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvsHandle);
+    if (err != ESP_OK)
+        return err;
+    err = nvs_set_str(nvsHandle, NVS_KEYNAME, buf);
+    if (err == ESP_OK)
+        err = nvs_commit(nvsHandle);
+    nvs_close(nvsHandle);
+    return err;
+}
+
+esp_err_t trackleRulesLoad()
+{
+    char buf[TRACKLE_RULES_MAX * TRACKLE_RULES_SRC_LEN];
+    nvs_handle_t nvsHandle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvsHandle);
+    if (err != ESP_OK)
+        return err;
+    size_t len = sizeof(buf);
+    err = nvs_get_str(nvsHandle, NVS_KEYNAME, buf, &len);
+    nvs_close(nvsHandle);
+    if (err != ESP_OK)
+        return err;
+
+    trackleRulesClear();
+    TrackleArgs_t parser;
+    TrackleStr_t token;
+    char src[TRACKLE_RULES_SRC_LEN];
+    trackleArgsInit(&parser, buf, ';');
+    while (trackleArgsNext(&parser, &token))
+    {
+        if (token.len == 0)
+            continue;
+        if (!trackleStrCopy(token, src, sizeof(src)) || trackleRulesSet(src) != ESP_OK)
+            ESP_LOGW(RULES_TAG, "invalid rule in NVS: %.*s", (int)token.len, token.ptr);
+    }
+    return ESP_OK;
+}
+
+bool trackleRulesMatch(const char *eventName, float value)
+{
+    const uint32_t now = getMillis();
+    portENTER_CRITICAL(&rulesMux);
+    const Rule_t *rule = findRule(eventName);
+    const bool match = rule == NULL || evaluate(rule, value, now);
+    portEXIT_CRITICAL(&rulesMux);
+    return match;
+}
+
+TrackleRules_Result trackleRulesPublish(const char *eventName, float value)
+{
+    const uint32_t now = getMillis();
+    portENTER_CRITICAL(&rulesMux);
+    const Rule_t *rule = findRule(eventName);
+    const bool hasRule = rule != NULL;
+    const bool match = !hasRule || evaluate(rule, value, now);
+    if (hasRule)
+    {
+        rulesStats.evaluated++;
+        if (!match)
+            rulesStats.filtered++;
+    }
+    portEXIT_CRITICAL(&rulesMux);
+
+    if (!match)
+        return TRACKLE_RULES_FILTERED;
+
+    char data[24];
+    snprintf(data, sizeof(data), "%g", value);
+    if (!tracklePublishSecure(eventName, data))
+        return TRACKLE_RULES_ERROR;
+
+    // the rule may have been replaced in the meantime, look it up again
+    portENTER_CRITICAL(&rulesMux);
+    Rule_t *published = findRule(eventName);
+    if (published != NULL)
+    {
+        published->published = true;
+        published->lastValue = value;
+        published->lastMillis = now;
+        rulesStats.published++;
+    }
+    portEXIT_CRITICAL(&rulesMux);
+    return TRACKLE_RULES_PUBLISHED;
+}
+
+int trackleRulesPostCb(const char *args)
+{
+    Rule_t compiled;
+    if (args == NULL || !compileRule(args, &compiled))
+    {
+        ESP_LOGE(RULES_TAG, "invalid rule: %s", args ? args : "");
+        return -1;
+    }
+    if (compiled.codeLen == 0)
+        trackleRulesRemove(compiled.name);
+    else if (trackleRulesSet(args) != ESP_OK)
+        return -1;
+
+    const esp_err_t err = trackleRulesSave();
+    if (err != ESP_OK)
+        ESP_LOGW(RULES_TAG, "cannot save rules: %s", esp_err_to_name(err));
+    return 1;
+}
+
+void trackleRulesGetStats(TrackleRules_Stats *stats)
+{
+    portENTER_CRITICAL(&rulesMux);
+    *stats = rulesStats;
+    portEXIT_CRITICAL(&rulesMux);
+}
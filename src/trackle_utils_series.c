@@ -0,0 +1,400 @@
+#include "trackle_utils_series.h"
+
+#include <float.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "trackle_esp32.h"
+#include "trackle_utils_codec.h"
+#include "trackle_utils_time.h"
+#include "trackle_utils_writer.h"
+
+// worst case of one sample: '1111' + 32 bits of time, '11' + 5 + 5 + 32 bits of value
+#define SAMPLE_MAX_BITS (4 + 32 + 2 + 10 + 32)
+#define PAYLOAD_LEN (TRACKLE_BASE64_ENCODED_LEN(TRACKLE_SERIES_RAW_BYTES) + 192)
+
+static const char *SERIES_TAG = "trackle-utils-series";
+
+typedef struct
+{
+    uint32_t startMillis; // the wall time is worked out at publish time, outside the lock
+    uint32_t count;
+    float min;
+    float max;
+    double sum;
+    float last;
+
+    // raw samples
+    uint32_t rawCount;
+    uint32_t bits;
+    uint32_t prevMillis;
+    int32_t prevDelta;
+    uint32_t prevValue;
+    uint8_t prevLeading;
+    uint8_t prevTrailing;
+    uint8_t raw[TRACKLE_SERIES_RAW_BYTES];
+} Window_t;
+
+typedef struct
+{
+    bool used;
+    bool raw;
+    bool flush;
+    char name[TRACKLE_SERIES_NAME_LEN];
+    uint32_t windowMs;
+    Window_t window;
+    TrackleSeries_Stats stats;
+    uint32_t rawInputBytes;  // 8 bytes per raw sample
+    uint32_t rawOutputBytes; // compressed, of the closed windows
+} Series_t;
+
+static Series_t series[TRACKLE_SERIES_MAX];
+// a mutex, not a critical section: a window is a few hundred bytes to copy and compress
+static SemaphoreHandle_t seriesMutex = NULL;
+static StaticSemaphore_t seriesMutexBuffer;
+static bool seriesMutexClaimed = false;
+static portMUX_TYPE seriesMux = portMUX_INITIALIZER_UNLOCKED; // only to create seriesMutex once
+
+// window waiting to be published, shared by all the series: a full window is moved here by
+// trackleSeriesAdd, so the samples that follow start a new one without waiting for the loop
+static Window_t closing;
+static Series_t *closingSeries = NULL;
+static uint32_t closingMillis;
+static char payload[PAYLOAD_LEN];
+
+// false if no series was ever created
+static bool lockSeries()
+{
+    if (seriesMutex == NULL)
+        return false;
+    xSemaphoreTake(seriesMutex, portMAX_DELAY);
+    return true;
+}
+
+static void unlockSeries()
+{
+    xSemaphoreGive(seriesMutex);
+}
+
+// the first trackleSeriesCreate creates the mutex, out of the critical section
+static void createMutex()
+{
+    portENTER_CRITICAL(&seriesMux);
+    const bool create = !seriesMutexClaimed;
+    seriesMutexClaimed = true;
+    portEXIT_CRITICAL(&seriesMux);
+
+    if (create)
+    {
+        SemaphoreHandle_t mutex = xSemaphoreCreateMutexStatic(&seriesMutexBuffer);
+        portENTER_CRITICAL(&seriesMux);
+        seriesMutex = mutex;
+        portEXIT_CRITICAL(&seriesMux);
+    }
+    while (seriesMutex == NULL)
+        vTaskDelay(1);
+}
+
+static Series_t *findSeries(const char *name)
+{
+    for (size_t i = 0; i < TRACKLE_SERIES_MAX; i++)
+    {
+        if (series[i].used && strcmp(series[i].name, name) == 0)
+            return &series[i];
+    }
+    return NULL;
+}
+
+static void startWindow(Window_t *w, uint32_t now)
+{
+    w->startMillis = now;
+    w->count = 0;
+    w->min = FLT_MAX;
+    w->max = -FLT_MAX;
+    w->sum = 0;
+    w->rawCount = 0;
+    w->bits = 0;
+}
+
+// with seriesMutex taken
+static bool closeWindow(Series_t *s, uint32_t now)
+{
+    if (closingSeries != NULL)
+        return false;
+    closing = s->window;
+    closingSeries = s;
+    closingMillis = now;
+    startWindow(&s->window, now);
+    s->flush = false;
+    return true;
+}
+
+static void putBits(Window_t *w, uint32_t value, uint8_t n)
+{
+    while (n > 0)
+    {
+        const uint8_t room = 8 - (w->bits & 7);
+        const uint8_t take = n < room ? n : room;
+        const uint8_t chunk = (value >> (n - take)) & ((1u << take) - 1);
+        uint8_t *byte = &w->raw[w->bits >> 3];
+        if (room == 8)
+            *byte = 0;
+        *byte |= chunk << (room - take);
+        w->bits += take;
+        n -= take;
+    }
+}
+
+static void putTime(Window_t *w, uint32_t now)
+{
+    if (w->rawCount == 0)
+    {
+        putBits(w, now - w->startMillis, 32);
+        w->prevDelta = 0;
+    }
+    else
+    {
+        const int32_t delta = now - w->prevMillis;
+        const int32_t dod = delta - w->prevDelta;
+        if (dod == 0)
+            putBits(w, 0, 1);
+        else if (dod >= -64 && dod <= 63)
+        {
+            putBits(w, 0x2, 2);
+            putBits(w, dod, 7);
+        }
+        else if (dod >= -256 && dod <= 255)
+        {
+            putBits(w, 0x6, 3);
+            putBits(w, dod, 9);
+        }
+        else if (dod >= -2048 && dod <= 2047)
+        {
+            putBits(w, 0xE, 4);
+            putBits(w, dod, 12);
+        }
+        else
+        {
+            putBits(w, 0xF, 4);
+            putBits(w, dod, 32);
+        }
+        w->prevDelta = delta;
+    }
+    w->prevMillis = now;
+}
+
+static void putValue(Window_t *w, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (w->rawCount == 0)
+    {
+        putBits(w, bits, 32);
+        w->prevLeading = 0xFF; // no previous block
+    }
+    else
+    {
+        const uint32_t x = bits ^ w->prevValue;
+        if (x == 0)
+            putBits(w, 0, 1);
+        else
+        {
+            const uint8_t leading = __builtin_clz(x);
+            const uint8_t trailing = __builtin_ctz(x);
+            if (w->prevLeading != 0xFF && leading >= w->prevLeading && trailing >= w->prevTrailing)
+            {
+                putBits(w, 0x2, 2);
+                putBits(w, x >> w->prevTrailing, 32 - w->prevLeading - w->prevTrailing);
+            }
+            else
+            {
+                const uint8_t meaningful = 32 - leading - trailing;
+                putBits(w, 0x3, 2);
+                putBits(w, leading, 5);
+                putBits(w, meaningful - 1, 5);
+                putBits(w, x >> trailing, meaningful);
+                w->prevLeading = leading;
+                w->prevTrailing = trailing;
+            }
+        }
+    }
+    w->prevValue = bits;
+}
+
+esp_err_t trackleSeriesCreate(const char *name, uint32_t windowMs, bool raw)
+{
+    if (strlen(name) >= TRACKLE_SERIES_NAME_LEN || windowMs == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    createMutex();
+    esp_err_t err = ESP_ERR_NO_MEM;
+    lockSeries();
+    if (findSeries(name) != NULL)
+        err = ESP_ERR_INVALID_ARG;
+    for (size_t i = 0; err == ESP_ERR_NO_MEM && i < TRACKLE_SERIES_MAX; i++)
+    {
+        Series_t *s = &series[i];
+        if (s->used)
+            continue;
+        memset(s, 0, sizeof(*s));
+        strcpy(s->name, name);
+        s->windowMs = windowMs;
+        s->raw = raw;
+        s->stats.memoryBytes = raw ? sizeof(Series_t) : sizeof(Series_t) - TRACKLE_SERIES_RAW_BYTES;
+        startWindow(&s->window, getMillis());
+        s->used = true;
+        err = ESP_OK;
+    }
+    unlockSeries();
+    return err;
+}
+
+bool trackleSeriesAdd(const char *name, float value)
+{
+    const uint32_t now = getMillis();
+    if (!lockSeries())
+        return false;
+    Series_t *s = findSeries(name);
+    if (s != NULL)
+    {
+        Window_t *w = &s->window;
+        if (s->raw && w->bits + SAMPLE_MAX_BITS > TRACKLE_SERIES_RAW_BYTES * 8)
+            closeWindow(s, now);
+        w->count++;
+        w->sum += value;
+        w->last = value;
+        if (value < w->min)
+            w->min = value;
+        if (value > w->max)
+            w->max = value;
+        s->stats.samples++;
+
+        // if another window is still being published only the aggregates go on, the loop closes this one
+        if (s->raw && w->bits + SAMPLE_MAX_BITS <= TRACKLE_SERIES_RAW_BYTES * 8)
+        {
+            putTime(w, now);
+            putValue(w, value);
+            w->rawCount++;
+            s->stats.rawSamples++;
+            s->rawInputBytes += 8;
+        }
+        else if (s->raw)
+            s->flush = true;
+    }
+    unlockSeries();
+    return s != NULL;
+}
+
+bool trackleSeriesFlush(const char *name)
+{
+    if (!lockSeries())
+        return false;
+    Series_t *s = findSeries(name);
+    if (s != NULL)
+        s->flush = true;
+    unlockSeries();
+    return s != NULL;
+}
+
+bool trackleSeriesGetStats(const char *name, TrackleSeries_Stats *stats)
+{
+    if (!lockSeries())
+        return false;
+    Series_t *s = findSeries(name);
+    if (s != NULL)
+    {
+        *stats = s->stats;
+        const uint32_t compressed = s->rawOutputBytes + (s->window.bits + 7) / 8;
+        stats->compressionRatio = compressed > 0 ? (float)s->rawInputBytes / compressed : 0;
+    }
+    unlockSeries();
+    return s != NULL;
+}
+
+static bool publishWindow(const char *name, const Window_t *w, bool raw, uint32_t now)
+{
+    TrackleWriter_t writer;
+    trackleWriterInit(&writer, TRACKLE_WRITER_JSON, (uint8_t *)payload, sizeof(payload));
+    trackleWriterBeginObject(&writer);
+    // back from the current wall time, so that a sync received during the window is taken into account
+    trackleWriterKey(&writer, "t");
+    trackleWriterInt(&writer, trackleTimeNowMs() - (int64_t)(getMillis() - w->startMillis));
+    trackleWriterKey(&writer, "w");
+    trackleWriterInt(&writer, now - w->startMillis);
+    trackleWriterKey(&writer, "n");
+    trackleWriterInt(&writer, w->count);
+    trackleWriterKey(&writer, "min");
+    trackleWriterFloat(&writer, w->min);
+    trackleWriterKey(&writer, "max");
+    trackleWriterFloat(&writer, w->max);
+    trackleWriterKey(&writer, "mean");
+    trackleWriterFloat(&writer, w->sum / w->count);
+    trackleWriterKey(&writer, "last");
+    trackleWriterFloat(&writer, w->last);
+    if (raw)
+    {
+        char encoded[TRACKLE_BASE64_ENCODED_LEN(TRACKLE_SERIES_RAW_BYTES) + 1];
+        trackleBase64Encode(w->raw, (w->bits + 7) / 8, encoded, sizeof(encoded));
+        trackleWriterKey(&writer, "rn");
+        trackleWriterInt(&writer, w->rawCount);
+        trackleWriterKey(&writer, "raw");
+        trackleWriterString(&writer, encoded);
+    }
+    trackleWriterEndObject(&writer);
+    if (trackleWriterFinish(&writer) < 0)
+    {
+        ESP_LOGE(SERIES_TAG, "%s: payload truncated, %u bytes needed", name, (unsigned)trackleWriterLength(&writer));
+        return false;
+    }
+    return tracklePublishPacedSecure(name, payload);
+}
+
+static void publishClosing()
+{
+    Series_t *s = closingSeries;
+    if (closing.count > 0)
+    {
+        const bool published = publishWindow(s->name, &closing, s->raw, closingMillis);
+        lockSeries();
+        s->rawOutputBytes += (closing.bits + 7) / 8;
+        if (published)
+        {
+            s->stats.windows++;
+            s->stats.rawBytes += (closing.bits + 7) / 8;
+        }
+        else
+            s->stats.failed++;
+        unlockSeries();
+    }
+    lockSeries();
+    closingSeries = NULL;
+    unlockSeries();
+}
+
+void trackleSeriesLoop()
+{
+    if (seriesMutex == NULL)
+        return;
+
+    // a window closed by trackleSeriesAdd
+    if (closingSeries != NULL)
+        publishClosing();
+
+    const uint32_t now = getMillis();
+    for (size_t i = 0; i < TRACKLE_SERIES_MAX; i++)
+    {
+        Series_t *s = &series[i];
+        if (!s->used || (!s->flush && now - s->window.startMillis < s->windowMs))
+            continue;
+
+        lockSeries();
+        const bool closed = closeWindow(s, now);
+        unlockSeries();
+        if (closed)
+            publishClosing();
+    }
+}
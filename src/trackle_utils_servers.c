@@ -0,0 +1,408 @@
+#include "trackle_utils_servers.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/netdb.h"
+#include "ping/ping_sock.h"
+
+#include "trackle_esp32.h"
+#include "trackle_utils_connectivity.h"
+
+#define SERVERS_HOST_LEN 64
+
+static const char *SERVERS_TAG = "trackle-utils-servers";
+
+typedef struct
+{
+    char name[SERVERS_HOST_LEN];
+    int port;
+} ServerHost_t;
+
+typedef struct
+{
+    bool answered;
+    uint32_t rttMs;
+} ProbeSlot_t;
+
+static ServerHost_t hosts[TRACKLE_SERVERS_MAX_HOSTS];
+static size_t hostCount = 0;
+
+static TrackleServer_Stats endpoints[TRACKLE_SERVERS_MAX_ENDPOINTS];
+static size_t endpointCount = 0;
+static int currentEndpoint = -1;
+
+static bool probed = false;
+static uint32_t lastProbeMillis = 0;
+static SemaphoreHandle_t probeDone = NULL;
+static TaskHandle_t probeTask = NULL;
+
+static bool sessionOpen = false;
+static bool sessionAnswered = false;
+static uint32_t sessionStartMillis = 0;
+static uint32_t lastReceiveMillis = 0;
+
+static portMUX_TYPE serversMux = portMUX_INITIALIZER_UNLOCKED;
+
+static int findEndpoint(const TrackleServer_Stats *list, size_t count, const struct sockaddr_in *addr)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (list[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr && list[i].addr.sin_port == addr->sin_port)
+            return i;
+    }
+    return -1;
+}
+
+// failed endpoints are tried again after a while, they may be back
+static bool isHealthy(const TrackleServer_Stats *ep)
+{
+    return ep->failureStreak < TRACKLE_SERVERS_MAX_FAILURES || getMillis() - ep->lastFailureMillis >= TRACKLE_SERVERS_RETRY_MS;
+}
+
+// probed RTT, or the handshake RTT of the last session when ICMP is filtered
+static uint32_t effectiveRtt(const TrackleServer_Stats *ep)
+{
+    return ep->rttMs != TRACKLE_SERVERS_RTT_UNKNOWN ? ep->rttMs : ep->handshakeRttMs;
+}
+
+/**
+ * Append all IPv4 addresses of a host to the list, keeping the statistics of endpoints already known.
+ */
+static size_t resolveHost(const char *name, int port, TrackleServer_Stats *list, size_t count, const TrackleServer_Stats *known, size_t knownCount)
+{
+    const struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_DGRAM,
+    };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(name, NULL, &hints, &res) != 0 || res == NULL)
+    {
+        ESP_LOGW(SERVERS_TAG, "error resolving %s", name);
+        return count;
+    }
+
+    for (struct addrinfo *ai = res; ai != NULL && count < TRACKLE_SERVERS_MAX_ENDPOINTS; ai = ai->ai_next)
+    {
+        struct sockaddr_in addr = *(const struct sockaddr_in *)ai->ai_addr;
+        addr.sin_port = htons(port);
+        if (findEndpoint(list, count, &addr) >= 0)
+            continue;
+
+        const int index = findEndpoint(known, knownCount, &addr);
+        if (index >= 0)
+        {
+            list[count] = known[index];
+        }
+        else
+        {
+            memset(&list[count], 0, sizeof(list[count]));
+            list[count].addr = addr;
+            list[count].rttMs = TRACKLE_SERVERS_RTT_UNKNOWN;
+            list[count].handshakeRttMs = TRACKLE_SERVERS_RTT_UNKNOWN;
+        }
+        list[count].current = false;
+        count++;
+    }
+    freeaddrinfo(res);
+    return count;
+}
+
+static void probeSuccess(esp_ping_handle_t hdl, void *args)
+{
+    ProbeSlot_t *slot = (ProbeSlot_t *)args;
+    uint32_t elapsed = 0;
+    esp_ping_get_profile(hdl, ESP_PING_PROF_TIMEGAP, &elapsed, sizeof(elapsed));
+    slot->rttMs = elapsed;
+    slot->answered = true;
+}
+
+static void probeEnd(esp_ping_handle_t hdl, void *args)
+{
+    xSemaphoreGive(probeDone);
+}
+
+/**
+ * Send one ICMP echo to every endpoint at the same time and wait for all of them (or the timeout).
+ */
+static void probeEndpoints(TrackleServer_Stats *list, size_t count)
+{
+    if (probeDone == NULL)
+        probeDone = xSemaphoreCreateCounting(TRACKLE_SERVERS_MAX_ENDPOINTS, 0);
+    if (probeDone == NULL)
+        return;
+
+    esp_ping_handle_t handles[TRACKLE_SERVERS_MAX_ENDPOINTS] = {0};
+    ProbeSlot_t slots[TRACKLE_SERVERS_MAX_ENDPOINTS] = {0};
+    size_t started = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        esp_ping_config_t config = ESP_PING_DEFAULT_CONFIG();
+        const ip_addr_t target = IPADDR4_INIT(list[i].addr.sin_addr.s_addr);
+        config.target_addr = target;
+        config.count = 1;
+        config.interval_ms = 10;
+        config.timeout_ms = TRACKLE_SERVERS_PROBE_TIMEOUT_MS;
+
+        const esp_ping_callbacks_t callbacks = {
+            .cb_args = &slots[i],
+            .on_ping_success = probeSuccess,
+            .on_ping_timeout = NULL,
+            .on_ping_end = probeEnd,
+        };
+        if (esp_ping_new_session(&config, &callbacks, &handles[i]) != ESP_OK)
+        {
+            handles[i] = NULL;
+            continue;
+        }
+        if (esp_ping_start(handles[i]) != ESP_OK)
+        {
+            esp_ping_delete_session(handles[i]);
+            handles[i] = NULL;
+            continue;
+        }
+        started++;
+    }
+
+    for (size_t i = 0; i < started; i++)
+    {
+        if (xSemaphoreTake(probeDone, pdMS_TO_TICKS(TRACKLE_SERVERS_PROBE_TIMEOUT_MS + 200)) != pdTRUE)
+            break;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (handles[i] == NULL)
+            continue;
+        esp_ping_stop(handles[i]);
+        esp_ping_delete_session(handles[i]);
+
+        list[i].probes++;
+        if (slots[i].answered)
+        {
+            list[i].rttMs = slots[i].rttMs;
+        }
+        else
+        {
+            list[i].probeLosses++;
+            list[i].rttMs = TRACKLE_SERVERS_RTT_UNKNOWN;
+        }
+    }
+    while (xSemaphoreTake(probeDone, 0) == pdTRUE)
+        ;
+}
+
+/**
+ * Probes run here, never in connect_cb_udp: it is called with xTrackleSemaphore taken and the probes
+ * take up to TRACKLE_SERVERS_PROBE_TIMEOUT_MS. The results are used from the next connection.
+ */
+static void probeTaskFn(void *pvParameter)
+{
+    TrackleServer_Stats list[TRACKLE_SERVERS_MAX_ENDPOINTS];
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        portENTER_CRITICAL(&serversMux);
+        const size_t count = endpointCount;
+        memcpy(list, endpoints, count * sizeof(list[0]));
+        portEXIT_CRITICAL(&serversMux);
+
+        probeEndpoints(list, count);
+
+        // the list may have changed meanwhile, results are matched by address
+        portENTER_CRITICAL(&serversMux);
+        for (size_t i = 0; i < count; i++)
+        {
+            const int index = findEndpoint(endpoints, endpointCount, &list[i].addr);
+            if (index < 0)
+                continue;
+            endpoints[index].rttMs = list[i].rttMs;
+            endpoints[index].probes = list[i].probes;
+            endpoints[index].probeLosses = list[i].probeLosses;
+        }
+        portEXIT_CRITICAL(&serversMux);
+    }
+}
+
+static void startProbe()
+{
+    if (probeTask == NULL && xTaskCreate(&probeTaskFn, "trackle_servers_probe", 4096, NULL, 3, &probeTask) != pdPASS)
+    {
+        probeTask = NULL;
+        ESP_LOGW(SERVERS_TAG, "cannot start probe task");
+        return;
+    }
+    xTaskNotifyGive(probeTask);
+}
+
+// healthy endpoints first, then the lowest RTT
+static int chooseEndpoint(const TrackleServer_Stats *list, size_t count)
+{
+    int best = -1;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (best < 0)
+        {
+            best = i;
+            continue;
+        }
+        const bool healthy = isHealthy(&list[i]);
+        const bool bestHealthy = isHealthy(&list[best]);
+        if ((healthy && !bestHealthy) || (healthy == bestHealthy && effectiveRtt(&list[i]) < effectiveRtt(&list[best])))
+            best = i;
+    }
+    return best;
+}
+
+bool trackleServersAdd(const char *host, int port)
+{
+    if (strlen(host) >= SERVERS_HOST_LEN)
+        return false;
+
+    bool added = false;
+    portENTER_CRITICAL(&serversMux);
+    if (hostCount < TRACKLE_SERVERS_MAX_HOSTS)
+    {
+        strcpy(hosts[hostCount].name, host);
+        hosts[hostCount].port = port;
+        hostCount++;
+        added = true;
+    }
+    portEXIT_CRITICAL(&serversMux);
+    return added;
+}
+
+void trackleServersClear()
+{
+    portENTER_CRITICAL(&serversMux);
+    hostCount = 0;
+    portEXIT_CRITICAL(&serversMux);
+}
+
+bool trackleServersSelect(const char *defaultHost, int defaultPort, struct sockaddr_in *addr)
+{
+    TrackleServer_Stats list[TRACKLE_SERVERS_MAX_ENDPOINTS];
+    size_t count = 0;
+
+    ServerHost_t names[TRACKLE_SERVERS_MAX_HOSTS];
+    TrackleServer_Stats known[TRACKLE_SERVERS_MAX_ENDPOINTS];
+    portENTER_CRITICAL(&serversMux);
+    size_t nameCount = hostCount;
+    memcpy(names, hosts, sizeof(names));
+    const size_t knownCount = endpointCount;
+    memcpy(known, endpoints, knownCount * sizeof(known[0]));
+    const int knownCurrent = currentEndpoint;
+    portEXIT_CRITICAL(&serversMux);
+
+    if (nameCount == 0)
+        count = resolveHost(defaultHost, defaultPort, list, count, known, knownCount);
+    for (size_t i = 0; i < nameCount; i++)
+        count = resolveHost(names[i].name, names[i].port, list, count, known, knownCount);
+    if (count == 0)
+        return false;
+
+    int current = -1;
+    if (knownCurrent >= 0)
+        current = findEndpoint(list, count, &known[knownCurrent].addr);
+
+    // only cached results are used here, probes run in their own task
+    const bool mustChoose = current < 0 || !isHealthy(&list[current]);
+    if (mustChoose)
+        current = chooseEndpoint(list, count);
+    list[current].current = true;
+
+    portENTER_CRITICAL(&serversMux);
+    // probe results may have arrived while resolving
+    for (size_t i = 0; i < count; i++)
+    {
+        const int index = findEndpoint(endpoints, endpointCount, &list[i].addr);
+        if (index < 0)
+            continue;
+        list[i].rttMs = endpoints[index].rttMs;
+        list[i].probes = endpoints[index].probes;
+        list[i].probeLosses = endpoints[index].probeLosses;
+    }
+    memcpy(endpoints, list, count * sizeof(list[0]));
+    endpointCount = count;
+    currentEndpoint = current;
+    sessionOpen = true;
+    sessionAnswered = false;
+    sessionStartMillis = getMillis();
+    portEXIT_CRITICAL(&serversMux);
+
+    // refresh RTTs when stale or when the endpoint had to be changed
+    if (count > 1 && (!probed || mustChoose || getMillis() - lastProbeMillis >= TRACKLE_SERVERS_PROBE_INTERVAL_MS))
+    {
+        startProbe();
+        probed = true;
+        lastProbeMillis = getMillis();
+    }
+
+    *addr = list[current].addr;
+    char addrStr[16];
+    inet_ntoa_r(addr->sin_addr, addrStr, sizeof(addrStr));
+    if (effectiveRtt(&list[current]) != TRACKLE_SERVERS_RTT_UNKNOWN)
+        ESP_LOGI(SERVERS_TAG, "endpoint %s:%d (%d of %d), rtt %" PRIu32 " ms", addrStr, ntohs(addr->sin_port), current + 1, (int)count, effectiveRtt(&list[current]));
+    else
+        ESP_LOGI(SERVERS_TAG, "endpoint %s:%d (%d of %d)", addrStr, ntohs(addr->sin_port), current + 1, (int)count);
+    return true;
+}
+
+void trackleServersNotifyReceive()
+{
+    lastReceiveMillis = getMillis();
+    if (sessionAnswered)
+        return;
+    // first answer of the session: one round trip of the handshake
+    portENTER_CRITICAL(&serversMux);
+    sessionAnswered = true;
+    if (sessionOpen && currentEndpoint >= 0)
+        endpoints[currentEndpoint].handshakeRttMs = lastReceiveMillis - sessionStartMillis;
+    portEXIT_CRITICAL(&serversMux);
+}
+
+void trackleServersNotifyClose()
+{
+    // sessions closed because the network went down say nothing about the server
+    if (!sessionOpen || currentEndpoint < 0 || !trackleConnectivityIsUp())
+    {
+        sessionOpen = false;
+        return;
+    }
+
+    portENTER_CRITICAL(&serversMux);
+    TrackleServer_Stats *ep = &endpoints[currentEndpoint];
+    const bool answered = sessionAnswered && getMillis() - lastReceiveMillis < TRACKLE_SERVERS_SILENCE_MS;
+    if (answered)
+    {
+        ep->sessions++;
+        ep->failureStreak = 0;
+    }
+    else
+    {
+        ep->failures++;
+        ep->lastFailureMillis = getMillis();
+        if (ep->failureStreak < UINT8_MAX)
+            ep->failureStreak++;
+    }
+    sessionOpen = false;
+    portEXIT_CRITICAL(&serversMux);
+
+    if (!answered)
+        ESP_LOGW(SERVERS_TAG, "no answer from endpoint %d", currentEndpoint + 1);
+}
+
+size_t trackleServersGetStats(TrackleServer_Stats *stats, size_t max)
+{
+    portENTER_CRITICAL(&serversMux);
+    const size_t count = endpointCount < max ? endpointCount : max;
+    memcpy(stats, endpoints, count * sizeof(stats[0]));
+    portEXIT_CRITICAL(&serversMux);
+    return count;
+}
@@ -0,0 +1,242 @@
+#include "trackle_utils_storage.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_idf_version.h>
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "esp32/rom/crc.h"
+
+#include "trackle_esp32.h"
+#include "trackle_utils_codec.h"
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#define RECORD_MMAP_DATA ESP_PARTITION_MMAP_DATA
+#define recordMunmap(handle) esp_partition_munmap(handle)
+typedef esp_partition_mmap_handle_t RecordMmap_t;
+#else
+#define RECORD_MMAP_DATA SPI_FLASH_MMAP_DATA
+#define recordMunmap(handle) spi_flash_munmap(handle)
+typedef spi_flash_mmap_handle_t RecordMmap_t;
+#endif
+
+#define DEVICE_ID_STR_LEN (DEVICE_ID_LEN * 2 + 1)
+#define NVS_COPY_LEN (DEVICE_ID_LEN + PRIVATE_KEY_MAX_LEN + DEVICE_ID_STR_LEN)
+
+static const char *STORAGE_TAG = "storage";
+
+// header of the factory record, followed by the private key and the CRC
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t keyLen;
+    uint8_t deviceId[DEVICE_ID_LEN];
+    char deviceIdStr[DEVICE_ID_STR_LEN];
+    uint8_t reserved[3];
+} FactoryRecord_t;
+
+const uint8_t *device_id = NULL;
+const unsigned char *private_key = NULL;
+nvs_handle_t config_handle;
+nvs_handle_t device_handle;
+
+static const FactoryRecord_t *record = NULL; // mapped for the whole life of the firmware
+static size_t privateKeyLen = 0;
+static const char *deviceIdStr = "";
+static TrackleFactory_Stats factoryStats;
+
+static bool mapRecord()
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, FACTORY_RECORD_PARTITION);
+    if (part == NULL)
+        return false;
+
+    const size_t mapSize = part->size < FACTORY_RECORD_MAX_SIZE ? part->size : FACTORY_RECORD_MAX_SIZE;
+    const void *ptr;
+    RecordMmap_t handle;
+    if (mapSize < sizeof(FactoryRecord_t) + 4 || esp_partition_mmap(part, 0, mapSize, RECORD_MMAP_DATA, &ptr, &handle) != ESP_OK)
+        return false;
+
+    const FactoryRecord_t *r = (const FactoryRecord_t *)ptr;
+    const size_t len = sizeof(*r) + r->keyLen;
+    // the key must fit where the NVS path would put it: users of private_key may rely on that bound
+    bool valid = r->magic == FACTORY_RECORD_MAGIC && r->version == FACTORY_RECORD_VERSION && r->keyLen > 0 &&
+                 r->keyLen <= PRIVATE_KEY_MAX_LEN && len + 4 <= mapSize;
+    if (valid)
+    {
+        uint32_t crc;
+        memcpy(&crc, (const uint8_t *)r + len, sizeof(crc));
+        valid = crc32_le(0, (const uint8_t *)r, len) == crc;
+    }
+    if (valid)
+    {
+        // a CRC doesn't prove the string is the device ID: it's used as is for the cloud and mDNS
+        char expected[DEVICE_ID_STR_LEN];
+        trackleHexEncode(r->deviceId, DEVICE_ID_LEN, expected, sizeof(expected));
+        valid = memcmp(expected, r->deviceIdStr, DEVICE_ID_STR_LEN) == 0;
+    }
+    if (!valid)
+    {
+        ESP_LOGW(STORAGE_TAG, "invalid factory record in %s", FACTORY_RECORD_PARTITION);
+        recordMunmap(handle);
+        return false;
+    }
+    record = r;
+    return true;
+}
+
+static int openFactoryNvs()
+{
+    esp_err_t err = nvs_flash_init_partition(FACTORY_PARTITION);
+    if (err == ESP_OK)
+    { // FACTORY_PARTITION extists, try to read
+        err = nvs_open_from_partition(FACTORY_PARTITION, "device", NVS_READONLY, &device_handle);
+        if (err != ESP_OK)
+        {
+            return -2;
+        }
+        else
+        {
+            ESP_LOGI(STORAGE_TAG, "FACTORY_PARTITION found");
+        }
+    }
+    else
+    { // on error try with old factor partition named "factory"
+
+        err = nvs_flash_init_partition(OLD_FACTORY_PARTITION);
+        if (err == ESP_OK)
+        { // OLD_FACTORY_PARTITION extists, try to read
+            err = nvs_open_from_partition(OLD_FACTORY_PARTITION, "device", NVS_READONLY, &device_handle);
+            if (err != ESP_OK)
+            {
+                return -2;
+            }
+            else
+            {
+                ESP_LOGI(STORAGE_TAG, "OLD_FACTORY_PARTITION found");
+            }
+        }
+        else
+        { // no factory or factory data partition defined
+            ESP_LOGE(STORAGE_TAG, "no factory partition found");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static esp_err_t readFactoryNvs()
+{
+    static uint8_t *copy = NULL; // only allocated without factory record
+    if (copy == NULL)
+        copy = malloc(NVS_COPY_LEN);
+    if (copy == NULL)
+        return ESP_ERR_NO_MEM;
+
+    uint8_t *id = copy;
+    unsigned char *key = copy + DEVICE_ID_LEN;
+    char *str = (char *)key + PRIVATE_KEY_MAX_LEN;
+    size_t required_size = DEVICE_ID_LEN;
+    esp_err_t err = nvs_get_blob(device_handle, "device_id", id, &required_size);
+    hexToString(id, DEVICE_ID_LEN, str, DEVICE_ID_STR_LEN);
+    required_size = PRIVATE_KEY_MAX_LEN;
+    err += nvs_get_blob(device_handle, "private_key", key, &required_size);
+
+    device_id = id;
+    private_key = key;
+    privateKeyLen = err == ESP_OK ? required_size : 0;
+    deviceIdStr = str;
+    factoryStats.source = TRACKLE_FACTORY_NVS;
+    factoryStats.ramBytes = NVS_COPY_LEN;
+    return err;
+}
+
+int initStorage(bool has_config_partition)
+{
+    const int64_t start = esp_timer_get_time();
+    int res = 0;
+    if (record != NULL || mapRecord())
+        ESP_LOGI(STORAGE_TAG, "factory record found");
+    else
+        res = openFactoryNvs();
+    factoryStats.loadUs += esp_timer_get_time() - start;
+    if (res != 0)
+        return res;
+
+    if (has_config_partition)
+    {
+        esp_err_t err = nvs_flash_init_partition(CONFIG_PARTITION);
+        if (err != ESP_OK)
+            return -3;
+
+        err = nvs_open_from_partition(CONFIG_PARTITION, "machine", NVS_READWRITE, &config_handle);
+        if (err != ESP_OK)
+            return -4;
+
+        err = trackleConfigInit(config_handle);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(STORAGE_TAG, "cannot init config cache: %s", esp_err_to_name(err));
+            return -5;
+        }
+    }
+
+    return 0;
+}
+
+esp_err_t readDeviceInfoFromStorage()
+{
+    const int64_t start = esp_timer_get_time();
+    esp_err_t err = ESP_OK;
+    if (record != NULL)
+    {
+        // in place, no copies
+        device_id = record->deviceId;
+        private_key = (const unsigned char *)(record + 1);
+        privateKeyLen = record->keyLen;
+        deviceIdStr = record->deviceIdStr;
+        factoryStats.source = TRACKLE_FACTORY_RECORD;
+        factoryStats.ramBytes = 0;
+    }
+    else
+    {
+        err = readFactoryNvs();
+    }
+    factoryStats.loadUs += esp_timer_get_time() - start;
+    ESP_LOGI(STORAGE_TAG, "credentials read from %s in %" PRIu32 " us, %" PRIu32 " bytes of RAM",
+             record != NULL ? "factory record" : "NVS", factoryStats.loadUs, factoryStats.ramBytes);
+    return err;
+}
+
+size_t getPrivateKeyLength()
+{
+    return privateKeyLen;
+}
+
+void getFactoryStats(TrackleFactory_Stats *stats)
+{
+    *stats = factoryStats;
+}
+
+const char *trackleGetDeviceIdAsStr()
+{
+    return deviceIdStr;
+}
+
+esp_err_t readConfigFromStorage(void *out_value, size_t out_size, const char *key)
+{
+    esp_err_t err = trackleConfigRead(key, out_value, out_size);
+    ESP_LOGD(STORAGE_TAG, "reading config for key %s", key);
+    return err;
+}
+
+esp_err_t writeConfigToStorage(void *out_value, size_t out_size, const char *key)
+{
+    esp_err_t err = trackleConfigWrite(key, out_value, out_size);
+    ESP_LOGI(STORAGE_TAG, "writing config for key %s: %d bytes", key, out_size);
+    return err;
+}
@@ -0,0 +1,202 @@
+#include "trackle_utils_stream.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include "esp_random.h"
+#include "esp32/rom/crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "trackle_esp32.h"
+#include "trackle_utils_codec.h"
+#include "trackle_utils_rtt.h"
+#include "trackle_utils_trampoline.h"
+#include "trackle_utils_txqueue.h"
+#include "trackle_utils_writer.h"
+
+#if TRACKLE_STREAM_MAX_POSTS > TRACKLE_TRAMPOLINE_MAX
+#error "TRACKLE_STREAM_MAX_POSTS must be at most TRACKLE_TRAMPOLINE_MAX"
+#endif
+
+#define MIN_PAUSE_MS 50
+
+static const char *STREAM_TAG = "trackle-utils-stream";
+
+// one stream at a time: a binary chunk, its base64 and the event data
+static uint8_t chunk[TRACKLE_STREAM_CHUNK_SIZE];
+static char encoded[TRACKLE_BASE64_ENCODED_LEN(TRACKLE_STREAM_CHUNK_SIZE) + 1];
+static char text[TRACKLE_BASE64_ENCODED_LEN(TRACKLE_STREAM_CHUNK_SIZE) + 64];
+static bool streaming = false;
+static TrackleStream_Progress streamProgress;
+static portMUX_TYPE streamMux = portMUX_INITIALIZER_UNLOCKED;
+
+// inbound: cloud functions are called by the Trackle task one at a time, one block buffer is enough
+static TrackleRegistry_t postRegistry;
+static bool postRegistryReady = false;
+static TrackleEndpoint_Handle posts[TRACKLE_STREAM_MAX_POSTS];
+static char blockArgs[TRACKLE_STREAM_MAX_BLOCK_ARGS + 1];
+
+static void updateProgress(const TrackleStream_Progress *progress)
+{
+    portENTER_CRITICAL(&streamMux);
+    streamProgress = *progress;
+    portEXIT_CRITICAL(&streamMux);
+}
+
+static uint32_t pauseMs()
+{
+    TrackleRtt_Stats rtt;
+    trackleRttGetStats(&rtt);
+    return rtt.srttMs > MIN_PAUSE_MS ? rtt.srttMs : MIN_PAUSE_MS;
+}
+
+/**
+ * Publish a chunk, retrying with backoff while it's refused.
+ */
+static esp_err_t sendChunk(const char *eventName, TrackleStream_Progress *progress)
+{
+    const uint32_t start = getMillis();
+    while (!tracklePublishPacedSecure(eventName, text))
+    {
+        if (getMillis() - start >= TRACKLE_STREAM_TIMEOUT_MS)
+            return ESP_ERR_TIMEOUT;
+        progress->retries++;
+        progress->window = progress->window > 1 ? progress->window / 2 : 1;
+        vTaskDelay(pdMS_TO_TICKS(trackleRttGetRto()));
+    }
+    return ESP_OK;
+}
+
+esp_err_t tracklePublishStream(const char *eventName, TrackleStream_Producer producer, TrackleStream_ProgressCb progressCb, void *ctx)
+{
+    portENTER_CRITICAL(&streamMux);
+    const bool busy = streaming;
+    streaming = true;
+    portEXIT_CRITICAL(&streamMux);
+    if (busy)
+        return ESP_ERR_INVALID_STATE;
+
+    const uint32_t streamId = esp_random() & 0xFFFFFF;
+    const uint32_t start = getMillis();
+    TrackleStream_Progress progress = {.window = 1};
+    uint32_t crc = 0;
+    uint8_t sentInWindow = 0;
+    esp_err_t err = ESP_OK;
+    updateProgress(&progress);
+
+    for (uint32_t index = 0;; index++)
+    {
+        const int len = producer(chunk, sizeof(chunk), ctx);
+        if (len < 0 || len > (int)sizeof(chunk))
+        {
+            err = ESP_FAIL;
+            break;
+        }
+
+        TrackleWriter_t w;
+        trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)text, sizeof(text));
+        trackleWriterBeginObject(&w);
+        trackleWriterKey(&w, "s");
+        trackleWriterInt(&w, streamId);
+        trackleWriterKey(&w, "i");
+        trackleWriterInt(&w, index);
+        if (len > 0)
+        {
+            trackleBase64Encode(chunk, len, encoded, sizeof(encoded));
+            trackleWriterKey(&w, "d");
+            trackleWriterString(&w, encoded);
+            crc = crc32_le(crc, chunk, len);
+        }
+        else
+        {
+            trackleWriterKey(&w, "end");
+            trackleWriterBool(&w, true);
+            trackleWriterKey(&w, "len");
+            trackleWriterInt(&w, progress.bytes);
+            trackleWriterKey(&w, "crc");
+            trackleWriterInt(&w, crc);
+        }
+        trackleWriterEndObject(&w);
+        // sized for the longest chunk
+        trackleWriterFinish(&w);
+
+        err = sendChunk(eventName, &progress);
+        if (err != ESP_OK)
+            break;
+
+        progress.bytes += len;
+        progress.chunks++;
+        progress.elapsedMs = getMillis() - start;
+        progress.bytesPerSecond = progress.elapsedMs > 0 ? (uint64_t)progress.bytes * 1000 / progress.elapsedMs : 0;
+        updateProgress(&progress);
+        if (progressCb)
+            progressCb(&progress, ctx);
+        if (len == 0)
+            break;
+
+        // end of a window: give the network one RTT, grow the window if the queue kept up
+        if (++sentInWindow >= progress.window)
+        {
+            sentInWindow = 0;
+            vTaskDelay(pdMS_TO_TICKS(pauseMs()));
+            if (!trackleTxQueueCongested() && progress.window < TRACKLE_STREAM_MAX_WINDOW)
+                progress.window++;
+        }
+    }
+
+    if (err != ESP_OK)
+        ESP_LOGE(STREAM_TAG, "stream %s aborted after %" PRIu32 " bytes: %s", eventName, progress.bytes, esp_err_to_name(err));
+    portENTER_CRITICAL(&streamMux);
+    streaming = false;
+    portEXIT_CRITICAL(&streamMux);
+    return err;
+}
+
+void trackleStreamGetProgress(TrackleStream_Progress *progress)
+{
+    portENTER_CRITICAL(&streamMux);
+    *progress = streamProgress;
+    portEXIT_CRITICAL(&streamMux);
+}
+
+static int writeBlock(uint8_t post, const char *args)
+{
+    // the library argument is const, the block is decoded in place in a copy
+    const size_t len = strlen(args);
+    if (len > TRACKLE_STREAM_MAX_BLOCK_ARGS)
+        return TRACKLE_REGISTRY_ERR_BLOCK;
+    memcpy(blockArgs, args, len + 1);
+    return trackleRegistryWriteBlock(&postRegistry, posts[post], blockArgs);
+}
+
+// the library passes no context to functions: one trampoline per slot
+TRACKLE_TRAMPOLINES(trampolines, int, writeBlock, TRACKLE_STREAM_MAX_POSTS);
+
+bool trackleStreamAddPost(const char *name, TrackleRegistry_BlockCb function, Function_PermissionDef permission)
+{
+    if (!postRegistryReady)
+    {
+        trackleRegistryInit(&postRegistry);
+        postRegistryReady = true;
+    }
+    if (postRegistry.count >= TRACKLE_STREAM_MAX_POSTS)
+    {
+        ESP_LOGE(STREAM_TAG, "too many functions, max %d", TRACKLE_STREAM_MAX_POSTS);
+        return false;
+    }
+
+    const uint8_t i = postRegistry.count;
+    const TrackleEndpoint_Handle handle = trackleRegistryAddStream(&postRegistry, name, function);
+    if (handle == TRACKLE_ENDPOINT_INVALID)
+        return false;
+    posts[i] = handle;
+    if (!tracklePost(trackle_s, name, trampolines[i], permission))
+    {
+        trackleRegistryRemove(&postRegistry, name);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,129 @@
+#include "trackle_utils_time.h"
+
+#include <inttypes.h>
+#include <sys/time.h>
+
+#include <esp_log.h>
+
+#include "trackle_esp32.h"
+#include "trackle_utils_rtt.h"
+
+static const char *TIME_TAG = "trackle-utils-time";
+
+#if TRACKLE_TIME_MAX_DRIFT_PPM > 30000
+#error "TRACKLE_TIME_MAX_DRIFT_PPM must be at most 30000"
+#endif
+
+// the base is moved forward at least this often, so that delta * rateQ32 fits 64 bits (about 19 hours)
+#define TIME_REBASE_US (1LL << 36)
+
+// wall = baseWallUs + delta + (delta * rateQ32 >> 32), with delta = mono - baseMonoUs and rateQ32 the
+// drift in 2^-32 units (driftPpm * 2^32 / 10^6, computed at sync)
+static int64_t baseWallUs = 0;
+static int64_t baseMonoUs = 0;
+static int64_t rateQ32 = 0;
+static bool synced = false;
+
+// last sync, to estimate the drift
+static int64_t syncWallUs = 0;
+static int64_t syncMonoUs = 0;
+
+static TrackleTime_Status timeStatus;
+
+static portMUX_TYPE timeMux = portMUX_INITIALIZER_UNLOCKED;
+
+static int64_t wallUs(int64_t monoUs)
+{
+    int64_t delta = monoUs - baseMonoUs;
+    int64_t wall = baseWallUs;
+    // only if the time wasn't read for a day: a step per rebase period
+    while (delta > TIME_REBASE_US)
+    {
+        wall += TIME_REBASE_US + ((TIME_REBASE_US * rateQ32) >> 32);
+        delta -= TIME_REBASE_US;
+    }
+    return wall + delta + ((delta * rateQ32) >> 32);
+}
+
+int64_t trackleTimeNowMs()
+{
+    if (!synced)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    }
+
+    const int64_t monoUs = esp_timer_get_time();
+    portENTER_CRITICAL(&timeMux);
+    const int64_t now = wallUs(monoUs);
+    if (monoUs - baseMonoUs >= TIME_REBASE_US)
+    {
+        baseWallUs = now;
+        baseMonoUs = monoUs;
+    }
+    portEXIT_CRITICAL(&timeMux);
+    return now / 1000;
+}
+
+bool trackleTimeIsSynced()
+{
+    return synced;
+}
+
+void trackleTimeGetStatus(TrackleTime_Status *status)
+{
+    portENTER_CRITICAL(&timeMux);
+    *status = timeStatus;
+    portEXIT_CRITICAL(&timeMux);
+}
+
+void trackleTimeSync(time_t cloudTime)
+{
+    const int64_t monoUs = esp_timer_get_time();
+
+    // the time was taken by the server about half a round trip ago
+    TrackleRtt_Stats rtt;
+    trackleRttGetStats(&rtt);
+    const int64_t cloudUs = (int64_t)cloudTime * 1000000 + (int64_t)rtt.srttMs * 500;
+
+    int32_t driftPpm = timeStatus.driftPpm;
+    if (synced && monoUs - syncMonoUs >= (int64_t)TRACKLE_TIME_DRIFT_MIN_INTERVAL_MS * 1000)
+    {
+        const int64_t monoDelta = monoUs - syncMonoUs;
+        int64_t measured = (cloudUs - syncWallUs - monoDelta) * 1000000 / monoDelta;
+        if (measured > TRACKLE_TIME_MAX_DRIFT_PPM)
+            measured = TRACKLE_TIME_MAX_DRIFT_PPM;
+        else if (measured < -TRACKLE_TIME_MAX_DRIFT_PPM)
+            measured = -TRACKLE_TIME_MAX_DRIFT_PPM;
+        // smooth, a single sync has 1 s resolution
+        driftPpm = timeStatus.syncs > 1 ? (3 * driftPpm + (int32_t)measured) / 4 : (int32_t)measured;
+        syncWallUs = cloudUs;
+        syncMonoUs = monoUs;
+    }
+    else if (!synced)
+    {
+        syncWallUs = cloudUs;
+        syncMonoUs = monoUs;
+    }
+
+    portENTER_CRITICAL(&timeMux);
+    const int64_t offsetUs = synced ? cloudUs - wallUs(monoUs) : 0;
+    baseWallUs = cloudUs;
+    baseMonoUs = monoUs;
+    rateQ32 = (int64_t)driftPpm * (1LL << 32) / 1000000;
+    synced = true;
+    timeStatus.synced = true;
+    timeStatus.syncs++;
+    timeStatus.lastSyncMillis = monoUs / 1000;
+    timeStatus.lastOffsetMs = offsetUs / 1000;
+    timeStatus.driftPpm = driftPpm;
+    portEXIT_CRITICAL(&timeMux);
+
+    const struct timeval tv = {
+        .tv_sec = cloudUs / 1000000,
+        .tv_usec = cloudUs % 1000000,
+    };
+    settimeofday(&tv, NULL);
+    ESP_LOGI(TIME_TAG, "time synced: %lld, offset %" PRId32 " ms, drift %" PRId32 " ppm", (long long)cloudTime, timeStatus.lastOffsetMs, driftPpm);
+}
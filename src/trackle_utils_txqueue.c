@@ -0,0 +1,120 @@
+#include "trackle_utils_txqueue.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <esp_log.h>
+
+#include "trackle_esp32.h"
+#include "trackle_utils_rtt.h"
+
+static const char *TXQUEUE_TAG = "trackle-utils-txqueue";
+
+typedef struct
+{
+    uint32_t deadline;
+    uint16_t len;
+    uint8_t data[TRACKLE_TXQ_SLOT_SIZE];
+} TxSlot_t;
+
+// used with xTrackleSemaphore taken, except txCount that trackleTxQueueCongested reads without it:
+// an aligned word, only written under the semaphore
+static TxSlot_t txSlots[TRACKLE_TXQ_SLOTS];
+static size_t txHead = 0;
+static volatile size_t txCount = 0;
+static TrackleTxQueue_Stats txStats;
+
+static bool isTransient(int err)
+{
+    return err == ENOMEM || err == ENOBUFS || err == EAGAIN || err == EWOULDBLOCK;
+}
+
+static void pop()
+{
+    txHead = (txHead + 1) % TRACKLE_TXQ_SLOTS;
+    txCount--;
+}
+
+size_t trackleTxQueueFlush(int sock, const struct sockaddr_in *addr)
+{
+    const uint32_t now = getMillis();
+    while (txCount > 0)
+    {
+        const TxSlot_t *slot = &txSlots[txHead];
+        if ((int32_t)(now - slot->deadline) > 0)
+        {
+            txStats.dropped++;
+            pop();
+            continue;
+        }
+
+        const int res = sendto(sock, slot->data, slot->len, 0, (const struct sockaddr *)addr, sizeof(*addr));
+        if (res < 0 && isTransient(errno))
+            break;
+        if (res < 0)
+            txStats.dropped++;
+        else
+            txStats.retried++;
+        pop();
+    }
+    return txCount;
+}
+
+int trackleTxQueueSend(int sock, const struct sockaddr_in *addr, const uint8_t *buf, size_t len)
+{
+    // keep datagrams in order: nothing goes out directly while older ones are waiting
+    if (trackleTxQueueFlush(sock, addr) == 0)
+    {
+        const int res = sendto(sock, buf, len, 0, (const struct sockaddr *)addr, sizeof(*addr));
+        if (res >= 0 || !isTransient(errno))
+            return res;
+    }
+
+    // lost like before, the library recovers it with a CoAP retransmission
+    if (len > TRACKLE_TXQ_SLOT_SIZE || txCount == TRACKLE_TXQ_SLOTS)
+    {
+        txStats.dropped++;
+        ESP_LOGW(TXQUEUE_TAG, "dropping datagram of %u bytes", (unsigned)len);
+        return TRACKLE_TXQ_DROPPED;
+    }
+
+    TxSlot_t *slot = &txSlots[(txHead + txCount) % TRACKLE_TXQ_SLOTS];
+    memcpy(slot->data, buf, len);
+    slot->len = len;
+    slot->deadline = getMillis() + trackleRttGetRto();
+    txCount++;
+    txStats.deferred++;
+    if (txCount > txStats.maxQueued)
+        txStats.maxQueued = txCount;
+    ESP_LOGD(TXQUEUE_TAG, "deferred datagram of %u bytes, %u queued", (unsigned)len, (unsigned)txCount);
+    return len;
+}
+
+void trackleTxQueueClear()
+{
+    txHead = 0;
+    txCount = 0;
+}
+
+bool trackleTxQueueCongested()
+{
+    return txCount >= TRACKLE_TXQ_HIGH_WATERMARK;
+}
+
+bool trackleTxQueueAccepting()
+{
+    if (!trackleTxQueueCongested())
+        return true;
+    txStats.rejected++;
+    return false;
+}
+
+void trackleTxQueueGetStats(TrackleTxQueue_Stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
+    {
+        *stats = txStats;
+        xSemaphoreGive(xTrackleSemaphore);
+    }
+}
@@ -0,0 +1,432 @@
+#include "trackle_utils_writer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NINT 1
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+#define CBOR_NULL 0xF6
+#define CBOR_FLOAT32 0xFA
+#define CBOR_FLOAT64 0xFB
+#define CBOR_INDEFINITE 0x1F
+#define CBOR_BREAK 0xFF
+
+static bool isJson(const TrackleWriter_t *w)
+{
+    return w->format == TRACKLE_WRITER_JSON;
+}
+
+static void flushChunk(TrackleWriter_t *w)
+{
+    if (w->used == 0)
+        return;
+    if (w->chunkCb(w->buf, w->used, w->chunkCtx) < 0)
+        w->failed = true;
+    w->flushed += w->used;
+    w->used = 0;
+}
+
+static void put(TrackleWriter_t *w, const void *data, size_t len)
+{
+    if (w->chunkCb == NULL)
+    {
+        // buffer mode: after truncation keep counting, so that the caller knows the required size
+        const size_t capacity = w->size - (isJson(w) && w->size > 0 ? 1 : 0);
+        if (!w->failed && w->used + len <= capacity)
+        {
+            memcpy(w->buf + w->used, data, len);
+            w->used += len;
+        }
+        else
+        {
+            w->failed = true;
+            w->flushed += len;
+        }
+        return;
+    }
+
+    const uint8_t *p = (const uint8_t *)data;
+    while (len > 0 && !w->failed)
+    {
+        size_t n = w->size - w->used;
+        if (n > len)
+            n = len;
+        memcpy(w->buf + w->used, p, n);
+        w->used += n;
+        p += n;
+        len -= n;
+        if (w->used == w->size)
+            flushChunk(w);
+    }
+}
+
+static void putByte(TrackleWriter_t *w, uint8_t b)
+{
+    put(w, &b, 1);
+}
+
+static void putCborHead(TrackleWriter_t *w, uint8_t major, uint64_t value)
+{
+    uint8_t head[9];
+    size_t n;
+    if (value < 24)
+    {
+        head[0] = (major << 5) | (uint8_t)value;
+        n = 1;
+    }
+    else if (value <= 0xFF)
+    {
+        head[0] = (major << 5) | 24;
+        head[1] = (uint8_t)value;
+        n = 2;
+    }
+    else if (value <= 0xFFFF)
+    {
+        head[0] = (major << 5) | 25;
+        head[1] = (uint8_t)(value >> 8);
+        head[2] = (uint8_t)value;
+        n = 3;
+    }
+    else if (value <= 0xFFFFFFFFULL)
+    {
+        head[0] = (major << 5) | 26;
+        for (int i = 0; i < 4; i++)
+            head[1 + i] = (uint8_t)(value >> (24 - 8 * i));
+        n = 5;
+    }
+    else
+    {
+        head[0] = (major << 5) | 27;
+        for (int i = 0; i < 8; i++)
+            head[1 + i] = (uint8_t)(value >> (56 - 8 * i));
+        n = 9;
+    }
+    put(w, head, n);
+}
+
+// Emits the separator needed before a value or a key at the current nesting level.
+static void beginItem(TrackleWriter_t *w)
+{
+    if (w->afterKey)
+    {
+        w->afterKey = false;
+        return;
+    }
+    if (w->depth == 0)
+        return;
+
+    const uint32_t bit = 1UL << (w->depth - 1);
+    if ((w->hasItems & bit) && isJson(w))
+        putByte(w, ',');
+    w->hasItems |= bit;
+}
+
+static void putJsonString(TrackleWriter_t *w, const char *value, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    putByte(w, '"');
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        const unsigned char c = (unsigned char)value[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        put(w, value + start, i - start);
+        start = i + 1;
+
+        char esc[6] = {'\\', 0, 0, 0, 0, 0};
+        size_t escLen = 2;
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            esc[1] = c;
+            break;
+        case '\b':
+            esc[1] = 'b';
+            break;
+        case '\f':
+            esc[1] = 'f';
+            break;
+        case '\n':
+            esc[1] = 'n';
+            break;
+        case '\r':
+            esc[1] = 'r';
+            break;
+        case '\t':
+            esc[1] = 't';
+            break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0xF];
+            escLen = 6;
+            break;
+        }
+        put(w, esc, escLen);
+    }
+    put(w, value + start, len - start);
+    putByte(w, '"');
+}
+
+static void putString(TrackleWriter_t *w, const char *value, size_t len)
+{
+    if (isJson(w))
+    {
+        putJsonString(w, value, len);
+    }
+    else
+    {
+        putCborHead(w, CBOR_MAJOR_TEXT, len);
+        put(w, value, len);
+    }
+}
+
+static void beginContainer(TrackleWriter_t *w, uint8_t major, char open)
+{
+    beginItem(w);
+    if (w->depth >= TRACKLE_WRITER_MAX_DEPTH)
+    {
+        w->failed = true;
+        return;
+    }
+    if (isJson(w))
+        putByte(w, open);
+    else
+        putByte(w, (major << 5) | CBOR_INDEFINITE);
+    w->depth++;
+    w->hasItems &= ~(1UL << (w->depth - 1));
+}
+
+static void endContainer(TrackleWriter_t *w, char close)
+{
+    if (w->depth == 0 || w->afterKey)
+    {
+        w->failed = true;
+        return;
+    }
+    putByte(w, isJson(w) ? close : CBOR_BREAK);
+    w->depth--;
+}
+
+void trackleWriterInit(TrackleWriter_t *w, TrackleWriter_Format format, uint8_t *buf, size_t size)
+{
+    memset(w, 0, sizeof(*w));
+    w->format = format;
+    w->buf = buf;
+    w->size = size;
+    if (format == TRACKLE_WRITER_JSON && size > 0)
+        buf[0] = '\0';
+}
+
+void trackleWriterInitChunked(TrackleWriter_t *w, TrackleWriter_Format format, uint8_t *scratch, size_t scratchSize, TrackleWriter_ChunkCb chunkCb, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->format = format;
+    w->buf = scratch;
+    w->size = scratchSize;
+    w->chunkCb = chunkCb;
+    w->chunkCtx = ctx;
+    if (scratchSize == 0 || chunkCb == NULL)
+        w->failed = true;
+}
+
+void trackleWriterBeginObject(TrackleWriter_t *w)
+{
+    beginContainer(w, CBOR_MAJOR_MAP, '{');
+}
+
+void trackleWriterEndObject(TrackleWriter_t *w)
+{
+    endContainer(w, '}');
+}
+
+void trackleWriterBeginArray(TrackleWriter_t *w)
+{
+    beginContainer(w, CBOR_MAJOR_ARRAY, '[');
+}
+
+void trackleWriterEndArray(TrackleWriter_t *w)
+{
+    endContainer(w, ']');
+}
+
+void trackleWriterKey(TrackleWriter_t *w, const char *key)
+{
+    if (w->depth == 0 || w->afterKey)
+    {
+        w->failed = true;
+        return;
+    }
+    beginItem(w);
+    putString(w, key, strlen(key));
+    if (isJson(w))
+        putByte(w, ':');
+    w->afterKey = true;
+}
+
+void trackleWriterString(TrackleWriter_t *w, const char *value)
+{
+    if (value == NULL)
+    {
+        trackleWriterNull(w);
+        return;
+    }
+    trackleWriterStringN(w, value, strlen(value));
+}
+
+void trackleWriterStringN(TrackleWriter_t *w, const char *value, size_t len)
+{
+    beginItem(w);
+    putString(w, value, len);
+}
+
+void trackleWriterInt(TrackleWriter_t *w, int64_t value)
+{
+    beginItem(w);
+    if (isJson(w))
+    {
+        char num[21];
+        const int n = snprintf(num, sizeof(num), "%lld", (long long)value);
+        put(w, num, n);
+    }
+    else if (value >= 0)
+    {
+        putCborHead(w, CBOR_MAJOR_UINT, (uint64_t)value);
+    }
+    else
+    {
+        putCborHead(w, CBOR_MAJOR_NINT, ~(uint64_t)value); // -1 - value, without overflow
+    }
+}
+
+void trackleWriterDouble(TrackleWriter_t *w, double value)
+{
+    if (isJson(w))
+    {
+        if (isnan(value) || isinf(value))
+        {
+            trackleWriterNull(w);
+            return;
+        }
+        beginItem(w);
+
+        // shortest of the two precisions that reads back to the same value
+        char num[32];
+        int n = snprintf(num, sizeof(num), "%.15g", value);
+        if (strtod(num, NULL) != value)
+            n = snprintf(num, sizeof(num), "%.17g", value);
+        put(w, num, n);
+        return;
+    }
+
+    beginItem(w);
+    const float f = (float)value;
+    if ((double)f == value || isnan(value))
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        uint8_t out[5] = {CBOR_FLOAT32, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits};
+        put(w, out, sizeof(out));
+    }
+    else
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint8_t out[9];
+        out[0] = CBOR_FLOAT64;
+        for (int i = 0; i < 8; i++)
+            out[1 + i] = (uint8_t)(bits >> (56 - 8 * i));
+        put(w, out, sizeof(out));
+    }
+}
+
+void trackleWriterFloat(TrackleWriter_t *w, float value)
+{
+    if (!isJson(w))
+    {
+        trackleWriterDouble(w, value); // always fits a CBOR float32
+        return;
+    }
+    if (isnan(value) || isinf(value))
+    {
+        trackleWriterNull(w);
+        return;
+    }
+    beginItem(w);
+
+    // as for doubles, "21.1" rather than the exact value of the float "21.100000381469727"
+    char num[24];
+    int n = snprintf(num, sizeof(num), "%.7g", value);
+    if (strtof(num, NULL) != value)
+        n = snprintf(num, sizeof(num), "%.9g", value);
+    put(w, num, n);
+}
+
+void trackleWriterBool(TrackleWriter_t *w, bool value)
+{
+    beginItem(w);
+    if (isJson(w))
+        put(w, value ? "true" : "false", value ? 4 : 5);
+    else
+        putByte(w, value ? CBOR_TRUE : CBOR_FALSE);
+}
+
+void trackleWriterNull(TrackleWriter_t *w)
+{
+    beginItem(w);
+    if (isJson(w))
+        put(w, "null", 4);
+    else
+        putByte(w, CBOR_NULL);
+}
+
+void trackleWriterRaw(TrackleWriter_t *w, const uint8_t *data, size_t len)
+{
+    beginItem(w);
+    put(w, data, len);
+}
+
+int trackleWriterFinish(TrackleWriter_t *w)
+{
+    if (w->depth != 0 || w->afterKey)
+        w->failed = true;
+
+    if (w->chunkCb != NULL)
+    {
+        if (!w->failed)
+            flushChunk(w);
+    }
+    else if (isJson(w) && w->size > 0)
+    {
+        // never leave a partial document around that could be mistaken for a valid one
+        w->buf[w->failed ? 0 : w->used] = '\0';
+    }
+
+    if (w->failed)
+        return -1;
+    return (int)trackleWriterLength(w);
+}
+
+size_t trackleWriterLength(const TrackleWriter_t *w)
+{
+    return w->flushed + w->used;
+}
+
+bool trackleWriterFailed(const TrackleWriter_t *w)
+{
+    return w->failed;
+}
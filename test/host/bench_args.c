@@ -0,0 +1,105 @@
+/**
+ * Time spent parsing a typical condition argument ("<name>,<op>,<value>,<action>,<value>") with the
+ * zero-copy parser, compared to the copy + strtok_r + atoi code it replaced. Both results are checked
+ * to be the same.
+ *
+ * Usage: bench_args [iterations]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "test_host.h"
+#include "trackle_utils_args.h"
+
+#define ARGS "temp,>=,1234,alarm,-42"
+
+typedef struct
+{
+    char name[16];
+    TrackleCompare_Op op;
+    int32_t threshold;
+    char action[16];
+    int32_t value;
+} Condition_t;
+
+static bool parseArgs(const char *input, Condition_t *c)
+{
+    TrackleArgs_t args;
+    TrackleStr_t token;
+    trackleArgsInit(&args, input, ',');
+    if (!trackleArgsNext(&args, &token) || !trackleStrCopy(token, c->name, sizeof(c->name)))
+        return false;
+    if (!trackleArgsNext(&args, &token) || (c->op = trackleCompareOpParse(token)) == TRACKLE_CMP_INVALID)
+        return false;
+    if (!trackleArgsNextInt32(&args, &c->threshold))
+        return false;
+    if (!trackleArgsNext(&args, &token) || !trackleStrCopy(token, c->action, sizeof(c->action)))
+        return false;
+    return trackleArgsNextInt32(&args, &c->value);
+}
+
+static bool parseStrtok(const char *input, Condition_t *c)
+{
+    char copy[64];
+    char *save;
+    strncpy(copy, input, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+
+    const char *name = strtok_r(copy, ",", &save);
+    const char *op = strtok_r(NULL, ",", &save);
+    const char *threshold = strtok_r(NULL, ",", &save);
+    const char *action = strtok_r(NULL, ",", &save);
+    const char *value = strtok_r(NULL, ",", &save);
+    if (value == NULL || strlen(name) >= sizeof(c->name) || strlen(action) >= sizeof(c->action))
+        return false;
+
+    strcpy(c->name, name);
+    if (strcmp(op, "<") == 0)
+        c->op = TRACKLE_CMP_LT;
+    else if (strcmp(op, "<=") == 0)
+        c->op = TRACKLE_CMP_LE;
+    else if (strcmp(op, ">") == 0)
+        c->op = TRACKLE_CMP_GT;
+    else if (strcmp(op, ">=") == 0)
+        c->op = TRACKLE_CMP_GE;
+    else if (strcmp(op, "=") == 0)
+        c->op = TRACKLE_CMP_EQ;
+    else
+        return false;
+    c->threshold = atoi(threshold);
+    strcpy(c->action, action);
+    c->value = atoi(value);
+    return true;
+}
+
+static double nsPerCall(bool (*parse)(const char *, Condition_t *), long iterations, Condition_t *c)
+{
+    // volatile: the input must be read again at every iteration
+    static const char *volatile input = ARGS;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++)
+        CHECK(parse(input, c));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    const long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    Condition_t parsed, reference;
+    memset(&parsed, 0, sizeof(parsed));
+    memset(&reference, 0, sizeof(reference));
+
+    const double argsNs = nsPerCall(parseArgs, iterations, &parsed);
+    const double strtokNs = nsPerCall(parseStrtok, iterations, &reference);
+    CHECK(memcmp(&parsed, &reference, sizeof(parsed)) == 0);
+    CHECK(strcmp(parsed.name, "temp") == 0 && parsed.op == TRACKLE_CMP_GE && parsed.threshold == 1234 && parsed.value == -42);
+
+    printf("\"%s\", %ld iterations\n", ARGS, iterations);
+    printf("  trackleArgs:            %6.1f ns per call\n", argsNs);
+    printf("  copy + strtok_r + atoi: %6.1f ns per call\n", strtokNs);
+    return 0;
+}
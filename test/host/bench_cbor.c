@@ -0,0 +1,153 @@
+/**
+ * Size on the wire and encode time of representative telemetry, as JSON text and as the text form of
+ * CBOR the Trackle library carries ("cbor:" + base64). Both documents are written with the
+ * TrackleWriter from the same values; the CBOR one is checked to read back.
+ *
+ * Usage: bench_cbor [iterations]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "test_host.h"
+#include "trackle_utils_cbor.h"
+#include "trackle_utils_writer.h"
+
+#define MAX_DOC 600
+
+typedef void (*Payload_t)(TrackleWriter_t *w);
+
+// a few sensors read once a minute
+static void sensors(TrackleWriter_t *w)
+{
+    trackleWriterBeginObject(w);
+    trackleWriterKey(w, "temp");
+    trackleWriterFloat(w, 21.5f);
+    trackleWriterKey(w, "hum");
+    trackleWriterInt(w, 48);
+    trackleWriterKey(w, "bat");
+    trackleWriterFloat(w, 3.71f);
+    trackleWriterKey(w, "rssi");
+    trackleWriterInt(w, -67);
+    trackleWriterKey(w, "door");
+    trackleWriterBool(w, false);
+    trackleWriterEndObject(w);
+}
+
+// the state a device syncs: mostly strings and flags
+static void state(TrackleWriter_t *w)
+{
+    trackleWriterBeginObject(w);
+    trackleWriterKey(w, "fw");
+    trackleWriterString(w, "2.3.1");
+    trackleWriterKey(w, "mode");
+    trackleWriterString(w, "auto");
+    trackleWriterKey(w, "setpoint");
+    trackleWriterFloat(w, 20.5f);
+    trackleWriterKey(w, "uptime");
+    trackleWriterInt(w, 864123);
+    trackleWriterKey(w, "alarms");
+    trackleWriterBeginArray(w);
+    trackleWriterString(w, "filter");
+    trackleWriterEndArray(w);
+    trackleWriterKey(w, "relay");
+    trackleWriterBool(w, true);
+    trackleWriterKey(w, "ssid");
+    trackleWriterString(w, "office-2g");
+    trackleWriterEndObject(w);
+}
+
+// a minute of readings at 1 Hz, one decimal
+static void floatSeries(TrackleWriter_t *w)
+{
+    trackleWriterBeginObject(w);
+    trackleWriterKey(w, "t");
+    trackleWriterInt(w, 1700000000000LL);
+    trackleWriterKey(w, "v");
+    trackleWriterBeginArray(w);
+    for (int i = 0; i < 60; i++)
+        trackleWriterFloat(w, (200 + (i * 7) % 23) / 10.0f);
+    trackleWriterEndArray(w);
+    trackleWriterEndObject(w);
+}
+
+// the same minute as integer tenths
+static void intSeries(TrackleWriter_t *w)
+{
+    trackleWriterBeginObject(w);
+    trackleWriterKey(w, "t");
+    trackleWriterInt(w, 1700000000000LL);
+    trackleWriterKey(w, "v");
+    trackleWriterBeginArray(w);
+    for (int i = 0; i < 60; i++)
+        trackleWriterInt(w, 200 + (i * 7) % 23);
+    trackleWriterEndArray(w);
+    trackleWriterEndObject(w);
+}
+
+static char json[MAX_DOC + 1];
+static uint8_t cbor[MAX_DOC];
+static uint8_t decoded[MAX_DOC];
+static char text[TRACKLE_CBOR_TEXT_SIZE(MAX_DOC)];
+
+static int writeJson(Payload_t payload)
+{
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+    payload(&w);
+    return trackleWriterFinish(&w);
+}
+
+static int writeCborText(Payload_t payload, int *cborLen)
+{
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_CBOR, cbor, sizeof(cbor));
+    payload(&w);
+    *cborLen = trackleWriterFinish(&w);
+    return *cborLen < 0 ? *cborLen : trackleCborToText(cbor, *cborLen, text, sizeof(text));
+}
+
+static double nsPerCall(Payload_t payload, bool asCbor, long iterations)
+{
+    struct timespec start, end;
+    volatile int sink = 0;
+    int cborLen;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++)
+        sink += asCbor ? writeCborText(payload, &cborLen) : writeJson(payload);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    (void)sink;
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / iterations;
+}
+
+static void bench(const char *name, Payload_t payload, long iterations)
+{
+    const int jsonLen = writeJson(payload);
+    int cborLen;
+    const int textLen = writeCborText(payload, &cborLen);
+    CHECK(jsonLen > 0 && textLen > 0);
+
+    // the text form reads back to the same document
+    CHECK(trackleCborFromText(text, decoded, sizeof(decoded)) == cborLen);
+    CHECK(memcmp(decoded, cbor, cborLen) == 0);
+    TrackleCborReader_t r;
+    trackleCborReaderInit(&r, decoded, cborLen);
+    CHECK(trackleCborSkip(&r) && trackleCborPeek(&r) == TRACKLE_CBOR_END);
+
+    const double jsonNs = nsPerCall(payload, false, iterations);
+    const double cborNs = nsPerCall(payload, true, iterations);
+    printf("  %-12s json %4d, cbor %4d bytes, cbor: text %4d (%+4.0f%% vs json); encode json %6.0f ns, cbor: text %6.0f ns\n",
+           name, jsonLen, cborLen, textLen, 100.0 * (textLen - jsonLen) / jsonLen, jsonNs, cborNs);
+}
+
+int main(int argc, char **argv)
+{
+    const long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    printf("%ld iterations\n", iterations);
+    bench("sensors", sensors, iterations);
+    bench("state", state, iterations);
+    bench("float series", floatSeries, iterations);
+    bench("int series", intSeries, iterations);
+    return 0;
+}
@@ -0,0 +1,179 @@
+/**
+ * Throughput of the table-driven codec compared to the functions it replaced: hexToString (nibble by
+ * nibble), stringToHex (sscanf per byte) and the bit accumulator base64 decoder of the CBOR helpers.
+ * Outputs are checked to be the same.
+ *
+ * Usage: bench_codec [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "test_host.h"
+#include "trackle_utils_codec.h"
+
+#define MAX_LEN 256
+
+// the functions replaced by the codec, as they were
+
+static void legacyHexToString(unsigned char *in, size_t insz, char *out, size_t outz)
+{
+    memset(out, 0, outz);
+    unsigned char *pin = in;
+    const char *hex = "0123456789abcdef";
+    char *pout = out;
+    for (; pin < in + insz; pout += 2, pin++)
+    {
+        pout[0] = hex[(*pin >> 4) & 0xF];
+        pout[1] = hex[*pin & 0xF];
+    }
+}
+
+static int legacyStringToHex(char *hex_str, unsigned char *byte_array, int byte_array_max)
+{
+    int hex_str_len = strlen(hex_str);
+    int i = 0, j = 0;
+    int byte_array_size = (hex_str_len + 1) / 2;
+    if (byte_array_size > byte_array_max)
+        return -1;
+    if (hex_str_len % 2 == 1)
+    {
+        if (sscanf(&(hex_str[0]), "%1hhx", &(byte_array[0])) != 1)
+            return -1;
+        i = j = 1;
+    }
+    for (; i < hex_str_len; i += 2, j++)
+    {
+        if (sscanf(&(hex_str[i]), "%2hhx", &(byte_array[j])) != 1)
+            return -1;
+    }
+    return byte_array_size;
+}
+
+static int legacyBase64Value(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+static int legacyBase64Decode(const char *text, uint8_t *out, size_t outSize)
+{
+    size_t len = strlen(text);
+    if (len % 4 != 0)
+        return -1;
+    while (len > 0 && text[len - 1] == '=')
+        len--;
+    if (len * 3 / 4 > outSize)
+        return -2;
+
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t o = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        const int v = legacyBase64Value(text[i]);
+        if (v < 0)
+            return -1;
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out[o++] = (uint8_t)(acc >> bits);
+        }
+    }
+    return (int)o;
+}
+
+static uint8_t bytes[MAX_LEN];
+static uint8_t decoded[MAX_LEN];
+static char hexText[TRACKLE_HEX_ENCODED_LEN(MAX_LEN) + 1];
+static char legacyHexText[TRACKLE_HEX_ENCODED_LEN(MAX_LEN) + 1];
+static char base64Text[TRACKLE_BASE64_ENCODED_LEN(MAX_LEN) + 1];
+
+static double elapsedNs(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec);
+}
+
+static void report(const char *what, size_t len, double newNs, double legacyNs, long iterations)
+{
+    printf("  %-14s %3zu bytes: %8.1f ns, legacy %8.1f ns (%.1fx)\n", what, len, newNs / iterations,
+           legacyNs / iterations, legacyNs / newNs);
+}
+
+static void bench(size_t len, long iterations)
+{
+    struct timespec start;
+    volatile int sink = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++)
+        sink += trackleHexEncode(bytes, len, hexText, sizeof(hexText));
+    const double encodeNs = elapsedNs(&start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++)
+    {
+        legacyHexToString(bytes, len, legacyHexText, sizeof(legacyHexText));
+        sink += legacyHexText[0];
+    }
+    const double legacyEncodeNs = elapsedNs(&start);
+    CHECK(strcmp(hexText, legacyHexText) == 0);
+    report("hex encode", len, encodeNs, legacyEncodeNs, iterations);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++)
+        sink += trackleHexDecode(hexText, 2 * len, decoded, sizeof(decoded));
+    const double decodeNs = elapsedNs(&start);
+    CHECK(memcmp(decoded, bytes, len) == 0);
+    memset(decoded, 0, sizeof(decoded));
+    // sscanf is slow: fewer rounds, scaled
+    const long legacyIterations = iterations / 10 > 0 ? iterations / 10 : 1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < legacyIterations; i++)
+        sink += legacyStringToHex(hexText, decoded, sizeof(decoded));
+    const double legacyDecodeNs = elapsedNs(&start) * iterations / legacyIterations;
+    CHECK(memcmp(decoded, bytes, len) == 0);
+    report("hex decode", len, decodeNs, legacyDecodeNs, iterations);
+
+    const int textLen = trackleBase64Encode(bytes, len, base64Text, sizeof(base64Text));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++)
+        sink += trackleBase64Decode(base64Text, textLen, decoded, sizeof(decoded));
+    const double base64Ns = elapsedNs(&start);
+    CHECK(memcmp(decoded, bytes, len) == 0);
+    memset(decoded, 0, sizeof(decoded));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++)
+        sink += legacyBase64Decode(base64Text, decoded, sizeof(decoded));
+    const double legacyBase64Ns = elapsedNs(&start);
+    CHECK(memcmp(decoded, bytes, len) == 0);
+    report("base64 decode", len, base64Ns, legacyBase64Ns, iterations);
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    const long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    srand(1);
+    for (size_t i = 0; i < MAX_LEN; i++)
+        bytes[i] = rand();
+
+    printf("%ld iterations\n", iterations);
+    bench(12, iterations); // a device ID
+    bench(MAX_LEN, iterations);
+    return 0;
+}
@@ -0,0 +1,350 @@
+/**
+ * The slab pools under a heap tracer: the benchmark stands in for heap_caps_malloc/realloc/free and
+ * records every call and every live block. The same emulated cloud session (DTLS handshakes, a JSON
+ * event per exchange, datagrams waiting in the retransmission queue) runs once on the heap alone, as
+ * without the pools, and once through the pools with the cJSON hooks installed. For each run: heap
+ * calls and peak heap bytes, and for the pools the usage, peak, allocations and failures of each
+ * class. Then the fallbacks: an exhausted class, SPIRAM, and the no-heap mode.
+ *
+ * Sizes are those of the ESP32 (32-bit pointers); the tinydtls ones are approximate.
+ *
+ * Usage: bench_pool [exchanges]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cJSON.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+#include "test_host.h"
+#include "trackle_utils_pool.h"
+
+#define MAX_LIVE 1024
+#define MAX_CLASSES 8
+
+#define PEER_SIZE 120
+#define HANDSHAKE_SIZE 640 // hash contexts and randoms, only during the handshake
+#define SECURITY_SIZE 140  // current and pending cipher state
+#define NETQ_SIZE 24       // retransmission node, followed by the datagram
+#define JSON_NODE_SIZE 40  // sizeof(cJSON)
+#define JSON_PRINT_SIZE 256 // first buffer of cJSON_PrintUnformatted
+#define HANDSHAKE_EVERY 500 // exchanges per DTLS session
+#define IN_FLIGHT 4         // datagrams waiting for their ack
+
+typedef struct
+{
+    void *ptr;
+    size_t size;
+    bool spiram;
+} Block_t;
+
+typedef struct
+{
+    uint32_t mallocs;
+    uint32_t reallocs;
+    uint32_t frees;
+    size_t inUse;
+    size_t peak;
+} Trace_t;
+
+static Block_t live[MAX_LIVE];
+static size_t liveCount = 0;
+static Trace_t trace;
+
+static Block_t *findBlock(const void *ptr)
+{
+    for (size_t i = 0; i < liveCount; i++)
+    {
+        if (live[i].ptr == ptr)
+            return &live[i];
+    }
+    return NULL;
+}
+
+static void track(size_t size)
+{
+    trace.inUse += size;
+    if (trace.inUse > trace.peak)
+        trace.peak = trace.inUse;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    CHECK(liveCount < MAX_LIVE);
+    void *ptr = malloc(size);
+    CHECK(ptr != NULL);
+    live[liveCount++] = (Block_t){ptr, size, (caps & MALLOC_CAP_SPIRAM) != 0};
+    trace.mallocs++;
+    track(size);
+    return ptr;
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    Block_t *block = findBlock(ptr);
+    CHECK(block != NULL);
+    void *bigger = realloc(ptr, size);
+    CHECK(bigger != NULL);
+    trace.inUse -= block->size;
+    track(size);
+    block->ptr = bigger;
+    block->size = size;
+    trace.reallocs++;
+    return bigger;
+}
+
+void heap_caps_free(void *ptr)
+{
+    Block_t *block = findBlock(ptr);
+    CHECK(block != NULL);
+    trace.inUse -= block->size;
+    trace.frees++;
+    free(ptr);
+    *block = live[--liveCount];
+}
+
+bool esp_ptr_external_ram(const void *p)
+{
+    const Block_t *block = findBlock(p);
+    return block != NULL && block->spiram;
+}
+
+// cJSON allocates through its hooks, or from the heap until they are installed
+static void *heapMalloc(size_t size)
+{
+    return heap_caps_malloc(size, MALLOC_CAP_8BIT);
+}
+
+static cJSON_Hooks jsonHooks = {heapMalloc, heap_caps_free};
+
+void cJSON_InitHooks(cJSON_Hooks *hooks)
+{
+    jsonHooks = *hooks;
+}
+
+typedef struct
+{
+    void *(*malloc_fn)(size_t size);
+    void (*free_fn)(void *ptr);
+} Allocator_t;
+
+static void *alloc(const Allocator_t *a, size_t size)
+{
+    void *ptr = a->malloc_fn(size);
+    CHECK(ptr != NULL);
+    memset(ptr, 0xA5, size);
+    return ptr;
+}
+
+static void release(const Allocator_t *a, void **ptr)
+{
+    a->free_fn(*ptr);
+    *ptr = NULL;
+}
+
+// a published event: a tree of nodes and keys, printed, the tree freed, then the text
+static size_t jsonEvent(const Allocator_t *json)
+{
+    void *nodes[16], *keys[16];
+    const int count = 4 + rand() % 12;
+    size_t len = 2;
+    nodes[0] = alloc(json, JSON_NODE_SIZE);
+    for (int i = 1; i < count; i++)
+    {
+        const size_t keyLen = 2 + rand() % 12;
+        nodes[i] = alloc(json, JSON_NODE_SIZE);
+        keys[i] = alloc(json, keyLen + 1);
+        len += keyLen + 4 + rand() % 10;
+    }
+    void *buffer = alloc(json, JSON_PRINT_SIZE);
+    void *printed = alloc(json, len + 1);
+    release(json, &buffer);
+    for (int i = 1; i < count; i++)
+    {
+        release(json, &nodes[i]);
+        release(json, &keys[i]);
+    }
+    release(json, &nodes[0]);
+    release(json, &printed);
+    return len;
+}
+
+static void session(const Allocator_t *stack, const Allocator_t *json, int exchanges)
+{
+    void *peer = NULL, *security[2] = {NULL, NULL}, *handshake = NULL;
+    void *inFlight[IN_FLIGHT] = {NULL};
+    int handshakeLeft = 0;
+    for (int i = 0; i < exchanges; i++)
+    {
+        if (i % HANDSHAKE_EVERY == 0)
+        {
+            if (peer != NULL)
+            {
+                release(stack, &peer);
+                release(stack, &security[0]);
+                release(stack, &security[1]);
+            }
+            peer = alloc(stack, PEER_SIZE);
+            handshake = alloc(stack, HANDSHAKE_SIZE);
+            security[0] = alloc(stack, SECURITY_SIZE);
+            security[1] = alloc(stack, SECURITY_SIZE);
+            handshakeLeft = 6; // flights
+        }
+        if (handshake != NULL && --handshakeLeft == 0)
+            release(stack, &handshake);
+
+        // the event goes out as a DTLS record and waits in the queue until acknowledged
+        const size_t len = jsonEvent(json);
+        void **slot = &inFlight[i % IN_FLIGHT];
+        if (*slot != NULL)
+            release(stack, slot);
+        *slot = alloc(stack, NETQ_SIZE + 29 + len); // record header, CoAP header and MAC
+    }
+    for (int i = 0; i < IN_FLIGHT; i++)
+    {
+        if (inFlight[i] != NULL)
+            release(stack, &inFlight[i]);
+    }
+    if (handshake != NULL)
+        release(stack, &handshake);
+    release(stack, &peer);
+    release(stack, &security[0]);
+    release(stack, &security[1]);
+}
+
+static void printTrace(const char *label, const Trace_t *t, int exchanges)
+{
+    printf("  %-10s heap: %6u malloc, %4u realloc, %6u free (%.2f calls per exchange), peak %6zu bytes\n", label,
+           (unsigned)t->mallocs, (unsigned)t->reallocs, (unsigned)t->frees, (double)(t->mallocs + t->reallocs + t->frees) / exchanges,
+           t->peak);
+}
+
+static int poolCount(TracklePool_Stats *stats)
+{
+    const int count = tracklePoolGetStats(stats, MAX_CLASSES);
+    CHECK(count <= MAX_CLASSES);
+    return count;
+}
+
+static void printPools()
+{
+    TracklePool_Stats stats[MAX_CLASSES];
+    const int count = poolCount(stats);
+    for (int i = 0; i < count; i++)
+    {
+        printf("    pool %4u: used %2u/%2u, peak %2u, allocs %7u, failures %u\n", stats[i].blockSize, stats[i].used, stats[i].blocks,
+               stats[i].peak, (unsigned)stats[i].allocs, (unsigned)stats[i].failures);
+    }
+    TracklePool_HeapStats heap;
+    tracklePoolGetHeapStats(&heap);
+    printf("    heap fallback: internal %u, spiram %u, failures %u\n", (unsigned)heap.internalAllocs, (unsigned)heap.spiramAllocs,
+           (unsigned)heap.failures);
+}
+
+static void compare(int exchanges)
+{
+    // without the pools: everything on the heap
+    const Allocator_t heap = {heapMalloc, heap_caps_free};
+    srand(1);
+    session(&heap, &heap, exchanges);
+    const Trace_t heapOnly = trace;
+    CHECK(liveCount == 0 && trace.inUse == 0);
+    printTrace("heap only", &heapOnly, exchanges);
+
+    // the same session through the pools
+    CHECK(tracklePoolHookCJSON() == ESP_ERR_INVALID_STATE);
+    memset(&trace, 0, sizeof(trace));
+    CHECK(tracklePoolInit() == ESP_OK);
+    CHECK(tracklePoolInit() == ESP_ERR_INVALID_STATE);
+    const size_t regions = trace.inUse;
+    TracklePool_Stats stats[MAX_CLASSES];
+    const int count = poolCount(stats);
+    CHECK(trace.mallocs == (uint32_t)count && liveCount == (size_t)count);
+    CHECK(tracklePoolHookCJSON() == ESP_OK);
+
+    memset(&trace, 0, sizeof(trace));
+    trace.inUse = trace.peak = regions;
+    const Allocator_t pools = {tracklePoolMalloc, tracklePoolFree};
+    const Allocator_t json = {jsonHooks.malloc_fn, jsonHooks.free_fn};
+    srand(1);
+    session(&pools, &json, exchanges);
+    printTrace("pools", &trace, exchanges);
+    printf("    of which %zu bytes of pool regions, allocated once\n", regions);
+    printPools();
+
+    // only the handshake parameters don't fit: one heap block per session
+    const uint32_t sessions = (exchanges + HANDSHAKE_EVERY - 1) / HANDSHAKE_EVERY;
+    CHECK(trace.mallocs == sessions && trace.frees == sessions && trace.reallocs == 0);
+    CHECK(liveCount == (size_t)count && trace.inUse == regions);
+    poolCount(stats);
+    for (int i = 0; i < count; i++)
+    {
+        CHECK(stats[i].used == 0 && stats[i].peak <= stats[i].blocks && stats[i].failures == 0);
+    }
+}
+
+static void exhausted()
+{
+    // the 64 byte class runs out: the failure is counted there, the next class serves
+    TracklePool_Stats before[MAX_CLASSES], after[MAX_CLASSES];
+    const int count = poolCount(before);
+    CHECK(count >= 3 && before[1].blockSize == 64);
+    void *blocks[64];
+    for (int i = 0; i < before[1].blocks; i++)
+        blocks[i] = tracklePoolMalloc(64);
+    void *spill = tracklePoolMalloc(64);
+    poolCount(after);
+    CHECK(after[1].used == after[1].blocks && after[1].failures == before[1].failures + 1);
+    CHECK(after[2].used == 1);
+    printf("  a full 64 byte class: failure counted, served by the %u byte class\n", after[2].blockSize);
+
+    // no heap: what doesn't fit anywhere fails, and the heap isn't touched
+    tracklePoolSetNoHeap(true);
+    const Trace_t start = trace;
+    CHECK(tracklePoolMalloc(2000) == NULL);
+    TracklePool_HeapStats heap;
+    tracklePoolGetHeapStats(&heap);
+    CHECK(trace.mallocs == start.mallocs && heap.failures == 1);
+    tracklePoolSetNoHeap(false);
+
+    tracklePoolFree(spill);
+    for (int i = 0; i < before[1].blocks; i++)
+        tracklePoolFree(blocks[i]);
+    poolCount(after);
+    for (int i = 0; i < count; i++)
+        CHECK(after[i].used == 0);
+}
+
+static void bigBlocks()
+{
+    // big requests go to SPIRAM, a heap block can't grow in no-heap mode
+    TracklePool_HeapStats before, after;
+    tracklePoolGetHeapStats(&before);
+    void *big = tracklePoolMalloc(TRACKLE_POOL_SPIRAM_THRESHOLD);
+    void *medium = tracklePoolMalloc(TRACKLE_POOL_SPIRAM_THRESHOLD - 1);
+    CHECK(esp_ptr_external_ram(big) && !esp_ptr_external_ram(medium));
+
+    tracklePoolSetNoHeap(true);
+    CHECK(tracklePoolRealloc(medium, 4000) == NULL);
+    tracklePoolSetNoHeap(false);
+    medium = tracklePoolRealloc(medium, 4000);
+    CHECK(medium != NULL);
+    tracklePoolGetHeapStats(&after);
+    CHECK(after.spiramAllocs == before.spiramAllocs + 1);
+    CHECK(after.internalAllocs == before.internalAllocs + 2 && after.failures == before.failures + 1);
+    printf("  %d bytes to spiram, %d bytes internal; a realloc in no-heap mode fails\n", TRACKLE_POOL_SPIRAM_THRESHOLD,
+           TRACKLE_POOL_SPIRAM_THRESHOLD - 1);
+    tracklePoolFree(big);
+    tracklePoolFree(medium);
+}
+
+int main(int argc, char **argv)
+{
+    const int exchanges = argc > 1 ? atoi(argv[1]) : 20000;
+    printf("%d exchanges, a DTLS handshake every %d\n", exchanges, HANDSHAKE_EVERY);
+    compare(exchanges);
+    exhausted();
+    bigBlocks();
+    return 0;
+}
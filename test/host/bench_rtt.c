@@ -0,0 +1,312 @@
+/**
+ * The RTT estimator and the transmit queue as they run today, on an emulated lossy link: the library
+ * retransmits with the fixed CoAP defaults (ACK_TIMEOUT 2 s, ACK_RANDOM_FACTOR 1.5, binary backoff,
+ * MAX_RETRANSMIT 4), and every transmission goes through trackleTxQueueSend and feeds the estimator as
+ * send_cb_udp and receive_cb_udp do.
+ *  - clean run: how close SRTT gets to the link RTT, how many answers come within the RTO, and the
+ *    loss estimate against the one the retransmissions that happened give;
+ *  - run with lwIP buffer shortages (sendto fails with ENOBUFS for 20 ms to 1.5 s): datagrams queued,
+ *    sent late within their RTO deadline or expired, and datagrams that went out when they were stale
+ *    (the message already answered or retransmitted).
+ * The cloud variable of \ref trackleRttAddDiagnostics is checked against the estimates at the end.
+ *
+ * Usage: bench_rtt <rtt ms> <loss %>. A loss applies to each direction of each transmission.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_host.h"
+#include "trackle_esp32.h"
+#include "trackle_utils_rtt.h"
+#include "trackle_utils_txqueue.h"
+
+#define MESSAGES 2000
+#define INTERVAL_MS 1000
+#define ACK_TIMEOUT_MS 2000
+#define MAX_RETRANSMIT 4
+#define LOOP_PERIOD_MS 10 // trackle_task flushes the queue at every loop
+#define WARMUP 50         // messages before the estimates are looked at
+#define NONE UINT32_MAX
+#define SOCK 3
+
+static uint32_t now = 0;
+struct Trackle *trackle_s = NULL;
+SemaphoreHandle_t xTrackleSemaphore = NULL;
+static void *(*diagnostics)(const char *) = NULL;
+
+uint32_t getMillis()
+{
+    return now;
+}
+
+bool trackleGet(struct Trackle *trackle, const char *name, void *(*function)(const char *), Data_TypeDef dataType)
+{
+    diagnostics = function;
+    return true;
+}
+
+// what the emulated wire sees of a datagram
+typedef struct
+{
+    uint32_t message;
+    uint32_t attempt;
+    uint32_t sentAt;   // when the library sent it
+    uint32_t deadline; // sentAt + RTO, the expiry of the queue
+} Datagram_t;
+
+typedef struct
+{
+    uint32_t latencies[MESSAGES];
+    uint32_t delivered;
+    uint64_t totalMs;
+    uint32_t transmissions;
+    uint32_t late;      // went out of the queue after sentAt
+    uint32_t maxLateMs; // longest wait in the queue
+    uint32_t stale;     // went out after the message was answered or retransmitted
+    uint32_t queueFull; // dropped at once, the queue was full
+} Result_t;
+
+static uint32_t linkRttMs;
+static int lossPercent;
+static bool shortages;
+static uint32_t shortageStart = NONE;
+static uint32_t shortageEnd = 0;
+static Result_t *res;
+
+// exchange in progress
+static uint32_t currentMessage;
+static uint32_t wireAttempt;
+static uint32_t answerAt;
+
+static bool lost()
+{
+    return rand() % 100 < lossPercent;
+}
+
+static void updateShortage()
+{
+    if (!shortages)
+        return;
+    while (now >= shortageEnd)
+    {
+        shortageStart = shortageEnd + 2000 + rand() % 18001;
+        shortageEnd = shortageStart + 20 + rand() % 1481;
+    }
+}
+
+// the lwIP socket: out of buffers during a shortage, a lossy link otherwise
+ssize_t sendto(int sock, const void *buf, size_t len, int flags, const struct sockaddr *addr, socklen_t addrLen)
+{
+    updateShortage();
+    if (now >= shortageStart && now < shortageEnd)
+    {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    Datagram_t d;
+    memcpy(&d, buf, sizeof(d));
+    if (now != d.sentAt)
+    {
+        CHECK(now <= d.deadline);
+        res->late++;
+        if (now - d.sentAt > res->maxLateMs)
+            res->maxLateMs = now - d.sentAt;
+    }
+    if (d.message != currentMessage || d.attempt < wireAttempt)
+    {
+        res->stale++;
+        return len;
+    }
+    wireAttempt = d.attempt;
+    // 0.5x to 1.5x the link RTT, if neither the datagram nor its answer is lost
+    if (!lost() && !lost())
+    {
+        const uint32_t arrival = now + linkRttMs / 2 + rand() % (linkRttMs + 1);
+        if (arrival < answerAt)
+            answerAt = arrival;
+    }
+    return len;
+}
+
+static const struct sockaddr_in cloudAddr = {.sin_family = AF_INET};
+
+// send_cb_udp
+static void transmit(uint32_t message, uint32_t attempt)
+{
+    const Datagram_t d = {message, attempt, now, now + trackleRttGetRto()};
+    const int sent = trackleTxQueueSend(SOCK, &cloudAddr, (const uint8_t *)&d, sizeof(d));
+    if (sent == TRACKLE_TXQ_DROPPED)
+        res->queueFull++;
+    else if (sent > 0)
+        trackleRttNotifySend();
+    res->transmissions++;
+}
+
+/**
+ * The library sends one confirmable message. Returns its delivery latency, 0 if it was given up, and
+ * the number of transmissions.
+ */
+static uint32_t deliver(uint32_t message, uint32_t *transmissions)
+{
+    const uint32_t start = now;
+    uint32_t timeout = ACK_TIMEOUT_MS + rand() % (ACK_TIMEOUT_MS / 2 + 1);
+    uint32_t retransmitAt = start + timeout;
+    uint32_t attempt = 0;
+    currentMessage = message;
+    wireAttempt = 0;
+    answerAt = NONE;
+    transmit(message, attempt);
+    for (;; now++)
+    {
+        updateShortage();
+        if (now % LOOP_PERIOD_MS == 0)
+            trackleTxQueueFlush(SOCK, &cloudAddr);
+        if (now >= answerAt)
+        {
+            // receive_cb_udp
+            trackleTxQueueFlush(SOCK, &cloudAddr);
+            trackleRttNotifyReceive();
+            *transmissions = attempt + 1;
+            return now - start;
+        }
+        if (now >= retransmitAt)
+        {
+            if (attempt == MAX_RETRANSMIT)
+                return 0;
+            attempt++;
+            timeout *= 2;
+            retransmitAt = now + timeout;
+            transmit(message, attempt);
+        }
+    }
+}
+
+static int compare(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void printLatency(const char *label)
+{
+    qsort(res->latencies, res->delivered, sizeof(res->latencies[0]), compare);
+    printf("%-10s delivered %4u/%d  mean %5u ms  p95 %5u ms  transmissions %u\n", label, (unsigned)res->delivered, MESSAGES,
+           (unsigned)(res->delivered > 0 ? res->totalMs / res->delivered : 0),
+           (unsigned)(res->delivered > 0 ? res->latencies[res->delivered * 95 / 100] : 0), (unsigned)res->transmissions);
+}
+
+static void accuracy()
+{
+    static Result_t clean;
+    res = &clean;
+    shortages = false;
+    uint64_t srttErrorMs = 0, rtoSum = 0;
+    uint64_t lossSum = 0, expectedLossSum = 0;
+    uint32_t measured = 0, strong = 0, covered = 0;
+    for (uint32_t i = 0; i < MESSAGES; i++)
+    {
+        const uint32_t rto = trackleRttGetRto();
+        uint32_t transmissions = 0;
+        const uint32_t latency = deliver(i, &transmissions);
+        if (latency > 0)
+        {
+            clean.latencies[clean.delivered++] = latency;
+            clean.totalMs += latency;
+        }
+
+        TrackleRtt_Stats stats;
+        trackleRttGetStats(&stats);
+        if (i < WARMUP || latency == 0 || latency > TRACKLE_RTT_MAX_SAMPLE_MS)
+        {
+            now += INTERVAL_MS;
+            continue;
+        }
+        measured++;
+        srttErrorMs += stats.srttMs > linkRttMs ? stats.srttMs - linkRttMs : linkRttMs - stats.srttMs;
+        lossSum += stats.lossPermille;
+        expectedLossSum += 1000 * (transmissions - 1) / transmissions;
+        if (transmissions == 1)
+        {
+            strong++;
+            covered += latency <= rto;
+            rtoSum += rto;
+        }
+        now += INTERVAL_MS;
+    }
+
+    const uint32_t srttError = srttErrorMs / measured;
+    const uint32_t loss = lossSum / measured;
+    const uint32_t expectedLoss = expectedLossSum / measured;
+    printf("link rtt %u ms, loss %d%% per direction\n", (unsigned)linkRttMs, lossPercent);
+    printLatency("clean");
+    printf("  srtt off by %u ms on average, %u of %u answers within the rto (mean rto %u ms)\n", (unsigned)srttError,
+           (unsigned)covered, (unsigned)strong, (unsigned)(rtoSum / strong));
+    printf("  loss estimate %u permille, %u permille expected from the retransmissions\n", (unsigned)loss, (unsigned)expectedLoss);
+
+    CHECK(srttError <= linkRttMs / 5);
+    CHECK(covered >= strong * 95 / 100);
+    CHECK(loss <= expectedLoss + 30 && loss + 30 >= expectedLoss);
+}
+
+static void shortage()
+{
+    static Result_t queued;
+    res = &queued;
+    shortages = true;
+    shortageEnd = now;
+    for (uint32_t i = 0; i < MESSAGES; i++)
+    {
+        uint32_t transmissions = 0;
+        const uint32_t latency = deliver(MESSAGES + i, &transmissions);
+        if (latency > 0)
+        {
+            queued.latencies[queued.delivered++] = latency;
+            queued.totalMs += latency;
+        }
+        now += INTERVAL_MS;
+    }
+    // whatever is left expires
+    shortages = false;
+    now += TRACKLE_RTT_MAX_RTO_MS + 1;
+    CHECK(trackleTxQueueFlush(SOCK, &cloudAddr) == 0);
+
+    TrackleTxQueue_Stats stats;
+    trackleTxQueueGetStats(&stats);
+    printLatency("shortages");
+    printf("  %u queued: %u sent late (max %u ms in the queue), %u expired, %u dropped at once; %u stale on the wire\n",
+           (unsigned)stats.deferred, (unsigned)stats.retried, (unsigned)queued.maxLateMs,
+           (unsigned)(stats.dropped - queued.queueFull), (unsigned)queued.queueFull, (unsigned)queued.stale);
+    CHECK(stats.deferred > 0 && queued.late == stats.retried);
+    CHECK(stats.deferred + queued.queueFull == stats.retried + stats.dropped);
+}
+
+static void diagnosticsVariable()
+{
+    CHECK(trackleRttAddDiagnostics("rtt") && diagnostics != NULL);
+    TrackleRtt_Stats stats;
+    trackleRttGetStats(&stats);
+    char expected[160];
+    snprintf(expected, sizeof(expected),
+             "{\"srtt\":%" PRIu32 ",\"rttvar\":%" PRIu32 ",\"rto\":%" PRIu32 ",\"loss\":%" PRIu32 ",\"strong\":%" PRIu32 ",\"weak\":%" PRIu32 ",\"dropped\":%" PRIu32 "}",
+             stats.srttMs, stats.rttvarMs, stats.rtoMs, stats.lossPermille, stats.strongSamples, stats.weakSamples, stats.dropped);
+    const char *json = diagnostics(NULL);
+    printf("  %s\n", json);
+    CHECK(strcmp(json, expected) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    linkRttMs = argc > 1 ? atoi(argv[1]) : 40;
+    lossPercent = argc > 2 ? atoi(argv[2]) : 10;
+    xTrackleSemaphore = xSemaphoreCreateMutex();
+    srand(1);
+    now = 1000;
+
+    accuracy();
+    shortage();
+    diagnosticsVariable();
+    return 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * Time and memory to write representative telemetry as JSON with the TrackleWriter and, when the
+ * cJSON sources are around (HAVE_CJSON), with cJSON as the component did before: a tree of nodes
+ * printed by cJSON_PrintUnformatted. The heap cJSON takes is counted through cJSON_InitHooks; the
+ * writer takes none, only its state and the output buffer, on the stack.
+ *
+ * Usage: bench_writer [iterations]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "test_host.h"
+#include "trackle_utils_writer.h"
+
+#ifdef HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+#define MAX_DOC 600
+#define SERIES_LEN 60
+
+static const char *alarms[] = {"filter", "door"};
+
+static double series(int i)
+{
+    return (200 + (i * 7) % 23) / 10.0;
+}
+
+// the state a device syncs: numbers, strings, flags and a small array
+static void writeState(TrackleWriter_t *w)
+{
+    trackleWriterBeginObject(w);
+    trackleWriterKey(w, "fw");
+    trackleWriterString(w, "2.3.1");
+    trackleWriterKey(w, "temp");
+    trackleWriterDouble(w, 21.5);
+    trackleWriterKey(w, "hum");
+    trackleWriterInt(w, 48);
+    trackleWriterKey(w, "rssi");
+    trackleWriterInt(w, -67);
+    trackleWriterKey(w, "uptime");
+    trackleWriterInt(w, 864123);
+    trackleWriterKey(w, "alarms");
+    trackleWriterBeginArray(w);
+    for (size_t i = 0; i < sizeof(alarms) / sizeof(alarms[0]); i++)
+        trackleWriterString(w, alarms[i]);
+    trackleWriterEndArray(w);
+    trackleWriterKey(w, "relay");
+    trackleWriterBool(w, true);
+    trackleWriterEndObject(w);
+}
+
+// a minute of readings at 1 Hz
+static void writeSeries(TrackleWriter_t *w)
+{
+    trackleWriterBeginObject(w);
+    trackleWriterKey(w, "t");
+    trackleWriterInt(w, 1700000000);
+    trackleWriterKey(w, "v");
+    trackleWriterBeginArray(w);
+    for (int i = 0; i < SERIES_LEN; i++)
+        trackleWriterDouble(w, series(i));
+    trackleWriterEndArray(w);
+    trackleWriterEndObject(w);
+}
+
+static char out[MAX_DOC + 1];
+
+static int writer(void (*payload)(TrackleWriter_t *w))
+{
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)out, sizeof(out));
+    payload(&w);
+    return trackleWriterFinish(&w);
+}
+
+static int writerState()
+{
+    return writer(writeState);
+}
+
+static int writerSeries()
+{
+    return writer(writeSeries);
+}
+
+#ifdef HAVE_CJSON
+// heap taken by cJSON: each block carries its size in front
+static size_t heapInUse = 0;
+static size_t heapPeak = 0;
+static size_t allocations = 0;
+
+static void *countingMalloc(size_t size)
+{
+    size_t *block = malloc(sizeof(size_t) + size);
+    if (block == NULL)
+        return NULL;
+    *block = size;
+    heapInUse += size;
+    if (heapInUse > heapPeak)
+        heapPeak = heapInUse;
+    allocations++;
+    return block + 1;
+}
+
+static void countingFree(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    size_t *block = (size_t *)ptr - 1;
+    heapInUse -= *block;
+    free(block);
+}
+
+static int printAndDelete(cJSON *root)
+{
+    char *text = cJSON_PrintUnformatted(root);
+    const int len = text != NULL ? (int)strlen(text) : -1;
+    if (text != NULL)
+        memcpy(out, text, len + 1);
+    cJSON_free(text);
+    cJSON_Delete(root);
+    return len;
+}
+
+static int cjsonState()
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "fw", "2.3.1");
+    cJSON_AddNumberToObject(root, "temp", 21.5);
+    cJSON_AddNumberToObject(root, "hum", 48);
+    cJSON_AddNumberToObject(root, "rssi", -67);
+    cJSON_AddNumberToObject(root, "uptime", 864123);
+    cJSON_AddItemToObject(root, "alarms", cJSON_CreateStringArray(alarms, sizeof(alarms) / sizeof(alarms[0])));
+    cJSON_AddBoolToObject(root, "relay", true);
+    return printAndDelete(root);
+}
+
+static int cjsonSeries()
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "t", 1700000000);
+    cJSON *values = cJSON_AddArrayToObject(root, "v");
+    for (int i = 0; i < SERIES_LEN; i++)
+        cJSON_AddItemToArray(values, cJSON_CreateNumber(series(i)));
+    return printAndDelete(root);
+}
+#endif
+
+static double nsPerCall(int (*encode)(), long iterations)
+{
+    struct timespec start, end;
+    volatile int sink = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < iterations; i++)
+        sink += encode();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    (void)sink;
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / iterations;
+}
+
+static void bench(const char *name, int (*withWriter)(), int (*withCjson)(), long iterations)
+{
+    const int len = withWriter();
+    CHECK(len > 0);
+    char expected[MAX_DOC + 1];
+    memcpy(expected, out, len + 1);
+    const double writerNs = nsPerCall(withWriter, iterations);
+    printf("  %-7s %4d bytes; writer %6.0f ns, 0 heap, %zu bytes of state + the output buffer\n", name, len, writerNs,
+           sizeof(TrackleWriter_t));
+
+#ifdef HAVE_CJSON
+    heapPeak = heapInUse = allocations = 0;
+    CHECK(withCjson() == len);
+    CHECK(strcmp(out, expected) == 0); // the same document
+    CHECK(heapInUse == 0);
+    const size_t peak = heapPeak, perDocument = allocations;
+    const double cjsonNs = nsPerCall(withCjson, iterations);
+    printf("  %-7s %4s        cJSON  %6.0f ns, %zu allocations, %zu bytes peak heap (%.1fx the time)\n", "", "", cjsonNs,
+           perDocument, peak, cjsonNs / writerNs);
+#else
+    (void)withCjson;
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    const long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    printf("%ld iterations\n", iterations);
+#ifdef HAVE_CJSON
+    cJSON_Hooks hooks = {.malloc_fn = countingMalloc, .free_fn = countingFree};
+    cJSON_InitHooks(&hooks);
+    bench("state", writerState, cjsonState, iterations);
+    bench("series", writerSeries, cjsonSeries, iterations);
+#else
+    printf("  cJSON sources not found, writer only\n");
+    bench("state", writerState, NULL, iterations);
+    bench("series", writerSeries, NULL, iterations);
+#endif
+    return 0;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// the cJSON allocation hooks only, for the modules that install them; the test provides the definition
+
+#include <stddef.h>
+
+typedef struct cJSON_Hooks
+{
+    void *(*malloc_fn)(size_t sz);
+    void (*free_fn)(void *ptr);
+} cJSON_Hooks;
+
+void cJSON_InitHooks(cJSON_Hooks *hooks);
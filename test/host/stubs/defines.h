@@ -0,0 +1,33 @@
+#pragma once
+
+// the subset of the Trackle library types used by the modules under test
+typedef enum
+{
+    VAR_BOOLEAN = 1,
+    VAR_INT = 2,
+    VAR_STRING = 4,
+    VAR_CHAR = 5,
+    VAR_LONG = 6,
+    VAR_JSON = 7,
+    VAR_DOUBLE = 9
+} Data_TypeDef;
+
+typedef enum
+{
+    PUBLIC = 0,
+    PRIVATE = 1
+} Event_Type;
+
+typedef enum
+{
+    EMPTY_FLAGS = 0,
+    NO_ACK = 0x2,
+    WITH_ACK = 0x8,
+    ALL_FLAGS = NO_ACK | WITH_ACK
+} Event_Flags;
+
+typedef enum
+{
+    ALL_USERS = 1,
+    OWNER_ONLY
+} Function_PermissionDef;
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// the ROM CRC32, same as zlib crc32
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
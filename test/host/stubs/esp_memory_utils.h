@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdbool.h>
+
+// defined by the test that stands in for the heap, see esp_heap_caps.h
+bool esp_ptr_external_ram(const void *p);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "esp_err.h"
+
+// the test defines the interfaces and these functions
+typedef struct esp_netif_obj esp_netif_t;
+
+const char *esp_netif_get_desc(esp_netif_t *esp_netif);
+esp_err_t esp_netif_set_default_netif(esp_netif_t *esp_netif);
+esp_err_t esp_netif_get_netif_impl_name(esp_netif_t *esp_netif, char *name);
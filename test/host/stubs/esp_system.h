@@ -0,0 +1,8 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+// declaration only, a test that needs it provides the definition
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handle);
@@ -0,0 +1,23 @@
+#pragma once
+
+// host build: tasks are threads and critical sections a process wide recursive mutex each, see freertos_stubs.c
+
+#include <pthread.h>
+#include <stdint.h>
+
+typedef pthread_mutex_t portMUX_TYPE;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#define portMAX_DELAY ((TickType_t)-1)
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
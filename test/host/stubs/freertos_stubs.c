@@ -0,0 +1,392 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+struct HostTask
+{
+    pthread_t thread;
+    TaskFunction_t function;
+    void *parameters;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notifications; // the notification value
+    bool pending;
+};
+
+struct HostQueue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t items[];
+};
+
+struct HostEventGroup
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+static __thread struct HostTask *currentTask = NULL;
+
+// absolute CLOCK_REALTIME deadline for pthread_cond_timedwait
+static struct timespec deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+// wait on cond until woken, false at the deadline; ticks 0 doesn't wait at all
+static bool wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *until)
+{
+    if (ticks == 0)
+        return false;
+    if (ticks == portMAX_DELAY)
+        return pthread_cond_wait(cond, lock) == 0;
+    return pthread_cond_timedwait(cond, lock, until) != ETIMEDOUT;
+}
+
+static struct HostTask *newTask(TaskFunction_t function, void *parameters)
+{
+    struct HostTask *task = calloc(1, sizeof(*task));
+    task->function = function;
+    task->parameters = parameters;
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+    return task;
+}
+
+static void *taskMain(void *arg)
+{
+    currentTask = arg;
+    currentTask->function(currentTask->parameters);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *created)
+{
+    struct HostTask *task = newTask(function, parameters);
+    if (pthread_create(&task->thread, NULL, taskMain, task) != 0)
+    {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (created != NULL)
+        *created = task;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == currentTask)
+        pthread_exit(NULL);
+    pthread_cancel(task->thread);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep((useconds_t)ticks * 1000);
+}
+
+TickType_t xTaskGetTickCount()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    if (currentTask == NULL) // the main thread, or a thread not created by xTaskCreate
+        currentTask = newTask(NULL, NULL);
+    return currentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notifications++;
+    task->pending = true;
+    pthread_cond_broadcast(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+    struct HostTask *task = xTaskGetCurrentTaskHandle();
+    const struct timespec until = deadline(ticks);
+    pthread_mutex_lock(&task->lock);
+    while (task->notifications == 0 && wait(&task->notified, &task->lock, ticks, &until))
+        ;
+    const uint32_t value = task->notifications;
+    if (value > 0)
+    {
+        task->notifications = clearOnExit ? 0 : value - 1;
+        task->pending = false;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    BaseType_t res = pdPASS;
+    pthread_mutex_lock(&task->lock);
+    switch (action)
+    {
+    case eSetBits:
+        task->notifications |= value;
+        break;
+    case eIncrement:
+        task->notifications++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notifications = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->pending)
+            res = pdFAIL;
+        else
+            task->notifications = value;
+        break;
+    default:
+        break;
+    }
+    task->pending = true;
+    pthread_cond_broadcast(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return res;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t ticks)
+{
+    struct HostTask *task = xTaskGetCurrentTaskHandle();
+    const struct timespec until = deadline(ticks);
+    pthread_mutex_lock(&task->lock);
+    if (!task->pending)
+        task->notifications &= ~clearOnEntry;
+    while (!task->pending && wait(&task->notified, &task->lock, ticks, &until))
+        ;
+    if (value != NULL)
+        *value = task->notifications;
+    const bool received = task->pending;
+    if (received)
+    {
+        task->notifications &= ~clearOnExit;
+        task->pending = false;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return received ? pdTRUE : pdFALSE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    struct HostQueue *queue = calloc(1, sizeof(*queue) + (size_t)length * itemSize);
+    if (queue == NULL)
+        return NULL;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    const struct timespec until = deadline(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length && wait(&queue->changed, &queue->lock, ticks, &until))
+        ;
+    const bool room = queue->count < queue->length;
+    if (room)
+    {
+        const UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + (size_t)tail * queue->itemSize, item, queue->itemSize);
+        queue->count++;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return room ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    const struct timespec until = deadline(ticks);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && wait(&queue->changed, &queue->lock, ticks, &until))
+        ;
+    const bool received = queue->count > 0;
+    if (received)
+    {
+        memcpy(item, queue->items + (size_t)queue->head * queue->itemSize, queue->itemSize);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return received ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    const UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+static SemaphoreHandle_t initSemaphore(StaticSemaphore_t *s, UBaseType_t max, UBaseType_t initial, bool recursive, bool heap)
+{
+    if (s == NULL)
+        return NULL;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->changed, NULL);
+    s->max = max;
+    s->count = initial;
+    s->recursive = recursive;
+    s->heap = heap;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    return initSemaphore(malloc(sizeof(StaticSemaphore_t)), max, initial, false, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return initSemaphore(malloc(sizeof(StaticSemaphore_t)), 1, 1, false, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+    return initSemaphore(buffer, 1, 1, false, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex()
+{
+    return initSemaphore(malloc(sizeof(StaticSemaphore_t)), 1, 1, true, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *buffer)
+{
+    return initSemaphore(buffer, 1, 1, true, false);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    if (semaphore->heap)
+        free(semaphore);
+}
+
+// a recursive mutex counts down from 1 while taken: 0 on the first take, then negative depths
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    const struct timespec until = deadline(ticks);
+    pthread_mutex_lock(&s->lock);
+    if (s->recursive && s->count <= 0 && pthread_equal(s->owner, pthread_self()))
+    {
+        s->count--;
+        pthread_mutex_unlock(&s->lock);
+        return pdTRUE;
+    }
+    while (s->count <= 0 && wait(&s->changed, &s->lock, ticks, &until))
+        ;
+    const bool taken = s->count > 0;
+    if (taken)
+    {
+        s->count--;
+        s->owner = pthread_self();
+    }
+    pthread_mutex_unlock(&s->lock);
+    return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    pthread_mutex_lock(&s->lock);
+    const bool given = s->count < s->max;
+    if (given)
+    {
+        s->count++;
+        pthread_cond_broadcast(&s->changed);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return given ? pdTRUE : pdFALSE;
+}
+
+EventGroupHandle_t xEventGroupCreate()
+{
+    struct HostEventGroup *group = calloc(1, sizeof(*group));
+    if (group == NULL)
+        return NULL;
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->changed, NULL);
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    const EventBits_t value = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+// the bits before clearing, as FreeRTOS does
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    const EventBits_t value = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
+
+static bool bitsSet(const struct HostEventGroup *group, EventBits_t bits, BaseType_t all)
+{
+    return all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit, BaseType_t waitForAll, TickType_t ticks)
+{
+    const struct timespec until = deadline(ticks);
+    pthread_mutex_lock(&group->lock);
+    while (!bitsSet(group, bits, waitForAll) && wait(&group->changed, &group->lock, ticks, &until))
+        ;
+    const EventBits_t value = group->bits;
+    if (clearOnExit && bitsSet(group, bits, waitForAll))
+        group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return value;
+}
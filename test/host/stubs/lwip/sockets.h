@@ -0,0 +1,9 @@
+#pragma once
+
+// lwIP offers the BSD socket API: the host one is used as is
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
@@ -0,0 +1,24 @@
+#include "mbedtls/md.h"
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+struct mbedtls_md_info_t
+{
+    mbedtls_md_type_t type;
+};
+
+static const mbedtls_md_info_t sha256 = {MBEDTLS_MD_SHA256};
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t type)
+{
+    return type == MBEDTLS_MD_SHA256 ? &sha256 : NULL;
+}
+
+int mbedtls_md_hmac(const mbedtls_md_info_t *info, const unsigned char *key, size_t keyLen, const unsigned char *input, size_t inputLen, unsigned char *output)
+{
+    if (info == NULL)
+        return -1;
+    unsigned int outLen = 0;
+    return HMAC(EVP_sha256(), key, (int)keyLen, input, inputLen, output, &outLen) != NULL ? 0 : -1;
+}
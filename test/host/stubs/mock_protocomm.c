@@ -0,0 +1,61 @@
+#include "wifi_provisioning/manager.h"
+
+#include <string.h>
+
+#define MOCK_MAX_ENDPOINTS 32
+
+typedef struct
+{
+    char name[32];
+    protocomm_req_handler_t handler;
+    void *ctx;
+} MockEndpoint_t;
+
+static MockEndpoint_t endpoints[MOCK_MAX_ENDPOINTS];
+static int endpointCount = 0;
+
+static MockEndpoint_t *find(const char *name)
+{
+    for (int i = 0; i < endpointCount; i++)
+    {
+        if (strcmp(endpoints[i].name, name) == 0)
+            return &endpoints[i];
+    }
+    return NULL;
+}
+
+esp_err_t wifi_prov_mgr_endpoint_create(const char *ep_name)
+{
+    if (find(ep_name) != NULL)
+        return ESP_OK;
+    if (endpointCount == MOCK_MAX_ENDPOINTS || strlen(ep_name) >= sizeof(endpoints[0].name))
+        return ESP_ERR_NO_MEM;
+    MockEndpoint_t *ep = &endpoints[endpointCount++];
+    strcpy(ep->name, ep_name);
+    ep->handler = NULL;
+    ep->ctx = NULL;
+    return ESP_OK;
+}
+
+esp_err_t wifi_prov_mgr_endpoint_register(const char *ep_name, protocomm_req_handler_t handler, void *user_ctx)
+{
+    MockEndpoint_t *ep = find(ep_name);
+    if (ep == NULL)
+        return ESP_ERR_NOT_FOUND;
+    ep->handler = handler;
+    ep->ctx = user_ctx;
+    return ESP_OK;
+}
+
+esp_err_t mock_protocomm_request(const char *ep_name, uint32_t session_id, const char *request, uint8_t **response, ssize_t *responseLen)
+{
+    const MockEndpoint_t *ep = find(ep_name);
+    if (ep == NULL || ep->handler == NULL)
+        return ESP_ERR_NOT_FOUND;
+    return ep->handler(session_id, (const uint8_t *)request, request != NULL ? (ssize_t)strlen(request) : 0, response, responseLen, ep->ctx);
+}
+
+void mock_protocomm_reset()
+{
+    endpointCount = 0;
+}
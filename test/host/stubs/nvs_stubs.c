@@ -0,0 +1,176 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "nvs_flash.h"
+
+#define MAX_NAMESPACES 8
+#define MAX_ENTRIES 32
+#define MAX_VALUE 1024
+
+typedef enum
+{
+    TYPE_STR,
+    TYPE_BLOB
+} EntryType_t;
+
+typedef struct
+{
+    bool used;
+    nvs_handle_t ns;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    EntryType_t type;
+    uint8_t value[MAX_VALUE];
+    size_t length;
+} Entry_t;
+
+// namespaces are numbered from 1, the handle is the namespace number and READWRITE in the high bit
+#define HANDLE_WRITABLE 0x80000000u
+
+static char namespaces[MAX_NAMESPACES][NVS_KEY_NAME_MAX_SIZE];
+static Entry_t entries[MAX_ENTRIES];
+
+NvsStub_Stats nvsStubStats;
+void (*nvsStubOnSet)(const char *key, size_t length) = NULL;
+
+void nvsStubErase()
+{
+    memset(namespaces, 0, sizeof(namespaces));
+    memset(entries, 0, sizeof(entries));
+    memset(&nvsStubStats, 0, sizeof(nvsStubStats));
+}
+
+esp_err_t nvs_flash_init()
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init_partition(const char *partition)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespaceName, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    if (strlen(namespaceName) >= NVS_KEY_NAME_MAX_SIZE)
+        return ESP_ERR_NVS_INVALID_NAME;
+    for (nvs_handle_t i = 0; i < MAX_NAMESPACES; i++)
+    {
+        if (namespaces[i][0] == '\0')
+        {
+            // as on the device, a namespace that was never written can't be opened read only
+            if (mode == NVS_READONLY)
+                return ESP_ERR_NVS_NOT_FOUND;
+            strcpy(namespaces[i], namespaceName);
+        }
+        if (strcmp(namespaces[i], namespaceName) == 0)
+        {
+            *handle = (i + 1) | (mode == NVS_READWRITE ? HANDLE_WRITABLE : 0);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+esp_err_t nvs_open_from_partition(const char *partition, const char *namespaceName, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    return nvs_open(namespaceName, mode, handle);
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    if ((handle & ~HANDLE_WRITABLE) == 0)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    nvsStubStats.commits++;
+    return ESP_OK;
+}
+
+static Entry_t *findEntry(nvs_handle_t handle, const char *key)
+{
+    for (size_t i = 0; i < MAX_ENTRIES; i++)
+    {
+        if (entries[i].used && entries[i].ns == (handle & ~HANDLE_WRITABLE) && strcmp(entries[i].key, key) == 0)
+            return &entries[i];
+    }
+    return NULL;
+}
+
+static esp_err_t set(nvs_handle_t handle, const char *key, EntryType_t type, const void *value, size_t length)
+{
+    if (!(handle & HANDLE_WRITABLE))
+        return ESP_ERR_NVS_READ_ONLY;
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+        return ESP_ERR_NVS_INVALID_NAME;
+    if (length > MAX_VALUE)
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    Entry_t *entry = findEntry(handle, key);
+    for (size_t i = 0; entry == NULL && i < MAX_ENTRIES; i++)
+    {
+        if (!entries[i].used)
+            entry = &entries[i];
+    }
+    if (entry == NULL)
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    entry->used = true;
+    entry->ns = handle & ~HANDLE_WRITABLE;
+    strcpy(entry->key, key);
+    entry->type = type;
+    memcpy(entry->value, value, length);
+    entry->length = length;
+    nvsStubStats.sets++;
+    nvsStubStats.bytes += length;
+    if (nvsStubOnSet != NULL)
+        nvsStubOnSet(key, length);
+    return ESP_OK;
+}
+
+// NULL out asks for the length only
+static esp_err_t get(nvs_handle_t handle, const char *key, EntryType_t type, void *out, size_t *length)
+{
+    const Entry_t *entry = findEntry(handle, key);
+    if (entry == NULL || entry->type != type)
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (out != NULL)
+    {
+        if (*length < entry->length)
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out, entry->value, entry->length);
+    }
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return set(handle, key, TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out, size_t *length)
+{
+    return get(handle, key, TYPE_STR, out, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set(handle, key, TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length)
+{
+    return get(handle, key, TYPE_BLOB, out, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    if (!(handle & HANDLE_WRITABLE))
+        return ESP_ERR_NVS_READ_ONLY;
+    Entry_t *entry = findEntry(handle, key);
+    if (entry == NULL)
+        return ESP_ERR_NVS_NOT_FOUND;
+    entry->used = false;
+    return ESP_OK;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// the part of trackle_esp32.h used by the modules under test; the test provides the definitions
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "trackle_interface.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+struct Trackle;
+extern struct Trackle *trackle_s;
+extern SemaphoreHandle_t xTrackleSemaphore;
+static TickType_t xTrackleSemaphoreWait __attribute__((unused)) = 100;
+
+uint32_t getMillis();
+bool tracklePublishPacedSecure(const char *eventName, const char *data);
+bool trackleGet(struct Trackle *trackle, const char *name, void *(*function)(const char *), Data_TypeDef dataType);
+bool tracklePublishSecure(const char *eventName, const char *data);
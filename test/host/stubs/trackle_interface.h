@@ -0,0 +1,14 @@
+#pragma once
+
+// the part of the Trackle library API used by the modules under test; the test provides the definitions
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <defines.h>
+
+struct Trackle;
+
+bool trackleConnected(struct Trackle *v);
+bool tracklePublish(struct Trackle *v, const char *eventName, const char *data, int ttl, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key);
+bool tracklePost(struct Trackle *v, const char *name, int (*function)(const char *), Function_PermissionDef permission);
@@ -0,0 +1,22 @@
+#pragma once
+
+// mock of the provisioning manager: endpoints are kept in a table the tests call as protocomm would
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "esp_err.h"
+
+typedef esp_err_t (*protocomm_req_handler_t)(uint32_t session_id, const uint8_t *inbuf, ssize_t inlen, uint8_t **outbuf, ssize_t *outlen, void *priv_data);
+
+esp_err_t wifi_prov_mgr_endpoint_create(const char *ep_name);
+esp_err_t wifi_prov_mgr_endpoint_register(const char *ep_name, protocomm_req_handler_t handler, void *user_ctx);
+
+/**
+ * Send a request to an endpoint registered with wifi_prov_mgr_endpoint_register, like protocomm does.
+ * The response is owned by the caller. Returns ESP_ERR_NOT_FOUND if the endpoint was never created.
+ */
+esp_err_t mock_protocomm_request(const char *ep_name, uint32_t session_id, const char *request, uint8_t **response, ssize_t *responseLen);
+
+// forget all endpoints, as at the end of a provisioning session
+void mock_protocomm_reset();
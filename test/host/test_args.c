@@ -0,0 +1,177 @@
+/**
+ * Unit and fuzz tests of the argument parser. The fuzz test compares the integer parsers with a strtoll
+ * based reference on random strings, and checks that the tokens rebuild the input.
+ *
+ * Usage: test_args [fuzz rounds]
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_host.h"
+#include "trackle_utils_args.h"
+
+#define FUZZ_MAX_LEN 24
+
+static void testTokens()
+{
+    TrackleArgs_t args;
+    TrackleStr_t token;
+    trackleArgsInit(&args, "a,,b", ',');
+    CHECK(trackleArgsNext(&args, &token) && trackleStrEquals(token, "a"));
+    CHECK(trackleArgsNext(&args, &token) && token.len == 0);
+    CHECK(trackleArgsNext(&args, &token) && trackleStrEquals(token, "b"));
+    CHECK(!trackleArgsNext(&args, &token));
+
+    // an empty input is one empty token, NULL too
+    trackleArgsInit(&args, NULL, ',');
+    CHECK(trackleArgsNext(&args, &token) && token.len == 0);
+    CHECK(!trackleArgsNext(&args, &token));
+
+    trackleArgsInit(&args, "cmd,x,y,z", ',');
+    CHECK(trackleArgsNext(&args, &token) && trackleStrEquals(token, "cmd"));
+    CHECK(trackleArgsRest(&args, &token) && trackleStrEquals(token, "x,y,z"));
+    CHECK(!trackleArgsRest(&args, &token));
+
+    // the length is explicit, the rest of the buffer is not looked at
+    trackleArgsInitLen(&args, "1;2;3", 3, ';');
+    int32_t v;
+    CHECK(trackleArgsNextInt32(&args, &v) && v == 1);
+    CHECK(trackleArgsNextInt32(&args, &v) && v == 2);
+    CHECK(!trackleArgsNextInt32(&args, &v));
+}
+
+static void testStrings()
+{
+    CHECK(trackleStrEquals(trackleStrTrim(trackleStr(" \tab \t")), "ab"));
+    CHECK(trackleStrTrim(trackleStr("   ")).len == 0);
+    CHECK(!trackleStrEquals(trackleStr("ab"), "abc"));
+    CHECK(trackleStr(NULL).len == 0);
+
+    char out[4];
+    CHECK(trackleStrCopy(trackleStr("abc"), out, sizeof(out)) && strcmp(out, "abc") == 0);
+    strcpy(out, "xyz");
+    CHECK(!trackleStrCopy(trackleStr("abcd"), out, sizeof(out)));
+    CHECK(strcmp(out, "xyz") == 0);
+}
+
+static void testIntegers()
+{
+    int32_t v = 7;
+    CHECK(trackleStrToInt32(trackleStr("2147483647"), &v) && v == INT32_MAX);
+    CHECK(trackleStrToInt32(trackleStr("-2147483648"), &v) && v == INT32_MIN);
+    CHECK(trackleStrToInt32(trackleStr(" +12 "), &v) && v == 12);
+    v = 7;
+    CHECK(!trackleStrToInt32(trackleStr("2147483648"), &v));
+    CHECK(!trackleStrToInt32(trackleStr("-2147483649"), &v));
+    CHECK(!trackleStrToInt32(trackleStr("1 2"), &v));
+    CHECK(!trackleStrToInt32(trackleStr("-"), &v));
+    CHECK(!trackleStrToInt32(trackleStr("0x10"), &v));
+    CHECK(!trackleStrToInt32(trackleStr(""), &v));
+    CHECK(v == 7); // untouched on failure
+
+    uint32_t u;
+    CHECK(trackleStrToUint32(trackleStr("4294967295"), &u) && u == UINT32_MAX);
+    CHECK(!trackleStrToUint32(trackleStr("4294967296"), &u));
+    CHECK(!trackleStrToUint32(trackleStr("-1"), &u));
+}
+
+static void testCompare()
+{
+    static const char *ops[] = {"<", "<=", ">", ">=", "="};
+    static const TrackleCompare_Op parsed[] = {TRACKLE_CMP_LT, TRACKLE_CMP_LE, TRACKLE_CMP_GT, TRACKLE_CMP_GE, TRACKLE_CMP_EQ};
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        CHECK(trackleCompareOpParse(trackleStr(ops[i])) == parsed[i]);
+    CHECK(trackleCompareOpParse(trackleStr(" >= ")) == TRACKLE_CMP_GE);
+    CHECK(trackleCompareOpParse(trackleStr("==")) == TRACKLE_CMP_INVALID);
+    CHECK(trackleCompareOpParse(trackleStr("=<")) == TRACKLE_CMP_INVALID);
+    CHECK(trackleCompareOpParse(trackleStr("")) == TRACKLE_CMP_INVALID);
+
+    CHECK(trackleCompare(1, TRACKLE_CMP_LT, 2) && !trackleCompare(2, TRACKLE_CMP_LT, 2));
+    CHECK(trackleCompare(2, TRACKLE_CMP_LE, 2) && trackleCompare(3, TRACKLE_CMP_GT, 2));
+    CHECK(trackleCompare(2, TRACKLE_CMP_GE, 2) && trackleCompare(-1, TRACKLE_CMP_EQ, -1));
+    CHECK(!trackleCompare(1, TRACKLE_CMP_INVALID, 1));
+}
+
+// reference parser: spaces and tabs around, optional sign, at least one digit, range checked by strtoll
+static bool referenceParse(const char *text, bool allowMinus, long long min, long long max, long long *value)
+{
+    const char *start = text + strspn(text, " \t");
+    size_t len = strlen(start);
+    while (len > 0 && (start[len - 1] == ' ' || start[len - 1] == '\t'))
+        len--;
+    const size_t sign = len > 0 && (start[0] == '+' || (allowMinus && start[0] == '-')) ? 1 : 0;
+    if (len == sign || strspn(start + sign, "0123456789") != len - sign)
+        return false;
+
+    char number[FUZZ_MAX_LEN + 1];
+    memcpy(number, start, len);
+    number[len] = '\0';
+    errno = 0;
+    *value = strtoll(number, NULL, 10);
+    return errno == 0 && *value >= min && *value <= max;
+}
+
+static void randomString(char *out)
+{
+    static const char alphabet[] = "0123456789 \t+-,x";
+    const size_t len = rand() % (FUZZ_MAX_LEN + 1);
+    // mostly digits, so that the 32 bit limits are crossed often
+    for (size_t i = 0; i < len; i++)
+        out[i] = rand() % 4 != 0 ? alphabet[rand() % 10] : alphabet[rand() % (sizeof(alphabet) - 1)];
+    out[len] = '\0';
+}
+
+static void testFuzz(long rounds)
+{
+    char input[FUZZ_MAX_LEN + 1];
+    char joined[FUZZ_MAX_LEN + 1];
+    srand(1);
+    for (long round = 0; round < rounds; round++)
+    {
+        randomString(input);
+
+        long long expected;
+        int32_t v;
+        const bool valid = referenceParse(input, true, INT32_MIN, INT32_MAX, &expected);
+        CHECK(trackleStrToInt32(trackleStr(input), &v) == valid);
+        CHECK(!valid || v == expected);
+        uint32_t u;
+        const bool validUnsigned = referenceParse(input, false, 0, UINT32_MAX, &expected);
+        CHECK(trackleStrToUint32(trackleStr(input), &u) == validUnsigned);
+        CHECK(!validUnsigned || u == expected);
+
+        // the tokens, joined back with the separator, are the input
+        TrackleArgs_t args;
+        TrackleStr_t token;
+        size_t len = 0;
+        int tokens = 0;
+        trackleArgsInit(&args, input, ',');
+        while (trackleArgsNext(&args, &token))
+        {
+            CHECK(memchr(token.ptr, ',', token.len) == NULL);
+            if (tokens++ > 0)
+                joined[len++] = ',';
+            memcpy(joined + len, token.ptr, token.len);
+            len += token.len;
+        }
+        int separators = 0;
+        for (const char *p = input; *p; p++)
+            separators += *p == ',';
+        CHECK(tokens == separators + 1);
+        CHECK(len == strlen(input) && memcmp(joined, input, len) == 0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const long rounds = argc > 1 ? atol(argv[1]) : 200000;
+    RUN(testTokens);
+    RUN(testStrings);
+    RUN(testIntegers);
+    RUN(testCompare);
+    testFuzz(rounds);
+    printf("ok testFuzz (%ld strings)\n", rounds);
+    return 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * Async cloud functions on real worker threads: with 2 workers and 4 waiting slots 6 calls are
+ * accepted and the next ones are busy, too long arguments are refused, every call runs with its own
+ * arguments and its result is published with the id the cloud got; the slots free up after the drain.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/semphr.h"
+#include "test_host.h"
+#include "trackle_esp32.h"
+#include "trackle_utils_async.h"
+
+#define SLOTS (TRACKLE_ASYNC_WORKERS + TRACKLE_ASYNC_QUEUE_LEN)
+#define MAX_RESULTS 16
+
+typedef struct
+{
+    int id;
+    int ret;
+} Result_t;
+
+struct Trackle *trackle_s = NULL;
+SemaphoreHandle_t xTrackleSemaphore = NULL;
+static int (*registered)(const char *) = NULL;
+static SemaphoreHandle_t entered; // given by a call when a worker runs it
+static SemaphoreHandle_t gate;    // taken by a call to complete
+static SemaphoreHandle_t published;
+static pthread_mutex_t resultsLock = PTHREAD_MUTEX_INITIALIZER;
+static Result_t results[MAX_RESULTS];
+static int resultCount = 0;
+
+uint32_t getMillis()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool tracklePost(struct Trackle *v, const char *name, int (*function)(const char *), Function_PermissionDef permission)
+{
+    CHECK(strcmp(name, "relay") == 0 && permission == OWNER_ONLY);
+    registered = function;
+    return true;
+}
+
+bool tracklePublishSecure(const char *eventName, const char *data)
+{
+    Result_t r;
+    int ms;
+    CHECK(strcmp(eventName, TRACKLE_ASYNC_RESULT_EVENT) == 0);
+    CHECK(sscanf(data, "{\"fn\":\"relay\",\"id\":%d,\"ret\":%d,\"ms\":%d}", &r.id, &r.ret, &ms) == 3 && ms >= 0);
+    pthread_mutex_lock(&resultsLock);
+    CHECK(resultCount < MAX_RESULTS);
+    results[resultCount++] = r;
+    pthread_mutex_unlock(&resultsLock);
+    xSemaphoreGive(published);
+    return true;
+}
+
+// returns the length of its arguments, once let through
+static int relay(const char *args)
+{
+    xSemaphoreGive(entered);
+    xSemaphoreTake(gate, portMAX_DELAY);
+    return strlen(args);
+}
+
+// a call with id as long as its arguments, so that the results tell the arguments were not mixed up
+static int call(int length)
+{
+    char args[TRACKLE_ASYNC_MAX_ARGS + 2];
+    memset(args, 'x', length);
+    args[length] = '\0';
+    return registered(args);
+}
+
+static int byId(const void *a, const void *b)
+{
+    return ((const Result_t *)a)->id - ((const Result_t *)b)->id;
+}
+
+static TrackleAsync_Stats stats()
+{
+    TrackleAsync_Stats s;
+    CHECK(trackleAsyncGetStats("relay", &s));
+    return s;
+}
+
+static void testRegister()
+{
+    CHECK(trackleAsyncAddPost("relay", relay, OWNER_ONLY));
+    CHECK(registered != NULL);
+    CHECK(!trackleAsyncAddPost("relay", relay, OWNER_ONLY));
+    CHECK(!trackleAsyncAddPost("a name much longer than allowed here", relay, OWNER_ONLY));
+    TrackleAsync_Stats s;
+    CHECK(!trackleAsyncGetStats("other", &s));
+}
+
+static void testBusy()
+{
+    for (int i = 1; i <= SLOTS; i++)
+        CHECK(call(i) == i);
+    // both workers are held in the function, 4 calls wait
+    for (int i = 0; i < TRACKLE_ASYNC_WORKERS; i++)
+        CHECK(xSemaphoreTake(entered, 1000) == pdTRUE);
+    CHECK(call(1) == TRACKLE_ASYNC_BUSY);
+    CHECK(call(1) == TRACKLE_ASYNC_BUSY);
+    CHECK(call(TRACKLE_ASYNC_MAX_ARGS + 1) == TRACKLE_ASYNC_TOO_LONG);
+    CHECK(stats().rejected == 3 && stats().calls == 0);
+}
+
+static void testDrain()
+{
+    for (int i = 0; i < SLOTS; i++)
+        xSemaphoreGive(gate);
+    for (int i = 0; i < SLOTS; i++)
+        CHECK(xSemaphoreTake(published, 1000) == pdTRUE);
+
+    // every id once, with the result of its own call
+    pthread_mutex_lock(&resultsLock);
+    CHECK(resultCount == SLOTS);
+    qsort(results, resultCount, sizeof(results[0]), byId);
+    for (int i = 0; i < resultCount; i++)
+        CHECK(results[i].id == i + 1 && results[i].ret == i + 1);
+    resultCount = 0;
+    pthread_mutex_unlock(&resultsLock);
+    CHECK(stats().calls == SLOTS && stats().rejected == 3);
+
+    // the slots are free again, ids go on
+    CHECK(call(TRACKLE_ASYNC_MAX_ARGS) == SLOTS + 1);
+    xSemaphoreGive(gate);
+    CHECK(xSemaphoreTake(published, 1000) == pdTRUE);
+    CHECK(results[0].id == SLOTS + 1 && results[0].ret == TRACKLE_ASYNC_MAX_ARGS);
+    CHECK(stats().calls == SLOTS + 1 && stats().lastResult == TRACKLE_ASYNC_MAX_ARGS);
+}
+
+int main()
+{
+    entered = xSemaphoreCreateCounting(SLOTS + 1, 0);
+    gate = xSemaphoreCreateCounting(SLOTS + 1, 0);
+    published = xSemaphoreCreateCounting(SLOTS + 1, 0);
+    RUN(testRegister);
+    RUN(testBusy);
+    RUN(testDrain);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_host.h"
+#include "trackle_utils_bt_functions.h"
+#include "wifi_provisioning/manager.h"
+
+static int lastPostArgLen = -1;
+static int32_t value = 42;
+
+static int post(const char *args)
+{
+    lastPostArgLen = strlen(args);
+    return 7;
+}
+
+static int otherPost(const char *args)
+{
+    return 8;
+}
+
+static int32_t getValue(const char *args)
+{
+    return value;
+}
+
+static void registerAll()
+{
+    mock_protocomm_reset();
+    CHECK(btFunctionsEndpointsCreate() == ESP_OK);
+    CHECK(btFunctionsEndpointsRegister() == ESP_OK);
+}
+
+// request an endpoint and check the text returned, NULL terminator included
+static void expect(const char *name, uint32_t session, const char *request, const char *expected)
+{
+    uint8_t *out = NULL;
+    ssize_t outLen = 0;
+    CHECK(mock_protocomm_request(name, session, request, &out, &outLen) == ESP_OK);
+    CHECK(out != NULL && outLen == (ssize_t)strlen(expected) + 1);
+    CHECK(memcmp(out, expected, outLen) == 0);
+    free(out);
+}
+
+static void testCalls()
+{
+    CHECK(Trackle_BtPost_add("post", post));
+    CHECK(trackleRegistryAddGetInt(Trackle_BtFunctions_registry(), "value", getValue) != TRACKLE_ENDPOINT_INVALID);
+    CHECK(!Trackle_BtPost_add("post", otherPost)); // names are unique
+    registerAll();
+
+    expect("post", 1, "abc", "7");
+    CHECK(lastPostArgLen == 3);
+    expect("value", 1, NULL, "42");
+    value = -5;
+    expect("value", 1, "", "-5");
+}
+
+static void testArgsDontLeak()
+{
+    // buffers are reused by every call: a shorter argument must not see the tail of the previous one
+    expect("post", 1, "a long argument", "7");
+    expect("post", 2, "x", "7");
+    CHECK(lastPostArgLen == 1);
+    expect("post", 2, NULL, "7");
+    CHECK(lastPostArgLen == 0);
+}
+
+static void testArgTooLong()
+{
+    char *arg = malloc(MAX_BT_FUNCTION_ARG_LEN + 2);
+    memset(arg, 'a', MAX_BT_FUNCTION_ARG_LEN + 1);
+    arg[MAX_BT_FUNCTION_ARG_LEN + 1] = '\0';
+    uint8_t *out = NULL;
+    ssize_t outLen = 0;
+    CHECK(mock_protocomm_request("post", 1, arg, &out, &outLen) == ESP_ERR_INVALID_SIZE);
+    CHECK(out == NULL && outLen == 0);
+
+    arg[MAX_BT_FUNCTION_ARG_LEN] = '\0';
+    expect("post", 1, arg, "7");
+    CHECK(lastPostArgLen == MAX_BT_FUNCTION_ARG_LEN);
+    free(arg);
+}
+
+static void testRemovedDuringSession()
+{
+    // the endpoint stays visible to the client, but the old registration must not be called
+    CHECK(Trackle_BtFunction_remove("post"));
+    uint8_t *out = NULL;
+    ssize_t outLen = 0;
+    CHECK(mock_protocomm_request("post", 1, "abc", &out, &outLen) == ESP_ERR_NOT_FOUND);
+
+    // the slot is reused by a new function with the same name: still not reachable through the old handle
+    CHECK(Trackle_BtPost_add("post", otherPost));
+    CHECK(mock_protocomm_request("post", 1, "abc", &out, &outLen) == ESP_ERR_NOT_FOUND);
+    CHECK(out == NULL);
+
+    // a new session registers the endpoints again
+    registerAll();
+    expect("post", 3, "abc", "8");
+}
+
+int main()
+{
+    RUN(testCalls);
+    RUN(testArgsDontLeak);
+    RUN(testArgTooLong);
+    RUN(testRemovedDuringSession);
+    return 0;
+}
@@ -0,0 +1,155 @@
+/**
+ * Cached variables: reads never call the getter, a miss is answered as not ready and fetched by the
+ * worker, a slow getter doesn't hold up reads, a failed refresh keeps the last good value.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "freertos/task.h"
+#include "test_host.h"
+#include "trackle_esp32.h"
+#include "trackle_utils_cache.h"
+
+#define TTL_MS 1000
+
+struct Trackle *trackle_s = NULL;
+static volatile uint32_t fakeMillis = 1000;
+static void *(*reads[TRACKLE_CACHE_MAX])(const char *);
+static int registered = 0;
+
+static pthread_t mainThread;
+static volatile int32_t sensor = 10;
+static volatile bool failing = false;
+static volatile bool blocked = false; // the getter waits while set
+static volatile bool inGetter = false;
+
+uint32_t getMillis()
+{
+    return fakeMillis;
+}
+
+bool trackleGet(struct Trackle *trackle, const char *name, void *(*function)(const char *), Data_TypeDef dataType)
+{
+    reads[registered++] = function;
+    return true;
+}
+
+static void *getTemp(const char *args)
+{
+    static int32_t value;
+    CHECK(!pthread_equal(pthread_self(), mainThread)); // never from trackleLoop
+    CHECK(strcmp(args, "") == 0);
+    inGetter = true;
+    while (blocked)
+        vTaskDelay(1);
+    inGetter = false;
+    if (failing)
+        return NULL;
+    value = sensor;
+    return &value;
+}
+
+static void *getName(const char *args)
+{
+    return "living room";
+}
+
+static TrackleCache_Stats stats(const char *name)
+{
+    TrackleCache_Stats s;
+    CHECK(trackleCacheGetStats(name, &s));
+    return s;
+}
+
+// wait for the worker to be done with n getter calls
+static void waitRefreshes(const char *name, uint32_t n)
+{
+    for (int i = 0; i < 1000 && stats(name).refreshes < n; i++)
+        vTaskDelay(1);
+    CHECK(stats(name).refreshes == n);
+}
+
+static int32_t readInt(int index)
+{
+    const int32_t *value = reads[index]("");
+    CHECK(value != NULL);
+    return *value;
+}
+
+static void testMiss()
+{
+    CHECK(trackleCacheAddGet("temp", getTemp, VAR_INT, TTL_MS));
+    CHECK(!trackleCacheAddGet("temp", getTemp, VAR_INT, TTL_MS));
+    // no value yet: not ready, the worker fetches it
+    blocked = true;
+    CHECK(reads[0]("") == NULL);
+    CHECK(reads[0]("") == NULL);
+    blocked = false;
+    waitRefreshes("temp", 1); // one fetch for both misses
+    CHECK(readInt(0) == 10);
+
+    const TrackleCache_Stats s = stats("temp");
+    CHECK(s.misses == 2 && s.hits == 1 && s.refreshes == 1 && s.failures == 0);
+}
+
+static void testRefreshBeforeRead()
+{
+    CHECK(trackleCacheAddGet("name", getName, VAR_STRING, TTL_MS));
+    CHECK(trackleCacheRefresh("name"));
+    CHECK(!trackleCacheRefresh("missing"));
+    waitRefreshes("name", 1);
+    CHECK(strcmp(reads[1](""), "living room") == 0);
+    CHECK(stats("name").misses == 0);
+}
+
+static void testSlowGetter()
+{
+    // the value gets stale and the getter hangs: reads go on with the stale value
+    sensor = 11;
+    blocked = true;
+    fakeMillis += TTL_MS;
+    CHECK(readInt(0) == 10);
+    while (!inGetter)
+        vTaskDelay(1);
+    const uint32_t start = xTaskGetTickCount();
+    for (int i = 0; i < 100; i++)
+        CHECK(readInt(0) == 10);
+    CHECK(xTaskGetTickCount() - start < 50);
+    CHECK(stats("temp").staleHits == 101 && stats("temp").refreshes == 1); // one refresh in flight
+
+    blocked = false;
+    waitRefreshes("temp", 2);
+    CHECK(readInt(0) == 11);
+}
+
+static void testFailedRefresh()
+{
+    // the getter fails: the last good value stays, stale, and is refreshed again at the next read
+    failing = true;
+    sensor = 12;
+    fakeMillis += TTL_MS;
+    CHECK(readInt(0) == 11);
+    waitRefreshes("temp", 3);
+    CHECK(stats("temp").failures == 1);
+    CHECK(readInt(0) == 11);
+    waitRefreshes("temp", 4);
+    CHECK(stats("temp").failures == 2);
+
+    failing = false;
+    CHECK(readInt(0) == 11);
+    waitRefreshes("temp", 5);
+    CHECK(readInt(0) == 12);
+    const TrackleCache_Stats s = stats("temp");
+    CHECK(s.misses == 2 && s.failures == 2 && s.hits == 3);
+}
+
+int main()
+{
+    mainThread = pthread_self();
+    RUN(testMiss);
+    RUN(testRefreshBeforeRead);
+    RUN(testSlowGetter);
+    RUN(testFailedRefresh);
+    return 0;
+}
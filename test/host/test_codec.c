@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_host.h"
+#include "trackle_utils_codec.h"
+
+#define MAX_LEN 300
+
+static void testVectors()
+{
+    // RFC 4648, section 10
+    static const char *plain[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+    static const char *base64[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+    static const char *base64Url[] = {"", "Zg", "Zm8", "Zm9v", "Zm9vYg", "Zm9vYmE", "Zm9vYmFy"};
+    char text[16];
+    uint8_t bytes[16];
+    for (size_t i = 0; i < sizeof(plain) / sizeof(plain[0]); i++)
+    {
+        const size_t len = strlen(plain[i]);
+        CHECK(trackleBase64Encode((const uint8_t *)plain[i], len, text, sizeof(text)) == (int)strlen(base64[i]));
+        CHECK(strcmp(text, base64[i]) == 0);
+        CHECK(trackleBase64UrlEncode((const uint8_t *)plain[i], len, text, sizeof(text)) == (int)strlen(base64Url[i]));
+        CHECK(strcmp(text, base64Url[i]) == 0);
+        CHECK(trackleBase64Decode(base64[i], strlen(base64[i]), bytes, sizeof(bytes)) == (int)len);
+        CHECK(memcmp(bytes, plain[i], len) == 0);
+        // base64url is accepted with and without padding
+        CHECK(trackleBase64UrlDecode(base64Url[i], strlen(base64Url[i]), bytes, sizeof(bytes)) == (int)len);
+        CHECK(memcmp(bytes, plain[i], len) == 0);
+        CHECK(trackleBase64UrlDecode(base64[i], strlen(base64[i]), bytes, sizeof(bytes)) == (int)len);
+        CHECK(memcmp(bytes, plain[i], len) == 0);
+    }
+}
+
+static void testRoundTrips()
+{
+    static uint8_t in[MAX_LEN];
+    static uint8_t out[MAX_LEN];
+    static char text[TRACKLE_HEX_ENCODED_LEN(MAX_LEN) + 1]; // the longest of the three encodings
+    static char reference[TRACKLE_HEX_ENCODED_LEN(MAX_LEN) + 1];
+    srand(1);
+    for (int round = 0; round < 2000; round++)
+    {
+        const size_t len = rand() % (MAX_LEN + 1);
+        for (size_t i = 0; i < len; i++)
+            in[i] = rand();
+
+        CHECK(trackleHexEncode(in, len, text, sizeof(text)) == (int)TRACKLE_HEX_ENCODED_LEN(len));
+        for (size_t i = 0; i < len; i++)
+            sprintf(reference + 2 * i, "%02x", in[i]);
+        CHECK(memcmp(text, reference, 2 * len) == 0 && text[2 * len] == '\0');
+        CHECK(trackleHexDecode(text, 2 * len, out, sizeof(out)) == (int)len);
+        CHECK(memcmp(in, out, len) == 0);
+
+        const int b64Len = trackleBase64Encode(in, len, text, sizeof(text));
+        CHECK(b64Len == (int)TRACKLE_BASE64_ENCODED_LEN(len) && text[b64Len] == '\0');
+        CHECK(trackleBase64Decode(text, b64Len, out, sizeof(out)) == (int)len);
+        CHECK(memcmp(in, out, len) == 0);
+
+        const int urlLen = trackleBase64UrlEncode(in, len, text, sizeof(text));
+        CHECK(urlLen == (int)TRACKLE_BASE64URL_ENCODED_LEN(len) && text[urlLen] == '\0');
+        CHECK(strpbrk(text, "+/=") == NULL);
+        CHECK(trackleBase64UrlDecode(text, urlLen, out, sizeof(out)) == (int)len);
+        CHECK(memcmp(in, out, len) == 0);
+    }
+}
+
+static void testHexOddLength()
+{
+    uint8_t out[4];
+    // an implicit leading '0'
+    CHECK(trackleHexDecode("abc", 3, out, sizeof(out)) == 2);
+    CHECK(out[0] == 0x0a && out[1] == 0xbc);
+    CHECK(trackleHexDecode("F", 1, out, sizeof(out)) == 1);
+    CHECK(out[0] == 0x0f);
+    CHECK(trackleHexDecode("ABcd", 4, out, sizeof(out)) == 2);
+    CHECK(out[0] == 0xab && out[1] == 0xcd);
+    CHECK(trackleHexDecode("", 0, out, sizeof(out)) == 0);
+
+    CHECK(trackleHexDecode("g", 1, out, sizeof(out)) == TRACKLE_CODEC_ERR_INPUT);
+    CHECK(trackleHexDecode("0g1", 3, out, sizeof(out)) == TRACKLE_CODEC_ERR_INPUT);
+    CHECK(trackleHexDecode("12 4", 4, out, sizeof(out)) == TRACKLE_CODEC_ERR_INPUT);
+    // the length is explicit: an embedded NULL is an invalid character
+    CHECK(trackleHexDecode("12\0004", 4, out, sizeof(out)) == TRACKLE_CODEC_ERR_INPUT);
+}
+
+static void testMalformedBase64()
+{
+    static const char *malformed[] = {
+        "Zm9",      // not a multiple of 4
+        "Zm9vY",    // not a multiple of 4
+        "Zm9v$g==", // invalid character
+        "Zm-v",     // base64url character
+        "Z===",     // too much padding
+        "Zg=v",     // padding in the middle
+        "=Zm9",     // padding at the start
+        "Zm9vYg=",  // short padding
+    };
+    uint8_t out[16];
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+        CHECK(trackleBase64Decode(malformed[i], strlen(malformed[i]), out, sizeof(out)) == TRACKLE_CODEC_ERR_INPUT);
+
+    static const char *malformedUrl[] = {
+        "Zm9vY",   // a single character left over
+        "Zm+v",    // standard alphabet character
+        "Zg=",     // padding without a full group
+        "Z===",    // too much padding
+        "Zg=v",    // padding in the middle
+        "Zm9v\n",  // trailing newline
+    };
+    for (size_t i = 0; i < sizeof(malformedUrl) / sizeof(malformedUrl[0]); i++)
+        CHECK(trackleBase64UrlDecode(malformedUrl[i], strlen(malformedUrl[i]), out, sizeof(out)) == TRACKLE_CODEC_ERR_INPUT);
+}
+
+static void testNoSpace()
+{
+    const uint8_t in[] = {1, 2, 3, 4};
+    char text[16];
+    uint8_t out[4];
+    // the NULL terminator must fit too
+    CHECK(trackleHexEncode(in, sizeof(in), text, 8) == TRACKLE_CODEC_ERR_SPACE);
+    CHECK(trackleHexEncode(in, sizeof(in), text, 9) == 8);
+    CHECK(trackleBase64Encode(in, sizeof(in), text, 8) == TRACKLE_CODEC_ERR_SPACE);
+    CHECK(trackleBase64Encode(in, sizeof(in), text, 9) == 8);
+    CHECK(trackleBase64UrlEncode(in, sizeof(in), text, 6) == TRACKLE_CODEC_ERR_SPACE);
+    CHECK(trackleBase64UrlEncode(in, sizeof(in), text, 7) == 6);
+
+    CHECK(trackleHexDecode("abc", 3, out, 1) == TRACKLE_CODEC_ERR_SPACE);
+    CHECK(trackleBase64Decode("Zm9vYg==", 8, out, 3) == TRACKLE_CODEC_ERR_SPACE);
+    CHECK(trackleBase64UrlDecode("Zm9vYg", 6, out, 3) == TRACKLE_CODEC_ERR_SPACE);
+}
+
+int main()
+{
+    RUN(testVectors);
+    RUN(testRoundTrips);
+    RUN(testHexOddLength);
+    RUN(testMalformedBase64);
+    RUN(testNoSpace);
+    return 0;
+}
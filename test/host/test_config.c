@@ -0,0 +1,187 @@
+/**
+ * Configuration cache on the NVS stub: reads are served from RAM, 22 writes to 2 keys reach the flash
+ * as 2 blobs and 1 commit when the commit timer fires, blobs are flushed in the order of their last
+ * modification, and a blob that doesn't fit the cache is written after the pending ones. Shutdown
+ * flushes too.
+ */
+
+#include <string.h>
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "test_host.h"
+#include "trackle_utils_config.h"
+
+struct HostTimer
+{
+    esp_timer_create_args_t args;
+    bool active;
+};
+
+static struct HostTimer timer;
+static shutdown_handler_t shutdownHandler = NULL;
+
+// keys in the order they reach the flash
+static char written[16];
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    timer.args = *args;
+    *handle = &timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t t, uint64_t timeoutUs)
+{
+    CHECK(t == &timer && timeoutUs == TRACKLE_CONFIG_COMMIT_DELAY_MS * 1000ULL);
+    if (t->active)
+        return ESP_ERR_INVALID_STATE;
+    t->active = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t t)
+{
+    if (!t->active)
+        return ESP_ERR_INVALID_STATE;
+    t->active = false;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t t)
+{
+    return t->active;
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler)
+{
+    shutdownHandler = handler;
+    return ESP_OK;
+}
+
+static void onSet(const char *key, size_t length)
+{
+    const size_t n = strlen(written);
+    CHECK(n + 1 < sizeof(written));
+    written[n] = key[0];
+    written[n + 1] = '\0';
+}
+
+// the timer expires: the flush runs on the task of the cache
+static void fireTimer()
+{
+    CHECK(timer.active);
+    timer.active = false;
+    timer.args.callback(timer.args.arg);
+}
+
+static bool waitCommits(uint32_t commits)
+{
+    for (int i = 0; i < 100 && nvsStubStats.commits < commits; i++)
+        vTaskDelay(pdMS_TO_TICKS(10));
+    return nvsStubStats.commits == commits;
+}
+
+static bool writtenWere(const char *expected)
+{
+    const bool same = strcmp(written, expected) == 0;
+    if (!same)
+        fprintf(stderr, "written %s, expected %s\n", written, expected);
+    written[0] = '\0';
+    return same;
+}
+
+static TrackleConfig_Stats stats()
+{
+    TrackleConfig_Stats s;
+    trackleConfigGetStats(&s);
+    return s;
+}
+
+static nvs_handle_t handle;
+
+static void testRead()
+{
+    char buf[8];
+    CHECK(trackleConfigRead("a", buf, sizeof(buf)) == ESP_ERR_INVALID_STATE);
+
+    // "a" was saved before the boot
+    CHECK(nvs_open("config", NVS_READWRITE, &handle) == ESP_OK);
+    CHECK(nvs_set_blob(handle, "a", "AAAA", 4) == ESP_OK && nvs_commit(handle) == ESP_OK);
+    memset(&nvsStubStats, 0, sizeof(nvsStubStats));
+    written[0] = '\0';
+    nvsStubOnSet = onSet;
+
+    CHECK(trackleConfigInit(handle) == ESP_OK && shutdownHandler != NULL);
+    CHECK(trackleConfigRead("a", buf, sizeof(buf)) == ESP_OK && memcmp(buf, "AAAA", 4) == 0);
+    CHECK(trackleConfigRead("a", buf, 2) == ESP_ERR_NVS_INVALID_LENGTH);
+    CHECK(trackleConfigRead("zz", buf, sizeof(buf)) == ESP_ERR_NVS_NOT_FOUND);
+    CHECK(stats().reads == 3 && stats().readHits == 3);
+}
+
+static void testWriteBack()
+{
+    // 22 writes: b 10 times, a 10 times with the value it has, then c and b again
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK(trackleConfigWrite("b", &i, sizeof(i)) == ESP_OK);
+        CHECK(trackleConfigWrite("a", "AAAA", 4) == ESP_OK);
+    }
+    CHECK(trackleConfigWrite("c", "xyz", 3) == ESP_OK);
+    CHECK(trackleConfigWrite("b", "12345678", 8) == ESP_OK);
+    CHECK(nvsStubStats.sets == 0 && timer.active);
+
+    char buf[8];
+    CHECK(trackleConfigRead("c", buf, sizeof(buf)) == ESP_OK && memcmp(buf, "xyz", 3) == 0);
+    CHECK(trackleConfigRead("b", buf, sizeof(buf)) == ESP_OK && memcmp(buf, "12345678", 8) == 0);
+
+    // b was modified last: it goes after c
+    fireTimer();
+    CHECK(waitCommits(1) && nvsStubStats.sets == 2 && writtenWere("cb"));
+    size_t len = sizeof(buf);
+    CHECK(nvs_get_blob(handle, "b", buf, &len) == ESP_OK && len == 8 && memcmp(buf, "12345678", 8) == 0);
+
+    const TrackleConfig_Stats s = stats();
+    CHECK(s.writes == 22 && s.unchangedWrites == 10 && s.commits == 1 && s.commitsSaved == 21);
+    CHECK(s.flashBytesWritten == 11 && s.failures == 0);
+
+    // nothing left to write
+    CHECK(trackleConfigFlush() == ESP_OK && nvsStubStats.commits == 1);
+}
+
+static void testDirect()
+{
+    // d and e are pending when f, too big for what is left of the cache, is written through
+    char big[600];
+    memset(big, 7, sizeof(big));
+    CHECK(trackleConfigWrite("d", big, 600) == ESP_OK);
+    CHECK(trackleConfigWrite("e", "q", 1) == ESP_OK);
+    CHECK(trackleConfigWrite("d", big, 600) == ESP_OK);
+    CHECK(written[0] == '\0' && timer.active);
+    CHECK(trackleConfigWrite("f", big, 500) == ESP_OK);
+    CHECK(writtenWere("def") && nvsStubStats.commits == 3);
+
+    // and read from NVS
+    char out[600];
+    CHECK(trackleConfigRead("f", out, sizeof(out)) == ESP_OK && memcmp(out, big, 500) == 0);
+    CHECK(stats().readHits == stats().reads - 1);
+}
+
+static void testShutdown()
+{
+    CHECK(trackleConfigWrite("a", "BBBB", 4) == ESP_OK);
+    shutdownHandler();
+    CHECK(writtenWere("a") && nvsStubStats.commits == 4 && !timer.active);
+}
+
+int main()
+{
+    nvsStubErase();
+    RUN(testRead);
+    RUN(testWriteBack);
+    RUN(testDirect);
+    RUN(testShutdown);
+    return 0;
+}
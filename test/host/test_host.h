@@ -0,0 +1,25 @@
+#ifndef TEST_HOST_H
+#define TEST_HOST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// minimal assertions: report the failing check and exit with an error, so ctest marks the test failed
+#define CHECK(cond)                                                            \
+    do                                                                         \
+    {                                                                          \
+        if (!(cond))                                                           \
+        {                                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                           \
+        }                                                                      \
+    } while (0)
+
+#define RUN(test)                    \
+    do                               \
+    {                                \
+        test();                      \
+        printf("ok %s\n", #test);    \
+    } while (0)
+
+#endif
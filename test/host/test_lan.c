@@ -0,0 +1,263 @@
+/**
+ * The LAN endpoint over loopback: authentication, server nonce, replay protection per client, also
+ * against requests sent again from another source address.
+ */
+
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "test_host.h"
+#include "trackle_esp32.h"
+#include "trackle_utils_bt_functions.h"
+#include "trackle_utils_lan.h"
+
+#define MAC_LEN 32
+#define HEADER_LEN (MAC_LEN + 8 + 16)
+
+static const uint8_t secret[] = "not really a private key";
+static uint8_t key[MAC_LEN];
+static uint16_t port;
+static uint8_t nonce[8];
+static int posts = 0;
+
+struct Trackle *trackle_s = NULL;
+
+uint32_t getMillis()
+{
+    return xTaskGetTickCount();
+}
+
+bool trackleGet(struct Trackle *trackle, const char *name, void *(*function)(const char *), Data_TypeDef dataType)
+{
+    return true;
+}
+
+void tracklePowersaveNotifyActivity()
+{
+}
+
+static int post(const char *args)
+{
+    posts++;
+    return (int)strlen(args);
+}
+
+// a client socket bound to a loopback address, e.g. "127.0.0.2" to play another host
+static int clientSocket(const char *address)
+{
+    const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(sock >= 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    inet_pton(AF_INET, address, &addr.sin_addr);
+    CHECK(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    struct timeval timeout = {.tv_usec = 200000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sock;
+}
+
+static void writeBigEndian(uint8_t *out, uint64_t value)
+{
+    for (int i = 7; i >= 0; i--, value >>= 8)
+        out[i] = value;
+}
+
+static void sign(uint8_t *datagram, size_t len)
+{
+    unsigned int macLen;
+    HMAC(EVP_sha256(), key, sizeof(key), datagram + MAC_LEN, len - MAC_LEN, datagram, &macLen);
+}
+
+static size_t request(uint8_t *out, uint64_t client, uint64_t counter, const char *name, const char *args)
+{
+    memcpy(out + MAC_LEN, nonce, sizeof(nonce));
+    writeBigEndian(out + MAC_LEN + 8, client);
+    writeBigEndian(out + MAC_LEN + 16, counter);
+    const size_t nameLen = strlen(name) + 1;
+    memcpy(out + HEADER_LEN, name, nameLen);
+    memcpy(out + HEADER_LEN + nameLen, args, strlen(args));
+    const size_t len = HEADER_LEN + nameLen + strlen(args);
+    sign(out, len);
+    return len;
+}
+
+static void sendTo(int sock, const uint8_t *datagram, size_t len)
+{
+    struct sockaddr_in to = {.sin_family = AF_INET, .sin_port = htons(port)};
+    inet_pton(AF_INET, "127.0.0.1", &to.sin_addr);
+    CHECK(sendto(sock, datagram, len, 0, (struct sockaddr *)&to, sizeof(to)) == (ssize_t)len);
+}
+
+/**
+ * Wait for the response to a request: checks its MAC, client ID and counter, and saves the nonce.
+ * Returns the status, -1 if nothing was received.
+ */
+static int response(int sock, const uint8_t *req, char *result)
+{
+    uint8_t in[512];
+    const ssize_t len = recv(sock, in, sizeof(in), 0);
+    if (len < 0)
+        return -1;
+    CHECK(len > HEADER_LEN);
+    uint8_t mac[MAC_LEN];
+    memcpy(mac, in, MAC_LEN);
+    sign(in, len);
+    CHECK(memcmp(mac, in, MAC_LEN) == 0);
+    CHECK(memcmp(in + MAC_LEN + 8, req + MAC_LEN + 8, 16) == 0);
+    memcpy(nonce, in + MAC_LEN, sizeof(nonce));
+    if (result != NULL)
+    {
+        memcpy(result, in + HEADER_LEN + 1, len - HEADER_LEN - 1);
+        result[len - HEADER_LEN - 1] = '\0';
+    }
+    return in[HEADER_LEN];
+}
+
+static void start()
+{
+    static const char label[] = "trackle-lan-v1";
+    unsigned int keyLen;
+    HMAC(EVP_sha256(), secret, sizeof(secret), (const uint8_t *)label, sizeof(label) - 1, key, &keyLen);
+    CHECK(Trackle_BtPost_add("post", post));
+
+    // a port of its own, so that parallel ctest runs don't collide
+    for (port = 40000 + getpid() % 20000; trackleLanStart(port, secret, sizeof(secret)) != ESP_OK; port++)
+        ;
+    CHECK(trackleLanStart(port, secret, sizeof(secret)) == ESP_ERR_INVALID_STATE);
+}
+
+static void testNonce()
+{
+    const int sock = clientSocket("127.0.0.1");
+    uint8_t req[256];
+    // any nonce the first time: not executed, the answer carries the right one
+    const size_t len = request(req, 1, 1, "post", "abc");
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, NULL) == TRACKLE_LAN_STALE_NONCE);
+    CHECK(posts == 0);
+    close(sock);
+}
+
+static void testCall()
+{
+    const int sock = clientSocket("127.0.0.1");
+    uint8_t req[256];
+    char result[64];
+    size_t len = request(req, 1, 2, "post", "abcd");
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, result) == TRACKLE_LAN_OK);
+    CHECK(strcmp(result, "4") == 0 && posts == 1);
+
+    len = request(req, 1, 3, "missing", "");
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, NULL) == TRACKLE_LAN_NOT_FOUND);
+    close(sock);
+}
+
+static void testBadMac()
+{
+    const int sock = clientSocket("127.0.0.1");
+    uint8_t req[256];
+    TrackleLan_Stats before, after;
+    trackleLanGetStats(&before);
+    size_t len = request(req, 1, 10, "post", "abc");
+    req[len - 1] ^= 1; // the arguments changed after signing
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, NULL) == -1);
+    sendTo(sock, req, HEADER_LEN - 1); // too short
+    CHECK(response(sock, req, NULL) == -1);
+    trackleLanGetStats(&after);
+    CHECK(after.authFailures == before.authFailures + 2 && posts == 1);
+    close(sock);
+}
+
+static void testReplay()
+{
+    const int sock = clientSocket("127.0.0.1");
+    uint8_t req[256];
+    const size_t len = request(req, 1, 20, "post", "abc");
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, NULL) == TRACKLE_LAN_OK);
+    CHECK(posts == 2);
+
+    TrackleLan_Stats before, after;
+    trackleLanGetStats(&before);
+    // the same datagram again, and an older counter
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, NULL) == -1);
+    const size_t olderLen = request(req, 1, 15, "post", "abc");
+    sendTo(sock, req, olderLen);
+    CHECK(response(sock, req, NULL) == -1);
+    trackleLanGetStats(&after);
+    CHECK(after.replays == before.replays + 2 && posts == 2);
+    close(sock);
+}
+
+static void testSpoofedSource()
+{
+    // a request captured on the LAN, sent again from another address: the source is not authenticated
+    const int sock = clientSocket("127.0.0.1");
+    const int attacker = clientSocket("127.0.0.2");
+    uint8_t req[256];
+    const size_t len = request(req, 1, 30, "post", "abc");
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, NULL) == TRACKLE_LAN_OK);
+    CHECK(posts == 3);
+
+    sendTo(attacker, req, len);
+    CHECK(response(attacker, req, NULL) == -1);
+    CHECK(response(sock, req, NULL) == -1);
+    CHECK(posts == 3);
+    close(sock);
+    close(attacker);
+}
+
+static void testClients()
+{
+    // another client ID has its own counter, whatever its address
+    const int sock = clientSocket("127.0.0.2");
+    uint8_t req[256];
+    size_t len = request(req, 2, 5, "post", "abc");
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, NULL) == TRACKLE_LAN_OK);
+    len = request(req, 1, 31, "post", "abc");
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, NULL) == TRACKLE_LAN_OK);
+    CHECK(posts == 5);
+
+    // new clients make the server forget 1 and 2: their requests must not become valid again
+    const size_t capturedLen = request(req, 1, 31, "post", "abc");
+    uint8_t captured[256];
+    memcpy(captured, req, capturedLen);
+    for (uint64_t id = 100; id < 100 + TRACKLE_LAN_MAX_CLIENTS; id++)
+    {
+        vTaskDelay(5); // clients are forgotten least recently seen first
+        len = request(req, id, 40, "post", ""); // new clients start above the counters forgotten
+        sendTo(sock, req, len);
+        CHECK(response(sock, req, NULL) == TRACKLE_LAN_OK);
+    }
+    sendTo(sock, captured, capturedLen);
+    CHECK(response(sock, captured, NULL) == -1);
+    // client 1 is new again: it must go past the highest counter forgotten, 40 by now
+    len = request(req, 1, 41, "post", "abc");
+    sendTo(sock, req, len);
+    CHECK(response(sock, req, NULL) == TRACKLE_LAN_OK);
+    close(sock);
+}
+
+int main()
+{
+    start();
+    RUN(testNonce);
+    RUN(testCall);
+    RUN(testBadMac);
+    RUN(testReplay);
+    RUN(testSpoofedSource);
+    RUN(testClients);
+    return 0;
+}
@@ -0,0 +1,236 @@
+/**
+ * Interface failover with stubbed netifs: the best interface that is up is active, the cloud is told
+ * when the first one gets its address, when the route moves (failover and failback) and when the
+ * last one goes down; the socket is bound to the active interface.
+ */
+
+#include <string.h>
+
+#include "esp_netif.h"
+#include "lwip/sockets.h"
+#include "test_host.h"
+#include "trackle_esp32.h"
+#include "trackle_utils.h"
+#include "trackle_utils_connectivity.h"
+#include "trackle_utils_netif.h"
+
+#define WIFI 1
+#define ETHERNET 2
+#define CELLULAR 3
+
+struct esp_netif_obj
+{
+    const char *desc;
+    const char *implName;
+};
+
+static esp_netif_t wifi = {"sta", "st1"};
+static esp_netif_t eth = {"eth", "en1"};
+static esp_netif_t ppp = {"ppp", "pp1"};
+static esp_netif_t other = {"ap", "ap1"};
+
+EventGroupHandle_t s_wifi_event_group;
+struct Trackle *trackle_s = NULL;
+static uint32_t fakeMillis = 1000;
+static esp_netif_t *defaultNetif = NULL;
+static char boundTo[16];
+static bool bindFails = false;
+
+// connectivity events, in order: L link up, G got ip, R route change, D link down
+static char events[32];
+
+uint32_t getMillis()
+{
+    return fakeMillis;
+}
+
+const char *esp_netif_get_desc(esp_netif_t *netif)
+{
+    return netif->desc;
+}
+
+esp_err_t esp_netif_set_default_netif(esp_netif_t *netif)
+{
+    defaultNetif = netif;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_netif_impl_name(esp_netif_t *netif, char *name)
+{
+    strcpy(name, netif->implName);
+    return ESP_OK;
+}
+
+int setsockopt(int sock, int level, int name, const void *value, socklen_t len)
+{
+    CHECK(level == SOL_SOCKET && name == SO_BINDTODEVICE && len == sizeof(struct ifreq));
+    if (bindFails)
+    {
+        errno = ENODEV;
+        return -1;
+    }
+    strcpy(boundTo, ((const struct ifreq *)value)->ifr_name);
+    return 0;
+}
+
+static void event(char e)
+{
+    const size_t n = strlen(events);
+    CHECK(n + 1 < sizeof(events));
+    events[n] = e;
+    events[n + 1] = '\0';
+}
+
+void trackleConnectivityOnLinkUp()
+{
+    event('L');
+}
+
+void trackleConnectivityOnGotIp()
+{
+    event('G');
+}
+
+void trackleConnectivityOnLinkDown()
+{
+    event('D');
+}
+
+void trackleConnectivityOnRouteChange()
+{
+    event('R');
+}
+
+// the events since the last call
+static bool eventsWere(const char *expected)
+{
+    const bool same = strcmp(events, expected) == 0;
+    if (!same)
+        fprintf(stderr, "events %s, expected %s\n", events, expected);
+    events[0] = '\0';
+    return same;
+}
+
+static bool connected()
+{
+    return (xEventGroupGetBits(s_wifi_event_group) & NETWORK_CONNECTED_BIT) != 0;
+}
+
+static uint32_t switches()
+{
+    TrackleNetif_Stats stats;
+    trackleNetifGetStats(&stats);
+    return stats.switches;
+}
+
+static void testNoInterface()
+{
+    CHECK(trackleNetifGetActive() == NULL);
+    CHECK(trackleNetifGetConnectionType() == -1);
+    CHECK(trackleNetifBindSocket(3)); // nothing to bind to
+    CHECK(boundTo[0] == '\0');
+}
+
+static void testFirstUp()
+{
+    CHECK(trackleNetifRegister(&wifi, TRACKLE_NETIF_PRIORITY_WIFI, WIFI));
+    CHECK(trackleNetifRegister(&eth, TRACKLE_NETIF_PRIORITY_ETHERNET, ETHERNET));
+    CHECK(!trackleNetifBindSocket(3)); // registered, none up
+
+    trackleNetifLinkUp(&wifi);
+    CHECK(eventsWere("L"));
+    trackleNetifSetUp(&wifi, true);
+    CHECK(eventsWere("G"));
+    CHECK(trackleNetifGetActive() == &wifi && defaultNetif == &wifi && connected());
+    CHECK(trackleNetifGetConnectionType() == WIFI && trackleNetifIsUp(&wifi) && !trackleNetifIsUp(&eth));
+    CHECK(trackleNetifBindSocket(3) && strcmp(boundTo, "st1") == 0);
+    CHECK(switches() == 1);
+}
+
+static void testPreferred()
+{
+    // the cable is plugged: the session moves to the preferred interface
+    trackleNetifLinkUp(&eth); // doesn't disturb the session on Wi-Fi
+    CHECK(eventsWere(""));
+    fakeMillis = 2000;
+    trackleNetifSetUp(&eth, true);
+    CHECK(eventsWere("R"));
+    CHECK(trackleNetifGetActive() == &eth && defaultNetif == &eth && trackleNetifGetConnectionType() == ETHERNET);
+    CHECK(trackleNetifBindSocket(3) && strcmp(boundTo, "en1") == 0);
+
+    // a backup going up or down while the preferred one is active changes nothing
+    trackleNetifSetUp(&wifi, false);
+    trackleNetifSetUp(&wifi, true);
+    trackleNetifSetUp(&eth, true);
+    CHECK(eventsWere("") && trackleNetifGetActive() == &eth);
+
+    TrackleNetif_Stats stats;
+    trackleNetifGetStats(&stats);
+    CHECK(stats.switches == 2 && stats.lastSwitchMillis == 2000);
+}
+
+static void testFailoverAndFailback()
+{
+    fakeMillis = 3000;
+    trackleNetifSetUp(&eth, false);
+    CHECK(eventsWere("R") && trackleNetifGetActive() == &wifi && defaultNetif == &wifi && connected());
+    fakeMillis = 4000;
+    trackleNetifSetUp(&eth, true);
+    CHECK(eventsWere("R") && trackleNetifGetActive() == &eth && defaultNetif == &eth);
+
+    TrackleNetif_Stats stats;
+    trackleNetifGetStats(&stats);
+    CHECK(stats.switches == 4 && stats.lastSwitchMillis == 4000);
+}
+
+static void testAllDown()
+{
+    trackleNetifSetUp(&wifi, false);
+    CHECK(eventsWere(""));
+    trackleNetifSetUp(&eth, false);
+    CHECK(eventsWere("D") && trackleNetifGetActive() == NULL && !connected());
+    CHECK(trackleNetifGetConnectionType() == -1);
+    CHECK(switches() == 5);
+
+    // back on the backup only: a new session, not a route change
+    trackleNetifSetUp(&wifi, true);
+    CHECK(eventsWere("G") && trackleNetifGetActive() == &wifi && connected());
+}
+
+static void testRegistration()
+{
+    // equal priorities: the first registered wins; a new registration updates the priority
+    CHECK(trackleNetifRegister(&ppp, TRACKLE_NETIF_PRIORITY_WIFI, CELLULAR));
+    trackleNetifSetUp(&ppp, true);
+    CHECK(eventsWere("") && trackleNetifGetActive() == &wifi);
+    CHECK(trackleNetifRegister(&ppp, TRACKLE_NETIF_PRIORITY_WIFI + 1, CELLULAR));
+    trackleNetifSetUp(&ppp, true);
+    CHECK(eventsWere("R") && trackleNetifGetActive() == &ppp && trackleNetifGetConnectionType() == CELLULAR);
+
+    // the table is full, unknown interfaces are ignored
+    CHECK(trackleNetifRegister(&other, 0, WIFI));
+    static esp_netif_t extra = {"extra", "ex1"};
+    CHECK(!trackleNetifRegister(&extra, 100, WIFI));
+    trackleNetifSetUp(&extra, true);
+    CHECK(eventsWere("") && trackleNetifGetActive() == &ppp && !trackleNetifIsUp(&extra));
+}
+
+static void testBindFails()
+{
+    bindFails = true;
+    CHECK(!trackleNetifBindSocket(3));
+    bindFails = false;
+}
+
+int main()
+{
+    s_wifi_event_group = xEventGroupCreate();
+    RUN(testNoInterface);
+    RUN(testFirstUp);
+    RUN(testPreferred);
+    RUN(testFailoverAndFailback);
+    RUN(testAllDown);
+    RUN(testRegistration);
+    RUN(testBindFails);
+    return 0;
+}
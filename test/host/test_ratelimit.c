@@ -0,0 +1,197 @@
+/**
+ * Publish rate limiter on a stubbed clock: a 1/s global quota drains a burst at one event per second
+ * in order, MERGE keeps only the last value, slow rates refill exactly, DROP and a full queue reject,
+ * and the queue waits while disconnected, congested or refused by the library.
+ */
+
+#include <string.h>
+
+#include "test_host.h"
+#include "trackle_esp32.h"
+#include "trackle_utils_ratelimit.h"
+
+#define LOOP_PERIOD_MS 20 // trackle_task
+#define MAX_PUBLISHED 64
+
+typedef struct
+{
+    char name[16];
+    char data[16];
+    uint32_t at;
+} Published_t;
+
+struct Trackle *trackle_s = NULL;
+SemaphoreHandle_t xTrackleSemaphore = NULL;
+static uint32_t now = 1000;
+static bool connected = true;
+static bool congested = false;
+static bool refusing = false;
+static Published_t published[MAX_PUBLISHED];
+static int publishedCount = 0;
+
+uint32_t getMillis()
+{
+    return now;
+}
+
+bool trackleConnected(struct Trackle *v)
+{
+    return connected;
+}
+
+bool trackleTxQueueCongested()
+{
+    return congested;
+}
+
+bool tracklePublish(struct Trackle *v, const char *eventName, const char *data, int ttl, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key)
+{
+    if (refusing)
+        return false;
+    CHECK(publishedCount < MAX_PUBLISHED);
+    Published_t *p = &published[publishedCount++];
+    snprintf(p->name, sizeof(p->name), "%s", eventName);
+    snprintf(p->data, sizeof(p->data), "%s", data);
+    p->at = now;
+    return true;
+}
+
+static TrackleRateLimit_Result admit(const char *name, const char *data)
+{
+    return trackleRateLimitAdmit(name, data, PRIVATE, WITH_ACK, 0);
+}
+
+// trackle_task for a while
+static void run(uint32_t ms)
+{
+    for (uint32_t end = now + ms; now < end;)
+    {
+        now += LOOP_PERIOD_MS;
+        trackleRateLimitLoop();
+    }
+}
+
+static TrackleRateLimit_Stats stats()
+{
+    TrackleRateLimit_Stats s;
+    trackleRateLimitGetStats(&s);
+    return s;
+}
+
+static void reset()
+{
+    CHECK(trackleRateLimitSetGlobal(0, 0, TRACKLE_RATELIMIT_DROP));
+    publishedCount = 0;
+}
+
+static void testBurst()
+{
+    // 1/s, burst of 3: the rest of a burst of 8 goes out one per second, in order
+    CHECK(trackleRateLimitSetGlobal(60, 3, TRACKLE_RATELIMIT_QUEUE));
+    const uint32_t start = now;
+    char data[8];
+    for (int i = 0; i < 8; i++)
+    {
+        snprintf(data, sizeof(data), "x%d", i);
+        CHECK(admit("ev", data) == (i < 3 ? TRACKLE_RATELIMIT_ADMITTED : TRACKLE_RATELIMIT_QUEUED));
+    }
+    run(10000);
+    CHECK(publishedCount == 5);
+    for (int i = 0; i < 5; i++)
+    {
+        snprintf(data, sizeof(data), "x%d", i + 3);
+        CHECK(strcmp(published[i].data, data) == 0);
+        CHECK(published[i].at == start + 1000 * (i + 1));
+    }
+    const TrackleRateLimit_Stats s = stats();
+    CHECK(s.admitted == 3 && s.queued == 5 && s.drained == 5 && s.maxQueued == 5 && s.dropped == 0);
+    reset();
+}
+
+static void testMerge()
+{
+    // one "temp" every 10 s: the values in between are merged into the last one
+    CHECK(trackleRateLimitSetEvent("temp", 6, 1, TRACKLE_RATELIMIT_MERGE));
+    CHECK(admit("temp", "20") == TRACKLE_RATELIMIT_ADMITTED);
+    CHECK(admit("temp", "21") == TRACKLE_RATELIMIT_QUEUED);
+    CHECK(admit("temp", "22") == TRACKLE_RATELIMIT_QUEUED);
+    CHECK(admit("temp", "23") == TRACKLE_RATELIMIT_QUEUED);
+    // other events aren't held up by it
+    CHECK(admit("other", "x") == TRACKLE_RATELIMIT_ADMITTED);
+    run(20000);
+    CHECK(publishedCount == 1 && strcmp(published[0].data, "23") == 0);
+    CHECK(trackleRateLimitGetThrottled("temp") == 3 && trackleRateLimitGetThrottled("other") == 0);
+    CHECK(stats().merged == 2);
+    reset();
+}
+
+static void testSlowRate()
+{
+    // 2/min refilled at every loop: exactly 2 per minute
+    CHECK(trackleRateLimitSetEvent("slow", 2, 1, TRACKLE_RATELIMIT_QUEUE));
+    CHECK(admit("slow", "0") == TRACKLE_RATELIMIT_ADMITTED);
+    for (int i = 1; i < 8; i++)
+        CHECK(admit("slow", "n") == TRACKLE_RATELIMIT_QUEUED);
+    run(120000);
+    CHECK(publishedCount == 4);
+    run(90000);
+    CHECK(publishedCount == 7 && stats().maxQueued == 7);
+    reset();
+}
+
+static void testDrop()
+{
+    CHECK(trackleRateLimitSetEvent("drop", 60, 1, TRACKLE_RATELIMIT_DROP));
+    CHECK(admit("drop", "1") == TRACKLE_RATELIMIT_ADMITTED);
+    CHECK(admit("drop", "2") == TRACKLE_RATELIMIT_DROPPED);
+
+    // too long to be queued, then a full queue
+    CHECK(trackleRateLimitSetEvent("full", 60, 1, TRACKLE_RATELIMIT_QUEUE));
+    CHECK(admit("full", "a") == TRACKLE_RATELIMIT_ADMITTED);
+    char tooLong[TRACKLE_RATELIMIT_DATA_LEN + 1];
+    memset(tooLong, 'x', TRACKLE_RATELIMIT_DATA_LEN);
+    tooLong[TRACKLE_RATELIMIT_DATA_LEN] = '\0';
+    CHECK(admit("full", tooLong) == TRACKLE_RATELIMIT_DROPPED);
+    for (int i = 0; i < TRACKLE_RATELIMIT_QUEUE_LEN; i++)
+        CHECK(admit("full", "q") == TRACKLE_RATELIMIT_QUEUED);
+    CHECK(admit("full", "q") == TRACKLE_RATELIMIT_DROPPED);
+    CHECK(stats().dropped == 3);
+    run(TRACKLE_RATELIMIT_QUEUE_LEN * 1000);
+    CHECK(publishedCount == TRACKLE_RATELIMIT_QUEUE_LEN);
+    reset();
+}
+
+static void testWaiting()
+{
+    // nothing goes out while disconnected, congested or refused; then the queue drains
+    CHECK(trackleRateLimitSetEvent("wait", 60, 1, TRACKLE_RATELIMIT_QUEUE));
+    CHECK(admit("wait", "1") == TRACKLE_RATELIMIT_ADMITTED);
+    CHECK(admit("wait", "2") == TRACKLE_RATELIMIT_QUEUED);
+    CHECK(admit("wait", "3") == TRACKLE_RATELIMIT_QUEUED);
+    connected = false;
+    run(5000);
+    connected = true;
+    congested = true;
+    run(5000);
+    congested = false;
+    refusing = true;
+    run(5000);
+    CHECK(publishedCount == 0);
+    refusing = false;
+    run(LOOP_PERIOD_MS);
+    CHECK(publishedCount == 1 && strcmp(published[0].data, "2") == 0);
+    run(1000);
+    CHECK(publishedCount == 2 && strcmp(published[1].data, "3") == 0);
+    reset();
+}
+
+int main()
+{
+    xTrackleSemaphore = xSemaphoreCreateMutex();
+    RUN(testBurst);
+    RUN(testMerge);
+    RUN(testSlowRate);
+    RUN(testDrop);
+    RUN(testWaiting);
+    return 0;
+}
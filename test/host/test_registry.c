@@ -0,0 +1,158 @@
+/**
+ * Stream endpoints of a registry: blocks in sequence, resume offsets, malformed blocks, aborts, and
+ * the block function running without the registry lock while other calls go on.
+ */
+
+#include <string.h>
+
+#include "freertos/task.h"
+#include "test_host.h"
+#include "trackle_utils_codec.h"
+#include "trackle_utils_registry.h"
+
+static TrackleRegistry_t reg;
+static uint8_t received[64];
+static uint32_t receivedLen = 0;
+static bool lastSeen = false;
+static volatile bool blocked = false; // the block function waits while set
+static volatile bool inBlock = false;
+static int failAt = -1;
+
+static int writeBlock(uint32_t offset, const uint8_t *data, size_t len, bool last)
+{
+    inBlock = true;
+    while (blocked)
+        vTaskDelay(1);
+    inBlock = false;
+    if ((int)offset == failAt)
+        return -5;
+    CHECK(offset + len <= sizeof(received));
+    memcpy(received + offset, data, len);
+    receivedLen = offset + len;
+    lastSeen = last;
+    return 0;
+}
+
+static int post(const char *args)
+{
+    return 7;
+}
+
+// "offset,more,base64 data" in args
+static int sendBlock(TrackleEndpoint_Handle handle, uint32_t offset, bool more, const char *data)
+{
+    char args[128];
+    const int n = snprintf(args, sizeof(args), "%u,%d,", (unsigned)offset, more);
+    trackleBase64Encode((const uint8_t *)data, strlen(data), args + n, sizeof(args) - n);
+    return trackleRegistryWriteBlock(&reg, handle, args);
+}
+
+static void testSequence()
+{
+    const TrackleEndpoint_Handle stream = trackleRegistryAddStream(&reg, "upload", writeBlock);
+    CHECK(stream != TRACKLE_ENDPOINT_INVALID);
+    CHECK(sendBlock(stream, 0, true, "hello ") == 6);
+    CHECK(sendBlock(stream, 6, true, "blocky ") == 13);
+    // repeated and out of order blocks are answered with the offset to go on from
+    CHECK(sendBlock(stream, 6, true, "blocky ") == 13);
+    CHECK(sendBlock(stream, 20, true, "later") == 13);
+    CHECK(sendBlock(stream, 13, false, "world") == 18);
+    CHECK(receivedLen == 18 && lastSeen && memcmp(received, "hello blocky world", 18) == 0);
+
+    // the payload is over: only a new one is accepted
+    CHECK(sendBlock(stream, 18, false, "x") == 0);
+
+    char malformed[] = "0,1,not base64!";
+    CHECK(trackleRegistryWriteBlock(&reg, stream, malformed) == TRACKLE_REGISTRY_ERR_BLOCK);
+    char badFraming[] = "0,2,aGk=";
+    CHECK(trackleRegistryWriteBlock(&reg, stream, badFraming) == TRACKLE_REGISTRY_ERR_BLOCK);
+    const TrackleEndpoint_Handle other = trackleRegistryAddPost(&reg, "post", post);
+    CHECK(sendBlock(other, 0, false, "hi") == TRACKLE_REGISTRY_ERR_BLOCK);
+}
+
+static void testAbort()
+{
+    const TrackleEndpoint_Handle stream = trackleRegistryFind(&reg, "upload");
+    CHECK(sendBlock(stream, 0, true, "abc") == 3);
+    // a malformed block leaves the transfer where it was
+    char malformed[] = "3,1,***";
+    CHECK(trackleRegistryWriteBlock(&reg, stream, malformed) == TRACKLE_REGISTRY_ERR_BLOCK);
+    CHECK(sendBlock(stream, 3, true, "def") == 6);
+    // the function refuses a block: the transfer starts over
+    failAt = 6;
+    CHECK(sendBlock(stream, 6, true, "ghi") == -5);
+    failAt = -1;
+    CHECK(sendBlock(stream, 6, true, "ghi") == 0);
+}
+
+static TrackleEndpoint_Handle slowStream;
+static volatile int slowResult = 0;
+static volatile bool slowDone = false;
+
+static void slowWriter(void *arg)
+{
+    slowResult = sendBlock(slowStream, 0, true, "slow");
+    slowDone = true;
+    vTaskDelete(NULL);
+}
+
+static void testWithoutLock()
+{
+    // a block function that takes long (a flash write) doesn't hold the registry
+    slowStream = trackleRegistryFind(&reg, "upload");
+    blocked = true;
+    CHECK(xTaskCreate(slowWriter, "writer", 4096, NULL, 5, NULL) == pdPASS);
+    while (!inBlock)
+        vTaskDelay(1);
+
+    char args[] = "";
+    char scratch[32];
+    const char *result;
+    size_t resultLen;
+    CHECK(trackleRegistryCall(&reg, trackleRegistryFind(&reg, "post"), args, scratch, sizeof(scratch), &result, &resultLen) == ESP_OK);
+    CHECK(resultLen == 1 && result[0] == '7');
+    CHECK(trackleRegistryAddPost(&reg, "added", post) != TRACKLE_ENDPOINT_INVALID);
+    // another block of the same function must wait
+    CHECK(sendBlock(slowStream, 0, true, "other") == TRACKLE_REGISTRY_ERR_BUSY);
+    char block[64];
+    snprintf(block, sizeof(block), "0,1,b3RoZXI=");
+    CHECK(trackleRegistryCall(&reg, slowStream, block, scratch, sizeof(scratch), &result, &resultLen) == ESP_OK);
+    CHECK(strncmp(result, "-1001", resultLen) == 0);
+
+    blocked = false;
+    while (!slowDone)
+        vTaskDelay(1);
+    CHECK(slowResult == 4);
+    CHECK(sendBlock(slowStream, 4, false, "er") == 6);
+    CHECK(memcmp(received, "slower", 6) == 0);
+}
+
+static void testRemovedWhileWriting()
+{
+    // the endpoint goes away during the block: the block completes, the new endpoint starts clean
+    slowDone = false;
+    blocked = true;
+    CHECK(xTaskCreate(slowWriter, "writer", 4096, NULL, 5, NULL) == pdPASS);
+    while (!inBlock)
+        vTaskDelay(1);
+    CHECK(trackleRegistryRemove(&reg, "upload"));
+    const TrackleEndpoint_Handle stream = trackleRegistryAddStream(&reg, "upload", writeBlock);
+    CHECK(stream != TRACKLE_ENDPOINT_INVALID && stream != slowStream);
+    blocked = false;
+    while (!slowDone)
+        vTaskDelay(1);
+    CHECK(slowResult == 4);
+    CHECK(sendBlock(slowStream, 4, false, "er") == TRACKLE_REGISTRY_ERR_BLOCK);
+    CHECK(sendBlock(stream, 4, false, "er") == 0); // not started
+    CHECK(sendBlock(stream, 0, false, "new") == 3);
+}
+
+int main()
+{
+    trackleRegistryInit(&reg);
+    RUN(testSequence);
+    RUN(testAbort);
+    RUN(testWithoutLock);
+    RUN(testRemovedWhileWriting);
+    return 0;
+}
@@ -0,0 +1,134 @@
+/**
+ * Publish rules on a stubbed clock: the example of the header publishes 6 readings out of 10, '&'
+ * binds tighter than '|', malformed rules are rejected, rules pushed from the cloud are saved to the
+ * NVS stub and loaded back. Prints the time of an evaluation.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "nvs.h"
+#include "test_host.h"
+#include "trackle_esp32.h"
+#include "trackle_utils_rules.h"
+
+#define MAX_PUBLISHED 16
+
+struct Trackle *trackle_s = NULL;
+SemaphoreHandle_t xTrackleSemaphore = NULL;
+static uint32_t now = 0;
+static char published[MAX_PUBLISHED][16];
+static int publishedCount = 0;
+
+uint32_t getMillis()
+{
+    return now;
+}
+
+bool tracklePublishSecure(const char *eventName, const char *data)
+{
+    CHECK(publishedCount < MAX_PUBLISHED);
+    snprintf(published[publishedCount++], sizeof(published[0]), "%s", data);
+    return true;
+}
+
+static TrackleRules_Stats stats()
+{
+    TrackleRules_Stats s;
+    trackleRulesGetStats(&s);
+    return s;
+}
+
+static void testExample()
+{
+    // above 30, or moved by more than 0.5, or an hour since the last publish
+    CHECK(trackleRulesSet("temp:>30|delta>0.5|age>=3600") == ESP_OK);
+    const float values[] = {20, 20.2, 20.4, 20.6, 20.7, 31, 31.1, 19, 19};
+    const TrackleRules_Result expected[] = {TRACKLE_RULES_PUBLISHED, TRACKLE_RULES_FILTERED, TRACKLE_RULES_FILTERED,
+                                            TRACKLE_RULES_PUBLISHED, TRACKLE_RULES_FILTERED, TRACKLE_RULES_PUBLISHED,
+                                            TRACKLE_RULES_PUBLISHED, TRACKLE_RULES_PUBLISHED, TRACKLE_RULES_FILTERED};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        now += 1000;
+        CHECK(trackleRulesPublish("temp", values[i]) == expected[i]);
+    }
+    now += 3600 * 1000;
+    CHECK(trackleRulesPublish("temp", 19) == TRACKLE_RULES_PUBLISHED);
+
+    const char *data[] = {"20", "20.6", "31", "31.1", "19", "19"};
+    CHECK(publishedCount == 6);
+    for (int i = 0; i < publishedCount; i++)
+        CHECK(strcmp(published[i], data[i]) == 0);
+    const TrackleRules_Stats s = stats();
+    CHECK(s.evaluated == 10 && s.published == 6 && s.filtered == 4);
+
+    // events without a rule always go out
+    CHECK(trackleRulesPublish("other", 1) == TRACKLE_RULES_PUBLISHED && stats().evaluated == 10);
+}
+
+static void testPrecedence()
+{
+    // (>=40 & <60) | =100
+    CHECK(trackleRulesSet("hum:>=40 & <60 | =100") == ESP_OK);
+    CHECK(!trackleRulesMatch("hum", 39));
+    CHECK(trackleRulesMatch("hum", 40) && trackleRulesMatch("hum", 59.5));
+    CHECK(!trackleRulesMatch("hum", 60) && !trackleRulesMatch("hum", 99));
+    CHECK(trackleRulesMatch("hum", 100));
+}
+
+static void testMalformed()
+{
+    const char *malformed[] = {"temp:>", "temp:x>3", ":>3", "t:>3|", "temp>3", "temp:>3&", "temp:delta"};
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+    {
+        CHECK(trackleRulesSet(malformed[i]) == ESP_ERR_INVALID_ARG);
+        CHECK(trackleRulesPostCb(malformed[i]) == -1);
+    }
+    CHECK(trackleRulesPostCb(NULL) == -1);
+    // the previous rule is still there
+    CHECK(!trackleRulesMatch("hum", 39));
+}
+
+static void testSaveLoad()
+{
+    nvsStubErase();
+    CHECK(trackleRulesLoad() == ESP_ERR_NVS_NOT_FOUND);
+
+    // set and removed from the cloud, saved every time
+    CHECK(trackleRulesPostCb("press:delta>=10") == 1);
+    CHECK(trackleRulesPostCb("hum:") == 1);
+    CHECK(nvsStubStats.sets == 2 && nvsStubStats.commits == 2);
+
+    trackleRulesClear();
+    CHECK(trackleRulesMatch("hum", 39) && trackleRulesMatch("temp", 20));
+    CHECK(trackleRulesLoad() == ESP_OK);
+
+    // temp and press are back, hum isn't
+    CHECK(trackleRulesMatch("hum", 39));
+    CHECK(trackleRulesPublish("temp", 25) == TRACKLE_RULES_PUBLISHED && !trackleRulesMatch("temp", 25.1));
+    CHECK(trackleRulesPublish("press", 1000) == TRACKLE_RULES_PUBLISHED);
+    CHECK(!trackleRulesMatch("press", 1009) && trackleRulesMatch("press", 1010));
+}
+
+static void testSpeed()
+{
+    const int n = 5000000;
+    struct timespec start, end;
+    volatile int matches = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < n; i++)
+        matches += trackleRulesMatch("temp", (float)(i & 63));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    CHECK(matches > 0);
+    printf("  %.0f ns per evaluation\n", ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / n);
+}
+
+int main()
+{
+    RUN(testExample);
+    RUN(testPrecedence);
+    RUN(testMalformed);
+    RUN(testSaveLoad);
+    RUN(testSpeed);
+    return 0;
+}
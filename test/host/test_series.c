@@ -0,0 +1,265 @@
+/**
+ * Series windows: aggregates, the raw format decoded as documented in trackle_utils_series.h, the
+ * window start time and samples added from another task while windows are published.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/task.h"
+#include "test_host.h"
+#include "trackle_esp32.h"
+#include "trackle_utils_codec.h"
+#include "trackle_utils_series.h"
+#include "trackle_utils_time.h"
+
+#define WALL_BASE_MS 1700000000000LL
+#define MAX_SAMPLES 1000
+
+static volatile uint32_t fakeMillis = 1000;
+static int64_t wallOffsetMs = 0; // a cloud sync moves the wall clock
+static const char *watched = NULL; // the series whose windows are looked at
+static char published[2048];
+static int publishes = 0;
+
+uint32_t getMillis()
+{
+    return fakeMillis;
+}
+
+int64_t trackleTimeNowMs()
+{
+    return WALL_BASE_MS + fakeMillis + wallOffsetMs;
+}
+
+bool tracklePublishPacedSecure(const char *eventName, const char *data)
+{
+    CHECK(strlen(data) < sizeof(published));
+    if (watched == NULL || strcmp(eventName, watched) != 0)
+        return true;
+    strcpy(published, data);
+    publishes++;
+    return true;
+}
+
+static long long field(const char *json, const char *key)
+{
+    char pattern[16];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(json, pattern);
+    CHECK(p != NULL);
+    return atoll(p + strlen(pattern));
+}
+
+static double floatField(const char *json, const char *key)
+{
+    char pattern[16];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(json, pattern);
+    CHECK(p != NULL);
+    return atof(p + strlen(pattern));
+}
+
+// bit reader of the raw format
+static const uint8_t *rawBytes;
+static uint32_t rawPos;
+
+static uint32_t getBits(int n)
+{
+    uint32_t v = 0;
+    for (; n > 0; n--, rawPos++)
+        v = (v << 1) | ((rawBytes[rawPos >> 3] >> (7 - (rawPos & 7))) & 1);
+    return v;
+}
+
+static int32_t signExtend(uint32_t v, int n)
+{
+    return n == 32 ? (int32_t)v : (int32_t)(v << (32 - n)) >> (32 - n);
+}
+
+// decode the raw samples of a window: ms since t, values
+static int decodeRaw(const char *json, uint32_t *times, float *values)
+{
+    static uint8_t raw[TRACKLE_SERIES_RAW_BYTES];
+    const int count = field(json, "rn");
+    const char *text = strstr(json, "\"raw\":\"") + 7;
+    CHECK(trackleBase64Decode(text, strchr(text, '"') - text, raw, sizeof(raw)) >= 0);
+    rawBytes = raw;
+    rawPos = 0;
+
+    uint32_t t = getBits(32);
+    uint32_t value = getBits(32);
+    int32_t delta = 0;
+    int leading = 0, trailing = 0;
+    times[0] = t;
+    memcpy(&values[0], &value, sizeof(value));
+    for (int i = 1; i < count; i++)
+    {
+        int32_t dod;
+        if (!getBits(1))
+            dod = 0;
+        else if (!getBits(1))
+            dod = signExtend(getBits(7), 7);
+        else if (!getBits(1))
+            dod = signExtend(getBits(9), 9);
+        else if (!getBits(1))
+            dod = signExtend(getBits(12), 12);
+        else
+            dod = (int32_t)getBits(32);
+        delta += dod;
+        t += delta;
+        times[i] = t;
+
+        if (getBits(1))
+        {
+            if (!getBits(1))
+                value ^= getBits(32 - leading - trailing) << trailing;
+            else
+            {
+                leading = getBits(5);
+                const int meaningful = getBits(5) + 1;
+                trailing = 32 - leading - meaningful;
+                value ^= getBits(meaningful) << trailing;
+            }
+        }
+        memcpy(&values[i], &value, sizeof(value));
+    }
+    return count;
+}
+
+static void testCreate()
+{
+    CHECK(trackleSeriesAdd("temp", 1) == false); // not created yet
+    CHECK(trackleSeriesCreate("temp", 60000, true) == ESP_OK);
+    CHECK(trackleSeriesCreate("temp", 1000, false) == ESP_ERR_INVALID_ARG);
+    CHECK(trackleSeriesCreate("zero", 0, false) == ESP_ERR_INVALID_ARG);
+    CHECK(trackleSeriesCreate("a name much longer than thirty-two characters", 1000, false) == ESP_ERR_INVALID_ARG);
+    CHECK(trackleSeriesCreate("agg", 10000, false) == ESP_OK);
+}
+
+static void testRaw()
+{
+    // 10 Hz with jitter, 0.1 resolution: the raw buffer fills up before the minute is over
+    static uint32_t times[MAX_SAMPLES];
+    static float values[MAX_SAMPLES];
+    static uint32_t decodedTimes[MAX_SAMPLES];
+    static float decodedValues[MAX_SAMPLES];
+    int pending = 0;
+    int decoded = 0;
+    int windows = 0;
+    watched = "temp";
+    srand(3);
+    for (int i = 0; i < 600; i++)
+    {
+        fakeMillis += 100 + (rand() % 5 == 0 ? rand() % 7 - 3 : 0);
+        const float v = roundf((20 + 2 * sinf(i / 50.0f) + (rand() % 3 - 1) * 0.1f) * 10) / 10;
+        CHECK(trackleSeriesAdd("temp", v));
+        times[pending] = fakeMillis;
+        values[pending++] = v;
+
+        publishes = 0;
+        trackleSeriesLoop();
+        if (publishes > 0)
+        {
+            const int count = decodeRaw(published, decodedTimes, decodedValues);
+            const long long start = field(published, "t") - WALL_BASE_MS;
+            CHECK(count == field(published, "n") && count <= pending);
+            for (int k = 0; k < count; k++)
+                CHECK(start + decodedTimes[k] == times[k] && decodedValues[k] == values[k]);
+            CHECK(strlen(published) < 700);
+            memmove(times, times + count, (pending - count) * sizeof(times[0]));
+            memmove(values, values + count, (pending - count) * sizeof(values[0]));
+            pending -= count;
+            decoded += count;
+            windows++;
+        }
+    }
+    CHECK(windows >= 2 && decoded + pending == 600);
+
+    TrackleSeries_Stats stats;
+    CHECK(trackleSeriesGetStats("temp", &stats));
+    CHECK(stats.samples == 600 && stats.rawSamples == 600 && stats.windows == (uint32_t)windows);
+    CHECK(stats.compressionRatio > 2);
+    printf("  %d windows, compression %.1fx, %u bytes of RAM\n", windows, stats.compressionRatio, stats.memoryBytes);
+}
+
+static void testAggregates()
+{
+    CHECK(trackleSeriesCreate("minmax", 5000, false) == ESP_OK);
+    watched = "minmax";
+    // the window starts now; a cloud sync in the middle of it moves the wall clock
+    const int64_t start = trackleTimeNowMs();
+    const float samples[] = {3, -1, 7.5f, 2};
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+    {
+        fakeMillis += 1000;
+        CHECK(trackleSeriesAdd("minmax", samples[i]));
+    }
+    wallOffsetMs = 250;
+    publishes = 0;
+    trackleSeriesLoop();
+    CHECK(publishes == 0); // the window isn't over
+
+    fakeMillis += 1000;
+    trackleSeriesLoop();
+    CHECK(strstr(published, "\"raw\"") == NULL);
+    CHECK(field(published, "n") == 4 && field(published, "w") == 5000);
+    CHECK(field(published, "t") == start + wallOffsetMs);
+    CHECK(floatField(published, "min") == -1 && floatField(published, "max") == 7.5);
+    CHECK(floatField(published, "mean") == 2.875 && floatField(published, "last") == 2);
+    wallOffsetMs = 0;
+}
+
+static volatile bool adding = false;
+static volatile int added = 0;
+
+static void adder(void *arg)
+{
+    while (adding)
+    {
+        trackleSeriesAdd("busy", 1);
+        added++;
+    }
+    adding = true; // done
+    vTaskDelete(NULL);
+}
+
+static void testConcurrentAdd()
+{
+    // windows closed and published while another task adds samples: none is lost or counted twice
+    CHECK(trackleSeriesCreate("busy", 10, false) == ESP_OK);
+    watched = "busy";
+    long long windowed = 0;
+    adding = true;
+    CHECK(xTaskCreate(adder, "adder", 4096, NULL, 5, NULL) == pdPASS);
+    for (int i = 0; i < 2000; i++)
+    {
+        fakeMillis += 5;
+        publishes = 0;
+        trackleSeriesLoop();
+        if (publishes > 0)
+            windowed += field(published, "n");
+    }
+    adding = false;
+    while (!adding)
+        vTaskDelay(1);
+    CHECK(trackleSeriesFlush("busy"));
+    publishes = 0;
+    trackleSeriesLoop();
+    if (publishes > 0)
+        windowed += field(published, "n");
+
+    TrackleSeries_Stats stats;
+    CHECK(trackleSeriesGetStats("busy", &stats));
+    CHECK(stats.samples == (uint32_t)added && windowed == added);
+}
+
+int main()
+{
+    RUN(testCreate);
+    RUN(testRaw);
+    RUN(testAggregates);
+    RUN(testConcurrentAdd);
+    return 0;
+}
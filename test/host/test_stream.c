@@ -0,0 +1,252 @@
+/**
+ * Streams on a stubbed link that refuses every 7th publish: 20000 bytes go out in 53 chunks and an end
+ * event, all under 600 characters, and reassemble to the payload with the announced length and CRC;
+ * the window grows to its maximum, halves on refusals and stays at 1 while the queue is congested.
+ * Producer aborts, nested streams and a link that never accepts end with their errors; block calls
+ * reach the functions added with trackleStreamAddPost.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp32/rom/crc.h"
+#include "test_host.h"
+#include "trackle_esp32.h"
+#include "trackle_utils_codec.h"
+#include "trackle_utils_rtt.h"
+#include "trackle_utils_stream.h"
+#include "trackle_utils_txqueue.h"
+
+#define PAYLOAD_LEN 20000
+#define CHUNKS ((PAYLOAD_LEN + TRACKLE_STREAM_CHUNK_SIZE - 1) / TRACKLE_STREAM_CHUNK_SIZE)
+#define MAX_EVENT_LEN 600
+
+struct Trackle *trackle_s = NULL;
+SemaphoreHandle_t xTrackleSemaphore = NULL;
+static uint32_t now = 1000;
+static int refuseEvery = 0; // 0 accepts all, 1 refuses all
+static bool congested = false;
+static int calls = 0;
+
+// what the cloud got
+static uint8_t payload[PAYLOAD_LEN];
+static uint8_t rebuilt[PAYLOAD_LEN];
+static size_t rebuiltLen = 0;
+static uint32_t streamId = 0;
+static uint32_t nextIndex = 0;
+static uint32_t endLen = 0;
+static uint32_t endCrc = 0;
+static bool ended = false;
+
+// what the sender reported
+static size_t produced = 0;
+static uint8_t maxWindow = 0;
+static uint8_t lastWindow = 0;
+static bool halved = false;
+
+uint32_t getMillis()
+{
+    return now;
+}
+
+void trackleRttGetStats(TrackleRtt_Stats *stats)
+{
+    *stats = (TrackleRtt_Stats){0};
+}
+
+uint32_t trackleRttGetRto()
+{
+    return 10;
+}
+
+bool trackleTxQueueCongested()
+{
+    return congested;
+}
+
+bool tracklePost(struct Trackle *v, const char *name, int (*function)(const char *), Function_PermissionDef permission);
+
+bool tracklePublishPacedSecure(const char *eventName, const char *data)
+{
+    calls++;
+    if (refuseEvery > 0 && calls % refuseEvery == 0)
+    {
+        now += refuseEvery == 1 ? 1000 : 5;
+        return false;
+    }
+    now += 5;
+    CHECK(strcmp(eventName, "dump") == 0);
+    CHECK(strlen(data) < MAX_EVENT_LEN && !ended);
+
+    uint32_t s, i;
+    int header;
+    CHECK(sscanf(data, "{\"s\":%u,\"i\":%u,%n", &s, &i, &header) == 2);
+    CHECK(i == nextIndex++);
+    if (i == 0)
+        streamId = s;
+    CHECK(s == streamId);
+    const char *d = data + header;
+    if (strncmp(d, "\"d\":\"", 5) == 0)
+    {
+        const char *start = d + 5;
+        const char *end = strchr(start, '"');
+        const int len = trackleBase64Decode(start, end - start, rebuilt + rebuiltLen, sizeof(rebuilt) - rebuiltLen);
+        CHECK(len > 0 && len <= TRACKLE_STREAM_CHUNK_SIZE);
+        rebuiltLen += len;
+    }
+    else
+    {
+        CHECK(sscanf(d, "\"end\":true,\"len\":%u,\"crc\":%u}", &endLen, &endCrc) == 2);
+        ended = true;
+    }
+    return true;
+}
+
+static int producer(uint8_t *buf, size_t size, void *ctx)
+{
+    const size_t n = PAYLOAD_LEN - produced < size ? PAYLOAD_LEN - produced : size;
+    memcpy(buf, payload + produced, n);
+    produced += n;
+    return n;
+}
+
+static void onProgress(const TrackleStream_Progress *progress, void *ctx)
+{
+    CHECK(ctx == payload);
+    if (progress->window > maxWindow)
+        maxWindow = progress->window;
+    if (progress->window < lastWindow)
+        halved = progress->window == (lastWindow > 1 ? lastWindow / 2 : 1);
+    lastWindow = progress->window;
+}
+
+static void reset()
+{
+    calls = 0;
+    rebuiltLen = produced = 0;
+    nextIndex = 0;
+    ended = false;
+    maxWindow = lastWindow = 0;
+    halved = false;
+}
+
+static void testStream()
+{
+    for (size_t i = 0; i < PAYLOAD_LEN; i++)
+        payload[i] = rand();
+    refuseEvery = 7;
+    CHECK(tracklePublishStream("dump", producer, onProgress, payload) == ESP_OK);
+
+    CHECK(ended && nextIndex == CHUNKS + 1);
+    CHECK(rebuiltLen == PAYLOAD_LEN && memcmp(rebuilt, payload, PAYLOAD_LEN) == 0);
+    CHECK(crc32_le(0, (const uint8_t *)"123456789", 9) == 0xCBF43926);
+    CHECK(endLen == PAYLOAD_LEN && endCrc == crc32_le(0, payload, PAYLOAD_LEN));
+
+    TrackleStream_Progress p;
+    trackleStreamGetProgress(&p);
+    printf("  %u bytes in %u events, %u refused, window up to %u\n", p.bytes, p.chunks, p.retries, maxWindow);
+    CHECK(p.bytes == PAYLOAD_LEN && p.chunks == CHUNKS + 1);
+    CHECK(p.retries == (uint32_t)calls / 7 && p.retries > 0);
+    CHECK(maxWindow == TRACKLE_STREAM_MAX_WINDOW && halved);
+    reset();
+}
+
+static void testCongested()
+{
+    // accepted, but the transmit queue is behind: the window doesn't grow
+    refuseEvery = 0;
+    congested = true;
+    CHECK(tracklePublishStream("dump", producer, onProgress, payload) == ESP_OK);
+    CHECK(ended && rebuiltLen == PAYLOAD_LEN && maxWindow == 1 && !halved);
+    congested = false;
+    reset();
+}
+
+static int aborting(uint8_t *buf, size_t size, void *ctx)
+{
+    return nextIndex < 3 ? producer(buf, size, ctx) : -1;
+}
+
+static esp_err_t nestedErr = ESP_OK;
+
+static int nesting(uint8_t *buf, size_t size, void *ctx)
+{
+    nestedErr = tracklePublishStream("dump", producer, NULL, NULL);
+    return 0;
+}
+
+static void testErrors()
+{
+    CHECK(tracklePublishStream("dump", aborting, NULL, NULL) == ESP_FAIL);
+    CHECK(!ended && nextIndex == 3);
+    reset();
+
+    CHECK(tracklePublishStream("dump", nesting, NULL, NULL) == ESP_OK);
+    CHECK(nestedErr == ESP_ERR_INVALID_STATE && ended && endLen == 0);
+    reset();
+
+    // never accepted: given up after TRACKLE_STREAM_TIMEOUT_MS
+    refuseEvery = 1;
+    const uint32_t start = now;
+    CHECK(tracklePublishStream("dump", producer, NULL, NULL) == ESP_ERR_TIMEOUT);
+    CHECK(now - start >= TRACKLE_STREAM_TIMEOUT_MS && nextIndex == 0);
+    refuseEvery = 0;
+    reset();
+}
+
+// inbound
+static int (*posted[TRACKLE_STREAM_MAX_POSTS + 1])(const char *);
+static int postedCount = 0;
+static uint8_t received[16];
+static size_t receivedLen = 0;
+
+bool tracklePost(struct Trackle *v, const char *name, int (*function)(const char *), Function_PermissionDef permission)
+{
+    posted[postedCount++] = function;
+    return true;
+}
+
+bool trackleGet(struct Trackle *trackle, const char *name, void *(*function)(const char *), Data_TypeDef dataType)
+{
+    return true;
+}
+
+static int block(uint32_t offset, const uint8_t *data, size_t len, bool last)
+{
+    if (offset == 0)
+        receivedLen = 0;
+    CHECK(offset == receivedLen && offset + len <= sizeof(received));
+    memcpy(received + offset, data, len);
+    receivedLen += len;
+    return 0;
+}
+
+static void testPosts()
+{
+    char name[8];
+    for (int i = 0; i < TRACKLE_STREAM_MAX_POSTS; i++)
+    {
+        snprintf(name, sizeof(name), "p%d", i);
+        CHECK(trackleStreamAddPost(name, block, ALL_USERS));
+    }
+    CHECK(!trackleStreamAddPost("full", block, ALL_USERS));
+    CHECK(postedCount == TRACKLE_STREAM_MAX_POSTS);
+
+    // "offset,more,base64": the answer is the next offset, the total after the last block
+    CHECK(posted[3]("0,1,AAEC") == 3);
+    CHECK(posted[3]("0,1,AAEC") == 3); // offset 0 starts over
+    CHECK(posted[3]("6,0,AwQ=") == 3); // out of order: resume from 3
+    CHECK(posted[3]("3,0,AwQ=") == 5);
+    const uint8_t expected[] = {0, 1, 2, 3, 4};
+    CHECK(receivedLen == 5 && memcmp(received, expected, 5) == 0);
+}
+
+int main()
+{
+    xTrackleSemaphore = xSemaphoreCreateMutex();
+    RUN(testStream);
+    RUN(testCongested);
+    RUN(testErrors);
+    RUN(testPosts);
+    return 0;
+}
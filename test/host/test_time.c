@@ -0,0 +1,134 @@
+/**
+ * Cloud time on a local clock that runs 100 ppm slow: the drift is estimated from the syncs and the
+ * wall clock keeps within a few milliseconds between syncs, the fixed-point computation follows the
+ * exact one over months without reads, and reads stay monotonic across the periodic rebase.
+ */
+
+#include <math.h>
+#include <sys/time.h>
+
+#include "test_host.h"
+#include "trackle_utils_rtt.h"
+#include "trackle_utils_time.h"
+
+#define SLOW_PPM 100
+#define SYNC_INTERVAL_S (12 * 3600)
+#define START_S 1700000000LL
+
+static int64_t monoUs = 5000000; // the local clock
+static double trueS = START_S;   // the time of the cloud
+static int64_t systemClockS = 0;
+
+int64_t esp_timer_get_time()
+{
+    return monoUs;
+}
+
+void trackleRttGetStats(TrackleRtt_Stats *stats)
+{
+    *stats = (TrackleRtt_Stats){0};
+}
+
+int settimeofday(const struct timeval *tv, const struct timezone *tz)
+{
+    systemClockS = tv->tv_sec;
+    return 0;
+}
+
+// true seconds go by, the local clock counts them 100 ppm short
+static void elapse(double seconds)
+{
+    trueS += seconds;
+    monoUs += llround(seconds * 1e6 * (1 - SLOW_PPM * 1e-6));
+}
+
+static double errorMs()
+{
+    return trackleTimeNowMs() - trueS * 1000;
+}
+
+static TrackleTime_Status status()
+{
+    TrackleTime_Status s;
+    trackleTimeGetStatus(&s);
+    return s;
+}
+
+static void testNotSynced()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    CHECK(!trackleTimeIsSynced());
+    CHECK(llabs(trackleTimeNowMs() - ((int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000)) < 1000);
+}
+
+static void testDrift()
+{
+    trackleTimeSync((time_t)trueS);
+    CHECK(trackleTimeIsSynced() && systemClockS == START_S);
+    CHECK(fabs(errorMs()) < 1);
+
+    // no estimate yet: 100 ppm of 12 hours behind at the next sync
+    elapse(SYNC_INTERVAL_S);
+    const double uncompensated = errorMs();
+    printf("  before the drift estimate: %.0f ms off after %d h\n", uncompensated, SYNC_INTERVAL_S / 3600);
+    CHECK(fabs(uncompensated + SYNC_INTERVAL_S * 1000.0 * SLOW_PPM * 1e-6) < 2);
+    trackleTimeSync((time_t)trueS);
+    CHECK(status().driftPpm == SLOW_PPM);
+    CHECK(abs(status().lastOffsetMs - (int32_t)(-uncompensated)) <= 1);
+
+    // compensated: a few milliseconds over the next syncs
+    for (int i = 0; i < 6; i++)
+    {
+        double worst = 0;
+        for (int h = 0; h < SYNC_INTERVAL_S / 3600; h++)
+        {
+            elapse(3600);
+            worst = fmax(worst, fabs(errorMs()));
+        }
+        trackleTimeSync((time_t)trueS);
+        CHECK(worst < 5);
+        CHECK(abs(status().driftPpm - SLOW_PPM) <= 1 && abs(status().lastOffsetMs) <= 5);
+    }
+    printf("  drift %d ppm, offset at the last sync %d ms\n", (int)status().driftPpm, (int)status().lastOffsetMs);
+
+    // a sync sooner than TRACKLE_TIME_DRIFT_MIN_INTERVAL_MS doesn't touch the estimate
+    elapse(60);
+    trackleTimeSync((time_t)trueS + 3);
+    CHECK(status().driftPpm == SLOW_PPM && systemClockS == (int64_t)trueS + 3);
+    trackleTimeSync((time_t)trueS);
+}
+
+static void testLongWithoutReads()
+{
+    // two months without a read or a sync: the fixed-point result matches the exact one
+    const double startS = trueS;
+    const int64_t startMs = trackleTimeNowMs();
+    elapse(60.0 * 86400);
+    const double exactMs = startMs + (trueS - startS) * 1000 * (1 - SLOW_PPM * 1e-6) * (1 + SLOW_PPM * 1e-6);
+    printf("  after 60 days: %.1f ms off the true time, %.3f ms off the exact computation\n", errorMs(), trackleTimeNowMs() - exactMs);
+    CHECK(fabs(trackleTimeNowMs() - exactMs) <= 2);
+    CHECK(fabs(errorMs()) < 60); // 100 ppm of the slow clock is 0.01 ppm short of the true drift
+}
+
+static void testMonotonic()
+{
+    // reads every 10 s for two days cross the rebase of the computation, never going back
+    int64_t last = trackleTimeNowMs();
+    for (int i = 0; i < 2 * 86400 / 10; i++)
+    {
+        elapse(10);
+        const int64_t now = trackleTimeNowMs();
+        CHECK(now >= last && now - last <= 10001);
+        last = now;
+    }
+}
+
+int main()
+{
+    RUN(testNotSynced);
+    RUN(testDrift);
+    RUN(testLongWithoutReads);
+    RUN(testMonotonic);
+    return 0;
+}
@@ -0,0 +1,278 @@
+/**
+ * TrackleWriter: the same calls give JSON text and CBOR, escaping, numbers that read back, a buffer
+ * too small (the document is dropped and the size it needs is known), chunked output with any scratch
+ * size, and calls out of order.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_host.h"
+#include "trackle_utils_cbor.h"
+#include "trackle_utils_writer.h"
+
+static char json[256];
+static uint8_t cbor[256];
+
+// {"a\"x":-5,"arr":[0.1,true,null,"l\n",21.1],"e":{}}
+static void document(TrackleWriter_t *w)
+{
+    trackleWriterBeginObject(w);
+    trackleWriterKey(w, "a\"x");
+    trackleWriterInt(w, -5);
+    trackleWriterKey(w, "arr");
+    trackleWriterBeginArray(w);
+    trackleWriterDouble(w, 0.1);
+    trackleWriterBool(w, true);
+    trackleWriterNull(w);
+    trackleWriterString(w, "l\n");
+    trackleWriterFloat(w, 21.1f);
+    trackleWriterEndArray(w);
+    trackleWriterKey(w, "e");
+    trackleWriterBeginObject(w);
+    trackleWriterEndObject(w);
+    trackleWriterEndObject(w);
+}
+
+static const char expectedJson[] = "{\"a\\\"x\":-5,\"arr\":[0.1,true,null,\"l\\n\",21.1],\"e\":{}}";
+
+static const uint8_t expectedCbor[] = {
+    0xBF,                                                 // map
+    0x63, 'a', '"', 'x', 0x24,                            // "a\"x": -5
+    0x63, 'a', 'r', 'r', 0x9F,                            // "arr": [
+    0xFB, 0x3F, 0xB9, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9A, // 0.1 needs a double
+    0xF5, 0xF6, 0x62, 'l', '\n',                          // true, null, "l\n"
+    0xFA, 0x41, 0xA8, 0xCC, 0xCD,                         // 21.1f
+    0xFF,                                                 // ]
+    0x61, 'e', 0xBF, 0xFF,                                // "e": {}
+    0xFF};
+
+static void testJson()
+{
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+    document(&w);
+    CHECK(trackleWriterFinish(&w) == (int)strlen(expectedJson));
+    CHECK(strcmp(json, expectedJson) == 0);
+
+    // control characters and non ASCII text
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+    trackleWriterString(&w, "\\\t\r\b\f\x01\x1f°C");
+    CHECK(trackleWriterFinish(&w) > 0);
+    CHECK(strcmp(json, "\"\\\\\\t\\r\\b\\f\\u0001\\u001f°C\"") == 0);
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+    trackleWriterStringN(&w, "ab\0c", 4);
+    CHECK(trackleWriterFinish(&w) > 0 && strcmp(json, "\"ab\\u0000c\"") == 0);
+}
+
+static void testNumbers()
+{
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+    trackleWriterBeginArray(&w);
+    trackleWriterInt(&w, INT64_MIN);
+    trackleWriterInt(&w, INT64_MAX);
+    trackleWriterDouble(&w, 1.0 / 3);
+    trackleWriterDouble(&w, 1e300);
+    trackleWriterDouble(&w, NAN);
+    trackleWriterFloat(&w, INFINITY);
+    trackleWriterFloat(&w, 3.71f);
+    trackleWriterEndArray(&w);
+    CHECK(trackleWriterFinish(&w) > 0);
+    CHECK(strcmp(json, "[-9223372036854775808,9223372036854775807,0.33333333333333331,1e+300,null,null,3.71]") == 0);
+
+    // CBOR: the shortest head for each integer, and values that read back exactly
+    static const int64_t ints[] = {0, 23, 24, 255, 256, 65535, 65536, 4294967295LL, 4294967296LL, INT64_MAX,
+                                   -1, -24, -25, -256, -257, -65537, INT64_MIN};
+    static const size_t sizes[] = {1, 1, 2, 2, 3, 3, 5, 5, 9, 9, 1, 1, 2, 2, 3, 5, 9};
+    static const double doubles[] = {0.0, -2.5, 0.1, 1e300, 21.1f};
+    for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); i++)
+    {
+        trackleWriterInit(&w, TRACKLE_WRITER_CBOR, cbor, sizeof(cbor));
+        trackleWriterInt(&w, ints[i]);
+        CHECK(trackleWriterFinish(&w) == (int)sizes[i]);
+        TrackleCborReader_t r;
+        int64_t value;
+        trackleCborReaderInit(&r, cbor, sizes[i]);
+        CHECK(trackleCborReadInt(&r, &value) && value == ints[i]);
+    }
+    for (size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++)
+    {
+        trackleWriterInit(&w, TRACKLE_WRITER_CBOR, cbor, sizeof(cbor));
+        trackleWriterDouble(&w, doubles[i]);
+        const int len = trackleWriterFinish(&w);
+        CHECK(len == ((double)(float)doubles[i] == doubles[i] ? 5 : 9));
+        TrackleCborReader_t r;
+        double value;
+        trackleCborReaderInit(&r, cbor, len);
+        CHECK(trackleCborReadDouble(&r, &value) && value == doubles[i]);
+    }
+}
+
+static void testCbor()
+{
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_CBOR, cbor, sizeof(cbor));
+    document(&w);
+    CHECK(trackleWriterFinish(&w) == sizeof(expectedCbor));
+    CHECK(memcmp(cbor, expectedCbor, sizeof(expectedCbor)) == 0);
+
+    TrackleCborReader_t r;
+    trackleCborReaderInit(&r, cbor, sizeof(expectedCbor));
+    CHECK(trackleCborMapFind(&r, "arr"));
+    size_t count;
+    bool flag;
+    CHECK(trackleCborEnter(&r, &count));
+    CHECK(trackleCborSkip(&r) && trackleCborReadBool(&r, &flag) && flag);
+}
+
+static void testTruncated()
+{
+    // the document is dropped, the length still tells the size it needs
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, 8);
+    document(&w);
+    CHECK(trackleWriterFailed(&w));
+    CHECK(trackleWriterFinish(&w) == -1);
+    CHECK(json[0] == '\0');
+    CHECK(trackleWriterLength(&w) == strlen(expectedJson));
+
+    // the terminator counts against the buffer, a CBOR document may fill it
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, strlen(expectedJson));
+    document(&w);
+    CHECK(trackleWriterFinish(&w) == -1);
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, strlen(expectedJson) + 1);
+    document(&w);
+    CHECK(trackleWriterFinish(&w) == (int)strlen(expectedJson));
+    trackleWriterInit(&w, TRACKLE_WRITER_CBOR, cbor, sizeof(expectedCbor));
+    document(&w);
+    CHECK(trackleWriterFinish(&w) == sizeof(expectedCbor));
+    trackleWriterInit(&w, TRACKLE_WRITER_CBOR, cbor, sizeof(expectedCbor) - 1);
+    document(&w);
+    CHECK(trackleWriterFinish(&w) == -1 && trackleWriterLength(&w) == sizeof(expectedCbor));
+}
+
+typedef struct
+{
+    uint8_t out[256];
+    size_t len;
+    size_t calls;
+    size_t failAt; // the call that fails, 0 for none
+} Sink_t;
+
+static int collect(const uint8_t *data, size_t len, void *ctx)
+{
+    Sink_t *sink = ctx;
+    sink->calls++;
+    if (sink->calls == sink->failAt)
+        return -1;
+    CHECK(sink->len + len <= sizeof(sink->out));
+    memcpy(sink->out + sink->len, data, len);
+    sink->len += len;
+    return 0;
+}
+
+static void testChunked()
+{
+    // any scratch size gives the same bytes as a buffer, in chunks of the scratch size
+    for (size_t scratchSize = 1; scratchSize <= 16; scratchSize++)
+    {
+        uint8_t scratch[16];
+        Sink_t sink = {0};
+        TrackleWriter_t w;
+        trackleWriterInitChunked(&w, TRACKLE_WRITER_CBOR, scratch, scratchSize, collect, &sink);
+        document(&w);
+        CHECK(trackleWriterFinish(&w) == sizeof(expectedCbor));
+        CHECK(sink.len == sizeof(expectedCbor) && memcmp(sink.out, expectedCbor, sink.len) == 0);
+        CHECK(sink.calls == (sizeof(expectedCbor) + scratchSize - 1) / scratchSize);
+
+        memset(&sink, 0, sizeof(sink));
+        trackleWriterInitChunked(&w, TRACKLE_WRITER_JSON, scratch, scratchSize, collect, &sink);
+        document(&w);
+        CHECK(trackleWriterFinish(&w) == (int)strlen(expectedJson));
+        CHECK(sink.len == strlen(expectedJson) && memcmp(sink.out, expectedJson, sink.len) == 0);
+    }
+
+    // a chunk that can't be sent fails the document, nothing else is handed over
+    uint8_t scratch[8];
+    Sink_t sink = {.failAt = 2};
+    TrackleWriter_t w;
+    trackleWriterInitChunked(&w, TRACKLE_WRITER_JSON, scratch, sizeof(scratch), collect, &sink);
+    document(&w);
+    CHECK(trackleWriterFinish(&w) == -1);
+    CHECK(sink.calls == 2 && sink.len == 8);
+
+    trackleWriterInitChunked(&w, TRACKLE_WRITER_JSON, scratch, 0, collect, &sink);
+    CHECK(trackleWriterFailed(&w));
+}
+
+static int finishAfter(void (*calls)(TrackleWriter_t *w))
+{
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+    calls(&w);
+    return trackleWriterFinish(&w);
+}
+
+static void unclosed(TrackleWriter_t *w)
+{
+    trackleWriterBeginArray(w);
+}
+
+static void closedTwice(TrackleWriter_t *w)
+{
+    trackleWriterBeginArray(w);
+    trackleWriterEndArray(w);
+    trackleWriterEndArray(w);
+}
+
+static void keyWithoutValue(TrackleWriter_t *w)
+{
+    trackleWriterBeginObject(w);
+    trackleWriterKey(w, "k");
+    trackleWriterEndObject(w);
+}
+
+static void keyOutsideObject(TrackleWriter_t *w)
+{
+    trackleWriterKey(w, "k");
+    trackleWriterInt(w, 1);
+}
+
+static void tooDeep(TrackleWriter_t *w)
+{
+    for (int i = 0; i <= TRACKLE_WRITER_MAX_DEPTH; i++)
+        trackleWriterBeginArray(w);
+    for (int i = 0; i <= TRACKLE_WRITER_MAX_DEPTH; i++)
+        trackleWriterEndArray(w);
+}
+
+static void deepest(TrackleWriter_t *w)
+{
+    for (int i = 0; i < TRACKLE_WRITER_MAX_DEPTH; i++)
+        trackleWriterBeginArray(w);
+    for (int i = 0; i < TRACKLE_WRITER_MAX_DEPTH; i++)
+        trackleWriterEndArray(w);
+}
+
+static void testOutOfOrder()
+{
+    CHECK(finishAfter(unclosed) == -1 && json[0] == '\0');
+    CHECK(finishAfter(closedTwice) == -1);
+    CHECK(finishAfter(keyWithoutValue) == -1);
+    CHECK(finishAfter(keyOutsideObject) == -1);
+    CHECK(finishAfter(tooDeep) == -1);
+    CHECK(finishAfter(deepest) == 2 * TRACKLE_WRITER_MAX_DEPTH);
+}
+
+int main()
+{
+    RUN(testJson);
+    RUN(testNumbers);
+    RUN(testCbor);
+    RUN(testTruncated);
+    RUN(testChunked);
+    RUN(testOutOfOrder);
+    return 0;
+}
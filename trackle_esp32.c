@@ -9,6 +9,16 @@
 #include "hal_platform.h"
 #include "cJSON.h"
 
+#include "trackle_utils_powersave.h"
+#include "trackle_utils_connectivity.h"
+#include "trackle_utils_netif.h"
+#include "trackle_utils_servers.h"
+#include "trackle_utils_rtt.h"
+#include "trackle_utils_txqueue.h"
+#include "trackle_utils_ratelimit.h"
+#include "trackle_utils_series.h"
+#include "trackle_utils_time.h"
+
 // check mandatory defines
 #ifndef CONFIG_OTA_ALLOW_HTTP
 #error "CONFIG_OTA_ALLOW_HTTP must be enabled on your sdkconfig file"
@@ -73,12 +83,15 @@ typedef struct
 
 const __attribute__((section(".rodata_custom_desc"))) esp_custom_app_desc_t custom_app_desc = {platform_version_v, empty_v, empty_v, empty_v, empty_v, firmware_version_v, empty_v, empty_v, product_id_v};
 
+// text form of CBOR payloads, only used with xTrackleSemaphore taken
+static char cbor_text[TRACKLE_CBOR_TEXT_SIZE(TRACKLE_CBOR_MAX_PAYLOAD)];
+
 // cloud socket
 struct sockaddr_in cloud_addr;
-int cloud_socket;
+int cloud_socket = -1;
 
 /**
- * @brief Sets the time. Time is given in milliseconds since the epoch, UCT.
+ * @brief Sets the time. Time is given in seconds since the epoch, UTC.
  * @param time Current time (timestamp)
  * @param param Optional parameter, not used
  * @param reserved Not used
@@ -86,6 +99,7 @@ int cloud_socket;
 void time_cb(time_t time, unsigned int param, void *reserved)
 {
     ESP_LOGI(TRACKLE_TAG, "time_cb: %lld", (long long)time);
+    trackleTimeSync(time);
     return;
 }
 
@@ -113,32 +127,24 @@ int connect_cb_udp(const char *address, int port)
     char addr_str[128];
 
 #ifdef SERVER_ADDRESS
-    struct hostent *res = gethostbyname(SERVER_ADDRESS);
+    address = SERVER_ADDRESS;
     ESP_LOGI(TRACKLE_TAG, "Overriding server address: %s", SERVER_ADDRESS);
-
-#else
-    struct hostent *res = gethostbyname(address);
 #endif
 
 #ifdef SERVER_PORT
     port = SERVER_PORT;
 #endif
 
-    if (res)
-    {
-        ESP_LOGI(TRACKLE_TAG, "Dns address %s resolved", address);
-    }
-    else
+    // resolve all the cloud endpoints and pick the fastest healthy one
+    trackleConnectivityDnsStart();
+    const bool resolved = trackleServersSelect(address, port, &cloud_addr);
+    trackleConnectivityDnsDone();
+    if (!resolved)
     {
-        ESP_LOGW(TRACKLE_TAG, "error resolving gethostbyname %s", address);
+        ESP_LOGW(TRACKLE_TAG, "error resolving %s", address);
         return -1;
     }
 
-    // cloud_addr.sin_addr.s_addr = inet_addr(address);
-    memcpy(&cloud_addr.sin_addr.s_addr, res->h_addr, sizeof(cloud_addr.sin_addr.s_addr));
-
-    cloud_addr.sin_family = AF_INET;
-    cloud_addr.sin_port = htons(port);
     addr_family = AF_INET;
     ip_protocol = IPPROTO_IP;
     inet_ntoa_r(cloud_addr.sin_addr, addr_str, sizeof(addr_str) - 1);
@@ -149,7 +155,20 @@ int connect_cb_udp(const char *address, int port)
         ESP_LOGE(TRACKLE_TAG, "Unable to create socket: errno %d", errno);
         return -3;
     }
-    ESP_LOGI(TRACKLE_TAG, "Socket created, sending to %s:%d", address, port);
+    ESP_LOGI(TRACKLE_TAG, "Socket created, sending to %s:%d", addr_str, ntohs(cloud_addr.sin_port));
+
+    // bind to the active interface, so that failover and failback move the session with the socket
+    if (!trackleNetifBindSocket(cloud_socket))
+    {
+        close(cloud_socket);
+        cloud_socket = -1;
+        return -3;
+    }
+    trackleRttReset(); // nothing outstanding on a new socket
+    trackleTxQueueClear();
+    const int connection_type = trackleNetifGetConnectionType();
+    if (connection_type >= 0)
+        trackleSetConnectionType(trackle_s, connection_type);
 
     // setto i timeout di lettura/scrittura del socket
     struct timeval socket_timeout;
@@ -167,8 +186,11 @@ int connect_cb_udp(const char *address, int port)
  */
 int disconnect_cb()
 {
-    if (cloud_socket)
+    trackleServersNotifyClose();
+    trackleTxQueueClear();
+    if (cloud_socket >= 0)
         close(cloud_socket);
+    cloud_socket = -1;
     return 1;
 }
 
@@ -184,14 +206,19 @@ int disconnect_cb()
  */
 int send_cb_udp(const unsigned char *buf, uint32_t buflen, void *tmp)
 {
-    size_t sent = sendto(cloud_socket, (const char *)buf, buflen, 0, (struct sockaddr *)&cloud_addr, sizeof(cloud_addr));
-    if ((int)sent > 0)
+    // datagrams are queued when lwIP is out of buffers
+    const int sent = trackleTxQueueSend(cloud_socket, &cloud_addr, buf, buflen);
+    if (sent == TRACKLE_TXQ_DROPPED)
+        return buflen; // lost, the library retransmits it: nothing to account
+    if (sent > 0)
     {
+        tracklePowersaveNotifyTraffic(false);
+        trackleRttNotifySend();
         ESP_LOGD(TRACKLE_TAG, "send_cb_udp sent %d", sent);
         ESP_LOG_BUFFER_HEX_LEVEL(TRACKLE_TAG, buf, sent, ESP_LOG_VERBOSE);
     }
 
-    return (int)sent;
+    return sent;
 }
 
 /**
@@ -206,9 +233,14 @@ int send_cb_udp(const unsigned char *buf, uint32_t buflen, void *tmp)
  */
 int receive_cb_udp(unsigned char *buf, uint32_t buflen, void *tmp)
 {
+    trackleTxQueueFlush(cloud_socket, &cloud_addr);
+
     size_t res = recvfrom(cloud_socket, (char *)buf, buflen, 0, (struct sockaddr *)NULL, NULL);
     if ((int)res > 0)
     {
+        tracklePowersaveNotifyTraffic(true);
+        trackleServersNotifyReceive();
+        trackleRttNotifyReceive();
         ESP_LOGD(TRACKLE_TAG, "receive_cb_udp received %d", res);
         ESP_LOG_BUFFER_HEX_LEVEL(TRACKLE_TAG, buf, res, ESP_LOG_VERBOSE);
     }
@@ -270,10 +302,37 @@ void trackle_task(void *pvParameter)
     {
         if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
         {
+            // link lost: close the socket now, the library sees the error at the next send/receive
+            // and starts reconnecting (connect_cb_udp refuses until the network is back). Publishers
+            // use the socket with the semaphore taken, so it is never closed under them.
+            if (trackleConnectivityTakeLinkLost() && cloud_socket >= 0)
+            {
+                ESP_LOGI(TRACKLE_TAG, "Network lost, closing cloud socket");
+                close(cloud_socket);
+                cloud_socket = -1;
+            }
+
+            // active interface changed: recreate the socket on the new one and resume the session
+            if (trackleConnectivityTakeRouteChange())
+            {
+                ESP_LOGI(TRACKLE_TAG, "Network interface changed, reconnecting");
+                trackleDisconnect(trackle_s);
+                trackleConnect(trackle_s);
+            }
+            // network is back: connect now instead of waiting for the library backoff
+            else if (trackleConnectivityTakeConnectRequest() && !trackleConnected(trackle_s))
+                trackleConnect(trackle_s);
+            if (cloud_socket >= 0)
+                trackleTxQueueFlush(cloud_socket, &cloud_addr);
             trackleLoop(trackle_s); // da chiamare nel loop per far funzionare la libreria
+            trackleRateLimitLoop();
+            trackleConnectivityLoop(trackleConnected(trackle_s));
             xSemaphoreGive(xTrackleSemaphore);
         }
 
+        // windows are published with the semaphore released, the publish takes it
+        trackleSeriesLoop();
+
         // updating diagnostic
         if (getMillis() - esp32_check_diagnostic_millis >= ESP32_DIAGNOSTIC_TIME)
         {
@@ -289,12 +348,26 @@ void trackle_task(void *pvParameter)
     vTaskDelete(NULL);
 }
 
+/**
+ * Publish through the rate limiter, with xTrackleSemaphore taken.
+ *
+ * @return true if published or queued for later.
+ */
+static bool publish_limited(const char *eventName, const char *data, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key)
+{
+    const TrackleRateLimit_Result admit = trackleRateLimitAdmit(eventName, data, eventType, eventFlag, msg_key);
+    if (admit != TRACKLE_RATELIMIT_ADMITTED)
+        return admit == TRACKLE_RATELIMIT_QUEUED;
+    return tracklePublish(trackle_s, eventName, data, 30, eventType, eventFlag, msg_key);
+}
+
 bool tracklePublishSecure(const char *eventName, const char *data)
 {
     bool res = false;
     if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
     {
-        res = tracklePublish(trackle_s, eventName, data, 30, PRIVATE, WITH_ACK, 0);
+        if (trackleTxQueueAccepting())
+            res = publish_limited(eventName, data, PRIVATE, WITH_ACK, 0);
         xSemaphoreGive(xTrackleSemaphore);
     }
     return res;
@@ -305,7 +378,20 @@ bool tracklePublishSecureWithParams(const char *eventName, const char *data, Eve
     bool res = false;
     if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
     {
-        res = tracklePublish(trackle_s, eventName, data, 30, eventType, eventFlag, msg_key);
+        if (trackleTxQueueAccepting())
+            res = publish_limited(eventName, data, eventType, eventFlag, msg_key);
+        xSemaphoreGive(xTrackleSemaphore);
+    }
+    return res;
+}
+
+bool tracklePublishPacedSecure(const char *eventName, const char *data)
+{
+    bool res = false;
+    if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
+    {
+        if (trackleTxQueueAccepting())
+            res = tracklePublish(trackle_s, eventName, data, 30, PRIVATE, WITH_ACK, 0);
         xSemaphoreGive(xTrackleSemaphore);
     }
     return res;
@@ -316,7 +402,51 @@ bool trackleSyncStateSecure(const char *data)
     bool res = false;
     if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
     {
-        res = trackleSyncState(trackle_s, data);
+        if (trackleTxQueueAccepting())
+            res = trackleSyncState(trackle_s, data);
+        xSemaphoreGive(xTrackleSemaphore);
+    }
+    return res;
+}
+
+bool tracklePublishCborSecure(const char *eventName, const uint8_t *data, size_t len)
+{
+    return tracklePublishCborSecureWithParams(eventName, data, len, PRIVATE, WITH_ACK, 0);
+}
+
+bool tracklePublishCborSecureWithParams(const char *eventName, const uint8_t *data, size_t len, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key)
+{
+    bool res = false;
+    if (len > TRACKLE_CBOR_MAX_PAYLOAD)
+    {
+        ESP_LOGE(TRACKLE_TAG, "CBOR payload too big: %u bytes", (unsigned)len);
+        return false;
+    }
+    if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
+    {
+        if (trackleTxQueueAccepting() && trackleCborToText(data, len, cbor_text, sizeof(cbor_text)) >= 0)
+        {
+            res = publish_limited(eventName, cbor_text, eventType, eventFlag, msg_key);
+        }
+        xSemaphoreGive(xTrackleSemaphore);
+    }
+    return res;
+}
+
+bool trackleSyncStateCborSecure(const uint8_t *data, size_t len)
+{
+    bool res = false;
+    if (len > TRACKLE_CBOR_MAX_PAYLOAD)
+    {
+        ESP_LOGE(TRACKLE_TAG, "CBOR state too big: %u bytes", (unsigned)len);
+        return false;
+    }
+    if (xSemaphoreTake(xTrackleSemaphore, xTrackleSemaphoreWait) == pdTRUE)
+    {
+        if (trackleTxQueueAccepting() && trackleCborToText(data, len, cbor_text, sizeof(cbor_text)) >= 0)
+        {
+            res = trackleSyncState(trackle_s, cbor_text);
+        }
         xSemaphoreGive(xTrackleSemaphore);
     }
     return res;
@@ -24,6 +24,7 @@
 
 #include "trackle_interface.h"
 #include "trackle_utils.h"
+#include "trackle_utils_cbor.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -87,6 +88,10 @@ bool tracklePublishSecure(const char *eventName, const char *data);
  */
 bool tracklePublishSecureWithParams(const char *eventName, const char *data, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key);
 
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+// Private publish with ack that skips the rate limiter, for producers that pace themselves (series, streams).
+bool tracklePublishPacedSecure(const char *eventName, const char *data);
+
 /**
  *  It takes a json that contain a list of properties and publishes it to the trackle server
  *
@@ -96,6 +101,44 @@ bool tracklePublishSecureWithParams(const char *eventName, const char *data, Eve
  */
 bool trackleSyncStateSecure(const char *data);
 
+/**
+ * It takes a binary CBOR document, and publishes it to the trackle server
+ *
+ * The document is sent in the text form described in \ref trackle_utils_cbor.h, which is usually
+ * bigger than the same data as JSON: see there for the sizes measured.
+ *
+ * @param eventName The name of the event to publish.
+ * @param data The CBOR document to be published.
+ * @param len The size of the document, at most TRACKLE_CBOR_MAX_PAYLOAD bytes.
+ *
+ * @return A boolean value.
+ */
+bool tracklePublishCborSecure(const char *eventName, const uint8_t *data, size_t len);
+
+/**
+ * It takes a binary CBOR document, and publishes it to the trackle server
+ *
+ * @param eventName the name of the event to publish
+ * @param data the CBOR document to be sent
+ * @param len the size of the document, at most TRACKLE_CBOR_MAX_PAYLOAD bytes.
+ * @param eventType type of event, public or private.
+ * @param eventFlag event flags, with or without ack.
+ * @param msg_key the message key, if you want to use it.
+ *
+ * @return A boolean value.
+ */
+bool tracklePublishCborSecureWithParams(const char *eventName, const uint8_t *data, size_t len, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key);
+
+/**
+ *  It takes a CBOR map that contain a list of properties and publishes it to the trackle server
+ *
+ * @param data The CBOR document to be sent to the Trackle server.
+ * @param len The size of the document, at most TRACKLE_CBOR_MAX_PAYLOAD bytes.
+ *
+ * @return A boolean value.
+ */
+bool trackleSyncStateCborSecure(const uint8_t *data, size_t len);
+
 /**
  * It converts the log level name to the corresponding esp-idf log level
  *
@@ -106,8 +149,8 @@ bool trackleSyncStateSecure(const char *data);
 esp_log_level_t get_espidf_log_level(const char *level_name);
 
 /**
- * @brief Get the currently set Trackle device ID as string.
- * @return String representation of the Trackle device ID.
+ * @brief Get the Trackle device ID as string.
+ * @return String representation of the Trackle device ID read by readDeviceInfoFromStorage, empty before.
  */
 const char *trackleGetDeviceIdAsStr();
 
@@ -48,6 +48,9 @@ extern EventGroupHandle_t s_wifi_event_group;
 /**
  * @brief Convert a raw bytes array to its HEX string representation.
  *
+ * The output is always NULL terminated: if \ref out is smaller than 2 * insz + 1 bytes only the bytes
+ * that fit are converted. See \ref trackleHexEncode for a version that reports errors.
+ *
  * @param in Raw bytes array to convert.
  * @param insz Size of the array to convert.
  * @param out Buffer where converted string will be saved.
@@ -67,6 +70,9 @@ int stringToHex(char *hex_str, unsigned char *byte_array, int byte_array_max);
 /**
  * @brief Split a string in tokens.
  *
+ * Separators in \ref value are replaced with NULL characters, consecutive separators count as one.
+ * Reentrant; \ref trackleArgsNext splits without modifying the string.
+ *
  * @param value String to split.
  * @param separator String to use as a separator.
  * @param results Array where tokens obtained by splitting the string can be saved.
@@ -82,7 +88,7 @@ int splitString(char *value, const char *separator, char *results[], size_t max_
  * @param op String containing a comparation operator (one of: "<", ">", "<=", ">=", "=")
  * @param b Second operator
  * @return true Expression evaluates to TRUE
- * @return false Expression evaluates to FALSE
+ * @return false Expression evaluates to FALSE, or \ref input is not a 32 bit integer, or \ref op is unknown
  */
 bool isValid(char *input, const char *op, int b);
 
@@ -0,0 +1,188 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_ARGS_H
+#define TRACKLE_UTILS_ARGS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file trackle_utils_args.h
+ * @brief Reentrant parser for the arguments of cloud and BLE functions.
+ *
+ * The input is never modified and nothing is copied: tokens are returned as views (pointer and
+ * length) into the argument string, so they are valid as long as the string is. All the state is in
+ * the caller's \ref TrackleArgs_t, so functions called at the same time from different tasks don't
+ * interfere.
+ *
+ * @code
+ * TrackleArgs_t args;
+ * TrackleStr_t key;
+ * int32_t value;
+ * trackleArgsInit(&args, "threshold,42", ',');
+ * if (trackleArgsNext(&args, &key) && trackleStrEquals(key, "threshold") && trackleArgsNextInt32(&args, &value))
+ *     ...
+ * @endcode
+ */
+
+/**
+ * @brief View of a string, not NULL terminated.
+ */
+typedef struct
+{
+    const char *ptr; ///< First character
+    size_t len;      ///< Number of characters
+} TrackleStr_t;
+
+/**
+ * @brief Tokenizer state.
+ */
+typedef struct
+{
+    const char *cur; ///< Start of the next token, NULL when the input is over
+    const char *end; ///< End of the input
+    char separator;  ///< Separator between tokens
+} TrackleArgs_t;
+
+/**
+ * @brief Comparison operators, see \ref trackleCompareOpParse.
+ */
+typedef enum
+{
+    TRACKLE_CMP_INVALID = 0,
+    TRACKLE_CMP_LT, ///< "<"
+    TRACKLE_CMP_LE, ///< "<="
+    TRACKLE_CMP_GT, ///< ">"
+    TRACKLE_CMP_GE, ///< ">="
+    TRACKLE_CMP_EQ, ///< "="
+} TrackleCompare_Op;
+
+/**
+ * @brief Start tokenizing a NULL terminated string.
+ *
+ * @param args Tokenizer state.
+ * @param input String to tokenize, NULL is the same as "".
+ * @param separator Separator between tokens.
+ */
+void trackleArgsInit(TrackleArgs_t *args, const char *input, char separator);
+
+/**
+ * @brief Start tokenizing a string of given length.
+ *
+ * @param args Tokenizer state.
+ * @param input String to tokenize.
+ * @param len Length of \ref input.
+ * @param separator Separator between tokens.
+ */
+void trackleArgsInitLen(TrackleArgs_t *args, const char *input, size_t len, char separator);
+
+/**
+ * @brief Get the next token.
+ *
+ * Unlike strtok, empty tokens are returned too: "a,,b" has three tokens and "" has one, so
+ * positional arguments keep their position.
+ *
+ * @param args Tokenizer state.
+ * @param token Where to save the token.
+ * @return true if a token was found, false at the end of the input.
+ */
+bool trackleArgsNext(TrackleArgs_t *args, TrackleStr_t *token);
+
+/**
+ * @brief Get the rest of the input as a single token, separators included.
+ *
+ * @param args Tokenizer state.
+ * @param token Where to save the token.
+ * @return true if some input was left, false at the end of the input.
+ */
+bool trackleArgsRest(TrackleArgs_t *args, TrackleStr_t *token);
+
+/**
+ * @brief Get the next token as a signed 32 bit integer, see \ref trackleStrToInt32.
+ *
+ * @return true on success, false at the end of the input or if the token is not a valid number.
+ */
+bool trackleArgsNextInt32(TrackleArgs_t *args, int32_t *value);
+
+/**
+ * @brief Remove spaces and tabs at both ends of a token.
+ */
+TrackleStr_t trackleStrTrim(TrackleStr_t str);
+
+/**
+ * @brief Compare a token with a NULL terminated string.
+ *
+ * @return true if they are equal.
+ */
+bool trackleStrEquals(TrackleStr_t str, const char *literal);
+
+/**
+ * @brief Copy a token to a NULL terminated buffer.
+ *
+ * @param str Token to copy.
+ * @param out Output buffer.
+ * @param outSize Size of \ref out.
+ * @return true on success, false if \ref out is too small (nothing is copied).
+ */
+bool trackleStrCopy(TrackleStr_t str, char *out, size_t outSize);
+
+/**
+ * @brief Parse a decimal signed 32 bit integer: optional sign followed by at least one digit.
+ *
+ * Surrounding spaces are ignored, any other character makes the token invalid.
+ *
+ * @param str Token to parse.
+ * @param value Where to save the value, untouched on failure.
+ * @return true on success, false if the token is not a number or it doesn't fit in 32 bits.
+ */
+bool trackleStrToInt32(TrackleStr_t str, int32_t *value);
+
+/**
+ * @brief Parse a decimal unsigned 32 bit integer, see \ref trackleStrToInt32.
+ */
+bool trackleStrToUint32(TrackleStr_t str, uint32_t *value);
+
+/**
+ * @brief Parse a comparison operator.
+ *
+ * @param str One of "<", "<=", ">", ">=", "=".
+ * @return The operator, TRACKLE_CMP_INVALID if unknown.
+ */
+TrackleCompare_Op trackleCompareOpParse(TrackleStr_t str);
+
+/**
+ * @brief Evaluate a op b.
+ *
+ * @return The result, false if \ref op is TRACKLE_CMP_INVALID.
+ */
+bool trackleCompare(int32_t a, TrackleCompare_Op op, int32_t b);
+
+/**
+ * @brief Make a view of a NULL terminated string.
+ */
+static inline TrackleStr_t trackleStr(const char *str)
+{
+    TrackleStr_t s = {str, str ? strlen(str) : 0};
+    return s;
+}
+
+#endif
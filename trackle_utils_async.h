@@ -0,0 +1,106 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_ASYNC_H
+#define TRACKLE_UTILS_ASYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <defines.h>
+
+/**
+ * @file trackle_utils_async.h
+ * @brief Cloud functions executed by a pool of worker tasks.
+ *
+ * Cloud functions run inside trackleLoop: a slow one (flash writes, relay sequences) delays ACKs and
+ * keepalives, and every publisher waits for xTrackleSemaphore. A function registered here is queued to
+ * \ref TRACKLE_ASYNC_WORKERS worker tasks instead, and the cloud gets an answer right away:
+ * - a call id (> 0) if the call was queued;
+ * - \ref TRACKLE_ASYNC_BUSY if \ref TRACKLE_ASYNC_QUEUE_LEN calls are already waiting;
+ * - \ref TRACKLE_ASYNC_TOO_LONG if the arguments don't fit \ref TRACKLE_ASYNC_MAX_ARGS.
+ *
+ * The return value of the function is published when it completes, as event
+ * \ref TRACKLE_ASYNC_RESULT_EVENT with data {"fn":"name","id":12,"ret":1,"ms":350}.
+ */
+
+#ifndef TRACKLE_ASYNC_MAX
+#define TRACKLE_ASYNC_MAX 8 ///< Max number of functions, at most 16
+#endif
+
+#ifndef TRACKLE_ASYNC_WORKERS
+#define TRACKLE_ASYNC_WORKERS 2
+#endif
+
+#ifndef TRACKLE_ASYNC_QUEUE_LEN
+#define TRACKLE_ASYNC_QUEUE_LEN 4 ///< Calls waiting for a worker, beyond these calls are refused
+#endif
+
+#ifndef TRACKLE_ASYNC_MAX_ARGS
+#define TRACKLE_ASYNC_MAX_ARGS 256 ///< Max length of the arguments of a queued call
+#endif
+
+#ifndef TRACKLE_ASYNC_STACK_SIZE
+#define TRACKLE_ASYNC_STACK_SIZE 4096
+#endif
+
+#ifndef TRACKLE_ASYNC_RESULT_EVENT
+#define TRACKLE_ASYNC_RESULT_EVENT "trackle/function/result"
+#endif
+
+#define TRACKLE_ASYNC_NAME_LEN 32 ///< Max length of a function name, NULL terminator included
+
+#define TRACKLE_ASYNC_BUSY -2     ///< Returned to the cloud when the queue is full
+#define TRACKLE_ASYNC_TOO_LONG -3 ///< Returned to the cloud when the arguments are too long
+
+/**
+ * @brief Counters of a function.
+ */
+typedef struct
+{
+    uint32_t calls;    ///< Calls executed
+    uint32_t rejected; ///< Calls refused, queue full or arguments too long
+    uint32_t avgMs;    ///< Average execution time
+    uint32_t maxMs;    ///< Longest execution time
+    int lastResult;    ///< Return value of the last call
+} TrackleAsync_Stats;
+
+/**
+ * @brief Register a cloud function executed by the workers, instead of tracklePost.
+ *
+ * The workers are started at the first call.
+ *
+ * @param name Function name.
+ * @param function Function, same as for tracklePost.
+ * @param permission Who can call the function, same as for tracklePost.
+ * @return true on success, false if the name is too long, \ref TRACKLE_ASYNC_MAX functions are
+ * already registered or the workers can't be started.
+ */
+bool trackleAsyncAddPost(const char *name, int (*function)(const char *), Function_PermissionDef permission);
+
+/**
+ * @brief Get the counters of a function.
+ *
+ * @param name Function name.
+ * @param stats Where to save the counters.
+ * @return true on success, false if the function is not registered here.
+ */
+bool trackleAsyncGetStats(const char *name, TrackleAsync_Stats *stats);
+
+#endif
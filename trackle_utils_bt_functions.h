@@ -20,11 +20,17 @@
 #ifndef TRACKLE_UTILS_BT_FUNCTIONS_H
 #define TRACKLE_UTILS_BT_FUNCTIONS_H
 
-#define MAX_BT_POST_NAME_LEN 32
-#define MAX_BT_POSTS_NUM 10
+#include "trackle_utils_registry.h"
 
-#define MAX_BT_GET_NAME_LEN 32
-#define MAX_BT_GETS_NUM 10
+// Kept for compatibility: POSTs and GETs now share a registry of TRACKLE_REGISTRY_MAX_ENDPOINTS functions.
+#define MAX_BT_POST_NAME_LEN TRACKLE_REGISTRY_NAME_LEN
+#define MAX_BT_POSTS_NUM TRACKLE_REGISTRY_MAX_ENDPOINTS
+
+#define MAX_BT_GET_NAME_LEN TRACKLE_REGISTRY_NAME_LEN
+#define MAX_BT_GETS_NUM TRACKLE_REGISTRY_MAX_ENDPOINTS
+
+#define MAX_BT_FUNCTION_ARG_LEN 512    ///< Max length of the argument of a BLE function call
+#define MAX_BT_FUNCTION_RESULT_LEN 128 ///< Size of the buffer used to format numeric results of BLE functions
 
 #include <stdbool.h>
 
@@ -73,6 +79,38 @@ bool Trackle_BtPost_add(const char *name, int (*function)(const char *));
  */
 bool Trackle_BtGet_add(const char *name, void *(*function)(const char *), Data_TypeDef dataType);
 
+/**
+ * @brief Add a function callable during BLE provisioning that receives its argument block by block.
+ *
+ * Arguments bigger than \ref MAX_BT_FUNCTION_ARG_LEN are sent as a sequence of calls "offset,more,base64",
+ * each one answered with the offset of the next block expected (see \ref trackleRegistryWriteBlock).
+ *
+ * @param name Name that the client will use to call the function. The name must be unique between BLE functions.
+ * @param function Function receiving the blocks.
+ * @return true The function was added successfully.
+ * @return false There was and error in adding the function.
+ */
+bool Trackle_BtStream_add(const char *name, TrackleRegistry_BlockCb function);
+
+/**
+ * @brief Remove a POST or GET function previously added.
+ *
+ * If provisioning is running, the endpoint stays visible to the client until the end of the session, but calls to it fail.
+ *
+ * @param name Name of the function to remove.
+ * @return true The function was removed.
+ * @return false No function with such name.
+ */
+bool Trackle_BtFunction_remove(const char *name);
+
+/**
+ * @brief Get the registry holding BLE functions, e.g. to add typed GETs (see \ref trackle_utils_registry.h)
+ * or to expose the same functions on another transport.
+ *
+ * @return The registry of BLE functions.
+ */
+TrackleRegistry_t *Trackle_BtFunctions_registry();
+
 // ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
 esp_err_t btFunctionsEndpointsCreate();
 
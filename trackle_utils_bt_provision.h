@@ -33,7 +33,9 @@
 #include "trackle_utils_wifi.h"
 #include "trackle_utils_bt_functions.h"
 #include "trackle_utils.h"
+#include "trackle_utils_args.h"
 #include "trackle_utils_claimcode.h"
+#include "trackle_utils_writer.h"
 
 #include "trackle_esp32.h"
 
@@ -211,14 +213,16 @@ static void get_device_service_name(char *service_name, size_t max)
 
 static int btPostCbClaimCode(const char *args)
 {
-    char *key = strtok(args, ",");
-    if (key == NULL || strcmp(key, "cc") != 0)
+    TrackleArgs_t parser;
+    TrackleStr_t key, value;
+    char claimCode[CLAIM_CODE_LENGTH + 1];
+    trackleArgsInit(&parser, args, ',');
+    if (!trackleArgsNext(&parser, &key) || !trackleStrEquals(key, "cc"))
     {
         ESP_LOGE("cc", "Invalid key for setting claim code");
         return -1;
     }
-    char *claimCode = strtok(NULL, ",");
-    if (key == NULL || strlen(claimCode) != 63)
+    if (!trackleArgsNext(&parser, &value) || value.len != CLAIM_CODE_LENGTH || !trackleStrCopy(value, claimCode, sizeof(claimCode)))
     {
         ESP_LOGE("cc", "Invalid claim code");
         return -1;
@@ -233,20 +237,28 @@ static int btPostCbClaimCode(const char *args)
 static void *btGetCbDeviceInfo(const char *args)
 {
     static char json[256] = {0};
-    char *jsonPtr = json;
-    jsonPtr += sprintf(jsonPtr, "{");
-    jsonPtr += sprintf(jsonPtr, "\"deviceID\":\"%s\",", trackleGetDeviceIdAsStr());
+    TrackleWriter_t w;
+    trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+    trackleWriterBeginObject(&w);
+    trackleWriterKey(&w, "deviceID");
+    trackleWriterString(&w, trackleGetDeviceIdAsStr());
+    trackleWriterKey(&w, "productID");
 #ifdef PRODUCT_ID
-    jsonPtr += sprintf(jsonPtr, "\"productID\":%u,", PRODUCT_ID);
+    trackleWriterInt(&w, PRODUCT_ID);
 #else
-    jsonPtr += sprintf(jsonPtr, "\"productID\":%u,", 0);
+    trackleWriterInt(&w, 0);
 #endif
+    trackleWriterKey(&w, "firmwareVersion");
 #ifdef FIRMWARE_VERSION
-    jsonPtr += sprintf(jsonPtr, "\"firmwareVersion\":%u", FIRMWARE_VERSION);
+    trackleWriterInt(&w, FIRMWARE_VERSION);
 #else
-    jsonPtr += sprintf(jsonPtr, "\"firmwareVersion\":%u", 0);
+    trackleWriterInt(&w, 0);
 #endif
-    jsonPtr += sprintf(jsonPtr, "}");
+    trackleWriterEndObject(&w);
+    if (trackleWriterFinish(&w) < 0)
+    {
+        ESP_LOGE(BT_TAG, "deviceInfo truncated, %u bytes needed", (unsigned)trackleWriterLength(&w));
+    }
     return json;
 }
 
@@ -278,7 +290,7 @@ void trackle_utils_bt_provision_loop()
         xEventGroupClearBits(s_wifi_event_group, START_PROVISIONING);
         xEventGroupSetBits(s_wifi_event_group, IS_PROVISIONING);
 
-        esp_wifi_set_ps(WIFI_PS_MIN_MODEM); // enable powersave
+        tracklePowersaveLoop(); // IS_PROVISIONING is set: the policy switches to modem sleep now
 
         // Configuration for the provisioning manager
         wifi_prov_mgr_config_t config = {
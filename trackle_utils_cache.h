@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_CACHE_H
+#define TRACKLE_UTILS_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <defines.h>
+
+/**
+ * @file trackle_utils_cache.h
+ * @brief Cloud variables served from a cache.
+ *
+ * Cloud reads run the getter inside trackleLoop, with xTrackleSemaphore taken: a slow getter (I2C
+ * sensor, big JSON) stalls the network loop and every publisher. A cached variable is read by a worker
+ * task, outside the semaphore, and reads are answered with the cached copy; once it is older than its
+ * TTL the next read still gets the cached copy and triggers a refresh on the worker. The getter is never
+ * called from trackleLoop: a read that finds no value yet (the first one, or all of them while the
+ * getter keeps failing) gets no value, as a getter returning NULL, and the worker fetches one. Call
+ * \ref trackleCacheRefresh after registering a variable to have a value before the first read.
+ *
+ * A failed refresh (the getter returns NULL) keeps the last good value, which goes on being served as
+ * stale and refreshed at the next read.
+ *
+ * The worker calls the getter with empty arguments, since the cached value is shared by all the
+ * reads. Strings (VAR_STRING, VAR_JSON) longer than \ref TRACKLE_CACHE_VALUE_LEN - 1 are truncated.
+ */
+
+#ifndef TRACKLE_CACHE_MAX
+#define TRACKLE_CACHE_MAX 8 ///< Max number of cached variables, at most 16
+#endif
+
+#ifndef TRACKLE_CACHE_VALUE_LEN
+#define TRACKLE_CACHE_VALUE_LEN 256 ///< Max size of a cached string, NULL terminator included
+#endif
+
+#define TRACKLE_CACHE_NAME_LEN 32 ///< Max length of a variable name, NULL terminator included
+
+/**
+ * @brief Counters of a cached variable.
+ */
+typedef struct
+{
+    uint32_t hits;        ///< Reads answered with a fresh value
+    uint32_t staleHits;   ///< Reads answered with a stale value, a refresh was started
+    uint32_t misses;      ///< Reads that found no value, a fetch was started
+    uint32_t refreshes;   ///< Getter calls
+    uint32_t failures;    ///< Getter calls that returned NULL
+    uint32_t getterUsAvg; ///< Average duration of a getter call
+    uint32_t getterUsMax; ///< Longest getter call
+} TrackleCache_Stats;
+
+/**
+ * @brief Register a cloud variable served from cache, instead of trackleGet.
+ *
+ * @param name Variable name.
+ * @param getter Getter, same as for trackleGet.
+ * @param dataType Type of the value returned by \ref getter.
+ * @param ttlMs Time after which the value is refreshed.
+ * @return true on success, false if the name is too long or \ref TRACKLE_CACHE_MAX variables are already
+ * cached.
+ */
+bool trackleCacheAddGet(const char *name, void *(*getter)(const char *), Data_TypeDef dataType, uint32_t ttlMs);
+
+/**
+ * @brief Refresh a variable now, e.g. because the application knows it changed.
+ *
+ * @param name Variable name.
+ * @return true on success, false if the variable is not cached.
+ */
+bool trackleCacheRefresh(const char *name);
+
+/**
+ * @brief Get the counters of a cached variable.
+ *
+ * @param name Variable name.
+ * @param stats Where to save the counters.
+ * @return true on success, false if the variable is not cached.
+ */
+bool trackleCacheGetStats(const char *name, TrackleCache_Stats *stats);
+
+#endif
@@ -0,0 +1,202 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_CBOR_H
+#define TRACKLE_UTILS_CBOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file trackle_utils_cbor.h
+ * @brief Binary CBOR payloads: zero-copy reader for incoming arguments and text transport helpers.
+ *
+ * CBOR documents are produced with \ref trackle_utils_writer.h (format \ref TRACKLE_WRITER_CBOR)
+ * and published with \ref tracklePublishCborSecure or \ref trackleSyncStateCborSecure.
+ *
+ * The Trackle library carries event data and function arguments as NULL-terminated strings, so on
+ * the wire a CBOR document travels as text: the marker \ref TRACKLE_CBOR_TEXT_PREFIX followed by the
+ * document base64 encoded (RFC 4648, standard alphabet, padded), e.g. "cbor:oWF0GQPo" for {"t": 1000}.
+ * The marker tells receivers the payload is not plain text or JSON: decode everything after it as
+ * base64, then as CBOR. Data without the marker is not CBOR. Use \ref trackleCborFromText to get back
+ * the binary document from a function argument, then read it with a \ref TrackleCborReader_t.
+ *
+ * Size: base64 adds a third to the document, so the text form is usually NOT smaller than the same data
+ * as JSON. test/host/bench_cbor.c measures it on typical telemetry: a few sensor readings or a device
+ * state are 7-8% bigger than JSON (61 vs 57 and 121 vs 112 characters), a minute of float readings 39%
+ * bigger (CBOR floats take 5 bytes); only integer arrays come out smaller, 29% for a minute of readings
+ * as integer tenths. Encoding is 2-20 times faster than JSON, which formats every float as text.
+ * Prefer CBOR for integer heavy payloads or where the receiver wants binary data, JSON otherwise.
+ */
+
+#define TRACKLE_CBOR_TEXT_PREFIX "cbor:" ///< Marker at the start of the text form of a CBOR document
+#define TRACKLE_CBOR_TEXT_PREFIX_LEN (sizeof(TRACKLE_CBOR_TEXT_PREFIX) - 1)
+
+/// Size of a buffer for the text form of a document of \ref len bytes, NULL terminator included
+#define TRACKLE_CBOR_TEXT_SIZE(len) (TRACKLE_CBOR_TEXT_PREFIX_LEN + (((len) + 2) / 3) * 4 + 1)
+
+#ifndef TRACKLE_CBOR_MAX_PAYLOAD
+#define TRACKLE_CBOR_MAX_PAYLOAD 600 ///< Max size in bytes of a binary document sent with the CBOR publish APIs
+#endif
+
+/**
+ * @brief Type of the next item of a \ref TrackleCborReader_t.
+ */
+typedef enum
+{
+    TRACKLE_CBOR_INT = 0, /*!< Signed or unsigned integer */
+    TRACKLE_CBOR_BYTES,   /*!< Byte string */
+    TRACKLE_CBOR_TEXT,    /*!< UTF-8 text string */
+    TRACKLE_CBOR_ARRAY,   /*!< Array */
+    TRACKLE_CBOR_MAP,     /*!< Map */
+    TRACKLE_CBOR_BOOL,    /*!< true or false */
+    TRACKLE_CBOR_NULL,    /*!< null or undefined */
+    TRACKLE_CBOR_FLOAT,   /*!< Half, single or double precision float */
+    TRACKLE_CBOR_BREAK,   /*!< End of an indefinite length container */
+    TRACKLE_CBOR_END,     /*!< No more data */
+    TRACKLE_CBOR_INVALID  /*!< Malformed or unsupported data */
+} TrackleCbor_Type;
+
+/**
+ * @brief Pull reader over a CBOR document. Never copies nor allocates: strings are returned as
+ * pointers into the document.
+ */
+typedef struct
+{
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    bool error;
+} TrackleCborReader_t;
+
+/**
+ * @brief Initialize a reader.
+ *
+ * @param r Reader to initialize.
+ * @param data CBOR document.
+ * @param len Size of \ref data in bytes.
+ */
+void trackleCborReaderInit(TrackleCborReader_t *r, const uint8_t *data, size_t len);
+
+/**
+ * @brief Get the type of the next item, without consuming it.
+ *
+ * @param r Reader.
+ * @return Type of the next item.
+ */
+TrackleCbor_Type trackleCborPeek(TrackleCborReader_t *r);
+
+/**
+ * @brief Read an integer.
+ *
+ * @param r Reader.
+ * @param out Where to save the value.
+ * @return true on success, false if the next item is not an integer or does not fit in int64_t.
+ */
+bool trackleCborReadInt(TrackleCborReader_t *r, int64_t *out);
+
+/**
+ * @brief Read a number, either integer or float.
+ *
+ * @param r Reader.
+ * @param out Where to save the value.
+ * @return true on success, false if the next item is not a number.
+ */
+bool trackleCborReadDouble(TrackleCborReader_t *r, double *out);
+
+/**
+ * @brief Read a boolean.
+ *
+ * @param r Reader.
+ * @param out Where to save the value.
+ * @return true on success, false if the next item is not a boolean.
+ */
+bool trackleCborReadBool(TrackleCborReader_t *r, bool *out);
+
+/**
+ * @brief Read a text or byte string of definite length.
+ *
+ * @param r Reader.
+ * @param str Where to save the pointer to the string bytes (not NULL-terminated).
+ * @param len Where to save the length of the string.
+ * @return true on success, false if the next item is not a definite length string.
+ */
+bool trackleCborReadString(TrackleCborReader_t *r, const char **str, size_t *len);
+
+/**
+ * @brief Enter an array or a map.
+ *
+ * @param r Reader.
+ * @param count Where to save the number of items (pairs for maps), or SIZE_MAX for indefinite length containers.
+ * @return true on success, false if the next item is not an array or a map.
+ */
+bool trackleCborEnter(TrackleCborReader_t *r, size_t *count);
+
+/**
+ * @brief Consume the break marker that closes an indefinite length container.
+ *
+ * @param r Reader.
+ * @return true if a break marker was consumed.
+ */
+bool trackleCborLeave(TrackleCborReader_t *r);
+
+/**
+ * @brief Skip the next item, including all nested items of containers.
+ *
+ * @param r Reader.
+ * @return true on success, false on malformed data.
+ */
+bool trackleCborSkip(TrackleCborReader_t *r);
+
+/**
+ * @brief Position the reader on the value associated to a text key in the map that starts at the current position.
+ *
+ * On failure the reader position is left unchanged.
+ *
+ * @param r Reader, positioned on a map.
+ * @param key NULL-terminated key to look for.
+ * @return true if the key was found.
+ */
+bool trackleCborMapFind(TrackleCborReader_t *r, const char *key);
+
+/**
+ * @brief Encode a binary CBOR document to its text form, as carried by the Trackle library: the
+ * \ref TRACKLE_CBOR_TEXT_PREFIX marker and the base64 encoded document.
+ *
+ * @param data CBOR document.
+ * @param len Size of \ref data in bytes.
+ * @param out Buffer for the NULL-terminated text.
+ * @param outSize Size of \ref out in bytes, see \ref TRACKLE_CBOR_TEXT_SIZE.
+ * @return Length of the text (NULL terminator excluded), negative value if \ref out is too small.
+ */
+int trackleCborToText(const uint8_t *data, size_t len, char *out, size_t outSize);
+
+/**
+ * @brief Decode the text form of a CBOR document received as function argument.
+ *
+ * @param text NULL-terminated text.
+ * @param out Buffer for the binary document.
+ * @param outSize Size of \ref out in bytes.
+ * @return Size of the document in bytes, negative value if the marker is missing, on invalid base64 or if
+ * \ref out is too small.
+ */
+int trackleCborFromText(const char *text, uint8_t *out, size_t outSize);
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_CODEC_H
+#define TRACKLE_UTILS_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file trackle_utils_codec.h
+ * @brief Hex, base64 and base64url encoding and decoding (RFC 4648).
+ *
+ * All functions work on caller provided buffers and never allocate. Encoders always NULL-terminate
+ * the output and return its length; decoders return the number of bytes written. On error nothing
+ * useful is written and a negative TRACKLE_CODEC_ERR_* value is returned.
+ */
+
+#define TRACKLE_CODEC_ERR_SPACE -1 ///< Output buffer too small
+#define TRACKLE_CODEC_ERR_INPUT -2 ///< Invalid character or length in the input
+
+#define TRACKLE_HEX_ENCODED_LEN(n) ((n) * 2)                  ///< Hex text length for n bytes, NULL terminator excluded
+#define TRACKLE_HEX_DECODED_LEN(n) (((n) + 1) / 2)            ///< Bytes decoded from n hex characters
+#define TRACKLE_BASE64_ENCODED_LEN(n) ((((n) + 2) / 3) * 4)   ///< Padded base64 length for n bytes, NULL terminator excluded
+#define TRACKLE_BASE64URL_ENCODED_LEN(n) (((n) * 4 + 2) / 3)  ///< Unpadded base64url length for n bytes, NULL terminator excluded
+#define TRACKLE_BASE64_DECODED_MAX_LEN(n) (((n) + 3) / 4 * 3) ///< Max bytes decoded from n base64 characters
+
+/**
+ * @brief Encode bytes as lowercase hex.
+ *
+ * @param in Bytes to encode.
+ * @param len Number of bytes.
+ * @param out Output buffer, at least TRACKLE_HEX_ENCODED_LEN(len) + 1 bytes.
+ * @param outSize Size of \ref out.
+ * @return Length of the text, TRACKLE_CODEC_ERR_SPACE if \ref out is too small.
+ */
+int trackleHexEncode(const uint8_t *in, size_t len, char *out, size_t outSize);
+
+/**
+ * @brief Decode hex text (upper or lower case). Odd lengths have an implicit leading '0'.
+ *
+ * @param in Text to decode, not necessarily NULL terminated.
+ * @param len Number of characters.
+ * @param out Output buffer, at least TRACKLE_HEX_DECODED_LEN(len) bytes.
+ * @param outSize Size of \ref out.
+ * @return Number of bytes, TRACKLE_CODEC_ERR_SPACE or TRACKLE_CODEC_ERR_INPUT.
+ */
+int trackleHexDecode(const char *in, size_t len, uint8_t *out, size_t outSize);
+
+/**
+ * @brief Encode bytes as padded base64, standard alphabet.
+ *
+ * @param in Bytes to encode.
+ * @param len Number of bytes.
+ * @param out Output buffer, at least TRACKLE_BASE64_ENCODED_LEN(len) + 1 bytes.
+ * @param outSize Size of \ref out.
+ * @return Length of the text, TRACKLE_CODEC_ERR_SPACE if \ref out is too small.
+ */
+int trackleBase64Encode(const uint8_t *in, size_t len, char *out, size_t outSize);
+
+/**
+ * @brief Decode padded base64, standard alphabet.
+ *
+ * @param in Text to decode, not necessarily NULL terminated. Its length must be a multiple of 4.
+ * @param len Number of characters.
+ * @param out Output buffer, at least TRACKLE_BASE64_DECODED_MAX_LEN(len) bytes is always enough.
+ * @param outSize Size of \ref out.
+ * @return Number of bytes, TRACKLE_CODEC_ERR_SPACE or TRACKLE_CODEC_ERR_INPUT.
+ */
+int trackleBase64Decode(const char *in, size_t len, uint8_t *out, size_t outSize);
+
+/**
+ * @brief Encode bytes as unpadded base64url (URL and file name safe alphabet).
+ *
+ * @param in Bytes to encode.
+ * @param len Number of bytes.
+ * @param out Output buffer, at least TRACKLE_BASE64URL_ENCODED_LEN(len) + 1 bytes.
+ * @param outSize Size of \ref out.
+ * @return Length of the text, TRACKLE_CODEC_ERR_SPACE if \ref out is too small.
+ */
+int trackleBase64UrlEncode(const uint8_t *in, size_t len, char *out, size_t outSize);
+
+/**
+ * @brief Decode base64url, with or without padding.
+ *
+ * @param in Text to decode, not necessarily NULL terminated.
+ * @param len Number of characters.
+ * @param out Output buffer, at least TRACKLE_BASE64_DECODED_MAX_LEN(len) bytes is always enough.
+ * @param outSize Size of \ref out.
+ * @return Number of bytes, TRACKLE_CODEC_ERR_SPACE or TRACKLE_CODEC_ERR_INPUT.
+ */
+int trackleBase64UrlDecode(const char *in, size_t len, uint8_t *out, size_t outSize);
+
+#endif
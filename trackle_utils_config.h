@@ -0,0 +1,124 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_CONFIG_H
+#define TRACKLE_UTILS_CONFIG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include "nvs.h"
+
+/**
+ * @file trackle_utils_config.h
+ * @brief Write-back RAM cache of the configuration stored in NVS.
+ *
+ * Every configuration blob is read from NVS once, then reads are served from RAM. Writes update the RAM
+ * copy and mark it dirty; dirty blobs are written to NVS together, with one commit, \ref
+ * TRACKLE_CONFIG_COMMIT_DELAY_MS after the first write, on \ref trackleConfigFlush or before a restart
+ * (esp_restart, including the one at the end of an OTA). A write of the same value already stored
+ * doesn't touch the flash at all.
+ *
+ * Ordering: at a flush, blobs are written in the order of their last modification, and every blob is
+ * written atomically by NVS. After a power loss a blob is either the old or the new value, and if a
+ * blob has the new value, so have all those whose last modification came before its own. Intermediate
+ * values are not kept: after writing A, then B, then A again, B may be found new with A still at the
+ * value it had before the first write. Writes not yet flushed are lost: call \ref trackleConfigFlush
+ * after changes that must survive a power loss, or between writes whose order matters.
+ *
+ * Blobs are kept in a static area of \ref TRACKLE_CONFIG_CACHE_SIZE bytes; when it is full, or more
+ * than \ref TRACKLE_CONFIG_MAX_ENTRIES keys are used, the blobs that don't fit are read and written
+ * directly on NVS, as without cache.
+ */
+
+#ifndef TRACKLE_CONFIG_MAX_ENTRIES
+#define TRACKLE_CONFIG_MAX_ENTRIES 8 ///< Max number of cached keys
+#endif
+
+#ifndef TRACKLE_CONFIG_CACHE_SIZE
+#define TRACKLE_CONFIG_CACHE_SIZE 1024 ///< Bytes for the cached blobs
+#endif
+
+#ifndef TRACKLE_CONFIG_COMMIT_DELAY_MS
+#define TRACKLE_CONFIG_COMMIT_DELAY_MS 5000 ///< Delay between the first write and the commit
+#endif
+
+/**
+ * @brief Cache counters.
+ */
+typedef struct
+{
+    uint32_t reads;             ///< Reads
+    uint32_t readHits;          ///< Reads served from RAM
+    uint32_t writes;            ///< Writes
+    uint32_t unchangedWrites;   ///< Writes of the value already stored, skipped
+    uint32_t commits;           ///< NVS commits
+    uint32_t commitsSaved;      ///< Commits avoided compared to one commit per write
+    uint32_t flashBytesWritten; ///< Blob bytes written to NVS
+    uint32_t failures;          ///< NVS errors during a flush
+} TrackleConfig_Stats;
+
+/**
+ * @brief Start the cache on an open NVS handle. Called by initStorage.
+ *
+ * Delayed flushes run in a low priority task started here, not in the esp_timer task.
+ *
+ * @param handle Handle of the configuration namespace, opened read/write.
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the task or the timer can't be created.
+ */
+esp_err_t trackleConfigInit(nvs_handle_t handle);
+
+/**
+ * @brief Read a blob, with the semantics of nvs_get_blob.
+ *
+ * @param key Key of the blob.
+ * @param out Where to save the blob.
+ * @param size Size of \ref out.
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if the key doesn't exist, ESP_ERR_NVS_INVALID_LENGTH if
+ * the blob is bigger than \ref size, ESP_ERR_INVALID_STATE if the cache is not started.
+ */
+esp_err_t trackleConfigRead(const char *key, void *out, size_t size);
+
+/**
+ * @brief Write a blob. It reaches NVS at the next flush.
+ *
+ * @param key Key of the blob.
+ * @param value Value.
+ * @param size Size of \ref value.
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the cache is not started, or the error of nvs_set_blob
+ * for blobs not cached.
+ */
+esp_err_t trackleConfigWrite(const char *key, const void *value, size_t size);
+
+/**
+ * @brief Write the dirty blobs to NVS and commit, now.
+ *
+ * @return ESP_OK on success, the NVS error otherwise (the blobs not written stay dirty).
+ */
+esp_err_t trackleConfigFlush();
+
+/**
+ * @brief Get cache counters.
+ *
+ * @param stats Where to save the counters.
+ */
+void trackleConfigGetStats(TrackleConfig_Stats *stats);
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_CONNECTIVITY_H
+#define TRACKLE_UTILS_CONNECTIVITY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file trackle_utils_connectivity.h
+ * @brief Links network events to the cloud connection.
+ *
+ * Network event handlers report link and IP changes here; \ref trackle_task acts on them:
+ *  - while the link is down cloud connection attempts are refused right away;
+ *  - when an IP address is obtained a cloud connection is started immediately, without waiting for
+ *    the library backoff;
+ *  - when the link is lost the cloud socket is closed at once, so the library notices it without
+ *    waiting for a keepalive timeout;
+ *  - when the active interface changes the cloud session is moved to a new socket right away.
+ *
+ * Every session also gets a breakdown of the time spent in each connection phase.
+ */
+
+/**
+ * @brief Duration of the phases of the last cloud session setup, in milliseconds.
+ */
+typedef struct
+{
+    uint32_t linkMs;      ///< From link loss (or boot) to link up
+    uint32_t ipMs;        ///< From link up to IP address
+    uint32_t dnsMs;       ///< Name resolution and selection of the cloud endpoint
+    uint32_t handshakeMs; ///< From socket creation to cloud connected (DTLS handshake and hello)
+    uint32_t totalMs;     ///< From link loss (or boot) to cloud connected
+    uint32_t sessions;    ///< Number of cloud sessions established since boot
+} TrackleConnectivity_Stats;
+
+void trackleConnectivityOnLinkUp();   ///< Report that the link is up (e.g. associated to the AP).
+void trackleConnectivityOnGotIp();    ///< Report that an IP address has been obtained.
+void trackleConnectivityOnLinkDown(); ///< Report that the link or the IP address has been lost.
+void trackleConnectivityOnRouteChange(); ///< Report that the cloud must be reached through another interface.
+
+/**
+ * @brief Tells if the network is usable for cloud connection.
+ *
+ * @return true if an IP address is available.
+ */
+bool trackleConnectivityIsUp();
+
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleConnectivityDnsStart();
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleConnectivityDnsDone();
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+bool trackleConnectivityTakeConnectRequest();
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+bool trackleConnectivityTakeLinkLost();
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+bool trackleConnectivityTakeRouteChange();
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleConnectivityLoop(bool cloudConnected);
+
+/**
+ * @brief Get phase durations of the last cloud session.
+ *
+ * @param stats Where to save the statistics.
+ */
+void trackleConnectivityGetStats(TrackleConnectivity_Stats *stats);
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_LAN_H
+#define TRACKLE_UTILS_LAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+/**
+ * @file trackle_utils_lan.h
+ * @brief Local control of the device over UDP, without going through the cloud.
+ *
+ * The functions of the local registry (\ref Trackle_BtPost_add, \ref Trackle_BtGet_add) can be called
+ * from the LAN with one datagram per request. Every datagram is authenticated with HMAC-SHA256 using a
+ * key derived from the device private key, so only clients provisioned with the same key can call them.
+ *
+ * Request:
+ * | bytes | content                                                                     |
+ * |-------|-----------------------------------------------------------------------------|
+ * | 32    | HMAC-SHA256 of the rest of the datagram                                     |
+ * | 8     | server nonce, from the last response received (any value the first time)    |
+ * | 8     | client ID, random, chosen once by the client                                |
+ * | 8     | counter, big endian; must grow at every request of the client (e.g. a ms timestamp) |
+ * | n + 1 | function name, NULL terminated                                              |
+ * | m     | arguments                                                                   |
+ *
+ * Response:
+ * | bytes | content                                     |
+ * |-------|---------------------------------------------|
+ * | 32    | HMAC-SHA256 of the rest of the datagram     |
+ * | 8     | server nonce                                |
+ * | 8     | client ID of the request                    |
+ * | 8     | counter of the request                      |
+ * | 1     | status, see \ref TrackleLan_Status          |
+ * | m     | result (POST return value or GET value)     |
+ *
+ * The server nonce is random and changes at every boot, so requests captured before a reboot can't be
+ * replayed after it. A request with a different nonce is not executed: the answer is
+ * \ref TRACKLE_LAN_STALE_NONCE with the current nonce, and the client sends the request again with it.
+ * Within a boot, every client must use growing counters; the last counter of up to
+ * \ref TRACKLE_LAN_MAX_CLIENTS clients is kept. Clients are told apart by the client ID, which is
+ * covered by the HMAC, and not by the source address, which anybody on the LAN can spoof. When a client is forgotten to make room for a new one,
+ * its last counter becomes the minimum for new clients, so its requests can't be replayed either.
+ *
+ * Unauthenticated or replayed requests get no answer. Requests are served by
+ * \ref TRACKLE_LAN_WORKERS tasks; when \ref TRACKLE_LAN_QUEUE_LEN requests are already waiting the
+ * answer is \ref TRACKLE_LAN_BUSY. When the mDNS component is available the service is announced as
+ * _trackle._udp.
+ */
+
+#ifndef TRACKLE_LAN_PORT
+#define TRACKLE_LAN_PORT 49684 ///< In the dynamic range, not assigned to any protocol
+#endif
+
+#ifndef TRACKLE_LAN_WORKERS
+#define TRACKLE_LAN_WORKERS 2
+#endif
+
+#ifndef TRACKLE_LAN_QUEUE_LEN
+#define TRACKLE_LAN_QUEUE_LEN 4
+#endif
+
+#ifndef TRACKLE_LAN_MAX_CLIENTS
+#define TRACKLE_LAN_MAX_CLIENTS 8 ///< Clients whose last counter is remembered
+#endif
+
+#ifndef TRACKLE_LAN_MAX_ARGS
+#define TRACKLE_LAN_MAX_ARGS 512
+#endif
+
+#ifndef TRACKLE_LAN_MAX_RESULT
+#define TRACKLE_LAN_MAX_RESULT 256
+#endif
+
+typedef enum
+{
+    TRACKLE_LAN_OK = 0,
+    TRACKLE_LAN_NOT_FOUND,
+    TRACKLE_LAN_ERROR,
+    TRACKLE_LAN_BUSY,
+    TRACKLE_LAN_TOO_LONG,
+    TRACKLE_LAN_STALE_NONCE, ///< Request with an old server nonce, not executed: send it again with the nonce of the response
+} TrackleLan_Status;
+
+/**
+ * @brief Server counters.
+ */
+typedef struct
+{
+    uint32_t requests;     ///< Datagrams received
+    uint32_t authFailures; ///< Datagrams with wrong HMAC or malformed
+    uint32_t replays;      ///< Datagrams with an old counter
+    uint32_t staleNonces;  ///< Requests with an old server nonce
+    uint32_t busy;         ///< Requests refused because all workers were busy
+    uint32_t calls;        ///< Functions called
+} TrackleLan_Stats;
+
+/**
+ * @brief Start the server task and the workers.
+ *
+ * @param port UDP port, e.g. TRACKLE_LAN_PORT.
+ * @param secret Secret the authentication key is derived from, usually the device private key.
+ * @param secretLen Length of secret.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if already started, ESP_FAIL or ESP_ERR_NO_MEM on error.
+ */
+esp_err_t trackleLanStart(uint16_t port, const uint8_t *secret, size_t secretLen);
+
+/**
+ * @brief Get server counters.
+ *
+ * @param stats Where to save the counters.
+ */
+void trackleLanGetStats(TrackleLan_Stats *stats);
+
+#endif
@@ -0,0 +1,137 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_NETIF_H
+#define TRACKLE_UTILS_NETIF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_netif.h"
+
+/**
+ * @file trackle_utils_netif.h
+ * @brief Network interfaces used for the cloud connection, with priority based failover.
+ *
+ * Every interface that can reach the cloud (Wi-Fi station, Ethernet, ...) is registered with a
+ * priority and reports when it gets or loses its IP address. The interface that is up and has the
+ * highest priority is the active one: the cloud socket is bound to it and it is used as default route.
+ * When the active interface changes (failover to a backup or failback to the preferred one) the
+ * cloud socket is recreated on the new interface and the session is resumed.
+ *
+ * \ref wifi_init registers the Wi-Fi station with priority \ref TRACKLE_NETIF_PRIORITY_WIFI. For a
+ * wired link, e.g. Ethernet:
+ * @code
+ * trackleNetifRegister(eth_netif, TRACKLE_NETIF_PRIORITY_ETHERNET, CONNECTION_TYPE_ETHERNET);
+ * // from IP_EVENT_ETH_GOT_IP / ETHERNET_EVENT_DISCONNECTED handlers
+ * trackleNetifSetUp(eth_netif, true);
+ * trackleNetifSetUp(eth_netif, false);
+ * @endcode
+ *
+ * The module keeps NETWORK_CONNECTED_BIT set while at least one interface is up.
+ */
+
+#ifndef TRACKLE_NETIF_MAX
+#define TRACKLE_NETIF_MAX 4
+#endif
+
+#ifndef TRACKLE_NETIF_PRIORITY_WIFI
+#define TRACKLE_NETIF_PRIORITY_WIFI 10
+#endif
+
+#ifndef TRACKLE_NETIF_PRIORITY_ETHERNET
+#define TRACKLE_NETIF_PRIORITY_ETHERNET 20
+#endif
+
+/**
+ * @brief Interface switch statistics.
+ */
+typedef struct
+{
+    uint32_t switches;         ///< Number of changes of the active interface
+    uint32_t lastSwitchMillis; ///< getMillis() at the last change
+} TrackleNetif_Stats;
+
+/**
+ * @brief Register an interface.
+ *
+ * @param netif Interface handle.
+ * @param priority Higher priority interfaces are preferred.
+ * @param connectionType Connection type reported to the cloud while the interface is active (CONNECTION_TYPE_*).
+ *
+ * @return true if registered, false if the table is full.
+ */
+bool trackleNetifRegister(esp_netif_t *netif, int priority, int connectionType);
+
+/**
+ * @brief Report that the link of an interface is up (e.g. associated to the AP), before it gets its IP
+ * address. Ignored while another interface is active, not to disturb the timing of the active session.
+ *
+ * @param netif Registered interface handle.
+ */
+void trackleNetifLinkUp(esp_netif_t *netif);
+
+/**
+ * @brief Report that an interface got (up = true) or lost (up = false) its IP address.
+ *
+ * @param netif Registered interface handle.
+ * @param up Interface state.
+ */
+void trackleNetifSetUp(esp_netif_t *netif, bool up);
+
+/**
+ * @brief Tells if an interface is up.
+ *
+ * @param netif Registered interface handle.
+ *
+ * @return true if the interface is up.
+ */
+bool trackleNetifIsUp(esp_netif_t *netif);
+
+/**
+ * @brief Get the interface used by the cloud connection.
+ *
+ * @return Active interface, NULL if no registered interface is up.
+ */
+esp_netif_t *trackleNetifGetActive();
+
+/**
+ * @brief Get the connection type of the active interface.
+ *
+ * @return connectionType of the active interface, -1 if no registered interface is up.
+ */
+int trackleNetifGetConnectionType();
+
+/**
+ * @brief Bind a socket to the active interface.
+ *
+ * @param sock Socket descriptor.
+ *
+ * @return true if bound (or no interface is registered), false on error.
+ */
+bool trackleNetifBindSocket(int sock);
+
+/**
+ * @brief Get interface switch statistics.
+ *
+ * @param stats Where to save the statistics.
+ */
+void trackleNetifGetStats(TrackleNetif_Stats *stats);
+
+#endif
@@ -0,0 +1,140 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_POOL_H
+#define TRACKLE_UTILS_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+/**
+ * @file trackle_utils_pool.h
+ * @brief Fixed-size slab pools for the short-lived allocations of the cloud stack.
+ *
+ * Small blocks are served from a set of slab pools carved out of internal RAM once, at
+ * \ref tracklePoolInit, so that the churn of DTLS peers, retransmission queue nodes and JSON nodes
+ * does not fragment the general heap over days of uptime. Requests bigger than the largest slab go
+ * to SPIRAM when the board has it, otherwise to the internal heap.
+ *
+ * The hooks are wired to the tinydtls sources by the component CMakeLists.txt. Until
+ * \ref tracklePoolInit is called they simply forward to the heap. cJSON is routed to the pools only
+ * on request, with \ref tracklePoolHookCJSON.
+ */
+
+/**
+ * Slab classes as X(block size in bytes, number of blocks), smallest first.
+ * Block sizes must be multiples of 8. Can be overridden from the project build flags.
+ */
+#ifndef TRACKLE_POOL_CLASSES
+#define TRACKLE_POOL_CLASSES(X) \
+    X(32, 48)                   \
+    X(64, 32)                   \
+    X(128, 16)                  \
+    X(256, 8)                   \
+    X(512, 4)
+#endif
+
+#ifndef TRACKLE_POOL_SPIRAM_THRESHOLD
+#define TRACKLE_POOL_SPIRAM_THRESHOLD 1024 ///< Requests of at least this size go to SPIRAM, when available
+#endif
+
+/**
+ * @brief Counters of a single slab pool.
+ */
+typedef struct
+{
+    uint16_t blockSize; ///< Size of the blocks of the pool
+    uint16_t blocks;    ///< Number of blocks in the pool
+    uint16_t used;      ///< Blocks currently allocated
+    uint16_t peak;      ///< Max number of blocks allocated at the same time
+    uint32_t allocs;    ///< Allocations served by the pool
+    uint32_t failures;  ///< Allocations of this class that could not be served by the pool
+} TracklePool_Stats;
+
+/**
+ * @brief Counters of the requests that did not fit in the slab pools.
+ */
+typedef struct
+{
+    uint32_t internalAllocs; ///< Allocations served by the internal heap
+    uint32_t spiramAllocs;   ///< Allocations served by SPIRAM
+    uint32_t failures;       ///< Allocations that failed (heap exhausted or no-heap mode)
+} TracklePool_HeapStats;
+
+/**
+ * @brief Carve the slab pools out of internal RAM.
+ *
+ * Must be called once, before \ref initTrackle.
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the pools could not be allocated, ESP_ERR_INVALID_STATE if already initialized.
+ */
+esp_err_t tracklePoolInit();
+
+/**
+ * @brief Route cJSON allocations to the slab pools.
+ *
+ * cJSON hooks are process-global: every cJSON user of the application, not only the Trackle
+ * component, will then allocate from the pools and compete for their blocks. Call it only if the
+ * application's JSON documents are small and short-lived, and after \ref tracklePoolInit.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the pools are not initialized.
+ */
+esp_err_t tracklePoolHookCJSON();
+
+/**
+ * @brief Enable or disable the "no heap after init" mode.
+ *
+ * When enabled, requests that cannot be served by a slab pool, and reallocations of blocks that came
+ * from the heap, fail instead of falling back to the heap, and are counted in \ref TracklePool_HeapStats.failures. Useful to prove that steady-state
+ * operation does not touch the heap.
+ *
+ * @param noHeap true to forbid heap fallback.
+ */
+void tracklePoolSetNoHeap(bool noHeap);
+
+/**
+ * @brief Get the counters of the slab pools.
+ *
+ * @param stats Array where counters are saved, smallest class first.
+ * @param maxStats Size of \ref stats.
+ * @return Number of pools (may be bigger than \ref maxStats).
+ */
+int tracklePoolGetStats(TracklePool_Stats *stats, int maxStats);
+
+/**
+ * @brief Get the counters of the requests served outside the slab pools.
+ *
+ * @param stats Where to save the counters.
+ */
+void tracklePoolGetHeapStats(TracklePool_HeapStats *stats);
+
+/**
+ * @brief Print pool and heap fallback counters with ESP_LOGI.
+ */
+void tracklePoolLogStats();
+
+void *tracklePoolMalloc(size_t size);              ///< malloc() replacement
+void *tracklePoolCalloc(size_t n, size_t size);    ///< calloc() replacement
+void *tracklePoolRealloc(void *ptr, size_t size);  ///< realloc() replacement
+void tracklePoolFree(void *ptr);                   ///< free() replacement, accepts any heap pointer too
+
+#endif
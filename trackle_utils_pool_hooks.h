@@ -0,0 +1,39 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_POOL_HOOKS_H
+#define TRACKLE_UTILS_POOL_HOOKS_H
+
+/**
+ * @file trackle_utils_pool_hooks.h
+ * @brief Force-included (-include) in the C sources of the cloud stack to route their allocations to \ref trackle_utils_pool.h.
+ *
+ * ONLY FOR INTERNAL USAGE. DON'T INCLUDE IN APPLICATION CODE!
+ */
+
+#include <stdlib.h>
+
+#include "trackle_utils_pool.h"
+
+#define malloc(size) tracklePoolMalloc(size)
+#define calloc(n, size) tracklePoolCalloc(n, size)
+#define realloc(ptr, size) tracklePoolRealloc(ptr, size)
+#define free(ptr) tracklePoolFree(ptr)
+
+#endif
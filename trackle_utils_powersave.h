@@ -0,0 +1,118 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_POWERSAVE_H
+#define TRACKLE_UTILS_POWERSAVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_wifi.h"
+
+/**
+ * @file trackle_utils_powersave.h
+ * @brief Wi-Fi power save policy driven by cloud traffic.
+ *
+ * The radio is kept awake (WIFI_PS_NONE) while there is something latency sensitive going on:
+ * an OTA update, a datagram sent to the cloud still waiting for an answer, or any cloud traffic
+ * (function calls, variable reads, publishes) in the last \ref TracklePowersave_Config.activeHoldMs.
+ * After that the policy steps down to WIFI_PS_MIN_MODEM and, once the device has been idle for
+ * \ref TracklePowersave_Config.maxModemAfterMs, to WIFI_PS_MAX_MODEM. Any new traffic brings the
+ * radio back to WIFI_PS_NONE at once.
+ *
+ * While BLE provisioning is running modem sleep is mandatory for Wi-Fi/BT coexistence, so the policy
+ * never goes below WIFI_PS_MIN_MODEM. Provisioning switches mode through the policy too, so nothing
+ * else calls esp_wifi_set_ps.
+ */
+
+/**
+ * @brief Policy configuration. Times are in milliseconds.
+ */
+typedef struct
+{
+    bool enabled;             ///< If false the radio is kept in WIFI_PS_NONE (outside provisioning)
+    bool allowMaxModem;       ///< If false WIFI_PS_MIN_MODEM is the deepest mode used
+    uint32_t activeHoldMs;    ///< Stay in WIFI_PS_NONE for this long after the last traffic
+    uint32_t maxModemAfterMs; ///< Go to WIFI_PS_MAX_MODEM after this long without traffic
+    uint32_t replyTimeoutMs;  ///< Stop waiting for an answer to a sent datagram after this long
+} TracklePowersave_Config;
+
+/**
+ * @brief Time spent in each power save mode since \ref tracklePowersaveInit, in milliseconds.
+ */
+typedef struct
+{
+    uint64_t noneMs;
+    uint64_t minModemMs;
+    uint64_t maxModemMs;
+    uint32_t switches; ///< Number of mode changes
+} TracklePowersave_Stats;
+
+/**
+ * @brief Start the policy in WIFI_PS_NONE. Called by \ref wifi_init_sta.
+ */
+void tracklePowersaveInit();
+
+/**
+ * @brief Change the policy configuration.
+ *
+ * @param config New configuration.
+ */
+void tracklePowersaveSetConfig(const TracklePowersave_Config *config);
+
+/**
+ * @brief Get the current policy configuration.
+ *
+ * @param config Where to save the configuration.
+ */
+void tracklePowersaveGetConfig(TracklePowersave_Config *config);
+
+/**
+ * @brief Evaluate the policy and switch mode if needed. Called by \ref trackle_utils_wifi_loop and
+ * when BLE provisioning starts, from the application loop.
+ */
+void tracklePowersaveLoop();
+
+/**
+ * @brief Record cloud traffic. Called by the UDP callbacks of the cloud connection.
+ *
+ * @param inbound true for received datagrams, false for sent ones.
+ */
+void tracklePowersaveNotifyTraffic(bool inbound);
+
+/**
+ * @brief Record application activity that needs a responsive radio (e.g. a local function call).
+ */
+void tracklePowersaveNotifyActivity();
+
+/**
+ * @brief Get the mode currently set by the policy.
+ *
+ * @return Current power save mode.
+ */
+wifi_ps_type_t tracklePowersaveGetMode();
+
+/**
+ * @brief Get time spent in each mode.
+ *
+ * @param stats Where to save the statistics.
+ */
+void tracklePowersaveGetStats(TracklePowersave_Stats *stats);
+
+#endif
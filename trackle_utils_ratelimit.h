@@ -0,0 +1,137 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_RATELIMIT_H
+#define TRACKLE_UTILS_RATELIMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "trackle_interface.h"
+
+/**
+ * @file trackle_utils_ratelimit.h
+ * @brief Token bucket rate limiter for publishes.
+ *
+ * Every publish done with the tracklePublish*Secure functions takes a token from the global bucket
+ * and, if the event name has its own quota, from the bucket of the event. When a bucket is empty the
+ * policy of the event (or the global one) decides what happens:
+ *  - \ref TRACKLE_RATELIMIT_DROP: the publish fails;
+ *  - \ref TRACKLE_RATELIMIT_QUEUE: the event is copied in a queue and published when tokens are available;
+ *  - \ref TRACKLE_RATELIMIT_MERGE: like QUEUE, but only the last value of each event name is kept.
+ * Queued events are published by \ref trackle_task, in order. Publishing costs a hash lookup and,
+ * when throttled, a copy.
+ *
+ * Buckets are disabled by default (rate 0 means unlimited).
+ *
+ * Windows of \ref trackle_utils_series.h and chunks of \ref tracklePublishStream don't go through the
+ * limiter: they pace themselves (one window per period, stream windows paced by the RTT and the transmit
+ * queue) and are bigger than \ref TRACKLE_RATELIMIT_DATA_LEN, so queueing would only drop them.
+ */
+
+#ifndef TRACKLE_RATELIMIT_SLOTS
+#define TRACKLE_RATELIMIT_SLOTS 16 // must be a power of 2
+#endif
+
+#define TRACKLE_RATELIMIT_MAX_EVENTS (TRACKLE_RATELIMIT_SLOTS * 3 / 4)
+
+#ifndef TRACKLE_RATELIMIT_QUEUE_LEN
+#define TRACKLE_RATELIMIT_QUEUE_LEN 8
+#endif
+
+#ifndef TRACKLE_RATELIMIT_NAME_LEN
+#define TRACKLE_RATELIMIT_NAME_LEN 64
+#endif
+
+#ifndef TRACKLE_RATELIMIT_DATA_LEN
+#define TRACKLE_RATELIMIT_DATA_LEN 256
+#endif
+
+typedef enum
+{
+    TRACKLE_RATELIMIT_DROP = 0,
+    TRACKLE_RATELIMIT_QUEUE,
+    TRACKLE_RATELIMIT_MERGE,
+} TrackleRateLimit_Policy;
+
+typedef enum
+{
+    TRACKLE_RATELIMIT_ADMITTED = 0, ///< Publish now
+    TRACKLE_RATELIMIT_QUEUED,       ///< Will be published later
+    TRACKLE_RATELIMIT_DROPPED,      ///< Rejected
+} TrackleRateLimit_Result;
+
+/**
+ * @brief Limiter counters.
+ */
+typedef struct
+{
+    uint32_t admitted;  ///< Published at once
+    uint32_t queued;    ///< Queued because a bucket was empty
+    uint32_t merged;    ///< Replaced the value of a queued event
+    uint32_t dropped;   ///< Rejected (DROP policy, queue full or data too long)
+    uint32_t drained;   ///< Queued events published later
+    uint32_t maxQueued; ///< Highest number of queued events
+} TrackleRateLimit_Stats;
+
+/**
+ * @brief Configure the global bucket.
+ *
+ * @param ratePerMinute Tokens added every minute, 0 to disable the bucket.
+ * @param burst Bucket size.
+ * @param policy What to do with events without own quota when the bucket is empty.
+ *
+ * @return true if configured.
+ */
+bool trackleRateLimitSetGlobal(uint32_t ratePerMinute, uint32_t burst, TrackleRateLimit_Policy policy);
+
+/**
+ * @brief Configure the bucket of an event name.
+ *
+ * @param eventName Event name. The string is copied.
+ * @param ratePerMinute Tokens added every minute, 0 to disable the bucket.
+ * @param burst Bucket size.
+ * @param policy What to do when the bucket (or the global one) is empty.
+ *
+ * @return true if configured, false if the table is full or the name too long.
+ */
+bool trackleRateLimitSetEvent(const char *eventName, uint32_t ratePerMinute, uint32_t burst, TrackleRateLimit_Policy policy);
+
+/**
+ * @brief Get the number of throttled (queued, merged or dropped) publishes of an event name.
+ *
+ * @param eventName Event name with its own bucket.
+ *
+ * @return Throttled publishes, 0 if the event has no bucket.
+ */
+uint32_t trackleRateLimitGetThrottled(const char *eventName);
+
+/**
+ * @brief Get limiter counters.
+ *
+ * @param stats Where to save the counters (all zero if the Trackle semaphore could not be taken).
+ */
+void trackleRateLimitGetStats(TrackleRateLimit_Stats *stats);
+
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE! Call with xTrackleSemaphore taken.
+TrackleRateLimit_Result trackleRateLimitAdmit(const char *eventName, const char *data, Event_Type eventType, Event_Flags eventFlag, uint32_t msg_key);
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE! Call with xTrackleSemaphore taken.
+void trackleRateLimitLoop();
+
+#endif
@@ -0,0 +1,290 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_REGISTRY_H
+#define TRACKLE_UTILS_REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <defines.h>
+
+/**
+ * @file trackle_utils_registry.h
+ * @brief Registry of named POST/GET functions, shared by the local transports (BLE provisioning, LAN).
+ *
+ * Functions follow the same format and semantics of Trackle cloud POSTs and GETs. Names are looked up
+ * by hash in a fixed-size open addressing table, so the cost of a call does not depend on how many
+ * functions are registered.
+ *
+ * The registry has its own lock, so functions can be added and removed while the transports use it.
+ * Transports refer to functions by \ref TrackleEndpoint_Handle: a handle refers to one registration, so
+ * once the function is removed calls through it fail, even if its slot is reused by a new function.
+ * Functions are called without the lock held, except stream endpoints, whose block state is updated
+ * under the lock.
+ */
+
+#ifndef TRACKLE_REGISTRY_SLOTS
+#define TRACKLE_REGISTRY_SLOTS 32 ///< Hash table slots, must be a power of two. At most 3/4 of them can be used.
+#endif
+
+#define TRACKLE_REGISTRY_MAX_ENDPOINTS (TRACKLE_REGISTRY_SLOTS * 3 / 4) ///< Max number of functions in a registry
+#define TRACKLE_REGISTRY_NAME_LEN 32                                    ///< Max length of a name, NULL terminator included
+
+/**
+ * Types of the typed GET functions, as X(Data_TypeDef, C type, name suffix, serializer).
+ * For every entry a \ref trackleRegistryAddGetInt "trackleRegistryAddGet<suffix>" function is generated.
+ */
+#define TRACKLE_REGISTRY_TYPES(X)                                \
+    X(VAR_BOOLEAN, bool, Bool, trackleRegistrySerializeBool)     \
+    X(VAR_INT, int32_t, Int, trackleRegistrySerializeInt)        \
+    X(VAR_LONG, int64_t, Long, trackleRegistrySerializeLong)     \
+    X(VAR_DOUBLE, double, Double, trackleRegistrySerializeDouble) \
+    X(VAR_CHAR, char, Char, trackleRegistrySerializeChar)
+
+/**
+ * @brief Kind of a registered function.
+ */
+typedef enum
+{
+    TRACKLE_ENDPOINT_POST = 0, /*!< int function(const char *args) */
+    TRACKLE_ENDPOINT_GET,      /*!< void *function(const char *args), result type given by dataType */
+    TRACKLE_ENDPOINT_GET_TYPED, /*!< Getter returning its value, see \ref TRACKLE_REGISTRY_TYPES */
+    TRACKLE_ENDPOINT_STREAM     /*!< Payload received in blocks, see \ref trackleRegistryWriteBlock */
+} TrackleEndpoint_Kind;
+
+/**
+ * @brief Receives a payload block by block.
+ *
+ * @param offset Position of \ref data in the payload, 0 for the first block (a new payload).
+ * @param data Block data.
+ * @param len Length of \ref data.
+ * @param last true for the last block of the payload.
+ * @return 0 or positive on success, negative to abort the transfer (returned to the sender).
+ */
+typedef int (*TrackleRegistry_BlockCb)(uint32_t offset, const uint8_t *data, size_t len, bool last);
+
+#define TRACKLE_REGISTRY_GETTER_MEMBER(type, ctype, suffix, serializer) ctype (*get##suffix)(const char *);
+
+/**
+ * @brief A registered function.
+ */
+typedef struct
+{
+    char name[TRACKLE_REGISTRY_NAME_LEN];
+    uint32_t hash;
+    uint32_t generation; // of the registration, see TrackleEndpoint_Handle
+    uint8_t state;
+    TrackleEndpoint_Kind kind;
+    Data_TypeDef dataType;
+    union
+    {
+        int (*post)(const char *);
+        void *(*get)(const char *);
+        TRACKLE_REGISTRY_TYPES(TRACKLE_REGISTRY_GETTER_MEMBER)
+        TrackleRegistry_BlockCb block;
+    } fn;
+    uint32_t nextOffset; ///< Stream endpoints: offset of the next block expected
+    bool busy;           ///< Stream endpoints: a block is being passed to the function
+} TrackleEndpoint_t;
+
+/**
+ * @brief A registry. Usually a static variable.
+ */
+typedef struct
+{
+    TrackleEndpoint_t slots[TRACKLE_REGISTRY_SLOTS];
+    int count;
+    uint32_t lastGeneration;
+    SemaphoreHandle_t mutex; // recursive
+    StaticSemaphore_t mutexBuffer;
+} TrackleRegistry_t;
+
+/**
+ * @brief Reference to a registered function: slot index and generation of the registration.
+ */
+typedef uint32_t TrackleEndpoint_Handle;
+
+#define TRACKLE_ENDPOINT_INVALID 0 ///< Handle of no function
+
+/**
+ * @brief Initialize an empty registry.
+ *
+ * @param reg Registry to initialize.
+ */
+void trackleRegistryInit(TrackleRegistry_t *reg);
+
+/**
+ * @brief Take the lock of a registry, e.g. to iterate with \ref trackleRegistryNext. Recursive.
+ *
+ * @param reg Registry.
+ */
+void trackleRegistryLock(TrackleRegistry_t *reg);
+
+/**
+ * @brief Release the lock taken with \ref trackleRegistryLock.
+ *
+ * @param reg Registry.
+ */
+void trackleRegistryUnlock(TrackleRegistry_t *reg);
+
+/**
+ * @brief Register a POST function.
+ *
+ * @param reg Registry.
+ * @param name Unique name of the function.
+ * @param function Function to call.
+ * @return Handle of the new function, TRACKLE_ENDPOINT_INVALID if the name is already used, too long or the registry is full.
+ */
+TrackleEndpoint_Handle trackleRegistryAddPost(TrackleRegistry_t *reg, const char *name, int (*function)(const char *));
+
+/**
+ * @brief Register a GET function returning a pointer to its value.
+ *
+ * @param reg Registry.
+ * @param name Unique name of the function.
+ * @param function Function to call.
+ * @param dataType Type of the variable pointed to by the pointer returned by \ref function.
+ * @return Handle of the new function, TRACKLE_ENDPOINT_INVALID if the name is already used, too long or the registry is full.
+ */
+TrackleEndpoint_Handle trackleRegistryAddGet(TrackleRegistry_t *reg, const char *name, void *(*function)(const char *), Data_TypeDef dataType);
+
+/**
+ * @brief Register a function receiving its argument block by block, see \ref trackleRegistryWriteBlock.
+ *
+ * @param reg Registry.
+ * @param name Unique name of the function.
+ * @param function Function receiving the blocks.
+ * @return Handle of the new function, TRACKLE_ENDPOINT_INVALID if the name is already used, too long or the registry is full.
+ */
+TrackleEndpoint_Handle trackleRegistryAddStream(TrackleRegistry_t *reg, const char *name, TrackleRegistry_BlockCb function);
+
+#define TRACKLE_REGISTRY_ADD_GET_DECL(type, ctype, suffix, serializer) \
+    TrackleEndpoint_Handle trackleRegistryAddGet##suffix(TrackleRegistry_t *reg, const char *name, ctype (*function)(const char *));
+
+/**
+ * Typed GET registration: trackleRegistryAddGetBool, trackleRegistryAddGetInt, trackleRegistryAddGetLong,
+ * trackleRegistryAddGetDouble, trackleRegistryAddGetChar. The getter returns its value directly.
+ */
+TRACKLE_REGISTRY_TYPES(TRACKLE_REGISTRY_ADD_GET_DECL)
+
+/**
+ * @brief Find a function by name.
+ *
+ * @param reg Registry.
+ * @param name Name to look for.
+ * @return Handle of the function, TRACKLE_ENDPOINT_INVALID if not found.
+ */
+TrackleEndpoint_Handle trackleRegistryFind(TrackleRegistry_t *reg, const char *name);
+
+/**
+ * @brief Unregister a function.
+ *
+ * @param reg Registry.
+ * @param name Name of the function to remove.
+ * @return true if the function was found and removed.
+ */
+bool trackleRegistryRemove(TrackleRegistry_t *reg, const char *name);
+
+/**
+ * @brief Tells if a handle still refers to a registered function.
+ *
+ * @param reg Registry.
+ * @param handle Handle.
+ * @return true if registered.
+ */
+bool trackleRegistryIsValid(TrackleRegistry_t *reg, TrackleEndpoint_Handle handle);
+
+/**
+ * @brief Get the handle of an endpoint returned by \ref trackleRegistryNext.
+ *
+ * @param reg Registry.
+ * @param ep Endpoint.
+ * @return Handle.
+ */
+TrackleEndpoint_Handle trackleRegistryGetHandle(TrackleRegistry_t *reg, const TrackleEndpoint_t *ep);
+
+/**
+ * @brief Iterate over registered functions. Call with the lock taken (\ref trackleRegistryLock): the
+ * endpoints can change as soon as it is released.
+ *
+ * @param reg Registry.
+ * @param prev Endpoint returned by the previous call, NULL to start.
+ * @return Next endpoint, NULL when done.
+ */
+TrackleEndpoint_t *trackleRegistryNext(TrackleRegistry_t *reg, TrackleEndpoint_t *prev);
+
+/**
+ * @brief Call a function and get its result as text, with the same representation used over BLE
+ * (POST return code in decimal, "TRUE"/"FALSE" for booleans, "%f" for doubles; stream endpoints
+ * return the result of \ref trackleRegistryWriteBlock in decimal).
+ *
+ * @param reg Registry.
+ * @param handle Function to call.
+ * @param args NULL-terminated argument; stream endpoints decode the block in place.
+ * @param scratch Buffer used to format numeric results.
+ * @param scratchSize Size of \ref scratch, at least 32 bytes.
+ * @param result Where to save a pointer to the result, either \ref scratch or a string owned by the function.
+ * @param resultLen Where to save the length of the result.
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the function has been removed, ESP_FAIL if a GET function returned NULL.
+ */
+esp_err_t trackleRegistryCall(TrackleRegistry_t *reg, TrackleEndpoint_Handle handle, char *args, char *scratch, size_t scratchSize, const char **result, size_t *resultLen);
+
+/**
+ * @brief Pass a block to a stream endpoint.
+ *
+ * Large arguments are sent as a sequence of calls with argument "offset,more,data": offset of the
+ * block in the payload, 1 if more blocks follow (0 for the last one), block data in base64. The
+ * result is the offset of the next block expected: the sender goes on from there, so a block
+ * repeated or out of order is answered with the offset to resume from and never reaches the function.
+ * A block with offset 0 always starts a new payload. The result is the total length after the last
+ * block, TRACKLE_REGISTRY_ERR_BLOCK for a malformed block, TRACKLE_REGISTRY_ERR_BUSY while another
+ * block of the same function is being written (send it again), or the negative value returned by the
+ * function, that aborts the transfer.
+ *
+ * Blocks are decoded in place, so only one block is in memory at a time. The registry lock is only
+ * held to check and advance the offset: the function runs without it, so a slow one (e.g. a flash
+ * write) doesn't hold up the other functions of the registry. As for the other kinds of functions, a
+ * function removed while a block is being written still gets that block.
+ *
+ * @param reg Registry.
+ * @param handle Stream function.
+ * @param args Block, modified.
+ * @return See above.
+ */
+int trackleRegistryWriteBlock(TrackleRegistry_t *reg, TrackleEndpoint_Handle handle, char *args);
+
+#define TRACKLE_REGISTRY_ERR_BLOCK -1000 ///< Malformed block, or not a stream function
+#define TRACKLE_REGISTRY_ERR_BUSY -1001  ///< Another block of the same function is being written
+
+#define TRACKLE_REGISTRY_SERIALIZER_DECL(type, ctype, suffix, serializer) \
+    int serializer(ctype value, char *out, size_t outSize);
+
+/**
+ * Text serializers of the typed values, one per entry of \ref TRACKLE_REGISTRY_TYPES.
+ * They return the length of the text, or a negative value if \ref out is too small.
+ */
+TRACKLE_REGISTRY_TYPES(TRACKLE_REGISTRY_SERIALIZER_DECL)
+
+#endif
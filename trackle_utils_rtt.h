@@ -0,0 +1,114 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_RTT_H
+#define TRACKLE_UTILS_RTT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file trackle_utils_rtt.h
+ * @brief Round trip time and retransmission timeout estimation for the cloud connection (CoCoA).
+ *
+ * Datagrams are encrypted, so requests and answers cannot be matched: an exchange starts with the
+ * first datagram sent while nothing is outstanding and ends with the next datagram received.
+ *  - exchanges with a single transmission feed the strong estimator (RTO = SRTT + 4 * RTTVAR);
+ *  - exchanges with more transmissions (retransmissions) are measured from the first one and feed
+ *    the weak estimator (RTO = SRTT + RTTVAR), and count as losses;
+ *  - exchanges longer than \ref TRACKLE_RTT_MAX_SAMPLE_MS are dropped (unacknowledged messages).
+ * The overall RTO blends the two as CoCoA does (1/2 strong, 1/4 weak), ages towards the default when
+ * there are no new samples, and comes with a variable backoff factor.
+ *
+ * The Trackle library revision this component is built against has no hook for its CoAP retransmission
+ * timers, which keep the fixed CoAP defaults. The RTO drives the timers of this component instead
+ * (expiry of the transmit queue, stream pacing, time sync compensation), and the estimates are exposed
+ * as a cloud variable with \ref trackleRttAddDiagnostics. test/host/bench_rtt.c measures, on an emulated
+ * lossy link with the library's fixed retransmissions, how close the estimates get to the link and how
+ * the transmit queue expires datagrams with this RTO during lwIP buffer shortages.
+ */
+
+#ifndef TRACKLE_RTT_INITIAL_RTO_MS
+#define TRACKLE_RTT_INITIAL_RTO_MS 2000
+#endif
+
+#ifndef TRACKLE_RTT_MIN_RTO_MS
+#define TRACKLE_RTT_MIN_RTO_MS 200
+#endif
+
+#ifndef TRACKLE_RTT_MAX_RTO_MS
+#define TRACKLE_RTT_MAX_RTO_MS 32000
+#endif
+
+#ifndef TRACKLE_RTT_MAX_SAMPLE_MS
+#define TRACKLE_RTT_MAX_SAMPLE_MS 10000
+#endif
+
+/**
+ * @brief Current estimates. Times are in milliseconds.
+ */
+typedef struct
+{
+    uint32_t srttMs;        ///< Smoothed RTT (strong estimator)
+    uint32_t rttvarMs;      ///< RTT variation (strong estimator)
+    uint32_t rtoMs;         ///< Overall retransmission timeout
+    uint32_t lossPermille;  ///< Smoothed share of exchanges that needed retransmissions
+    uint32_t strongSamples; ///< Exchanges with a single transmission
+    uint32_t weakSamples;   ///< Exchanges with retransmissions
+    uint32_t dropped;       ///< Exchanges too long to be measured
+} TrackleRtt_Stats;
+
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleRttNotifySend();
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleRttNotifyReceive();
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleRttReset();
+
+/**
+ * @brief Get the retransmission timeout.
+ *
+ * @return RTO in milliseconds.
+ */
+uint32_t trackleRttGetRto();
+
+/**
+ * @brief Get the backoff factor to apply to the RTO for the next retransmission, in tenths.
+ *
+ * @return 30 if RTO < 1 s, 15 if RTO > 3 s, 20 otherwise.
+ */
+uint32_t trackleRttGetBackoff();
+
+/**
+ * @brief Get current estimates.
+ *
+ * @param stats Where to save the estimates.
+ */
+void trackleRttGetStats(TrackleRtt_Stats *stats);
+
+/**
+ * @brief Expose the estimates as a cloud variable, a JSON object:
+ * {"srtt":ms,"rttvar":ms,"rto":ms,"loss":permille,"strong":n,"weak":n,"dropped":n}.
+ *
+ * @param name Name of the variable, e.g. "rtt".
+ * @return true if the variable was registered.
+ */
+bool trackleRttAddDiagnostics(const char *name);
+
+#endif
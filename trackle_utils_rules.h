@@ -0,0 +1,162 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_RULES_H
+#define TRACKLE_UTILS_RULES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+/**
+ * @file trackle_utils_rules.h
+ * @brief Local rules deciding which readings are worth publishing.
+ *
+ * A rule is attached to an event name and tells when a new reading of that event has to be published:
+ *
+ *     temp:>30|delta>0.5|age>=3600
+ *
+ * publishes temp when it is above 30, or when it differs by more than 0.5 from the last published
+ * value, or when the last publish is at least one hour old. Syntax:
+ *
+ *     rule      := name ':' term ('|' term)*     any term true
+ *     term      := condition ('&' condition)*    all conditions true
+ *     condition := [operand] op number
+ *     operand   := "value" (default) | "delta" | "age"
+ *     op        := "<" | "<=" | ">" | ">=" | "="
+ *
+ * delta is the absolute difference from the last published value and age the seconds since the last
+ * publish; both are infinite before the first publish, so the first reading always passes a delta or
+ * age condition. Rules are compiled once to a few bytes per condition and evaluated without parsing
+ * or allocating.
+ *
+ * Rules can be set from the application, restored from NVS at boot (\ref trackleRulesLoad) or pushed
+ * from the cloud registering \ref trackleRulesPostCb as a POST function.
+ */
+
+#ifndef TRACKLE_RULES_MAX
+#define TRACKLE_RULES_MAX 8 ///< Max number of rules
+#endif
+
+#ifndef TRACKLE_RULES_MAX_CONDITIONS
+#define TRACKLE_RULES_MAX_CONDITIONS 6 ///< Max conditions in a rule
+#endif
+
+#ifndef TRACKLE_RULES_SRC_LEN
+#define TRACKLE_RULES_SRC_LEN 64 ///< Max length of a rule text, NULL terminator included
+#endif
+
+#define TRACKLE_RULES_NAME_LEN 32 ///< Max length of an event name, NULL terminator included
+
+/**
+ * @brief Result of \ref trackleRulesPublish.
+ */
+typedef enum
+{
+    TRACKLE_RULES_PUBLISHED = 0, ///< Rule matched (or no rule for the event) and the event was published
+    TRACKLE_RULES_FILTERED,      ///< Rule didn't match, nothing sent
+    TRACKLE_RULES_ERROR,         ///< Rule matched but the publish failed, the next reading is evaluated again
+} TrackleRules_Result;
+
+/**
+ * @brief Rules counters.
+ */
+typedef struct
+{
+    uint32_t evaluated; ///< Readings evaluated against a rule
+    uint32_t published; ///< Readings that matched their rule and were published
+    uint32_t filtered;  ///< Readings that didn't match their rule
+} TrackleRules_Stats;
+
+/**
+ * @brief Add a rule, or replace the rule of the same event.
+ *
+ * @param rule Rule text, see the syntax above.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG on syntax error, ESP_ERR_NO_MEM if \ref TRACKLE_RULES_MAX
+ * rules are already set.
+ */
+esp_err_t trackleRulesSet(const char *rule);
+
+/**
+ * @brief Remove the rule of an event: its readings are always published.
+ *
+ * @param eventName Event name.
+ * @return true if the rule was found.
+ */
+bool trackleRulesRemove(const char *eventName);
+
+/**
+ * @brief Remove all the rules.
+ */
+void trackleRulesClear();
+
+/**
+ * @brief Save the current rules to NVS.
+ *
+ * @return ESP_OK on success, an NVS error otherwise.
+ */
+esp_err_t trackleRulesSave();
+
+/**
+ * @brief Replace the current rules with the ones saved in NVS.
+ *
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if no rules were saved, another NVS error otherwise.
+ */
+esp_err_t trackleRulesLoad();
+
+/**
+ * @brief Evaluate a reading against the rule of its event, without publishing it.
+ *
+ * @param eventName Event name.
+ * @param value Reading.
+ * @return true if the reading has to be published (always if the event has no rule).
+ */
+bool trackleRulesMatch(const char *eventName, float value);
+
+/**
+ * @brief Publish a reading with \ref tracklePublishSecure if it matches the rule of its event.
+ *
+ * The value is published as text ("%g").
+ *
+ * @param eventName Event name.
+ * @param value Reading.
+ * @return See \ref TrackleRules_Result.
+ */
+TrackleRules_Result trackleRulesPublish(const char *eventName, float value);
+
+/**
+ * @brief POST function to manage rules remotely, register it on the cloud (or on the local registry).
+ *
+ * The argument is a rule ("temp:>30|delta>0.5"), set and saved to NVS; a rule without conditions
+ * ("temp:") removes the rule of the event.
+ *
+ * @param args Rule text.
+ * @return 1 on success, -1 on error.
+ */
+int trackleRulesPostCb(const char *args);
+
+/**
+ * @brief Get rules counters.
+ *
+ * @param stats Where to save the counters.
+ */
+void trackleRulesGetStats(TrackleRules_Stats *stats);
+
+#endif
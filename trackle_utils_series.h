@@ -0,0 +1,119 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_SERIES_H
+#define TRACKLE_UTILS_SERIES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+/**
+ * @file trackle_utils_series.h
+ * @brief Time series buffered on the device and uploaded once per window.
+ *
+ * Samples of a series are aggregated (count, min, max, mean, last) over a time window, in fixed
+ * memory. Optionally the raw samples are kept too, compressed Gorilla style. At the end of the window
+ * (or when the raw buffer is full) the window is published as one event with
+ * \ref tracklePublishSecureWithParams, named as the series, with data:
+ *
+ *     {"t":1700000000000,"w":60000,"n":600,"min":20.1,"max":21.4,"mean":20.7,"last":21,"rn":600,"raw":"..."}
+ *
+ * t is the UNIX time of the window start in ms, w its duration in ms; rn and raw (base64) are there
+ * only for series with raw samples.
+ *
+ * Raw format, a bit stream, most significant bit first:
+ * - first sample: ms since t on 32 bits, value as IEEE 754 float on 32 bits;
+ * - next samples, time: delta of delta D of the ms since the previous sample, as '0' if D is 0,
+ *   '10' + 7 bits if D is in [-64, 63], '110' + 9 bits if in [-256, 255], '1110' + 12 bits if in
+ *   [-2048, 2047], '1111' + 32 bits otherwise (two's complement);
+ * - next samples, value: X = value XOR previous value, as '0' if X is 0, '10' + the meaningful bits
+ *   if they fall within the leading/trailing zeros of the previous block, '11' + 5 bits of leading
+ *   zeros + 5 bits of meaningful length - 1 + the meaningful bits otherwise.
+ *
+ * Windows are published from the Trackle task, by \ref trackleSeriesLoop.
+ */
+
+#ifndef TRACKLE_SERIES_MAX
+#define TRACKLE_SERIES_MAX 4 ///< Max number of series
+#endif
+
+#ifndef TRACKLE_SERIES_RAW_BYTES
+#define TRACKLE_SERIES_RAW_BYTES 384 ///< Compressed raw samples per window and series (the event must fit a publish)
+#endif
+
+#define TRACKLE_SERIES_NAME_LEN 32 ///< Max length of a series name, NULL terminator included
+
+/**
+ * @brief Series counters.
+ */
+typedef struct
+{
+    uint32_t samples;       ///< Samples added
+    uint32_t rawSamples;    ///< Samples stored raw
+    uint32_t windows;       ///< Windows published
+    uint32_t failed;        ///< Windows whose publish failed (data lost)
+    uint32_t rawBytes;      ///< Compressed raw bytes published
+    uint32_t memoryBytes;   ///< RAM used by the series
+    float compressionRatio; ///< Size of the raw samples stored as time + value (8 bytes) / compressed size
+} TrackleSeries_Stats;
+
+/**
+ * @brief Create a series.
+ *
+ * @param name Series and event name.
+ * @param windowMs Window duration.
+ * @param raw true to upload the raw samples too.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the name is too long or already used or
+ * \ref windowMs is 0, ESP_ERR_NO_MEM if \ref TRACKLE_SERIES_MAX series already exist.
+ */
+esp_err_t trackleSeriesCreate(const char *name, uint32_t windowMs, bool raw);
+
+/**
+ * @brief Add a sample, timestamped now.
+ *
+ * @param name Series name.
+ * @param value Sample.
+ * @return true on success, false if the series doesn't exist.
+ */
+bool trackleSeriesAdd(const char *name, float value);
+
+/**
+ * @brief Close the current window of a series at the next \ref trackleSeriesLoop, even if not expired.
+ *
+ * @param name Series name.
+ * @return true on success, false if the series doesn't exist.
+ */
+bool trackleSeriesFlush(const char *name);
+
+/**
+ * @brief Get the counters of a series.
+ *
+ * @param name Series name.
+ * @param stats Where to save the counters.
+ * @return true on success, false if the series doesn't exist.
+ */
+bool trackleSeriesGetStats(const char *name, TrackleSeries_Stats *stats);
+
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleSeriesLoop();
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_SERVERS_H
+#define TRACKLE_UTILS_SERVERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lwip/sockets.h"
+
+/**
+ * @file trackle_utils_servers.h
+ * @brief Cloud endpoint selection.
+ *
+ * The cloud is reached through a list of hosts: the ones added with \ref trackleServersAdd or, if none,
+ * the address given by the library (or SERVER_ADDRESS / SERVER_PORT when defined). Every host is
+ * resolved to all its IPv4 addresses. Endpoints are probed with ICMP echo by a background task (at
+ * most once every \ref TRACKLE_SERVERS_PROBE_INTERVAL_MS, and when the endpoint has to be changed), so
+ * connecting never waits for probes. The fastest healthy endpoint is used and kept while it works; where
+ * ICMP is filtered the round trip of the first handshake message of the last session is used instead.
+ * An endpoint that fails \ref TRACKLE_SERVERS_MAX_FAILURES sessions in a row (no answer from the server)
+ * is skipped, and becomes eligible again \ref TRACKLE_SERVERS_RETRY_MS after its last failure.
+ */
+
+#ifndef TRACKLE_SERVERS_MAX_HOSTS
+#define TRACKLE_SERVERS_MAX_HOSTS 4
+#endif
+
+#ifndef TRACKLE_SERVERS_MAX_ENDPOINTS
+#define TRACKLE_SERVERS_MAX_ENDPOINTS 6
+#endif
+
+#ifndef TRACKLE_SERVERS_MAX_FAILURES
+#define TRACKLE_SERVERS_MAX_FAILURES 2
+#endif
+
+#ifndef TRACKLE_SERVERS_PROBE_TIMEOUT_MS
+#define TRACKLE_SERVERS_PROBE_TIMEOUT_MS 500
+#endif
+
+#ifndef TRACKLE_SERVERS_PROBE_INTERVAL_MS
+#define TRACKLE_SERVERS_PROBE_INTERVAL_MS (10 * 60 * 1000)
+#endif
+
+#ifndef TRACKLE_SERVERS_RETRY_MS
+#define TRACKLE_SERVERS_RETRY_MS (30 * 60 * 1000) ///< Time after which a failed endpoint is tried again
+#endif
+
+// A session is considered failed if nothing was received from the server in this time before it closed
+#ifndef TRACKLE_SERVERS_SILENCE_MS
+#define TRACKLE_SERVERS_SILENCE_MS 30000
+#endif
+
+#define TRACKLE_SERVERS_RTT_UNKNOWN UINT32_MAX
+
+/**
+ * @brief Statistics of a cloud endpoint.
+ */
+typedef struct
+{
+    struct sockaddr_in addr;
+    uint32_t rttMs;             ///< Last probed RTT, TRACKLE_SERVERS_RTT_UNKNOWN if never answered
+    uint32_t handshakeRttMs;    ///< First handshake round trip of the last session, TRACKLE_SERVERS_RTT_UNKNOWN if none
+    uint32_t probes;            ///< Probes sent
+    uint32_t probeLosses;       ///< Probes without answer
+    uint32_t sessions;          ///< Sessions that received data from the server
+    uint32_t failures;          ///< Sessions without answer from the server
+    uint8_t failureStreak;      ///< Consecutive failed sessions
+    uint32_t lastFailureMillis; ///< getMillis() at the last failed session
+    bool current;               ///< Endpoint in use
+} TrackleServer_Stats;
+
+/**
+ * @brief Add a cloud host. When at least one host is added the library address is ignored.
+ *
+ * @param host Host name or dotted IPv4 address. The string is copied.
+ * @param port UDP port.
+ *
+ * @return true if added, false if the list is full or the name too long.
+ */
+bool trackleServersAdd(const char *host, int port);
+
+/**
+ * @brief Remove all hosts added with \ref trackleServersAdd.
+ */
+void trackleServersClear();
+
+/**
+ * @brief Choose the endpoint for a new cloud session. Called by connect_cb_udp.
+ *
+ * @param defaultHost Address given by the library, used when no host has been added.
+ * @param defaultPort Port given by the library.
+ * @param addr Where to save the selected endpoint.
+ *
+ * @return true if an endpoint has been selected, false if no host could be resolved.
+ */
+bool trackleServersSelect(const char *defaultHost, int defaultPort, struct sockaddr_in *addr);
+
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleServersNotifyReceive();
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleServersNotifyClose();
+
+/**
+ * @brief Get endpoint statistics.
+ *
+ * @param stats Where to save the statistics.
+ * @param max Size of stats.
+ *
+ * @return Number of endpoints saved.
+ */
+size_t trackleServersGetStats(TrackleServer_Stats *stats, size_t max);
+
+#endif
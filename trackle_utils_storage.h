@@ -20,129 +20,139 @@
 #ifndef TRACKLE_UTILS_STORAGE_H
 #define TRACKLE_UTILS_STORAGE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #include "nvs_flash.h"
 #include "trackle_utils.h"
+#include "trackle_utils_config.h"
 
 /**
  * @file trackle_utils_storage.h
  * @brief Functions and globals for reading/writing Trackle credentials and firmware configuration from/to NVS.
+ *
+ * Device ID and private key are read from a factory record in a raw partition (\ref FACTORY_RECORD_PARTITION)
+ * when there is one: the record is memory mapped, so the credentials are used in place from flash, with no
+ * copies in RAM. Otherwise they are copied from the "device" namespace of the factory NVS partition.
+ *
+ * Factory record, little endian:
+ * | bytes  | content                                                   |
+ * |--------|-----------------------------------------------------------|
+ * | 4      | magic, \ref FACTORY_RECORD_MAGIC                          |
+ * | 2      | version, \ref FACTORY_RECORD_VERSION                      |
+ * | 2      | private key length (n), at most \ref PRIVATE_KEY_MAX_LEN  |
+ * | 12     | device ID                                                 |
+ * | 25     | device ID as lowercase hex string, NULL terminated        |
+ * | 3      | zero                                                      |
+ * | n      | private key (DER)                                         |
+ * | 4      | CRC32 (as zlib) of all the previous bytes                 |
+ *
+ * A record with a bad CRC, a key longer than \ref PRIVATE_KEY_MAX_LEN or a device ID string that is not the
+ * lowercase hex of the device ID is ignored, and the NVS partition is used.
+ *
+ * The mapped credentials can't be accessed while the flash cache is disabled (flash writes, IRAM ISRs).
+ *
+ * @warning Breaking change: device_id and private_key used to be arrays (uint8_t device_id[12],
+ * unsigned char private_key[122]); they are now const pointers, NULL until
+ * \ref readDeviceInfoFromStorage succeeds. sizeof(device_id) and sizeof(private_key) no longer give the
+ * lengths (use DEVICE_ID_LEN and \ref getPrivateKeyLength), the data can't be written, and code declaring
+ * them as extern arrays must use the declarations of this header. string_device_id has been removed: use
+ * \ref trackleGetDeviceIdAsStr.
  */
 
-static uint8_t device_id[12];   ///< Device ID read by \ref readDeviceInfoFromStorage from NVS.
-unsigned char private_key[122]; ///< Private key read by \ref readDeviceInfoFromStorage from NVS.
-char string_device_id[12 * 2 + 1];
-
 #define CONFIG_PARTITION "nvs"
 #define FACTORY_PARTITION "factory_data"
 #define OLD_FACTORY_PARTITION "factory"
 
-static const char *STORAGE_TAG = "storage";
+#ifndef FACTORY_RECORD_PARTITION
+#define FACTORY_RECORD_PARTITION "factory_id" ///< Label of the raw partition with the factory record
+#endif
+
+#define FACTORY_RECORD_MAGIC 0x464B5254 ///< "TRKF"
+#define FACTORY_RECORD_VERSION 1
+#define FACTORY_RECORD_MAX_SIZE 4096 ///< Max size of the record, mapped in one go
 
-nvs_handle_t config_handle;
-nvs_handle_t device_handle;
+#define DEVICE_ID_LEN 12
+#define PRIVATE_KEY_MAX_LEN 122
+
+/**
+ * @brief Where the credentials were read from.
+ */
+typedef enum
+{
+    TRACKLE_FACTORY_NONE = 0, ///< Not read yet, or not found
+    TRACKLE_FACTORY_RECORD,   ///< Memory mapped factory record
+    TRACKLE_FACTORY_NVS,      ///< Factory NVS partition
+} TrackleFactory_Source;
+
+/**
+ * @brief Cost of reading the credentials.
+ */
+typedef struct
+{
+    TrackleFactory_Source source; ///< Where the credentials come from
+    uint32_t loadUs;              ///< Time spent in initStorage and readDeviceInfoFromStorage
+    uint32_t ramBytes;            ///< Bytes of RAM holding copies of the credentials (0 for the record)
+} TrackleFactory_Stats;
+
+extern const uint8_t *device_id;         ///< Device ID (12 bytes), set by \ref readDeviceInfoFromStorage.
+extern const unsigned char *private_key; ///< Private key, set by \ref readDeviceInfoFromStorage.
+extern nvs_handle_t config_handle;
+extern nvs_handle_t device_handle;
 
 /**
  * @brief Opens NVS partition that contains device ID and private key (and configuration partition if required).
+ * The factory NVS partition is not needed when there is a valid factory record.
  *
  * @param has_config_partition If true, open the configuration partition too.
- * @return 0 on success, negative value on error
+ * @return 0 on success, negative value on error (-5 if the configuration cache can't be started)
  */
-int initStorage(bool has_config_partition)
-{
-    esp_err_t err = nvs_flash_init_partition(FACTORY_PARTITION);
-    if (err == ESP_OK)
-    { // FACTORY_PARTITION extists, try to read
-        err = nvs_open_from_partition(FACTORY_PARTITION, "device", NVS_READONLY, &device_handle);
-        if (err != ESP_OK)
-        {
-            return -2;
-        }
-        else
-        {
-            ESP_LOGI(STORAGE_TAG, "FACTORY_PARTITION found");
-        }
-    }
-    else
-    { // on error try with old factor partition named "factory"
-
-        err = nvs_flash_init_partition(OLD_FACTORY_PARTITION);
-        if (err == ESP_OK)
-        { // OLD_FACTORY_PARTITION extists, try to read
-            err = nvs_open_from_partition(OLD_FACTORY_PARTITION, "device", NVS_READONLY, &device_handle);
-            if (err != ESP_OK)
-            {
-                return -2;
-            }
-            else
-            {
-                ESP_LOGI(STORAGE_TAG, "OLD_FACTORY_PARTITION found");
-            }
-        }
-        else
-        { // no factory or factory data partition defined
-            ESP_LOGE(STORAGE_TAG, "no factory partition found");
-            return -1;
-        }
-    }
-
-    if (has_config_partition)
-    {
-        err = nvs_flash_init_partition(CONFIG_PARTITION);
-        if (err != ESP_OK)
-            return -3;
-
-        err = nvs_open_from_partition(CONFIG_PARTITION, "machine", NVS_READWRITE, &config_handle);
-        if (err != ESP_OK)
-            return -4;
-    }
-
-    return 0;
-}
+int initStorage(bool has_config_partition);
 
 /**
- * @brief Load Trackle device ID and private key from NVS.
- * The credentials are then stored in the \ref device_id and \ref private_key global variables.
+ * @brief Load Trackle device ID and private key, from the factory record or from NVS.
+ * The credentials are then pointed to by the \ref device_id and \ref private_key global variables and
+ * the device ID is returned by trackleGetDeviceIdAsStr.
  * @return ESP_OK on success, other value on error.
  */
-esp_err_t readDeviceInfoFromStorage()
-{
-    size_t required_size = 12;
-    esp_err_t err = nvs_get_blob(device_handle, "device_id", device_id, &required_size);
-    hexToString((unsigned char *)device_id, 12, string_device_id, 25);
-    required_size = 121;
-    err += nvs_get_blob(device_handle, "private_key", private_key, &required_size);
-    return err;
-}
+esp_err_t readDeviceInfoFromStorage();
+
+/**
+ * @brief Length of the private key pointed to by \ref private_key.
+ *
+ * @return Length in bytes, 0 if not read yet.
+ */
+size_t getPrivateKeyLength();
+
+/**
+ * @brief Get where the credentials were read from and the cost of reading them.
+ *
+ * @param stats Where to save the stats.
+ */
+void getFactoryStats(TrackleFactory_Stats *stats);
 
 /**
  * @brief Read firmware application-specific configuration structure from NVS.
+ * Only the first read of a key accesses NVS, then it is served from RAM (see \ref trackle_utils_config.h).
  *
  * @param out_value Location where to save read structure
  * @param out_size Size of the structure to read from NVS in bytes
  * @param key String containing the key of the configuration structure in NVS
  * @return ESP_OK on success, other value on error.
  */
-esp_err_t readConfigFromStorage(void *out_value, size_t out_size, const char *key)
-{
-    esp_err_t err = nvs_get_blob(config_handle, key, out_value, &out_size);
-    ESP_LOGI(STORAGE_TAG, "reading config from nvs datastore for key %s", key);
-    return err;
-}
+esp_err_t readConfigFromStorage(void *out_value, size_t out_size, const char *key);
 
 /**
  * @brief Write firmware application-specific configuration structure to NVS.
+ * The write is cached and committed together with the others within TRACKLE_CONFIG_COMMIT_DELAY_MS, or
+ * at \ref trackleConfigFlush or restart (see \ref trackle_utils_config.h).
  *
  * @param out_value Pointer to the structure to write to NVS.
  * @param out_size Size of the structure to write in bytes.
  * @param key String containing the key of the configuration structure in NVS
  * @return ESP_OK on success, other value on error.
  */
-esp_err_t writeConfigToStorage(void *out_value, size_t out_size, const char *key)
-{
-    esp_err_t err = nvs_set_blob(config_handle, key, out_value, out_size);
-    nvs_commit(config_handle);
-    ESP_LOGI(STORAGE_TAG, "writing config in nvs datastore for key %s: %d bytes", key, out_size);
-    return err;
-}
+esp_err_t writeConfigToStorage(void *out_value, size_t out_size, const char *key);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,145 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_STREAM_H
+#define TRACKLE_UTILS_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_err.h>
+
+#include <defines.h>
+
+#include "trackle_utils_registry.h"
+
+/**
+ * @file trackle_utils_stream.h
+ * @brief Publish of payloads bigger than RAM, produced chunk by chunk.
+ *
+ * The application gives a producer callback instead of the whole payload: it is called to fill one
+ * chunk at a time, and every chunk is sent as soon as it is ready, so whatever the size of the payload
+ * only one binary chunk and its text form are in memory.
+ *
+ * Every chunk is an event with the given name and data:
+ *
+ *     {"s":12345,"i":0,"d":"<base64 of up to TRACKLE_STREAM_CHUNK_SIZE bytes>"}
+ *
+ * where s identifies the stream and i is the chunk index; the stream ends with an event without d:
+ *
+ *     {"s":12345,"i":42,"end":true,"len":16128,"crc":3735928559}
+ *
+ * with the total length and the CRC32 (as zlib) of the payload, to check the reassembly.
+ *
+ * Flow control: chunks are sent in windows; after each window the sender waits one smoothed RTT. The
+ * window grows by one chunk after every window sent without backpressure and halves when a publish is
+ * refused (transmit queue congested), up to \ref TRACKLE_STREAM_MAX_WINDOW. Chunks bypass the publish rate
+ * limiter, this flow control takes its place.
+ *
+ * In the other direction, \ref trackleStreamAddPost registers a cloud function that receives an argument
+ * bigger than RAM block by block, with the framing of \ref trackleRegistryWriteBlock: the caller sends
+ * "offset,more,base64" calls and goes on from the offset returned by each one.
+ */
+
+#ifndef TRACKLE_STREAM_CHUNK_SIZE
+#define TRACKLE_STREAM_CHUNK_SIZE 384 ///< Payload bytes per chunk
+#endif
+
+#ifndef TRACKLE_STREAM_MAX_WINDOW
+#define TRACKLE_STREAM_MAX_WINDOW 4 ///< Max chunks sent back to back
+#endif
+
+#ifndef TRACKLE_STREAM_MAX_POSTS
+#define TRACKLE_STREAM_MAX_POSTS 4 ///< Max cloud functions added with trackleStreamAddPost, at most 16
+#endif
+
+#ifndef TRACKLE_STREAM_MAX_BLOCK_ARGS
+#define TRACKLE_STREAM_MAX_BLOCK_ARGS 640 ///< Max length of the argument of a block call (448 bytes of data)
+#endif
+
+#ifndef TRACKLE_STREAM_TIMEOUT_MS
+#define TRACKLE_STREAM_TIMEOUT_MS 30000 ///< The stream is aborted when a chunk can't be sent for this long
+#endif
+
+/**
+ * @brief Fill the next chunk.
+ *
+ * @param buf Where to write the data.
+ * @param size Size of \ref buf.
+ * @param ctx Context given to \ref tracklePublishStream.
+ * @return Bytes written, 0 at the end of the payload, negative to abort.
+ */
+typedef int (*TrackleStream_Producer)(uint8_t *buf, size_t size, void *ctx);
+
+/**
+ * @brief Progress of a stream.
+ */
+typedef struct
+{
+    uint32_t bytes;          ///< Payload bytes sent
+    uint32_t chunks;         ///< Chunks sent
+    uint32_t retries;        ///< Chunks refused and sent again
+    uint8_t window;          ///< Current window
+    uint32_t elapsedMs;      ///< Time since the start
+    uint32_t bytesPerSecond; ///< Average throughput
+} TrackleStream_Progress;
+
+/**
+ * @brief Called after every chunk sent.
+ */
+typedef void (*TrackleStream_ProgressCb)(const TrackleStream_Progress *progress, void *ctx);
+
+/**
+ * @brief Publish a payload produced chunk by chunk. Blocks until the last chunk is sent: call it from an
+ * application task, not from the Trackle task or from a Trackle callback.
+ *
+ * @param eventName Event name.
+ * @param producer Producer callback.
+ * @param progressCb Progress callback, can be NULL.
+ * @param ctx Context given to the callbacks.
+ * @return ESP_OK when the whole payload was sent, ESP_ERR_INVALID_STATE if another stream is running,
+ * ESP_ERR_TIMEOUT if a chunk couldn't be sent in \ref TRACKLE_STREAM_TIMEOUT_MS, ESP_FAIL if the producer
+ * aborted.
+ */
+esp_err_t tracklePublishStream(const char *eventName, TrackleStream_Producer producer, TrackleStream_ProgressCb progressCb, void *ctx);
+
+/**
+ * @brief Get the progress of the current stream, or of the last one.
+ *
+ * @param progress Where to save the progress.
+ */
+void trackleStreamGetProgress(TrackleStream_Progress *progress);
+
+/**
+ * @brief Add a cloud function receiving its argument block by block.
+ *
+ * Every call carries one block, "offset,more,base64", and returns the offset of the next block expected
+ * (see \ref trackleRegistryWriteBlock), so a transfer interrupted by a disconnection is resumed from
+ * there. \ref function is called once per block, so it can write the payload to flash or feed a parser
+ * without ever holding it whole.
+ *
+ * @param name Name of the cloud function.
+ * @param function Function receiving the blocks.
+ * @param permission Who can call the function.
+ * @return true if the function was added.
+ */
+bool trackleStreamAddPost(const char *name, TrackleRegistry_BlockCb function, Function_PermissionDef permission);
+
+#endif
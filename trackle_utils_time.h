@@ -0,0 +1,95 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_TIME_H
+#define TRACKLE_UTILS_TIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_timer.h"
+
+/**
+ * @file trackle_utils_time.h
+ * @brief Time synchronized with the cloud.
+ *
+ * The time sent by the cloud at connection (time_cb) is compensated by half the measured RTT and
+ * applied to the system clock, so time() and localtime() work as well. Between two syncs the
+ * frequency error of the local oscillator is estimated (drift, in ppm) and compensated: the wall clock
+ * is computed from the monotonic clock with a multiply and a shift (the drift is kept as a 32-bit
+ * fixed-point fraction) plus an add, under a spinlock; the division to milliseconds is done outside it.
+ * The base of the computation moves forward every 19 hours or so, at a read, to keep the product in 64
+ * bits.
+ */
+
+// Minimum time between two syncs to update the drift estimate (cloud time has 1 s resolution)
+#ifndef TRACKLE_TIME_DRIFT_MIN_INTERVAL_MS
+#define TRACKLE_TIME_DRIFT_MIN_INTERVAL_MS (6 * 3600 * 1000)
+#endif
+
+#ifndef TRACKLE_TIME_MAX_DRIFT_PPM
+#define TRACKLE_TIME_MAX_DRIFT_PPM 500
+#endif
+
+/**
+ * @brief Sync status.
+ */
+typedef struct
+{
+    bool synced;             ///< Cloud time received at least once
+    uint32_t syncs;          ///< Syncs since boot
+    uint64_t lastSyncMillis; ///< getMillis64() at the last sync
+    int32_t lastOffsetMs;    ///< Correction applied at the last sync (cloud - local)
+    int32_t driftPpm;        ///< Estimated frequency error of the local clock
+} TrackleTime_Status;
+
+/**
+ * @brief Monotonic milliseconds since boot, on 64 bits (getMillis wraps after 49 days).
+ */
+static inline uint64_t getMillis64(void)
+{
+    return (uint64_t)esp_timer_get_time() / 1000;
+}
+
+/**
+ * @brief Wall clock.
+ *
+ * @return Milliseconds since the UNIX epoch (system clock until the first sync).
+ */
+int64_t trackleTimeNowMs();
+
+/**
+ * @brief Tells if the cloud time has been received.
+ *
+ * @return true if synced.
+ */
+bool trackleTimeIsSynced();
+
+/**
+ * @brief Get sync status.
+ *
+ * @param status Where to save the status.
+ */
+void trackleTimeGetStatus(TrackleTime_Status *status);
+
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleTimeSync(time_t cloudTime);
+
+#endif
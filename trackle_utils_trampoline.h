@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+
+#ifndef TRACKLE_UTILS_TRAMPOLINE_H
+#define TRACKLE_UTILS_TRAMPOLINE_H
+
+/**
+ * @file trackle_utils_trampoline.h
+ * @brief Tables of trampolines, to give a context to Trackle library callbacks.
+ *
+ * The library calls functions and variable getters with their argument only. Modules that register
+ * many of them through a single handler (async functions, cached variables, stream functions) give
+ * every slot its own trampoline, that calls the handler with the slot index:
+ *
+ *     static int handler(uint8_t slot, const char *args);
+ *     TRACKLE_TRAMPOLINES(trampolines, int, handler, TRACKLE_ASYNC_MAX);
+ *     ...
+ *     tracklePost(trackle_s, name, trampolines[slot], permission);
+ *
+ * Only \ref count trampolines are generated.
+ */
+
+#define TRACKLE_TRAMPOLINE_MAX 16 ///< Max size of a table
+
+// ONLY FOR INTERNAL USAGE. Repeat m(a, b, c, i) for i from 0 to n - 1.
+#define TRACKLE_REPEAT_1(m, a, b, c) m(a, b, c, 0)
+#define TRACKLE_REPEAT_2(m, a, b, c) TRACKLE_REPEAT_1(m, a, b, c) m(a, b, c, 1)
+#define TRACKLE_REPEAT_3(m, a, b, c) TRACKLE_REPEAT_2(m, a, b, c) m(a, b, c, 2)
+#define TRACKLE_REPEAT_4(m, a, b, c) TRACKLE_REPEAT_3(m, a, b, c) m(a, b, c, 3)
+#define TRACKLE_REPEAT_5(m, a, b, c) TRACKLE_REPEAT_4(m, a, b, c) m(a, b, c, 4)
+#define TRACKLE_REPEAT_6(m, a, b, c) TRACKLE_REPEAT_5(m, a, b, c) m(a, b, c, 5)
+#define TRACKLE_REPEAT_7(m, a, b, c) TRACKLE_REPEAT_6(m, a, b, c) m(a, b, c, 6)
+#define TRACKLE_REPEAT_8(m, a, b, c) TRACKLE_REPEAT_7(m, a, b, c) m(a, b, c, 7)
+#define TRACKLE_REPEAT_9(m, a, b, c) TRACKLE_REPEAT_8(m, a, b, c) m(a, b, c, 8)
+#define TRACKLE_REPEAT_10(m, a, b, c) TRACKLE_REPEAT_9(m, a, b, c) m(a, b, c, 9)
+#define TRACKLE_REPEAT_11(m, a, b, c) TRACKLE_REPEAT_10(m, a, b, c) m(a, b, c, 10)
+#define TRACKLE_REPEAT_12(m, a, b, c) TRACKLE_REPEAT_11(m, a, b, c) m(a, b, c, 11)
+#define TRACKLE_REPEAT_13(m, a, b, c) TRACKLE_REPEAT_12(m, a, b, c) m(a, b, c, 12)
+#define TRACKLE_REPEAT_14(m, a, b, c) TRACKLE_REPEAT_13(m, a, b, c) m(a, b, c, 13)
+#define TRACKLE_REPEAT_15(m, a, b, c) TRACKLE_REPEAT_14(m, a, b, c) m(a, b, c, 14)
+#define TRACKLE_REPEAT_16(m, a, b, c) TRACKLE_REPEAT_15(m, a, b, c) m(a, b, c, 15)
+
+#define TRACKLE_TRAMPOLINE_FUNCTION(table, ret, handler, i) \
+    static ret table##_##i(const char *args)                \
+    {                                                       \
+        return handler(i, args);                            \
+    }
+#define TRACKLE_TRAMPOLINE_ENTRY(table, ret, handler, i) table##_##i,
+
+#define TRACKLE_TRAMPOLINES_EXPAND(table, ret, handler, count)                         \
+    TRACKLE_REPEAT_##count(TRACKLE_TRAMPOLINE_FUNCTION, table, ret, handler)           \
+    static ret (*const table[count])(const char *) = {                                 \
+        TRACKLE_REPEAT_##count(TRACKLE_TRAMPOLINE_ENTRY, table, ret, handler)}
+
+/**
+ * @brief Define the static array \ref table of \ref count functions ret (*)(const char *args): the i-th
+ * one returns handler(i, args).
+ *
+ * @param table Name of the array.
+ * @param ret Return type of the trampolines.
+ * @param handler Function ret handler(uint8_t index, const char *args).
+ * @param count Size of the array, a literal number (or a macro expanding to one) from 1 to \ref TRACKLE_TRAMPOLINE_MAX.
+ */
+#define TRACKLE_TRAMPOLINES(table, ret, handler, count) TRACKLE_TRAMPOLINES_EXPAND(table, ret, handler, count)
+
+#endif
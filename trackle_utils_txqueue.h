@@ -0,0 +1,93 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_TXQUEUE_H
+#define TRACKLE_UTILS_TXQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lwip/sockets.h"
+
+/**
+ * @file trackle_utils_txqueue.h
+ * @brief Transmit queue of the cloud socket.
+ *
+ * When lwIP is out of buffers (ENOMEM, ENOBUFS, EAGAIN) a datagram is copied into a fixed slot and
+ * reported as sent; queued datagrams are sent in order as soon as buffers are available again (at the
+ * next send, receive or \ref trackle_task loop). A datagram still queued after one RTO
+ * (\ref trackleRttGetRto) is dropped: by then the library retransmits it anyway.
+ *
+ * While the queue is above \ref TRACKLE_TXQ_HIGH_WATERMARK publish functions return false at once.
+ *
+ * The queue is used with xTrackleSemaphore taken; only \ref trackleTxQueueCongested can be called
+ * without it.
+ */
+
+#ifndef TRACKLE_TXQ_SLOTS
+#define TRACKLE_TXQ_SLOTS 4
+#endif
+
+#ifndef TRACKLE_TXQ_SLOT_SIZE
+#define TRACKLE_TXQ_SLOT_SIZE 1024
+#endif
+
+#ifndef TRACKLE_TXQ_HIGH_WATERMARK
+#define TRACKLE_TXQ_HIGH_WATERMARK (TRACKLE_TXQ_SLOTS / 2)
+#endif
+
+/**
+ * @brief Transmit queue counters.
+ */
+typedef struct
+{
+    uint32_t deferred;  ///< Datagrams queued because lwIP was out of buffers
+    uint32_t retried;   ///< Queued datagrams sent later
+    uint32_t dropped;   ///< Datagrams lost: queue full, too big for a slot or expired
+    uint32_t rejected;  ///< Publishes refused because of backpressure
+    uint32_t maxQueued; ///< Highest number of queued datagrams
+} TrackleTxQueue_Stats;
+
+#define TRACKLE_TXQ_DROPPED -2 ///< Returned by trackleTxQueueSend for a datagram dropped: report it as sent, nothing went out
+
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+int trackleTxQueueSend(int sock, const struct sockaddr_in *addr, const uint8_t *buf, size_t len);
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+size_t trackleTxQueueFlush(int sock, const struct sockaddr_in *addr);
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE!
+void trackleTxQueueClear();
+// ONLY FOR INTERNAL USAGE. DON'T CALL IN APPLICATION CODE! Call with xTrackleSemaphore taken.
+bool trackleTxQueueAccepting();
+
+/**
+ * @brief Tells if producers should slow down. Doesn't need xTrackleSemaphore, the result is a hint.
+ *
+ * @return true if the queue is above the high watermark.
+ */
+bool trackleTxQueueCongested();
+
+/**
+ * @brief Get transmit queue counters.
+ *
+ * @param stats Where to save the counters.
+ */
+void trackleTxQueueGetStats(TrackleTxQueue_Stats *stats);
+
+#endif
@@ -21,9 +21,20 @@
 #define TRACKLE_UTILS_WIFI_H
 
 #include <string.h>
+#include <inttypes.h>
 #include "esp_wifi.h"
+#include "esp_attr.h"
+#include "esp_idf_version.h"
+#include "nvs.h"
+#if ESP_IDF_VERSION_MAJOR >= 5
+#include "esp_random.h"
+#else
+#include "esp_system.h"
+#endif
 
 #include "trackle_utils.h"
+#include "trackle_utils_powersave.h"
+#include "trackle_utils_netif.h"
 
 /**
  * @file trackle_utils_wifi.h
@@ -34,6 +45,73 @@
 unsigned long timeout_connect_wifi = 0;
 esp_netif_t *sta_netif;
 
+// reconnect backoff: quick failures (AP lost, beacon timeout, ...) retry fast, persistent ones (wrong password, AP not found) back off longer
+#define WIFI_QUICK_BACKOFF_MIN 250
+#define WIFI_QUICK_BACKOFF_MAX 8000
+#define WIFI_PERSISTENT_BACKOFF_MIN 2000
+#define WIFI_PERSISTENT_BACKOFF_MAX 60000
+#define WIFI_BACKOFF_JITTER_PERCENT 25
+
+#define WIFI_CACHE_MAGIC 0x57494643 // "WIFC"
+#define WIFI_CACHE_NVS_NAMESPACE "trackle_wifi"
+#define WIFI_CACHE_NVS_KEY "last_ap"
+
+/**
+ * @brief Last AP the device got an IP from, used to connect without scanning.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t checksum;
+} wifi_cached_ap_t;
+
+/**
+ * @brief Timings and counters of Wi-Fi (re)connection attempts. Times are in milliseconds.
+ */
+typedef struct
+{
+    uint32_t attempts;              ///< Connection attempts since boot
+    uint32_t direct_attempts;       ///< Attempts made with cached BSSID and channel
+    uint32_t direct_successes;      ///< Direct attempts that got associated
+    uint32_t consecutive_failures;  ///< Failures since the last successful connection
+    uint32_t last_attempt_start;    ///< getMillis() when the last attempt started
+    uint32_t last_associate_time;   ///< From start of the last attempt to association
+    uint32_t last_ip_time;          ///< From association to IP address
+    uint32_t last_reconnect_time;   ///< From boot or disconnection to IP address
+    uint8_t last_disconnect_reason; ///< Reason of the last WIFI_EVENT_STA_DISCONNECTED
+    bool last_attempt_direct;       ///< Last attempt used cached BSSID and channel
+} wifi_reconnect_stats_t;
+
+/**
+ * @brief BSSID and channel settings of a station configuration.
+ */
+typedef struct
+{
+    bool bssid_set;
+    uint8_t bssid[6];
+    uint8_t channel;
+    wifi_scan_method_t scan_method;
+} wifi_sta_pinning_t;
+
+RTC_NOINIT_ATTR wifi_cached_ap_t wifi_rtc_cached_ap; // survives software resets
+wifi_cached_ap_t wifi_cached_ap;
+wifi_reconnect_stats_t wifi_reconnect_stats;
+uint32_t wifi_link_lost_millis = 0;
+uint32_t wifi_associated_millis = 0;
+bool wifi_skip_direct = false;
+
+// failures since the last connection, apart: a burst of quick failures must not delay a retry after a persistent one, and vice versa
+uint32_t wifi_quick_failures = 0;
+uint32_t wifi_persistent_failures = 0;
+
+// pinning of the provisioned configuration (the user may pin a BSSID or channel), restored by attempts
+// that don't use the cached AP, and the pinning written by the last attempt to tell the two apart
+wifi_sta_pinning_t wifi_provisioned_pinning;
+wifi_sta_pinning_t wifi_applied_pinning;
+bool wifi_pinning_saved = false;
+
 static const char *WIFI_TAG = "trackle-utils-wifi";
 
 // for diagnostics
@@ -41,6 +119,170 @@ static const char *WIFI_TAG = "trackle-utils-wifi";
 system_tick_t utility_check_diagnostic_millis = 0;
 wifi_ap_record_t ap;
 
+static uint8_t wifi_cached_ap_checksum(const wifi_cached_ap_t *cached)
+{
+    uint8_t sum = cached->channel;
+    for (int i = 0; i < 6; i++)
+        sum = (sum << 1 | sum >> 7) ^ cached->bssid[i];
+    return sum ^ 0xA5;
+}
+
+static bool wifi_cached_ap_valid(const wifi_cached_ap_t *cached)
+{
+    return cached->magic == WIFI_CACHE_MAGIC && cached->channel > 0 && cached->checksum == wifi_cached_ap_checksum(cached);
+}
+
+// Load last good AP from RTC memory (warm boot) or NVS (cold boot).
+static void wifi_cached_ap_load()
+{
+    if (wifi_cached_ap_valid(&wifi_rtc_cached_ap))
+    {
+        wifi_cached_ap = wifi_rtc_cached_ap;
+        return;
+    }
+
+    memset(&wifi_cached_ap, 0, sizeof(wifi_cached_ap));
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        size_t size = sizeof(wifi_cached_ap);
+        if (nvs_get_blob(handle, WIFI_CACHE_NVS_KEY, &wifi_cached_ap, &size) != ESP_OK || !wifi_cached_ap_valid(&wifi_cached_ap))
+            memset(&wifi_cached_ap, 0, sizeof(wifi_cached_ap));
+        nvs_close(handle);
+    }
+    wifi_rtc_cached_ap = wifi_cached_ap;
+}
+
+// Remember the AP we are connected to. NVS is written only when the AP changes, to save flash wear.
+static void wifi_cached_ap_store(const wifi_ap_record_t *ap_info)
+{
+    wifi_cached_ap_t cached = {.magic = WIFI_CACHE_MAGIC, .channel = ap_info->primary};
+    memcpy(cached.bssid, ap_info->bssid, sizeof(cached.bssid));
+    cached.checksum = wifi_cached_ap_checksum(&cached);
+    wifi_rtc_cached_ap = cached;
+
+    if (memcmp(&cached, &wifi_cached_ap, sizeof(cached)) == 0)
+        return;
+    wifi_cached_ap = cached;
+
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK)
+    {
+        nvs_set_blob(handle, WIFI_CACHE_NVS_KEY, &cached, sizeof(cached));
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
+
+static bool wifi_is_persistent_failure(uint8_t reason)
+{
+    switch (reason)
+    {
+    case WIFI_REASON_AUTH_FAIL:
+    case WIFI_REASON_AUTH_EXPIRE:
+    case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+    case WIFI_REASON_HANDSHAKE_TIMEOUT:
+    case WIFI_REASON_NO_AP_FOUND:
+    case WIFI_REASON_ASSOC_FAIL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Exponential backoff with +/- WIFI_BACKOFF_JITTER_PERCENT jitter, so that devices sharing an AP do not retry in lockstep.
+static uint32_t wifi_backoff_delay(uint32_t failures, bool persistent)
+{
+    const uint32_t min_delay = persistent ? WIFI_PERSISTENT_BACKOFF_MIN : WIFI_QUICK_BACKOFF_MIN;
+    const uint32_t max_delay = persistent ? WIFI_PERSISTENT_BACKOFF_MAX : WIFI_QUICK_BACKOFF_MAX;
+
+    uint32_t delay = min_delay;
+    for (uint32_t i = 1; i < failures && delay < max_delay; i++)
+        delay *= 2;
+    if (delay > max_delay)
+        delay = max_delay;
+
+    const uint32_t jitter = delay * WIFI_BACKOFF_JITTER_PERCENT / 100;
+    return delay - jitter + (jitter > 0 ? esp_random() % (2 * jitter + 1) : 0);
+}
+
+// copy the fields that pin the station to an AP out of a configuration
+static void wifi_get_pinning(const wifi_config_t *cfg, wifi_sta_pinning_t *pinning)
+{
+    memset(pinning, 0, sizeof(*pinning));
+    pinning->bssid_set = cfg->sta.bssid_set;
+    memcpy(pinning->bssid, cfg->sta.bssid, sizeof(pinning->bssid));
+    pinning->channel = cfg->sta.channel;
+    pinning->scan_method = cfg->sta.scan_method;
+}
+
+// write the pinning fields into a configuration, the other fields are left alone
+static void wifi_set_pinning(wifi_config_t *cfg, const wifi_sta_pinning_t *pinning)
+{
+    cfg->sta.bssid_set = pinning->bssid_set;
+    memcpy(cfg->sta.bssid, pinning->bssid, sizeof(cfg->sta.bssid));
+    cfg->sta.channel = pinning->channel;
+    cfg->sta.scan_method = pinning->scan_method;
+}
+
+/**
+ * @brief Start a connection attempt: directly to the cached BSSID and channel when available, else with the
+ * BSSID, channel and scan method of the provisioned configuration.
+ */
+static void wifi_start_connect_attempt()
+{
+    wifi_config_t wifi_cfg;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_cfg) != ESP_OK)
+        return;
+
+    // a configuration different from the one written by the last attempt comes from provisioning or the application
+    wifi_sta_pinning_t current;
+    wifi_get_pinning(&wifi_cfg, &current);
+    if (!wifi_pinning_saved || memcmp(&current, &wifi_applied_pinning, sizeof(current)) != 0)
+    {
+        wifi_provisioned_pinning = current;
+        wifi_pinning_saved = true;
+    }
+
+    const bool direct = !wifi_skip_direct && wifi_cached_ap_valid(&wifi_cached_ap);
+    if (direct)
+    {
+        wifi_cfg.sta.bssid_set = true;
+        memcpy(wifi_cfg.sta.bssid, wifi_cached_ap.bssid, sizeof(wifi_cfg.sta.bssid));
+        wifi_cfg.sta.channel = wifi_cached_ap.channel;
+        wifi_cfg.sta.scan_method = WIFI_FAST_SCAN;
+    }
+    else
+    {
+        wifi_set_pinning(&wifi_cfg, &wifi_provisioned_pinning);
+    }
+    wifi_get_pinning(&wifi_cfg, &wifi_applied_pinning);
+
+    // keep BSSID and channel hints out of the provisioned configuration saved in flash
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_cfg);
+    esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+
+    wifi_reconnect_stats.attempts++;
+    wifi_reconnect_stats.last_attempt_direct = direct;
+    wifi_reconnect_stats.last_attempt_start = getMillis();
+    if (direct)
+        wifi_reconnect_stats.direct_attempts++;
+
+    ESP_LOGI(WIFI_TAG, "Trying to connect to the AP%s...", direct ? " (cached BSSID/channel)" : "");
+    esp_wifi_connect();
+}
+
+/**
+ * @brief Get timings and counters of Wi-Fi connection attempts.
+ *
+ * @return Pointer to the statistics, updated by the Wi-Fi event handler.
+ */
+const wifi_reconnect_stats_t *wifi_get_reconnect_stats()
+{
+    return &wifi_reconnect_stats;
+}
+
 /**
  * @brief Tells if WiFi credentials have been set.
  * @return ESP_OK if credentials set, ESP_FAIL otherwise
@@ -67,7 +309,7 @@ esp_err_t wifi_is_provisioned()
 static void event_handler(void *arg, esp_event_base_t event_base,
                           int32_t event_id, void *event_data)
 {
-    EventBits_t bits = xEventGroupGetBits(s_wifi_event_group);
+    const bool wifi_up = trackleNetifIsUp(sta_netif);
 
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
     {
@@ -79,6 +321,7 @@ static void event_handler(void *arg, esp_event_base_t event_base,
         {
             ESP_LOGI(WIFI_TAG, "Connecting to the AP");
             xEventGroupSetBits(s_wifi_event_group, WIFI_TO_CONNECT_BIT); // connettiti
+            wifi_link_lost_millis = getMillis();
             timeout_connect_wifi = getMillis();
         }
         else if (currentMode == WIFI_MODE_APSTA)
@@ -92,7 +335,7 @@ static void event_handler(void *arg, esp_event_base_t event_base,
         wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
         ESP_LOGW(WIFI_TAG, "Wifi disconnection event: %d...", event->reason);
 
-        if (bits & NETWORK_CONNECTED_BIT)
+        if (wifi_up)
         {
             trackleDiagnosticNetwork(trackle_s, NETWORK_DISCONNECTS, 1);
 
@@ -100,22 +343,70 @@ static void event_handler(void *arg, esp_event_base_t event_base,
             trackleDiagnosticNetwork(trackle_s, NETWORK_CONNECTION_ATTEMPTS, 0);
         }
 
-        timeout_connect_wifi = getMillis() + CHECK_WIFI_TIMEOUT;
-        xEventGroupClearBits(s_wifi_event_group, NETWORK_CONNECTED_BIT);
+        if (wifi_up)
+        {
+            wifi_link_lost_millis = getMillis();
+        }
+
+        wifi_reconnect_stats.last_disconnect_reason = event->reason;
+        wifi_reconnect_stats.consecutive_failures++;
+        const bool persistent = wifi_is_persistent_failure(event->reason);
+        uint32_t *failures = persistent ? &wifi_persistent_failures : &wifi_quick_failures;
+        (*failures)++;
+
+        // a failed direct attempt falls back to a full scan immediately, the cached AP may have moved or changed channel
+        const bool direct_failed = wifi_reconnect_stats.last_attempt_direct && !wifi_skip_direct && !wifi_up;
+        if (direct_failed)
+        {
+            wifi_skip_direct = true;
+            timeout_connect_wifi = getMillis();
+        }
+        else
+        {
+            timeout_connect_wifi = getMillis() + wifi_backoff_delay(*failures, persistent);
+        }
+        trackleNetifSetUp(sta_netif, false);
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED)
+    {
+        trackleNetifLinkUp(sta_netif);
+        wifi_associated_millis = getMillis();
+        wifi_reconnect_stats.last_associate_time = wifi_associated_millis - wifi_reconnect_stats.last_attempt_start;
+        if (wifi_reconnect_stats.last_attempt_direct)
+        {
+            wifi_reconnect_stats.direct_successes++;
+        }
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
     {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         ESP_LOGW(WIFI_TAG, "Got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        xEventGroupSetBits(s_wifi_event_group, NETWORK_CONNECTED_BIT);
+        trackleNetifSetUp(sta_netif, true);
 
         // diagnostic
         esp_wifi_sta_get_ap_info(&ap);
+        wifi_cached_ap_store(&ap);
+
+        const uint32_t now = getMillis();
+        wifi_reconnect_stats.last_ip_time = now - wifi_associated_millis;
+        wifi_reconnect_stats.last_reconnect_time = now - wifi_link_lost_millis;
+        wifi_reconnect_stats.consecutive_failures = 0;
+        wifi_quick_failures = 0;
+        wifi_persistent_failures = 0;
+        wifi_skip_direct = false;
+        ESP_LOGI(WIFI_TAG, "Connected in %" PRIu32 " ms (associate %" PRIu32 " ms, ip %" PRIu32 " ms)",
+                 wifi_reconnect_stats.last_reconnect_time, wifi_reconnect_stats.last_associate_time, wifi_reconnect_stats.last_ip_time);
+
         trackleDiagnosticNetwork(trackle_s, NETWORK_IPV4_ADDRESS, (int32_t)(event->ip_info.ip.addr));
         trackleDiagnosticNetwork(trackle_s, NETWORK_IPV4_GATEWAY, (int32_t)event->ip_info.gw.addr);
         trackleDiagnosticNetwork(trackle_s, NETWORK_RSSI, ap.rssi);
         trackleDiagnosticNetwork(trackle_s, NETWORK_SIGNAL_STRENGTH, rssiToPercentage(ap.rssi));
     }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP)
+    {
+        ESP_LOGW(WIFI_TAG, "Lost ip");
+        trackleNetifSetUp(sta_netif, false);
+    }
 }
 
 /**
@@ -134,11 +425,15 @@ void wifi_init()
     // Register our event handler for Wi-Fi, IP and Provisioning related events
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_LOST_IP, &event_handler, NULL));
 
     sta_netif = esp_netif_create_default_wifi_sta();
+    trackleNetifRegister(sta_netif, TRACKLE_NETIF_PRIORITY_WIFI, CONNECTION_TYPE_WIFI);
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
     esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+
+    wifi_cached_ap_load();
 }
 
 /**
@@ -148,7 +443,7 @@ void wifi_init_sta()
 {
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_start());
-    esp_wifi_set_ps(WIFI_PS_NONE); // Disable powersave
+    tracklePowersaveInit(); // powersave disabled until the policy sees the device idle
     ESP_LOGI(WIFI_TAG, "wifi_init_sta finished.");
 }
 
@@ -166,18 +461,19 @@ void trackle_utils_wifi_loop()
         timeout_connect_wifi = 0;
         if ((bits & WIFI_TO_CONNECT_BIT))
         {
-            ESP_LOGI(WIFI_TAG, "Trying to connect to the AP...");
-            esp_wifi_connect();
+            wifi_start_connect_attempt();
 
             trackleDiagnosticNetwork(trackle_s, NETWORK_CONNECTION_ATTEMPTS, 1);
         }
     }
 
+    tracklePowersaveLoop();
+
     // updating diagnostic
     if (getMillis() - utility_check_diagnostic_millis >= UTILITY_DIAGNOSTIC_TIME)
     {
         utility_check_diagnostic_millis = getMillis();
-        if (bits & NETWORK_CONNECTED_BIT)
+        if (trackleNetifIsUp(sta_netif))
         {
             esp_wifi_sta_get_ap_info(&ap);
             trackleDiagnosticNetwork(trackle_s, NETWORK_RSSI, ap.rssi);
@@ -0,0 +1,195 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2022 IOTREADY S.r.l.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef TRACKLE_UTILS_WRITER_H
+#define TRACKLE_UTILS_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file trackle_utils_writer.h
+ * @brief Allocation-free streaming serializer producing either JSON or CBOR.
+ *
+ * The writer never allocates: output goes to a caller-provided buffer, or to a caller-provided
+ * scratch buffer that is handed to a chunk callback every time it fills up. The same sequence of
+ * calls produces JSON or CBOR depending on the format chosen at init, so payload builders can be
+ * written once.
+ *
+ * Errors are sticky: once the output has been truncated (or the chunk callback failed) every
+ * further call is a no-op, and \ref trackleWriterFinish reports the failure. In buffer mode the
+ * writer keeps counting, so \ref trackleWriterLength tells how big the buffer should have been.
+ *
+ * Example:
+ * @code
+ * char json[64];
+ * TrackleWriter_t w;
+ * trackleWriterInit(&w, TRACKLE_WRITER_JSON, (uint8_t *)json, sizeof(json));
+ * trackleWriterBeginObject(&w);
+ * trackleWriterKey(&w, "temp");
+ * trackleWriterDouble(&w, 21.5);
+ * trackleWriterEndObject(&w);
+ * if (trackleWriterFinish(&w) >= 0)
+ *     tracklePublishSecure("temp", json);
+ * @endcode
+ */
+
+#define TRACKLE_WRITER_MAX_DEPTH 32 ///< Max nesting of objects and arrays
+
+/**
+ * @brief Output format of a \ref TrackleWriter_t.
+ */
+typedef enum
+{
+    TRACKLE_WRITER_JSON = 0, /*!< Text JSON, NULL-terminated in buffer mode */
+    TRACKLE_WRITER_CBOR      /*!< RFC 8949 CBOR, containers encoded with indefinite length */
+} TrackleWriter_Format;
+
+/**
+ * @brief Callback receiving the serialized output in chunks.
+ *
+ * @param data Bytes produced.
+ * @param len Number of bytes in \ref data.
+ * @param ctx Context pointer given to \ref trackleWriterInitChunked.
+ * @return 0 on success, negative value to abort serialization.
+ */
+typedef int (*TrackleWriter_ChunkCb)(const uint8_t *data, size_t len, void *ctx);
+
+/**
+ * @brief Writer state. Treat as opaque, it is declared here only to allow allocation on the stack.
+ */
+typedef struct
+{
+    TrackleWriter_Format format;
+    uint8_t *buf;
+    size_t size;
+    size_t used;
+    size_t flushed;
+    TrackleWriter_ChunkCb chunkCb;
+    void *chunkCtx;
+    bool failed;
+    bool afterKey;
+    uint8_t depth;
+    uint32_t hasItems; // one bit per nesting level
+} TrackleWriter_t;
+
+/**
+ * @brief Initialize a writer that serializes into a fixed buffer.
+ *
+ * In JSON format one byte of the buffer is reserved for the NULL terminator.
+ *
+ * @param w Writer to initialize.
+ * @param format Output format.
+ * @param buf Destination buffer.
+ * @param size Size of \ref buf in bytes.
+ */
+void trackleWriterInit(TrackleWriter_t *w, TrackleWriter_Format format, uint8_t *buf, size_t size);
+
+/**
+ * @brief Initialize a writer that streams its output through \ref chunkCb.
+ *
+ * \ref scratch is used to batch small writes; it is passed to \ref chunkCb whenever it is full and
+ * on \ref trackleWriterFinish. No NULL terminator is produced in this mode.
+ *
+ * @param w Writer to initialize.
+ * @param format Output format.
+ * @param scratch Staging buffer.
+ * @param scratchSize Size of \ref scratch in bytes (must be > 0).
+ * @param chunkCb Callback receiving the output.
+ * @param ctx Context pointer passed to \ref chunkCb.
+ */
+void trackleWriterInitChunked(TrackleWriter_t *w, TrackleWriter_Format format, uint8_t *scratch, size_t scratchSize, TrackleWriter_ChunkCb chunkCb, void *ctx);
+
+void trackleWriterBeginObject(TrackleWriter_t *w); ///< Open an object (CBOR map).
+void trackleWriterEndObject(TrackleWriter_t *w);   ///< Close the innermost object.
+void trackleWriterBeginArray(TrackleWriter_t *w);  ///< Open an array.
+void trackleWriterEndArray(TrackleWriter_t *w);    ///< Close the innermost array.
+
+/**
+ * @brief Write the key of the next object member. Must be followed by exactly one value.
+ *
+ * @param w Writer.
+ * @param key NULL-terminated key.
+ */
+void trackleWriterKey(TrackleWriter_t *w, const char *key);
+
+/**
+ * @brief Write a string value (escaped as needed in JSON).
+ *
+ * @param w Writer.
+ * @param value NULL-terminated string. A NULL pointer is written as null.
+ */
+void trackleWriterString(TrackleWriter_t *w, const char *value);
+
+/**
+ * @brief Write a string value of known length, that does not need to be NULL-terminated.
+ *
+ * @param w Writer.
+ * @param value String bytes.
+ * @param len Number of bytes in \ref value.
+ */
+void trackleWriterStringN(TrackleWriter_t *w, const char *value, size_t len);
+
+void trackleWriterInt(TrackleWriter_t *w, int64_t value);   ///< Write a signed integer value.
+void trackleWriterDouble(TrackleWriter_t *w, double value); ///< Write a number (NaN and infinities are written as null).
+void trackleWriterFloat(TrackleWriter_t *w, float value);   ///< Write a single precision number, with the digits a float has.
+void trackleWriterBool(TrackleWriter_t *w, bool value);     ///< Write a boolean value.
+void trackleWriterNull(TrackleWriter_t *w);                 ///< Write a null value.
+
+/**
+ * @brief Write already serialized data as-is, in the current position.
+ *
+ * Meant to embed a nested document produced elsewhere; the caller is responsible for it being valid
+ * in the writer's format.
+ *
+ * @param w Writer.
+ * @param data Serialized bytes.
+ * @param len Number of bytes in \ref data.
+ */
+void trackleWriterRaw(TrackleWriter_t *w, const uint8_t *data, size_t len);
+
+/**
+ * @brief Complete serialization.
+ *
+ * In buffer mode JSON output is NULL-terminated; in chunked mode the remaining bytes are flushed.
+ *
+ * @param w Writer.
+ * @return Number of bytes produced (NULL terminator excluded) on success, -1 if the output was
+ * truncated, the chunk callback failed or containers are left open.
+ */
+int trackleWriterFinish(TrackleWriter_t *w);
+
+/**
+ * @brief Number of bytes the complete output needs (NULL terminator excluded), even when truncated.
+ *
+ * @param w Writer.
+ * @return Output length in bytes.
+ */
+size_t trackleWriterLength(const TrackleWriter_t *w);
+
+/**
+ * @brief Tells if something went wrong (truncation, chunk callback error, bad nesting).
+ *
+ * @param w Writer.
+ * @return true if the output is not usable.
+ */
+bool trackleWriterFailed(const TrackleWriter_t *w);
+
+#endif